@@ -0,0 +1,714 @@
+/*
+ * -----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * Lukas Niederbremer <webmaster@flippeh.de> and Clark Gaebel <cg.wowus.cg@gmail.com>
+ * wrote this file. As long as you retain this notice you can do whatever you
+ * want with this stuff. If we meet some day, and you think this stuff is worth
+ * it, you can buy us a beer in return.
+ * -----------------------------------------------------------------------------
+ */
+#define _POSIX_C_SOURCE 199309L /* for clock_gettime */
+
+#include "nbt.h"
+
+#include "bswap.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Times the different ways of parsing every chunk of a region file. Unless the
+ * benchmark says otherwise, the chunks are inflated up front, so only the
+ * parsing itself is measured.
+ *
+ * Usage: bench [region file] [iterations]
+ */
+
+struct chunk_set {
+    struct buffer* chunks;
+    struct buffer* compressed; /* The same chunks, deflated like in the region. */
+    size_t count;
+    size_t bytes; /* Uncompressed bytes over all chunks. */
+};
+
+static void die(const char* message)
+{
+    fprintf(stderr, "%s\n", message);
+    exit(1);
+}
+
+static void die_with_err(int err)
+{
+    fprintf(stderr, "Error %i: %s\n", err, nbt_error_to_string(err));
+    exit(1);
+}
+
+static struct chunk_set load_chunks(const char* filename)
+{
+    struct chunk_set ret = { NULL, NULL, 0, 0 };
+
+    MCR* mcr = mcr_open(filename, O_RDONLY);
+    if(mcr == NULL) die("Could not open the region file.");
+
+    ret.chunks     = calloc(32 * 32, sizeof *ret.chunks);
+    ret.compressed = calloc(32 * 32, sizeof *ret.compressed);
+    if(ret.chunks == NULL || ret.compressed == NULL) die_with_err(NBT_EMEM);
+
+    for(int x = 0; x < 32; x++)
+        for(int z = 0; z < 32; z++)
+        {
+            nbt_node* chunk = mcr_chunk_get(mcr, x, z);
+            if(chunk == NULL)
+            {
+                if(errno != NBT_OK) die_with_err(errno);
+                continue;
+            }
+
+            struct buffer b = nbt_dump_binary(chunk);
+            if(b.data == NULL) die_with_err(errno);
+
+            struct buffer z = nbt_dump_compressed(chunk, STRAT_INFLATE);
+            if(z.data == NULL) die_with_err(errno);
+
+            ret.bytes += b.len;
+            ret.compressed[ret.count] = z;
+            ret.chunks[ret.count++]   = b;
+
+            nbt_free(chunk);
+        }
+
+    mcr_close(mcr);
+    return ret;
+}
+
+/* Parses a single chunk, and throws the result away. */
+typedef void (*bench_fn)(const struct buffer* chunk, void* aux);
+
+static void run_bench(const char* name, const struct chunk_set* set, bool compressed,
+                      int iterations, bench_fn fn, void* aux)
+{
+    const struct buffer* chunks = compressed ? set->compressed : set->chunks;
+
+    clock_t start = clock();
+
+    for(int i = 0; i < iterations; i++)
+        for(size_t c = 0; c < set->count; c++)
+            fn(&chunks[c], aux);
+
+    double secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+    double mb   = (double)set->bytes * iterations / (1024.0 * 1024.0);
+
+    printf("%-16s %9.2f ms %9.1f MB/s %9.2f us/chunk\n",
+           name,
+           secs * 1000.0,
+           secs > 0 ? mb / secs : 0.0,
+           secs * 1e6 / ((double)set->count * iterations));
+}
+
+static void bench_malloc(const struct buffer* chunk, void* aux)
+{
+    (void)aux;
+
+    nbt_node* tree = nbt_parse(chunk->data, chunk->len);
+    if(tree == NULL) die_with_err(errno);
+
+    nbt_free(tree);
+}
+
+static void bench_options(const struct buffer* chunk, void* aux)
+{
+    nbt_node* tree = nbt_parse_opts(chunk->data, chunk->len, aux);
+    if(tree == NULL) die_with_err(errno);
+
+    nbt_free(tree);
+}
+
+static void bench_arena(const struct buffer* chunk, void* aux)
+{
+    nbt_arena* arena = aux;
+
+    nbt_node* tree = nbt_parse_arena(chunk->data, chunk->len, arena);
+    if(tree == NULL) die_with_err(errno);
+
+    nbt_arena_reset(arena);
+}
+
+static nbt_event_action count_event(const struct nbt_event* ev, void* aux)
+{
+    (void)ev;
+    ++*(size_t*)aux;
+    return NBT_EVENT_CONTINUE;
+}
+
+static void bench_events(const struct buffer* chunk, void* aux)
+{
+    const struct nbt_event_handler counter = {
+        .compound_begin = count_event,
+        .list_begin     = count_event,
+        .value          = count_event
+    };
+
+    nbt_status err = nbt_parse_events(chunk->data, chunk->len, &counter, aux);
+    if(err != NBT_OK) die_with_err(err);
+}
+
+static void bench_validate(const struct buffer* chunk, void* aux)
+{
+    (void)aux;
+
+    nbt_status err = nbt_validate(chunk->data, chunk->len, NULL);
+    if(err != NBT_OK) die_with_err(err);
+}
+
+static void bench_inflate_validate(const struct buffer* chunk, void* aux)
+{
+    (void)aux;
+
+    nbt_status err = nbt_validate_compressed(chunk->data, chunk->len, NULL);
+    if(err != NBT_OK) die_with_err(err);
+}
+
+/* What a chunk relocation job looks at. */
+static const char* const relocation_paths[] = {
+    ".Level.xPos", ".Level.zPos", ".Level.Entities", ".Level.TileEntities"
+};
+
+static void bench_paths(const struct buffer* chunk, void* aux)
+{
+    (void)aux;
+
+    nbt_node* tree = nbt_parse_paths(chunk->data, chunk->len, relocation_paths,
+                                     sizeof relocation_paths / sizeof *relocation_paths);
+    if(tree == NULL) die_with_err(errno);
+
+    nbt_free(tree);
+}
+
+/* Feeds the chunk in 4KiB slices, about what a socket read hands over. */
+/* What an analysis pass might go looking for, over and over. */
+static const char* const lookup_names[] = {
+    "xPos", "zPos", "LastUpdate", "Entities", "TileEntities", "Blocks", "Data", "SkyLight",
+    "HeightMap", "Sections", "Biomes", "id", "Pos", "x", "y", "z"
+};
+
+#define LOOKUP_ROUNDS 8
+
+/* Parses a chunk, then looks every name up LOOKUP_ROUNDS times, with an index if `aux' points at true. */
+static void bench_lookups(const struct buffer* chunk, void* aux)
+{
+    bool indexed = *(const bool*)aux;
+    size_t found = 0;
+
+    nbt_node* tree = nbt_parse(chunk->data, chunk->len);
+    if(tree == NULL) die_with_err(errno);
+
+    nbt_index* index = indexed ? nbt_index_new(tree, false) : NULL;
+    if(indexed && index == NULL) die_with_err(errno);
+
+    for(int round = 0; round < LOOKUP_ROUNDS; round++)
+        for(size_t i = 0; i < sizeof lookup_names / sizeof *lookup_names; i++)
+            found += (indexed ? nbt_index_find_by_name(index, lookup_names[i])
+                              : nbt_find_by_name(tree, lookup_names[i])) != NULL;
+
+    if(found == 0) die("No names found.");
+
+    nbt_index_free(index);
+    nbt_free(tree);
+}
+
+#define TEMPLATE_COPIES 16
+
+/*
+ * Parses a chunk, then stamps out TEMPLATE_COPIES copies of it at other
+ * coordinates, sharing everything else with it if `aux' points at true.
+ */
+static void bench_templates(const struct buffer* chunk, void* aux)
+{
+    bool shared = *(const bool*)aux;
+    nbt_node* copies[TEMPLATE_COPIES];
+
+    nbt_node* tree = nbt_parse(chunk->data, chunk->len);
+    if(tree == NULL) die_with_err(errno);
+
+    for(int i = 0; i < TEMPLATE_COPIES; i++)
+    {
+        nbt_node* copy = shared ? nbt_clone_shared(tree) : nbt_clone(tree);
+        if(copy == NULL) die_with_err(errno);
+
+        nbt_node* x = shared ? nbt_unshare(&copy, ".Level.xPos") : nbt_find_by_path(copy, ".Level.xPos");
+        nbt_node* z = shared ? nbt_unshare(&copy, ".Level.zPos") : nbt_find_by_path(copy, ".Level.zPos");
+        if(x == NULL || z == NULL) die("No coordinates.");
+
+        x->payload.tag_int += i;
+        z->payload.tag_int -= i;
+        copies[i] = copy;
+    }
+
+    for(int i = 0; i < TEMPLATE_COPIES; i++)
+        nbt_free(copies[i]);
+
+    nbt_free(tree);
+}
+
+static void bench_push(const struct buffer* chunk, void* aux)
+{
+    (void)aux;
+
+    nbt_push_parser* p = nbt_push_parser_new();
+    if(p == NULL) die_with_err(errno);
+
+    for(size_t off = 0; off < chunk->len; off += 4096)
+    {
+        size_t n = chunk->len - off < 4096 ? chunk->len - off : 4096;
+
+        nbt_status err = nbt_push_parser_feed(p, chunk->data + off, n);
+        if(err != NBT_OK) die_with_err(err);
+    }
+
+    nbt_node* tree = nbt_push_parser_finish(p);
+    if(tree == NULL) die_with_err(errno);
+
+    nbt_free(tree);
+    nbt_push_parser_free(p);
+}
+
+static void bench_inflate_malloc(const struct buffer* chunk, void* aux)
+{
+    (void)aux;
+
+    nbt_node* tree = nbt_parse_compressed(chunk->data, chunk->len);
+    if(tree == NULL) die_with_err(errno);
+
+    nbt_free(tree);
+}
+
+static void bench_inflate_borrowed(const struct buffer* chunk, void* aux)
+{
+    nbt_arena* arena = aux;
+
+    nbt_node* tree = nbt_parse_compressed_borrowed(chunk->data, chunk->len, arena);
+    if(tree == NULL) die_with_err(errno);
+
+    if(arena)
+        nbt_arena_reset(arena);
+    else
+        nbt_free(tree);
+}
+
+/* A sign search that most chunks can be ruled out of unparsed. */
+static void bench_prefilter(const struct buffer* chunk, void* aux)
+{
+    if(nbt_prefilter_match(aux, chunk->data, chunk->len))
+        bench_malloc(chunk, NULL);
+}
+
+static void bench_prefilter_tree(const struct buffer* chunk, void* aux)
+{
+    if(nbt_prefilter_match_tree(aux, chunk->data, chunk->len))
+        bench_malloc(chunk, NULL);
+}
+
+static void bench_inflate_filtered(const struct buffer* chunk, void* aux)
+{
+    nbt_node* tree = nbt_parse_compressed_filtered(chunk->data, chunk->len, aux);
+    if(tree == NULL && errno != NBT_OK) die_with_err(errno);
+
+    nbt_free(tree);
+}
+
+/* A world-wide scan for a couple of fields near the top of each chunk. */
+static void bench_inflate_extract(const struct buffer* chunk, void* aux)
+{
+    (void)aux;
+
+    static const char* const paths[] = { ".Level.xPos", ".Level.zPos" };
+    nbt_node* found[2];
+
+    nbt_status err = nbt_extract_compressed(chunk->data, chunk->len, paths, 2, found);
+    if(err != NBT_OK) die_with_err(err);
+
+    nbt_free(found[0]);
+    nbt_free(found[1]);
+}
+
+/* A game loading a chunk a slice of work per frame. */
+static void bench_inflate_sliced(const struct buffer* chunk, void* aux)
+{
+    const struct nbt_budget* budget = aux;
+
+    nbt_loader* l = nbt_loader_new(chunk->data, chunk->len, true);
+    if(l == NULL) die_with_err(errno);
+
+    nbt_status err;
+    while((err = nbt_loader_step(l, budget)) == NBT_AGAIN)
+        ;
+    if(err != NBT_OK) die_with_err(err);
+
+    nbt_node* tree = nbt_loader_finish(l);
+    if(tree == NULL) die_with_err(errno);
+
+    nbt_free(tree);
+    nbt_loader_free(l);
+}
+
+/* An inspection tool looking up a single field. */
+static void bench_inflate_lazy(const struct buffer* chunk, void* aux)
+{
+    (void)aux;
+
+    nbt_node* tree = nbt_parse_compressed_lazy(chunk->data, chunk->len);
+    if(tree == NULL) die_with_err(errno);
+
+    if(nbt_find_by_path(tree, ".Level.xPos") == NULL && errno != NBT_OK)
+        die_with_err(errno);
+
+    nbt_free(tree);
+}
+
+static void put(struct buffer* b, const void* data, size_t n)
+{
+    if(buffer_append(b, data, n)) die_with_err(NBT_EMEM);
+}
+
+/* Writes a tag's type and name. */
+static void put_header(struct buffer* b, nbt_type type, const char* name)
+{
+    unsigned char header[3] = { (unsigned char)type, 0, (unsigned char)strlen(name) };
+
+    put(b, header, sizeof header);
+    put(b, name, strlen(name));
+}
+
+static void put_int(struct buffer* b, const char* name, int32_t x)
+{
+    unsigned char be[4] = { (unsigned char)(x >> 24), (unsigned char)(x >> 16),
+                            (unsigned char)(x >> 8),  (unsigned char)x };
+
+    put_header(b, TAG_INT, name);
+    put(b, be, sizeof be);
+}
+
+/*
+ * A chain of compounds as deep as nbt_parse lets through, each with an int
+ * and the next compound inside.
+ */
+static struct buffer deep_tree(void)
+{
+    struct buffer b = BUFFER_INIT;
+    const unsigned char end = 0;
+
+    put_header(&b, TAG_COMPOUND, "");
+
+    for(int i = 1; i < NBT_DEFAULT_MAX_DEPTH; i++)
+    {
+        put_int(&b, "i", i);
+        put_header(&b, TAG_COMPOUND, "c");
+    }
+
+    for(int i = 0; i < NBT_DEFAULT_MAX_DEPTH; i++)
+        put(&b, &end, 1);
+
+    return b;
+}
+
+/* A list of 100000 compounds, each with a couple of ints in it. */
+static struct buffer wide_tree(void)
+{
+    struct buffer b = BUFFER_INIT;
+    const unsigned char end = 0;
+    const unsigned char list_header[5] = { TAG_COMPOUND, 0x00, 0x01, 0x86, 0xA0 };
+
+    put_header(&b, TAG_COMPOUND, "");
+    put_header(&b, TAG_LIST, "l");
+    put(&b, list_header, sizeof list_header);
+
+    for(int i = 0; i < 100000; i++)
+    {
+        put_int(&b, "x", i);
+        put_int(&b, "z", -i);
+        put(&b, &end, 1);
+    }
+
+    put(&b, &end, 1);
+
+    return b;
+}
+
+/* Wall-clock time, since clock() adds up the time of every thread. */
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static double elapsed_us(double start)
+{
+    return now_us() - start;
+}
+
+/* Times parsing, dumping, cloning and freeing a synthetic tree. */
+static void bench_shape(const char* name, struct buffer tree, int iterations,
+                        const struct nbt_parse_options* options)
+{
+    double parse = 0, dump = 0, clone = 0, freeing = 0;
+
+    for(int i = 0; i < iterations; i++)
+    {
+        double start = now_us();
+        nbt_node* parsed = nbt_parse_opts(tree.data, tree.len, options);
+        parse += elapsed_us(start);
+
+        if(parsed == NULL) die_with_err(errno);
+
+        start = now_us();
+        struct buffer dumped = nbt_dump_binary(parsed);
+        dump += elapsed_us(start);
+
+        if(dumped.data == NULL) die_with_err(errno);
+        if(dumped.len != tree.len) die("Synthetic tree dumps differently.");
+
+        start = now_us();
+        nbt_node* cloned = nbt_clone(parsed);
+        clone += elapsed_us(start);
+
+        if(cloned == NULL) die_with_err(errno);
+
+        start = now_us();
+        nbt_free(cloned);
+        nbt_free(parsed);
+        freeing += elapsed_us(start) / 2;
+
+        buffer_free(&dumped);
+    }
+
+    printf("%-16s %9.1f us %9.1f us %9.1f us %9.1f us\n", name,
+           parse / iterations, dump / iterations, clone / iterations, freeing / iterations);
+}
+
+static void bench_shapes(int iterations)
+{
+    printf("%-16s %12s %12s %12s %12s\n", "synthetic:", "parse", "dump", "clone", "free");
+
+    struct buffer deep = deep_tree();
+    bench_shape("deep", deep, iterations * 100, NULL);
+    buffer_free(&deep);
+
+    struct buffer wide = wide_tree();
+    bench_shape("wide", wide, iterations, NULL);
+
+    const struct nbt_parse_options threaded = { .threads = 4 };
+    bench_shape("wide, 4 threads", wide, iterations, &threaded);
+    buffer_free(&wide);
+}
+
+/*
+ * Swaps arrays of 4KiB up to 1MiB in place with every set of kernels this
+ * machine can run, and prints how many GB/s each one manages.
+ */
+static void bench_swap(void)
+{
+    static const size_t sizes[] = { 4096, 16384, 65536, 262144, 1048576 };
+    const size_t nsizes = sizeof sizes / sizeof *sizes;
+    const size_t per_cell = 64 * 1024 * 1024; /* bytes swapped per measurement */
+
+    unsigned char* data = malloc(sizes[nsizes - 1]);
+    if(data == NULL) die_with_err(NBT_EMEM);
+
+    for(size_t i = 0; i < sizes[nsizes - 1]; i++)
+        data[i] = (unsigned char)i;
+
+    size_t nkernels;
+    const struct bswap_kernels* kernels = bswap_kernels(&nkernels);
+
+    printf("%-16s", "byte swap, GB/s:");
+    for(size_t s = 0; s < nsizes; s++)
+        printf(" %6zuKiB", sizes[s] / 1024);
+    printf("\n");
+
+    for(size_t k = 0; k < nkernels; k++)
+        for(int bits = 32; bits <= 64; bits += 32)
+        {
+            char label[32];
+            snprintf(label, sizeof label, "%s %d-bit", kernels[k].name, bits);
+            printf("%-16s", label);
+
+            for(size_t s = 0; s < nsizes; s++)
+            {
+                size_t n = sizes[s] / (bits / 8);
+                size_t reps = per_cell / sizes[s];
+
+                clock_t start = clock();
+
+                for(size_t r = 0; r < reps; r++)
+                    (bits == 32 ? kernels[k].swap32 : kernels[k].swap64)(data, data, n);
+
+                double secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+                printf(" %9.2f", secs > 0 ? (double)per_cell / secs / 1e9 : 0.0);
+            }
+
+            printf("\n");
+        }
+
+    free(data);
+}
+
+/*
+ * What every chunk adds up to with nbt_memory_usage, all of them parsed with
+ * `options' and kept at once, so pooled arrays are shared between chunks.
+ */
+static struct nbt_memory_stats memory_usage(const struct chunk_set* set, const struct nbt_parse_options* options)
+{
+    struct nbt_memory_stats total = { 0 };
+
+    nbt_node** trees = calloc(set->count, sizeof *trees);
+    if(trees == NULL) die_with_err(NBT_EMEM);
+
+    for(size_t c = 0; c < set->count; c++)
+        if((trees[c] = nbt_parse_opts(set->chunks[c].data, set->chunks[c].len, options)) == NULL)
+            die_with_err(errno);
+
+    for(size_t c = 0; c < set->count; c++)
+    {
+        struct nbt_memory_stats stats;
+        nbt_memory_usage(trees[c], &stats);
+
+        total.bytes  += stats.bytes;
+        total.arrays += stats.arrays;
+    }
+
+    for(size_t c = 0; c < set->count; c++)
+        nbt_free(trees[c]);
+
+    free(trees);
+    return total;
+}
+
+static void bench_memory(const struct chunk_set* set)
+{
+    nbt_array_pool* pool = nbt_array_pool_new();
+    if(pool == NULL) die_with_err(errno);
+
+    const struct nbt_parse_options encoded = { .encode_arrays = true };
+    const struct nbt_parse_options pooled  = { .encode_arrays = true, .array_pool = pool };
+
+    struct nbt_memory_stats usage[] = {
+        memory_usage(set, NULL), memory_usage(set, &encoded), memory_usage(set, &pooled)
+    };
+
+    printf("%-16s %12s %12s %12s\n", "memory/chunk:", "plain", "encoded", "pooled");
+    printf("%-16s", "tree bytes");
+    for(size_t i = 0; i < 3; i++) printf(" %12.0f", (double)usage[i].bytes / set->count);
+    printf("\n%-16s", "array bytes");
+    for(size_t i = 0; i < 3; i++) printf(" %12.0f", (double)usage[i].arrays / set->count);
+    printf("\n");
+
+    nbt_array_pool_free(pool);
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 2 || strcmp(argv[1], "--help") == 0)
+    {
+        printf("Usage: %s [region file] [iterations]\n", argv[0]);
+        return 0;
+    }
+
+    int iterations = argc > 2 ? atoi(argv[2]) : 20;
+    if(iterations <= 0) die("Iterations must be positive.");
+
+    struct chunk_set set = load_chunks(argv[1]);
+
+    printf("%zu chunks, %zu bytes uncompressed, %d iterations\n",
+           set.count, set.bytes, iterations);
+
+    nbt_arena* arena = nbt_arena_new();
+    if(arena == NULL) die_with_err(errno);
+
+    run_bench("malloc",   &set, false, iterations, bench_malloc, NULL);
+    run_bench("arena",    &set, false, iterations, bench_arena, arena);
+
+    const struct nbt_parse_options utf8 = { .utf8 = true };
+    run_bench("malloc, utf8", &set, false, iterations, bench_options, (void*)&utf8);
+
+    const struct nbt_parse_options vectors = { .vector_lists = true };
+    run_bench("malloc, vectors", &set, false, iterations, bench_options, (void*)&vectors);
+
+    nbt_intern_table* names = nbt_intern_table_new();
+    if(names == NULL) die_with_err(errno);
+
+    const struct nbt_parse_options interned = { .intern = names };
+    run_bench("malloc, interned", &set, false, iterations, bench_options, (void*)&interned);
+
+    const struct nbt_parse_options packed = { .pack_lists = true };
+    run_bench("malloc, packed", &set, false, iterations, bench_options, (void*)&packed);
+
+    const struct nbt_parse_options compact = { .compact_nodes = true };
+    run_bench("malloc, compact", &set, false, iterations, bench_options, (void*)&compact);
+
+    const struct nbt_parse_options encoded = { .encode_arrays = true };
+    run_bench("malloc, encoded", &set, false, iterations, bench_options, (void*)&encoded);
+
+    nbt_array_pool* pool = nbt_array_pool_new();
+    if(pool == NULL) die_with_err(errno);
+
+    const struct nbt_parse_options pooled = { .encode_arrays = true, .array_pool = pool };
+    run_bench("malloc, pooled", &set, false, iterations, bench_options, (void*)&pooled);
+
+    run_bench("push",     &set, false, iterations, bench_push, NULL);
+    run_bench("paths",    &set, false, iterations, bench_paths, NULL);
+    bool without_index = false, with_index = true;
+    run_bench("find_by_name", &set, false, iterations, bench_lookups, &without_index);
+    run_bench("index",    &set, false, iterations, bench_lookups, &with_index);
+    bool deep = false, shared = true;
+    run_bench("clone",    &set, false, iterations, bench_templates, &deep);
+    run_bench("clone_shared", &set, false, iterations, bench_templates, &shared);
+
+    size_t events = 0;
+    run_bench("events",   &set, false, iterations, bench_events, &events);
+    run_bench("validate", &set, false, iterations, bench_validate, NULL);
+
+    static const char* const sign_search[] = { "Sign", "herobrine" };
+    nbt_prefilter* filter = nbt_prefilter_new(sign_search, NULL, 2, true);
+    if(filter == NULL) die_with_err(errno);
+
+    run_bench("prefilter", &set, false, iterations, bench_prefilter, filter);
+    run_bench("prefilter tree", &set, false, iterations, bench_prefilter_tree, filter);
+
+    printf("including inflate:\n");
+    run_bench("malloc",   &set, true, iterations, bench_inflate_malloc, NULL);
+    run_bench("borrowed", &set, true, iterations, bench_inflate_borrowed, NULL);
+    run_bench("arena+borrowed", &set, true, iterations, bench_inflate_borrowed, arena);
+    run_bench("lazy lookup", &set, true, iterations, bench_inflate_lazy, NULL);
+    run_bench("extract", &set, true, iterations, bench_inflate_extract, NULL);
+
+    struct nbt_budget slice = { 4096, 256 };
+    run_bench("sliced", &set, true, iterations, bench_inflate_sliced, &slice);
+    run_bench("validate", &set, true, iterations, bench_inflate_validate, NULL);
+    run_bench("prefilter", &set, true, iterations, bench_inflate_filtered, filter);
+
+    nbt_prefilter_free(filter);
+    nbt_arena_free(arena);
+    nbt_intern_table_free(names);
+    nbt_array_pool_free(pool);
+
+    bench_memory(&set);
+
+    bench_shapes(iterations);
+    bench_swap();
+
+    for(size_t c = 0; c < set.count; c++)
+    {
+        buffer_free(&set.chunks[c]);
+        buffer_free(&set.compressed[c]);
+    }
+    free(set.chunks);
+    free(set.compressed);
+
+    return 0;
+}
@@ -0,0 +1,194 @@
+/*
+ * -----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * Lukas Niederbremer <webmaster@flippeh.de> and Clark Gaebel <cg.wowus.cg@gmail.com>
+ * wrote this file. As long as you retain this notice you can do whatever you
+ * want with this stuff. If we meet some day, and you think this stuff is worth
+ * it, you can buy us a beer in return.
+ * -----------------------------------------------------------------------------
+ */
+#include "bswap.h"
+
+/*
+ * Long arrays (block states, height maps) are most of what's in a modern
+ * chunk, and every element of them gets swapped on the way in and out. On x86
+ * the swapping is done a vector at a time: SSE2 is always there on x86-64, and
+ * AVX2 is used when the CPU we end up running on has it.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define BSWAP_X86 1
+#include <immintrin.h>
+#endif
+
+#define SCALAR_KERNEL(bits)                                                \
+static void swap##bits##_scalar(void* dest, const void* src, size_t n)     \
+{                                                                          \
+    unsigned char* d = dest;                                               \
+    const unsigned char* s = src;                                          \
+                                                                           \
+    for(size_t i = 0; i < n; i++, d += bits / 8, s += bits / 8)            \
+    {                                                                      \
+        uint##bits##_t t;                                                  \
+        memcpy(&t, s, sizeof t);                                           \
+        t = bswap##bits(t);                                                \
+        memcpy(d, &t, sizeof t);                                           \
+    }                                                                      \
+}
+
+SCALAR_KERNEL(16)
+SCALAR_KERNEL(32)
+SCALAR_KERNEL(64)
+
+#undef SCALAR_KERNEL
+
+#ifdef BSWAP_X86
+
+/*
+ * Swaps every element in as many whole vectors as fit, then leaves the rest to
+ * the scalar kernel. Loading a whole vector before storing it is what makes it
+ * safe for `dest' to be `src'.
+ */
+#define VECTOR_KERNEL(name, bits, vec, loadu, storeu, vswap)               \
+static ATTRS void name(void* dest, const void* src, size_t n)              \
+{                                                                          \
+    const size_t per_vector = sizeof(vec) / (bits / 8);                    \
+                                                                           \
+    unsigned char* d = dest;                                               \
+    const unsigned char* s = src;                                          \
+    size_t i = 0;                                                          \
+                                                                           \
+    for(; i + per_vector <= n; i += per_vector)                            \
+    {                                                                      \
+        vec v = loadu((const vec*)(s + i * (bits / 8)));                   \
+        storeu((vec*)(d + i * (bits / 8)), vswap(v));                      \
+    }                                                                      \
+                                                                           \
+    swap##bits##_scalar(d + i * (bits / 8), s + i * (bits / 8), n - i);    \
+}
+
+/*
+ * SSE2 has no byte shuffle. Swap the bytes in each 16-bit word with shifts,
+ * then put the words themselves in reverse order.
+ */
+static inline __m128i sse2_swap16(__m128i v)
+{
+    return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+
+static inline __m128i sse2_swap32(__m128i v)
+{
+    v = sse2_swap16(v);
+    v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+    return _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+}
+
+static inline __m128i sse2_swap64(__m128i v)
+{
+    v = sse2_swap16(v);
+    v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+    return _mm_shufflehi_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+}
+
+#define ATTRS
+VECTOR_KERNEL(swap16_sse2, 16, __m128i, _mm_loadu_si128, _mm_storeu_si128, sse2_swap16)
+VECTOR_KERNEL(swap32_sse2, 32, __m128i, _mm_loadu_si128, _mm_storeu_si128, sse2_swap32)
+VECTOR_KERNEL(swap64_sse2, 64, __m128i, _mm_loadu_si128, _mm_storeu_si128, sse2_swap64)
+#undef ATTRS
+
+/* AVX2 does have a byte shuffle, which does the whole job in one go. */
+#define ATTRS __attribute__((target("avx2")))
+
+static ATTRS inline __m256i avx2_swap16(__m256i v)
+{
+    const __m256i order = _mm256_setr_epi8(
+        1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+        1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+
+    return _mm256_shuffle_epi8(v, order);
+}
+
+static ATTRS inline __m256i avx2_swap32(__m256i v)
+{
+    const __m256i order = _mm256_setr_epi8(
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+
+    return _mm256_shuffle_epi8(v, order);
+}
+
+static ATTRS inline __m256i avx2_swap64(__m256i v)
+{
+    const __m256i order = _mm256_setr_epi8(
+        7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+        7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+
+    return _mm256_shuffle_epi8(v, order);
+}
+
+VECTOR_KERNEL(swap16_avx2, 16, __m256i, _mm256_loadu_si256, _mm256_storeu_si256, avx2_swap16)
+VECTOR_KERNEL(swap32_avx2, 32, __m256i, _mm256_loadu_si256, _mm256_storeu_si256, avx2_swap32)
+VECTOR_KERNEL(swap64_avx2, 64, __m256i, _mm256_loadu_si256, _mm256_storeu_si256, avx2_swap64)
+#undef ATTRS
+
+#undef VECTOR_KERNEL
+
+#endif /* BSWAP_X86 */
+
+/* From slowest to fastest. Anything past the first might not be runnable. */
+static const struct bswap_kernels kernels[] = {
+    { "scalar", swap16_scalar, swap32_scalar, swap64_scalar },
+#ifdef BSWAP_X86
+    { "sse2",   swap16_sse2,   swap32_sse2,   swap64_sse2   },
+    { "avx2",   swap16_avx2,   swap32_avx2,   swap64_avx2   },
+#endif
+};
+
+const struct bswap_kernels* bswap_kernels(size_t* count)
+{
+    size_t n = sizeof kernels / sizeof *kernels;
+
+#ifdef BSWAP_X86
+    if(!__builtin_cpu_supports("avx2"))
+        n--;
+#endif
+
+    *count = n;
+    return kernels;
+}
+
+/*
+ * The kernels we settled on. The first swap can happen on any of a parallel
+ * parse's threads, so it's atomic; any that race to pick them pick the same.
+ */
+static const struct bswap_kernels* best;
+
+static inline const struct bswap_kernels* best_kernels(void)
+{
+    const struct bswap_kernels* kernels = __atomic_load_n(&best, __ATOMIC_ACQUIRE);
+
+    if(kernels == NULL)
+    {
+        size_t n;
+        const struct bswap_kernels* all = bswap_kernels(&n);
+
+        kernels = &all[n - 1];
+        __atomic_store_n(&best, kernels, __ATOMIC_RELEASE);
+    }
+
+    return kernels;
+}
+
+void bswap16_array(void* dest, const void* src, size_t n)
+{
+    best_kernels()->swap16(dest, src, n);
+}
+
+void bswap32_array(void* dest, const void* src, size_t n)
+{
+    best_kernels()->swap32(dest, src, n);
+}
+
+void bswap64_array(void* dest, const void* src, size_t n)
+{
+    best_kernels()->swap64(dest, src, n);
+}
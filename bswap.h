@@ -0,0 +1,172 @@
+/*
+ * -----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * Lukas Niederbremer <webmaster@flippeh.de> and Clark Gaebel <cg.wowus.cg@gmail.com>
+ * wrote this file. As long as you retain this notice you can do whatever you
+ * want with this stuff. If we meet some day, and you think this stuff is worth
+ * it, you can buy us a beer in return.
+ * -----------------------------------------------------------------------------
+ */
+#ifndef NBT_BSWAP_H
+#define NBT_BSWAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * NBT is big-endian. Whether we have to swap anything at all is decided right
+ * here, at compile time. If your compiler doesn't tell us, define
+ * NBT_BIG_ENDIAN to 1 or 0 yourself.
+ */
+#ifndef NBT_BIG_ENDIAN
+#  if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__)
+#    define NBT_BIG_ENDIAN (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#  elif defined(_WIN32) || defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#    define NBT_BIG_ENDIAN 0
+#  else
+#    error "Can't tell this platform's byte order. Define NBT_BIG_ENDIAN to 0 or 1."
+#  endif
+#endif
+
+#ifdef __GNUC__
+static inline uint16_t bswap16(uint16_t x) { return __builtin_bswap16(x); }
+static inline uint32_t bswap32(uint32_t x) { return __builtin_bswap32(x); }
+static inline uint64_t bswap64(uint64_t x) { return __builtin_bswap64(x); }
+#else
+static inline uint16_t bswap16(uint16_t x)
+{
+    return (uint16_t)(x << 8 | x >> 8);
+}
+
+static inline uint32_t bswap32(uint32_t x)
+{
+    return (x & 0x000000FFu) << 24 | (x & 0x0000FF00u) << 8 |
+           (x & 0x00FF0000u) >> 8  | (x & 0xFF000000u) >> 24;
+}
+
+static inline uint64_t bswap64(uint64_t x)
+{
+    return (uint64_t)bswap32((uint32_t)x) << 32 | bswap32((uint32_t)(x >> 32));
+}
+#endif
+
+/* big endian to native endian. works in-place on 1, 2, 4 or 8 bytes. */
+static inline void* be2ne(void* s, size_t len)
+{
+#if NBT_BIG_ENDIAN
+    (void)len;
+#else
+    switch(len)
+    {
+    case 2: { uint16_t t; memcpy(&t, s, 2); t = bswap16(t); memcpy(s, &t, 2); break; }
+    case 4: { uint32_t t; memcpy(&t, s, 4); t = bswap32(t); memcpy(s, &t, 4); break; }
+    case 8: { uint64_t t; memcpy(&t, s, 8); t = bswap64(t); memcpy(s, &t, 8); break; }
+    }
+#endif
+
+    return s;
+}
+
+/* native endian to big endian. works the exact same as its inverse */
+#define ne2be be2ne
+
+/* little endian to native endian, for the little-endian variants of NBT. */
+static inline void* le2ne(void* s, size_t len)
+{
+#if NBT_BIG_ENDIAN
+    switch(len)
+    {
+    case 2: { uint16_t t; memcpy(&t, s, 2); t = bswap16(t); memcpy(s, &t, 2); break; }
+    case 4: { uint32_t t; memcpy(&t, s, 4); t = bswap32(t); memcpy(s, &t, 4); break; }
+    case 8: { uint64_t t; memcpy(&t, s, 8); t = bswap64(t); memcpy(s, &t, 8); break; }
+    }
+#else
+    (void)len;
+#endif
+
+    return s;
+}
+
+/*
+ * A set of array kernels. Each one copies `n' elements from `src' to `dest',
+ * reversing the bytes of every one of them. `dest' may be the same as `src',
+ * but they mustn't overlap otherwise. Neither has to be aligned.
+ */
+struct bswap_kernels {
+    const char* name;
+    void (*swap16)(void* dest, const void* src, size_t n);
+    void (*swap32)(void* dest, const void* src, size_t n);
+    void (*swap64)(void* dest, const void* src, size_t n);
+};
+
+/*
+ * Every set of kernels this machine can run, from the plain C ones to the
+ * fastest, which is the one bswap16_array and friends use.
+ */
+const struct bswap_kernels* bswap_kernels(size_t* count);
+
+void bswap16_array(void* dest, const void* src, size_t n);
+void bswap32_array(void* dest, const void* src, size_t n);
+void bswap64_array(void* dest, const void* src, size_t n);
+
+/* Copies big-endian arrays into native ones (and back). `dest' may be `src'. */
+static inline void be2ne_array16(void* dest, const void* src, size_t n)
+{
+#if NBT_BIG_ENDIAN
+    if(dest != src) memcpy(dest, src, 2 * n);
+#else
+    bswap16_array(dest, src, n);
+#endif
+}
+
+static inline void be2ne_array32(void* dest, const void* src, size_t n)
+{
+#if NBT_BIG_ENDIAN
+    if(dest != src) memcpy(dest, src, 4 * n);
+#else
+    bswap32_array(dest, src, n);
+#endif
+}
+
+static inline void be2ne_array64(void* dest, const void* src, size_t n)
+{
+#if NBT_BIG_ENDIAN
+    if(dest != src) memcpy(dest, src, 8 * n);
+#else
+    bswap64_array(dest, src, n);
+#endif
+}
+
+#define ne2be_array16 be2ne_array16
+#define ne2be_array32 be2ne_array32
+#define ne2be_array64 be2ne_array64
+
+static inline void le2ne_array16(void* dest, const void* src, size_t n)
+{
+#if NBT_BIG_ENDIAN
+    bswap16_array(dest, src, n);
+#else
+    if(dest != src) memcpy(dest, src, 2 * n);
+#endif
+}
+
+static inline void le2ne_array32(void* dest, const void* src, size_t n)
+{
+#if NBT_BIG_ENDIAN
+    bswap32_array(dest, src, n);
+#else
+    if(dest != src) memcpy(dest, src, 4 * n);
+#endif
+}
+
+static inline void le2ne_array64(void* dest, const void* src, size_t n)
+{
+#if NBT_BIG_ENDIAN
+    bswap64_array(dest, src, n);
+#else
+    if(dest != src) memcpy(dest, src, 8 * n);
+#endif
+}
+
+#endif
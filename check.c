@@ -19,6 +19,328 @@ static void die_with_err(int err)
     exit(1);
 }
 
+static nbt_event_action count_event(const struct nbt_event* ev, void* aux)
+{
+    (void)ev;
+    ++*(size_t*)aux;
+    return NBT_EVENT_CONTINUE;
+}
+
+/*
+ * Writes down every event it's sent, so two ways of walking a tree can be
+ * compared. Containers `skip_depth' deep are skipped, and it stops after
+ * `stop_after' events, if those aren't 0.
+ */
+struct event_log {
+    struct buffer text;
+    size_t skip_depth;
+    size_t stop_after;
+    size_t count;
+};
+
+static nbt_event_action log_event(const char* what, const struct nbt_event* ev, void* aux)
+{
+    struct event_log* log = aux;
+    char line[128];
+
+    int n = snprintf(line, sizeof line, "%s %d %.*s @%zu", what, (int)ev->type,
+                     (int)(ev->name_length < 32 ? ev->name_length : 32), ev->name ? ev->name : "",
+                     ev->depth);
+
+    switch(ev->type)
+    {
+    case TAG_INT:    n += snprintf(line + n, sizeof line - n, " %d", (int)ev->payload.tag_int); break;
+    case TAG_DOUBLE: n += snprintf(line + n, sizeof line - n, " %g", ev->payload.tag_double); break;
+    case TAG_STRING: n += snprintf(line + n, sizeof line - n, " %.*s",
+                                   (int)(ev->payload.tag_string.length < 32 ? ev->payload.tag_string.length : 32),
+                                   ev->payload.tag_string.data); break;
+    case TAG_BYTE_ARRAY: case TAG_INT_ARRAY: case TAG_LONG_ARRAY:
+        n += snprintf(line + n, sizeof line - n, " [%d] %d", (int)ev->payload.tag_array.length,
+                      ev->payload.tag_array.length ? *(const unsigned char*)ev->payload.tag_array.data : -1);
+        break;
+    case TAG_LIST:   n += snprintf(line + n, sizeof line - n, " %d [%d]", (int)ev->payload.tag_list.type,
+                                   (int)ev->payload.tag_list.length); break;
+    default: break;
+    }
+
+    if(buffer_append(&log->text, line, strlen(line)) || buffer_append(&log->text, "\n", 1))
+        die_with_err(NBT_EMEM);
+
+    if(log->stop_after && ++log->count == log->stop_after)
+        return NBT_EVENT_STOP;
+
+    if(log->skip_depth && ev->depth == log->skip_depth && (ev->type == TAG_LIST || ev->type == TAG_COMPOUND))
+        return NBT_EVENT_SKIP;
+
+    return NBT_EVENT_CONTINUE;
+}
+
+static nbt_event_action log_compound_begin(const struct nbt_event* ev, void* aux) { return log_event("{", ev, aux); }
+static nbt_event_action log_compound_end(const struct nbt_event* ev, void* aux)   { return log_event("}", ev, aux); }
+static nbt_event_action log_list_begin(const struct nbt_event* ev, void* aux)     { return log_event("[", ev, aux); }
+static nbt_event_action log_list_end(const struct nbt_event* ev, void* aux)       { return log_event("]", ev, aux); }
+static nbt_event_action log_value(const struct nbt_event* ev, void* aux)          { return log_event("=", ev, aux); }
+
+static const struct nbt_event_handler logger = {
+    log_compound_begin, log_compound_end, log_list_begin, log_list_end, log_value
+};
+
+/*
+ * A tree that's nothing but `depth' lists or compounds, one inside the other.
+ * Every list holds just the next one, and the innermost is an empty list of
+ * bytes.
+ */
+static struct buffer deep_tree(size_t depth, bool lists)
+{
+    static const unsigned char compound[] = { TAG_COMPOUND, 0, 1, 'c' };
+    static const unsigned char list[]     = { TAG_LIST, 0, 1, 'l' };
+    static const unsigned char element[]  = { TAG_LIST, 0, 0, 0, 1 };
+    static const unsigned char innermost[] = { TAG_BYTE, 0, 0, 0, 0 };
+    static const unsigned char end = 0;
+
+    struct buffer b = BUFFER_INIT;
+    int err = 0;
+
+    if(lists)
+    {
+        err |= buffer_append(&b, list, sizeof list);
+
+        for(size_t i = 1; i < depth; i++)
+            err |= buffer_append(&b, element, sizeof element);
+
+        err |= buffer_append(&b, innermost, sizeof innermost);
+    }
+    else
+    {
+        for(size_t i = 0; i < depth; i++)
+            err |= buffer_append(&b, compound, sizeof compound);
+
+        for(size_t i = 0; i < depth; i++)
+            err |= buffer_append(&b, &end, sizeof end);
+    }
+
+    if(err) die_with_err(NBT_EMEM);
+    return b;
+}
+
+/*
+ * A compound with two big lists in it: one of 20000 small compounds, and one
+ * of 10000 ints.
+ */
+static struct buffer wide_tree(void)
+{
+    static const unsigned char root[]      = { TAG_COMPOUND, 0, 0 };
+    static const unsigned char compounds[] = { TAG_LIST, 0, 1, 'c', TAG_COMPOUND, 0, 0, 0x4e, 0x20 };
+    static const unsigned char ints[]      = { TAG_LIST, 0, 1, 'i', TAG_INT, 0, 0, 0x27, 0x10 };
+    static const unsigned char element[]   = {
+        TAG_INT, 0, 1, 'x', 0, 0, 0, 0,
+        TAG_STRING, 0, 1, 's', 0, 3, 'a', 'b', 'c',
+        TAG_LIST, 0, 1, 'l', TAG_BYTE, 0, 0, 0, 3, 1, 2, 3,
+        0
+    };
+    static const unsigned char end = 0;
+
+    struct buffer b = BUFFER_INIT;
+    int err = 0;
+
+    err |= buffer_append(&b, root, sizeof root);
+    err |= buffer_append(&b, compounds, sizeof compounds);
+
+    for(int i = 0; i < 20000; i++)
+    {
+        unsigned char e[sizeof element];
+        memcpy(e, element, sizeof e);
+        e[6] = (unsigned char)(i >> 8);
+        e[7] = (unsigned char)i;
+
+        err |= buffer_append(&b, e, sizeof e);
+    }
+
+    err |= buffer_append(&b, ints, sizeof ints);
+
+    for(int i = 0; i < 10000; i++)
+    {
+        unsigned char x[4] = { 0, 0, (unsigned char)(i >> 8), (unsigned char)i };
+        err |= buffer_append(&b, x, sizeof x);
+    }
+
+    err |= buffer_append(&b, &end, sizeof end);
+
+    if(err) die_with_err(NBT_EMEM);
+    return b;
+}
+
+/* A TAG_INT named k<value>, built by hand. */
+static nbt_node* int_node(int32_t value)
+{
+    nbt_node* ret = malloc(sizeof *ret);
+    if(ret == NULL) die_with_err(NBT_EMEM);
+
+    ret->type  = TAG_INT;
+    ret->flags = 0;
+    ret->payload.tag_int = value;
+
+    if((ret->name = malloc(16)) == NULL) die_with_err(NBT_EMEM);
+    sprintf(ret->name, "k%d", (int)value);
+
+    return ret;
+}
+
+/* Whether compound has a TAG_INT named k<value>, and what nbt_find_by_path says agrees. */
+static bool has_key(nbt_node* compound, int32_t value)
+{
+    char name[16], path[16];
+    sprintf(name, "k%d", (int)value);
+    sprintf(path, ".k%d", (int)value);
+
+    nbt_node* n = nbt_compound_get(compound, name);
+
+    return n != NULL && n->payload.tag_int == value && nbt_find_by_path(compound, path) == n;
+}
+
+/* Keeps everything but the odd elements of lists of ints. */
+static bool not_odd_element(const nbt_node* node, void* aux)
+{
+    (void)aux;
+    return !(node->type == TAG_INT && node->name == NULL && (node->payload.tag_int & 1));
+}
+
+/* Whether a list or compound is the empty one at the bottom of a deep_tree. */
+static bool bottom(const nbt_node* node, void* aux)
+{
+    (void)aux;
+
+    const struct tag_list* children = node->type == TAG_LIST ? node->payload.tag_list.list
+                                                             : node->payload.tag_compound;
+    return list_empty(&children->entry);
+}
+
+static bool not_bottom(const nbt_node* node, void* aux)
+{
+    return !bottom(node, aux);
+}
+
+static bool count_nodes(nbt_node* node, void* aux)
+{
+    (void)node;
+    ++*(size_t*)aux;
+    return true;
+}
+
+struct index_check {
+    nbt_index* index;
+    nbt_node* tree;
+};
+
+/* Whether the index finds what nbt_find_by_name does for this node's name. */
+static bool index_agrees(nbt_node* node, void* aux)
+{
+    struct index_check* check = aux;
+    return nbt_index_find_by_name(check->index, node->name) == nbt_find_by_name(check->tree, node->name);
+}
+
+/* Appends the low `size' bytes of `x', in either byte order. */
+static void put_number(struct buffer* b, uint64_t x, size_t size, bool little)
+{
+    unsigned char bytes[8];
+
+    for(size_t i = 0; i < size; i++)
+        bytes[little ? i : size - 1 - i] = (unsigned char)(x >> (8 * i));
+
+    if(buffer_append(b, bytes, size)) die_with_err(NBT_EMEM);
+}
+
+static void put_name(struct buffer* b, nbt_type type, const char* name, bool little)
+{
+    put_number(b, type, 1, little);
+    put_number(b, strlen(name), 2, little);
+
+    if(buffer_append(b, name, strlen(name))) die_with_err(NBT_EMEM);
+}
+
+/*
+ * The same small tree of every kind of number, in any of the dialects of NBT:
+ * big or little endian, with or without a name on the root.
+ */
+static struct buffer variant_tree(bool little, bool named)
+{
+    struct buffer b = BUFFER_INIT;
+
+    if(named)
+        put_name(&b, TAG_COMPOUND, "r", little);
+    else
+        put_number(&b, TAG_COMPOUND, 1, little);
+
+    put_name(&b, TAG_SHORT, "s", little);
+    put_number(&b, (uint16_t)-2, 2, little);
+
+    put_name(&b, TAG_INT, "i", little);
+    put_number(&b, 0x01020304, 4, little);
+
+    put_name(&b, TAG_DOUBLE, "d", little);
+    put_number(&b, UINT64_C(0x3FF8000000000000) /* 1.5 */, 8, little);
+
+    put_name(&b, TAG_STRING, "t", little);
+    put_number(&b, 2, 2, little);
+    if(buffer_append(&b, "hi", 2)) die_with_err(NBT_EMEM);
+
+    put_name(&b, TAG_INT_ARRAY, "a", little);
+    put_number(&b, 3, 4, little);
+    for(uint64_t i = 5; i <= 7; i++) put_number(&b, i, 4, little);
+
+    put_name(&b, TAG_LONG_ARRAY, "la", little);
+    put_number(&b, 2, 4, little);
+    put_number(&b, UINT64_MAX, 8, little);
+    put_number(&b, UINT64_C(0x0102030405060708), 8, little);
+
+    put_name(&b, TAG_LIST, "l", little);
+    put_number(&b, TAG_LONG, 1, little);
+    put_number(&b, 2, 4, little);
+    put_number(&b, 1, 8, little);
+    put_number(&b, 2, 8, little);
+
+    put_number(&b, TAG_INVALID, 1, little);
+    return b;
+}
+
+/*
+ * A compound of arrays: 4096 zero bytes, 1024 ints in four runs, 64 longs
+ * with nothing in common, and three bytes too short to be worth encoding.
+ */
+static struct buffer array_tree(void)
+{
+    struct buffer b = BUFFER_INIT;
+
+    put_name(&b, TAG_COMPOUND, "", false);
+
+    put_name(&b, TAG_BYTE_ARRAY, "fill", false);
+    put_number(&b, 4096, 4, false);
+    for(int i = 0; i < 4096; i++) put_number(&b, 0, 1, false);
+
+    put_name(&b, TAG_INT_ARRAY, "runs", false);
+    put_number(&b, 1024, 4, false);
+    for(int i = 0; i < 1024; i++) put_number(&b, (uint32_t)(i / 256 - 2), 4, false);
+
+    put_name(&b, TAG_LONG_ARRAY, "raw", false);
+    put_number(&b, 64, 4, false);
+    for(uint64_t i = 0; i < 64; i++) put_number(&b, i * UINT64_C(0x0102030405060708), 8, false);
+
+    put_name(&b, TAG_BYTE_ARRAY, "tiny", false);
+    put_number(&b, 3, 4, false);
+    for(int i = 0; i < 3; i++) put_number(&b, (uint64_t)i, 1, false);
+
+    put_number(&b, 0, 1, false);
+    return b;
+}
+
+/* Trees that end in an empty payload, which needs no bytes at all to finish. */
+static const struct { const unsigned char* data; size_t len; } ends_empty[] = {
+    { (const unsigned char[]){ TAG_STRING, 0, 0, 0, 0 }, 5 },
+    { (const unsigned char[]){ TAG_INT_ARRAY, 0, 0, 0, 0, 0, 0 }, 7 },
+    { (const unsigned char[]){ TAG_LIST, 0, 0, TAG_STRING, 0, 0, 0, 2, 0, 1, 'a', 0, 0 }, 13 },
+    { (const unsigned char[]){ TAG_LIST, 0, 0, TAG_BYTE_ARRAY, 0, 0, 0, 1, 0, 0, 0, 0 }, 12 },
+};
+
 static nbt_node* get_tree(const char* filename)
 {
     FILE* fp = fopen(filename, "rb");
@@ -45,6 +367,7 @@ int main(int argc, char** argv)
 
     /* Use this to refer to the tree in gdb. */
     char* the_tree = nbt_dump_ascii(tree);
+    nbt_status err;
 
     if(the_tree == NULL)
         die_with_err(errno);
@@ -59,10 +382,1620 @@ int main(int argc, char** argv)
         printf("OK.\n");
     }
 
-    FILE* temp = fopen("delete_me.nbt", "wb");
-    if(temp == NULL) die("Could not open a temporary file.");
+    {
+        printf("Checking nbt_parse_arena... ");
+        struct buffer b = nbt_dump_binary(tree);
+        if(b.data == NULL) die_with_err(errno);
 
-    nbt_status err;
+        nbt_arena* arena = nbt_arena_new();
+        if(arena == NULL) die_with_err(errno);
+
+        nbt_node* in_arena = nbt_parse_arena(b.data, b.len, arena);
+        if(in_arena == NULL) die_with_err(errno);
+        if(!nbt_eq(tree, in_arena))
+            die("FAILED. Arena tree not equal.");
+
+        nbt_arena_free(arena);
+        buffer_free(&b);
+        printf("OK.\n");
+    }
+
+    {
+        printf("Checking nbt_parse_borrowed... ");
+        struct buffer b = nbt_dump_binary(tree);
+        if(b.data == NULL) die_with_err(errno);
+
+        struct buffer scratch = BUFFER_INIT;
+        if(buffer_append(&scratch, b.data, b.len)) die_with_err(NBT_EMEM);
+
+        nbt_node* borrowed = nbt_parse_borrowed(scratch.data, scratch.len, NULL);
+        if(borrowed == NULL) die_with_err(errno);
+        if(!nbt_eq(tree, borrowed))
+            die("FAILED. Borrowed tree not equal.");
+
+        struct buffer redumped = nbt_dump_binary(borrowed);
+        if(redumped.data == NULL) die_with_err(errno);
+        if(redumped.len != b.len || memcmp(redumped.data, b.data, b.len) != 0)
+            die("FAILED. Borrowed tree dumps differently.");
+
+        nbt_node* clone = nbt_clone(borrowed);
+        if(clone == NULL || !nbt_eq(clone, tree))
+            die("FAILED. Clone of borrowed tree not equal.");
+
+        nbt_free(clone);
+        nbt_free(borrowed);
+        buffer_free(&redumped);
+        buffer_free(&scratch);
+        buffer_free(&b);
+        printf("OK.\n");
+    }
+
+    {
+        printf("Checking nbt_parse_events... ");
+        struct buffer b = nbt_dump_binary(tree);
+        if(b.data == NULL) die_with_err(errno);
+
+        const struct nbt_event_handler counter = {
+            .compound_begin = count_event,
+            .list_begin     = count_event,
+            .value          = count_event
+        };
+
+        size_t events = 0;
+        if((err = nbt_parse_events(b.data, b.len, &counter, &events)) != NBT_OK)
+            die_with_err(err);
+        if(events != nbt_size(tree))
+            die("FAILED. Wrong number of events.");
+
+        buffer_free(&b);
+        printf("OK.\n");
+    }
+
+    {
+        printf("Checking nbt_validate... ");
+        struct buffer b = nbt_dump_binary(tree);
+        if(b.data == NULL) die_with_err(errno);
+
+        struct nbt_stats stats;
+        if((err = nbt_validate(b.data, b.len, &stats)) != NBT_OK)
+            die_with_err(err);
+        if(stats.nodes != nbt_size(tree))
+            die("FAILED. Wrong number of nodes.");
+
+        size_t total = 0;
+        for(size_t i = 0; i < sizeof stats.bytes / sizeof *stats.bytes; i++)
+            total += stats.bytes[i];
+        if(total != b.len)
+            die("FAILED. Byte counts don't add up.");
+
+        /* Cut short, right in the middle. */
+        if(nbt_validate(b.data, b.len / 2, &stats) != NBT_ERR || stats.error_offset > b.len / 2)
+            die("FAILED. Truncated tree validated.");
+
+        /* An unknown type, right at the root. */
+        b.data[0] = 0x7f;
+        if(nbt_validate(b.data, b.len, &stats) != NBT_ERR || stats.error_offset != 0)
+            die("FAILED. Bad root type validated.");
+
+        buffer_free(&b);
+        printf("OK.\n");
+    }
+
+    {
+        printf("Checking nbt_parse_paths... ");
+        struct buffer b = nbt_dump_binary(tree);
+        if(b.data == NULL) die_with_err(errno);
+
+        const char* root_path = tree->name ? tree->name : "";
+
+        /* The root on its own is everything. */
+        nbt_node* all = nbt_parse_paths(b.data, b.len, &root_path, 1);
+        if(all == NULL) die_with_err(errno);
+        if(!nbt_eq(tree, all))
+            die("FAILED. Projecting the root lost something.");
+        nbt_free(all);
+
+        /* Nothing at all is just the root. */
+        nbt_node* none = nbt_parse_paths(b.data, b.len, NULL, 0);
+        if(none == NULL) die_with_err(errno);
+        if((tree->type == TAG_COMPOUND || tree->type == TAG_LIST) && nbt_size(none) != 1)
+            die("FAILED. Projecting nothing kept something.");
+        nbt_free(none);
+
+        /* Each of the root's children, one at a time. */
+        if(tree->type == TAG_COMPOUND)
+        {
+            const struct list_head* pos;
+            list_for_each(pos, &tree->payload.tag_compound->entry)
+            {
+                const nbt_node* child = list_entry(pos, struct tag_list, entry)->data;
+
+                char path[256];
+                snprintf(path, sizeof path, "%s.%s", root_path, child->name);
+                const char* paths[] = { path };
+
+                nbt_node* projected = nbt_parse_paths(b.data, b.len, paths, 1);
+                if(projected == NULL) die_with_err(errno);
+
+                nbt_node* found = nbt_find_by_path(projected, path);
+                if(found == NULL || !nbt_eq(found, nbt_find_by_path(tree, path)))
+                    die("FAILED. Projected child not equal.");
+                if(nbt_size(projected) != nbt_size(found) + 1)
+                    die("FAILED. Projection kept too much.");
+
+                nbt_free(projected);
+            }
+        }
+
+        buffer_free(&b);
+        printf("OK.\n");
+    }
+
+    {
+        printf("Checking nbt_extract... ");
+        struct buffer b = nbt_dump_binary(tree);
+        if(b.data == NULL) die_with_err(errno);
+        struct buffer gz = nbt_dump_compressed(tree, STRAT_INFLATE);
+        if(gz.data == NULL) die_with_err(errno);
+
+        const char* root_path = tree->name ? tree->name : "";
+
+        /*
+         * The root, every child and grandchild of it, a list's first element,
+         * something that isn't there, and the same path twice over.
+         */
+        static char storage[64][256];
+        const char* paths[64];
+        size_t n = 0;
+
+        snprintf(storage[n], sizeof storage[n], "%s", root_path);
+        paths[n] = storage[n]; n++;
+        snprintf(storage[n], sizeof storage[n], "%s.no such thing", root_path);
+        paths[n] = storage[n]; n++;
+
+        if(tree->type == TAG_COMPOUND)
+        {
+            const struct list_head* pos;
+            list_for_each(pos, &tree->payload.tag_compound->entry)
+            {
+                const nbt_node* child = list_entry(pos, struct tag_list, entry)->data;
+
+                if(n < 60)
+                {
+                    snprintf(storage[n], sizeof storage[n], "%s.%s", root_path, child->name);
+                    paths[n] = storage[n]; n++;
+                }
+
+                if(n < 60 && child->type == TAG_LIST)
+                {
+                    snprintf(storage[n], sizeof storage[n], "%s.%s.", root_path, child->name);
+                    paths[n] = storage[n]; n++;
+                }
+
+                if(child->type != TAG_COMPOUND)
+                    continue;
+
+                const struct list_head* inner;
+                list_for_each(inner, &child->payload.tag_compound->entry)
+                {
+                    const nbt_node* grandchild = list_entry(inner, struct tag_list, entry)->data;
+
+                    if(n < 60)
+                    {
+                        snprintf(storage[n], sizeof storage[n], "%s.%s.%s",
+                                 root_path, child->name, grandchild->name);
+                        paths[n] = storage[n]; n++;
+                    }
+                }
+            }
+        }
+
+        paths[n] = paths[n - 1]; n++;
+
+        nbt_node* found[64];
+
+        for(int compressed = 0; compressed <= 1; compressed++)
+        {
+            err = compressed ? nbt_extract_compressed(gz.data, gz.len, paths, n, found)
+                             : nbt_extract(b.data, b.len, paths, n, found);
+            if(err != NBT_OK) die_with_err(err);
+
+            for(size_t i = 0; i < n; i++)
+            {
+                nbt_node* expected = nbt_find_by_path(tree, paths[i]);
+
+                if(expected == NULL ? found[i] != NULL : !nbt_eq(expected, found[i]))
+                    die("FAILED. Extracted node not equal.");
+
+                nbt_free(found[i]);
+            }
+        }
+
+        /* Truncated input either fails cleanly or finds what came before the cut. */
+        err = nbt_extract_compressed(gz.data, gz.len / 2, paths, n, found);
+        for(size_t i = 0; i < n; i++)
+        {
+            if(err != NBT_OK && found[i] != NULL)
+                die("FAILED. Failed extraction left something behind.");
+
+            nbt_free(found[i]);
+        }
+
+        buffer_free(&gz);
+        buffer_free(&b);
+        printf("OK.\n");
+    }
+
+    {
+        printf("Checking nbt_prefilter... ");
+
+        /* The textbook case: overlapping patterns, and one inside another. */
+        static const char* const words[] = { "he", "she", "his", "hers", "sher" };
+        bool seen[5];
+
+        nbt_prefilter* f = nbt_prefilter_new(words, NULL, 5, false);
+        if(f == NULL) die_with_err(errno);
+        if(nbt_prefilter_scan(f, "ushers", 6, seen) != 4 || !seen[0] || !seen[1] || seen[2] || !seen[3] || !seen[4])
+            die("FAILED. Wrong patterns seen.");
+        if(nbt_prefilter_match(f, "ushers", 6) || !nbt_prefilter_match(f, "ushers his", 10))
+            die("FAILED. Wrong match.");
+        if(nbt_prefilter_scan(f, "USHERS", 6, NULL) != 0)
+            die("FAILED. Case ignored.");
+        nbt_prefilter_free(f);
+
+        f = nbt_prefilter_new(words, NULL, 5, true);
+        if(f == NULL) die_with_err(errno);
+        if(nbt_prefilter_scan(f, "UsHeRs", 6, NULL) != 4)
+            die("FAILED. Case not ignored.");
+        nbt_prefilter_free(f);
+
+        /* Raw bytes, NULs and all. */
+        static const char* const raw[] = { "\0\x01\xff" };
+        static const size_t raw_length[] = { 3 };
+        f = nbt_prefilter_new(raw, raw_length, 1, false);
+        if(f == NULL) die_with_err(errno);
+        if(!nbt_prefilter_match(f, "x\0\0\x01\xffy", 6) || nbt_prefilter_match(f, "\0\x01", 2))
+            die("FAILED. Raw pattern.");
+        nbt_prefilter_free(f);
+
+        const char* too_many[NBT_PREFILTER_MAX_PATTERNS + 1];
+        for(size_t i = 0; i <= NBT_PREFILTER_MAX_PATTERNS; i++) too_many[i] = "x";
+        if(nbt_prefilter_new(too_many, NULL, NBT_PREFILTER_MAX_PATTERNS + 1, false) != NULL || errno != NBT_ERR)
+            die("FAILED. Too many patterns.");
+
+        /* Every name in the tree is in it, and something made up isn't. */
+        struct buffer b = nbt_dump_binary(tree);
+        if(b.data == NULL) die_with_err(errno);
+        struct buffer gz = nbt_dump_compressed(tree, STRAT_GZIP);
+        if(gz.data == NULL) die_with_err(errno);
+
+        const char* names[] = { tree->name ? tree->name : "", "no such name, anywhere" };
+        if(tree->type == TAG_COMPOUND && !list_empty(&tree->payload.tag_compound->entry))
+            names[0] = list_entry(tree->payload.tag_compound->entry.blink, struct tag_list, entry)->data->name;
+
+        f = nbt_prefilter_new(names, NULL, 2, false);
+        if(f == NULL) die_with_err(errno);
+
+        if(nbt_prefilter_scan(f, b.data, b.len, seen) != 1 || !seen[0] ||
+           nbt_prefilter_scan_tree(f, b.data, b.len, seen) != 1 || !seen[0])
+            die("FAILED. Tree scan.");
+
+        nbt_node* filtered = nbt_parse_compressed_filtered(gz.data, gz.len, f);
+        if(filtered != NULL || errno != NBT_OK)
+            die("FAILED. Filtered tree parsed.");
+        nbt_prefilter_free(f);
+
+        f = nbt_prefilter_new(names, NULL, 1, false);
+        if(f == NULL) die_with_err(errno);
+        filtered = nbt_parse_compressed_filtered(gz.data, gz.len, f);
+        if(filtered == NULL) die_with_err(errno);
+        if(!nbt_eq(tree, filtered))
+            die("FAILED. Filtered tree not equal.");
+        nbt_free(filtered);
+        nbt_prefilter_free(f);
+
+        buffer_free(&gz);
+        buffer_free(&b);
+        printf("OK.\n");
+    }
+
+    {
+        printf("Checking NBT dialects... ");
+
+        struct buffer java   = variant_tree(false, true);
+        struct buffer little = variant_tree(true, true);
+        struct buffer net    = variant_tree(false, false);
+
+        nbt_node* expected = nbt_parse(java.data, java.len);
+        if(expected == NULL) die_with_err(errno);
+
+        nbt_node* i = nbt_find_by_name(expected, "i");
+        nbt_node* la = nbt_find_by_name(expected, "la");
+        if(i == NULL || i->payload.tag_int != 0x01020304 ||
+           la == NULL || la->payload.tag_long_array.data[1] != INT64_C(0x0102030405060708))
+            die("FAILED. Test tree is wrong.");
+
+        struct nbt_parse_options options = { .format = NBT_LITTLE_ENDIAN };
+        nbt_node* actual = nbt_parse_opts(little.data, little.len, &options);
+        if(actual == NULL) die_with_err(errno);
+        if(!nbt_eq(expected, actual))
+            die("FAILED. Little-endian tree not equal.");
+        nbt_free(actual);
+
+        options.format = NBT_NETWORK;
+        actual = nbt_parse_opts(net.data, net.len, &options);
+        if(actual == NULL) die_with_err(errno);
+        if(actual->name != NULL)
+            die("FAILED. Network root has a name.");
+        actual->name = expected->name;
+        if(!nbt_eq(expected, actual))
+            die("FAILED. Network tree not equal.");
+        actual->name = NULL;
+        nbt_free(actual);
+
+        if(nbt_parse_opts("\0", 1, &options) != NULL || errno != NBT_OK)
+            die("FAILED. Empty network tree.");
+
+        /* Each dialect read as another is garbage, or at least not the same tree. */
+        actual = nbt_parse(little.data, little.len);
+        if(actual != NULL && nbt_eq(expected, actual))
+            die("FAILED. Little-endian read as big-endian.");
+        nbt_free(actual);
+
+        buffer_free(&java);
+        buffer_free(&little);
+        buffer_free(&net);
+        nbt_free(expected);
+        printf("OK.\n");
+    }
+
+    {
+        printf("Checking Modified UTF-8... ");
+
+        /* U+1F600, as Java writes it, and as everyone else does. */
+        static const char mutf8[] = "a\xED\xA0\xBD\xED\xB8\x80" "b";
+        static const char utf8[]  = "a\xF0\x9F\x98\x80" "b";
+
+        if(!nbt_mutf8_valid(mutf8, 8) || !nbt_mutf8_valid("\xC0\x80", 2) ||
+           nbt_mutf8_valid(utf8, 6) || nbt_mutf8_valid("\xC0\x81", 2) ||
+           nbt_mutf8_valid("\xE2\x82", 2) || nbt_mutf8_valid("\x80", 1))
+            die("FAILED. Wrong validity.");
+
+        char out[16];
+        memcpy(out, mutf8, 8);
+        if(nbt_mutf8_to_utf8(out, out, 8) != 6 || memcmp(out, utf8, 6) != 0)
+            die("FAILED. Surrogate pair not joined.");
+        if(nbt_mutf8_to_utf8(out, "\xED\xA0\xBDx", 4) != 4 || memcmp(out, "\xEF\xBF\xBDx", 4) != 0)
+            die("FAILED. Unpaired surrogate kept.");
+        if(nbt_mutf8_to_utf8(out, "\xF0\x9F\x98\x80", 4) != SIZE_MAX)
+            die("FAILED. Four-byte sequence accepted.");
+
+        if(nbt_utf8_to_mutf8_length(utf8, 6) != 8 || nbt_utf8_to_mutf8(out, utf8, 6) != 8 ||
+           memcmp(out, mutf8, 8) != 0)
+            die("FAILED. Surrogate pair not split.");
+        if(nbt_utf8_to_mutf8(out, "x\0", 2) != 3 || memcmp(out, "x\xC0\x80", 3) != 0)
+            die("FAILED. NUL not encoded.");
+
+        /* A string tag named "n", transcoded on the way in and back on the way out. */
+        static const char tag[] = "\x08\x00\x01n\x00\x08" "a\xED\xA0\xBD\xED\xB8\x80" "b";
+        struct nbt_parse_options options = { .utf8 = true };
+
+        nbt_node* s = nbt_parse_opts(tag, sizeof tag - 1, &options);
+        if(s == NULL) die_with_err(errno);
+        if(strcmp(s->payload.tag_string, utf8) != 0)
+            die("FAILED. String not transcoded.");
+
+        struct buffer b = nbt_dump_binary(s);
+        if(b.data == NULL) die_with_err(errno);
+        if(b.len != sizeof tag - 1 || memcmp(b.data, tag, b.len) != 0)
+            die("FAILED. String not transcoded back.");
+        buffer_free(&b);
+        nbt_free(s);
+
+        s = nbt_parse(tag, sizeof tag - 1);
+        if(s == NULL) die_with_err(errno);
+        if(strcmp(s->payload.tag_string, mutf8) != 0)
+            die("FAILED. String transcoded unasked.");
+        nbt_free(s);
+
+        static const char bad[] = "\x08\x00\x01n\x00\x02\xC0\x81";
+        if(nbt_parse_opts(bad, sizeof bad - 1, &options) != NULL || errno != NBT_ERR)
+            die("FAILED. Invalid string accepted.");
+
+        printf("OK.\n");
+    }
+
+    {
+        printf("Checking nbt_parse_lazy... ");
+        struct buffer b = nbt_dump_binary(tree);
+        if(b.data == NULL) die_with_err(errno);
+
+        struct buffer scratch = BUFFER_INIT;
+        if(buffer_append(&scratch, b.data, b.len)) die_with_err(NBT_EMEM);
+
+        nbt_node* lazy = nbt_parse_lazy(scratch.data, scratch.len);
+        if(lazy == NULL) die_with_err(errno);
+
+        /* Untouched, it goes back out exactly as it came in. */
+        struct buffer redumped = nbt_dump_binary(lazy);
+        if(redumped.data == NULL) die_with_err(errno);
+        if(redumped.len != b.len || memcmp(redumped.data, b.data, b.len) != 0)
+            die("FAILED. Lazy tree dumps differently.");
+        buffer_free(&redumped);
+
+        /* Looking a path up only materializes what's along it. */
+        if(tree->type == TAG_COMPOUND && !list_empty(&tree->payload.tag_compound->entry))
+        {
+            const nbt_node* first = list_entry(tree->payload.tag_compound->entry.flink, struct tag_list, entry)->data;
+
+            char path[256];
+            snprintf(path, sizeof path, "%s.%s", tree->name ? tree->name : "", first->name);
+
+            nbt_node* found = nbt_find_by_path(lazy, path);
+            if(found == NULL || !nbt_eq(found, first))
+                die("FAILED. Lazy lookup not equal.");
+        }
+
+        redumped = nbt_dump_binary(lazy);
+        if(redumped.data == NULL) die_with_err(errno);
+        if(redumped.len != b.len || memcmp(redumped.data, b.data, b.len) != 0)
+            die("FAILED. Partly materialized tree dumps differently.");
+        buffer_free(&redumped);
+
+        if(!nbt_eq(tree, lazy))
+            die("FAILED. Lazy tree not equal.");
+        nbt_free(lazy);
+
+        struct buffer z = nbt_dump_compressed(tree, STRAT_INFLATE);
+        if(z.data == NULL) die_with_err(errno);
+
+        lazy = nbt_parse_compressed_lazy(z.data, z.len);
+        if(lazy == NULL) die_with_err(errno);
+        if(!nbt_eq(tree, lazy))
+            die("FAILED. Compressed lazy tree not equal.");
+        nbt_free(lazy);
+
+        buffer_free(&z);
+        buffer_free(&scratch);
+        buffer_free(&b);
+        printf("OK.\n");
+    }
+
+    {
+        printf("Checking nbt_push_parser... ");
+        struct buffer b = nbt_dump_binary(tree);
+        if(b.data == NULL) die_with_err(errno);
+
+        /* Every slice size from one byte to the whole thing at once. */
+        static const size_t slices[] = { 1, 2, 3, 7, 64, 4096, 0 };
+
+        for(const size_t* s = slices; ; s++)
+        {
+            size_t slice = *s ? *s : b.len;
+
+            nbt_push_parser* p = nbt_push_parser_new();
+            if(p == NULL) die_with_err(errno);
+
+            for(size_t off = 0; off < b.len; off += slice)
+            {
+                size_t n = b.len - off < slice ? b.len - off : slice;
+                if((err = nbt_push_parser_feed(p, b.data + off, n)) != NBT_OK)
+                    die_with_err(err);
+            }
+
+            nbt_node* pushed = nbt_push_parser_finish(p);
+            if(pushed == NULL) die_with_err(errno);
+            if(!nbt_eq(tree, pushed))
+                die("FAILED. Pushed tree not equal.");
+
+            nbt_free(pushed);
+            nbt_push_parser_free(p);
+
+            if(*s == 0) break;
+        }
+
+        /* A truncated tree has to be an error, not a crash or a leak. */
+        nbt_push_parser* p = nbt_push_parser_new();
+        if(p == NULL) die_with_err(errno);
+        if((err = nbt_push_parser_feed(p, b.data, b.len / 2)) != NBT_OK)
+            die_with_err(err);
+        if(nbt_push_parser_done(p) || nbt_push_parser_finish(p) != NULL)
+            die("FAILED. Truncated tree parsed.");
+        nbt_push_parser_free(p);
+
+        /* An empty string or array at the very end finishes the tree with no more input. */
+        for(size_t i = 0; i < sizeof ends_empty / sizeof *ends_empty; i++)
+        {
+            nbt_node* parsed = nbt_parse(ends_empty[i].data, ends_empty[i].len);
+            if(parsed == NULL) die_with_err(errno);
+
+            for(size_t slice = 1; slice <= ends_empty[i].len; slice += ends_empty[i].len - 1)
+            {
+                struct event_log log = { BUFFER_INIT, 0, 0, 0 };
+
+                p = nbt_push_parser_new();
+                nbt_push_parser* events = nbt_push_parser_new_events(&logger, &log);
+                if(p == NULL || events == NULL) die_with_err(errno);
+
+                for(size_t off = 0; off < ends_empty[i].len; off += slice)
+                {
+                    size_t n = ends_empty[i].len - off < slice ? ends_empty[i].len - off : slice;
+                    if((err = nbt_push_parser_feed(p, ends_empty[i].data + off, n)) != NBT_OK ||
+                       (err = nbt_push_parser_feed(events, ends_empty[i].data + off, n)) != NBT_OK)
+                        die_with_err(err);
+                }
+
+                nbt_node* pushed = nbt_push_parser_finish(p);
+                if(pushed == NULL || !nbt_eq(parsed, pushed) || !nbt_push_parser_done(events))
+                    die("FAILED. Tree ending in an empty payload.");
+
+                nbt_free(pushed);
+                nbt_push_parser_free(p);
+                nbt_push_parser_free(events);
+                buffer_free(&log.text);
+            }
+
+            nbt_free(parsed);
+        }
+
+        buffer_free(&b);
+        printf("OK.\n");
+    }
+
+    {
+        printf("Checking nbt_loader... ");
+        struct buffer raw = nbt_dump_binary(tree);
+        if(raw.data == NULL) die_with_err(errno);
+        struct buffer gz = nbt_dump_compressed(tree, STRAT_GZIP);
+        if(gz.data == NULL) die_with_err(errno);
+
+        static const struct nbt_budget budgets[] = {
+            { 1, 0 }, { 0, 1 }, { 7, 3 }, { 4096, 0 }, { 0, 0 }
+        };
+
+        for(size_t i = 0; i < sizeof budgets / sizeof *budgets; i++)
+        for(int compressed = 0; compressed <= 1; compressed++)
+        {
+            const struct buffer* in = compressed ? &gz : &raw;
+
+            nbt_loader* l = nbt_loader_new(in->data, in->len, compressed);
+            if(l == NULL) die_with_err(errno);
+
+            size_t steps = 1;
+            while((err = nbt_loader_step(l, &budgets[i])) == NBT_AGAIN)
+                steps++;
+            if(err != NBT_OK) die_with_err(err);
+
+            /* No budget means it's done in one go. */
+            if(budgets[i].bytes == 0 && budgets[i].nodes == 0 && steps != 1)
+                die("FAILED. Unlimited step didn't finish.");
+            if(budgets[i].bytes == 1 && steps < raw.len)
+                die("FAILED. Byte budget ignored.");
+
+            nbt_node* loaded = nbt_loader_finish(l);
+            if(loaded == NULL) die_with_err(errno);
+            if(!nbt_eq(tree, loaded))
+                die("FAILED. Loaded tree not equal.");
+
+            nbt_free(loaded);
+            nbt_loader_free(l);
+        }
+
+        /* Truncated input has to be an error that sticks. */
+        for(int compressed = 0; compressed <= 1; compressed++)
+        {
+            const struct buffer* in = compressed ? &gz : &raw;
+
+            nbt_loader* l = nbt_loader_new(in->data, in->len / 2, compressed);
+            if(l == NULL) die_with_err(errno);
+
+            struct nbt_budget budget = { 64, 0 };
+            while((err = nbt_loader_step(l, &budget)) == NBT_AGAIN)
+                ;
+            if(err == NBT_OK || nbt_loader_step(l, NULL) != err)
+                die("FAILED. Truncated tree loaded.");
+            if(nbt_loader_finish(l) != NULL || errno != err)
+                die("FAILED. Truncated tree finished.");
+
+            nbt_loader_free(l);
+        }
+
+        /* Trees ending in an empty payload, loaded a byte at a time and read from a gzip file. */
+        for(size_t i = 0; i < sizeof ends_empty / sizeof *ends_empty; i++)
+        {
+            nbt_node* parsed = nbt_parse(ends_empty[i].data, ends_empty[i].len);
+            if(parsed == NULL) die_with_err(errno);
+
+            struct buffer zipped = nbt_dump_compressed(parsed, STRAT_GZIP);
+            if(zipped.data == NULL) die_with_err(errno);
+
+            for(int compressed = 0; compressed <= 1; compressed++)
+            {
+                nbt_loader* l = compressed ? nbt_loader_new(zipped.data, zipped.len, true)
+                                           : nbt_loader_new(ends_empty[i].data, ends_empty[i].len, false);
+                if(l == NULL) die_with_err(errno);
+
+                struct nbt_budget budget = { 1, 0 };
+                while((err = nbt_loader_step(l, &budget)) == NBT_AGAIN)
+                    ;
+                if(err != NBT_OK) die_with_err(err);
+
+                nbt_node* loaded = nbt_loader_finish(l);
+                if(loaded == NULL || !nbt_eq(parsed, loaded))
+                    die("FAILED. Loading a tree ending in an empty payload.");
+
+                nbt_free(loaded);
+                nbt_loader_free(l);
+            }
+
+            FILE* fp = tmpfile();
+            if(fp == NULL || fwrite(zipped.data, 1, zipped.len, fp) != zipped.len)
+                die("Could not write a temporary file.");
+            rewind(fp);
+
+            nbt_node* read = nbt_parse_file(fp);
+            if(read == NULL) die_with_err(errno);
+            if(!nbt_eq(parsed, read))
+                die("FAILED. Reading a tree ending in an empty payload.");
+
+            fclose(fp);
+            nbt_free(read);
+            buffer_free(&zipped);
+            nbt_free(parsed);
+        }
+
+        buffer_free(&gz);
+        buffer_free(&raw);
+        printf("OK.\n");
+    }
+
+    {
+        printf("Checking nbt_push_parser_new_events... ");
+        struct buffer b = nbt_dump_binary(tree);
+        if(b.data == NULL) die_with_err(errno);
+
+        /* Everything, skipping the root's children's insides, and stopping early. */
+        static const size_t skips[] = { 0, 1, 0 };
+        static const size_t stops[] = { 0, 0, 5 };
+        static const size_t slices[] = { 1, 7, 4096 };
+
+        for(size_t k = 0; k < 3; k++)
+        {
+            struct event_log expected = { BUFFER_INIT, skips[k], stops[k], 0 };
+            if((err = nbt_parse_events(b.data, b.len, &logger, &expected)) != NBT_OK)
+                die_with_err(err);
+
+            for(size_t s = 0; s < 3; s++)
+            {
+                struct event_log pushed = { BUFFER_INIT, skips[k], stops[k], 0 };
+
+                nbt_push_parser* p = nbt_push_parser_new_events(&logger, &pushed);
+                if(p == NULL) die_with_err(errno);
+
+                for(size_t off = 0; off < b.len; off += slices[s])
+                {
+                    size_t n = b.len - off < slices[s] ? b.len - off : slices[s];
+                    if((err = nbt_push_parser_feed(p, b.data + off, n)) != NBT_OK)
+                        die_with_err(err);
+                }
+
+                if(!nbt_push_parser_done(p) || nbt_push_parser_finish(p) != NULL || errno != NBT_OK)
+                    die("FAILED. Event parser didn't finish.");
+                if(pushed.text.len != expected.text.len ||
+                   memcmp(pushed.text.data, expected.text.data, expected.text.len) != 0)
+                    die("FAILED. Pushed events differ.");
+
+                nbt_push_parser_free(p);
+                buffer_free(&pushed.text);
+            }
+
+            buffer_free(&expected.text);
+        }
+
+        /* And the same again, streamed out of a compressed file. */
+        struct event_log expected = { BUFFER_INIT, 0, 0, 0 };
+        struct event_log streamed = { BUFFER_INIT, 0, 0, 0 };
+
+        if((err = nbt_parse_events(b.data, b.len, &logger, &expected)) != NBT_OK)
+            die_with_err(err);
+
+        FILE* fp = fopen(argv[1], "rb");
+        if(fp == NULL) die("Could not open the file for reading.");
+        if((err = nbt_parse_file_events(fp, &logger, &streamed)) != NBT_OK)
+            die_with_err(err);
+        fclose(fp);
+
+        if(streamed.text.len != expected.text.len ||
+           memcmp(streamed.text.data, expected.text.data, expected.text.len) != 0)
+            die("FAILED. Streamed events differ.");
+
+        buffer_free(&streamed.text);
+        buffer_free(&expected.text);
+        buffer_free(&b);
+        printf("OK.\n");
+    }
+
+    {
+        printf("Checking deep trees... ");
+
+        for(int lists = 0; lists <= 1; lists++)
+        {
+            /* As deep as the default allows, and one more. */
+            struct buffer ok = deep_tree(NBT_DEFAULT_MAX_DEPTH, lists);
+            struct buffer too_deep = deep_tree(NBT_DEFAULT_MAX_DEPTH + 1, lists);
+
+            nbt_node* parsed = nbt_parse(ok.data, ok.len);
+            if(parsed == NULL) die_with_err(errno);
+            nbt_free(parsed);
+
+            const struct nbt_event_handler nothing = { 0 };
+            if(nbt_parse(too_deep.data, too_deep.len) != NULL ||
+               nbt_parse_events(too_deep.data, too_deep.len, &nothing, NULL) != NBT_ERR)
+                die("FAILED. Tree deeper than the default parsed.");
+
+            nbt_push_parser* p = nbt_push_parser_new();
+            if(p == NULL) die_with_err(errno);
+            if(nbt_push_parser_feed(p, too_deep.data, too_deep.len) != NBT_ERR)
+                die("FAILED. Push parser took a tree deeper than the default.");
+            nbt_push_parser_free(p);
+
+            if(nbt_parse_lazy(too_deep.data, too_deep.len) != NULL)
+                die("FAILED. Lazy parser took a tree deeper than the default.");
+
+            const struct nbt_parse_options shallow = { .max_depth = 2 };
+            if(nbt_parse_opts(ok.data, ok.len, &shallow) != NULL)
+                die("FAILED. max_depth ignored.");
+
+            buffer_free(&too_deep);
+            buffer_free(&ok);
+
+            /* Far deeper than any call stack would take, given the options. */
+            struct buffer deep = deep_tree(100000, lists);
+            const struct nbt_parse_options options = { .max_depth = 100000 };
+
+            parsed = nbt_parse_opts(deep.data, deep.len, &options);
+            if(parsed == NULL) die_with_err(errno);
+
+            nbt_node* clone = nbt_clone(parsed);
+            if(clone == NULL) die_with_err(errno);
+
+            struct buffer redumped = nbt_dump_binary(clone);
+            if(redumped.data == NULL) die_with_err(errno);
+            if(redumped.len != deep.len || memcmp(redumped.data, deep.data, deep.len) != 0)
+                die("FAILED. Deep tree dumps differently.");
+
+            buffer_free(&redumped);
+
+            size_t visited = 0;
+
+            if(!nbt_eq(parsed, clone) || nbt_size(parsed) != 100000 ||
+               !nbt_map(parsed, count_nodes, &visited) || visited != 100000 ||
+               nbt_find(parsed, bottom, NULL) == NULL)
+                die("FAILED. Deep tree walked wrong.");
+
+            nbt_node* filtered = nbt_filter(parsed, not_bottom, NULL);
+            if(filtered == NULL) die_with_err(errno);
+
+            if((clone = nbt_filter_inplace(clone, not_bottom, NULL)) == NULL ||
+               nbt_size(clone) != 99999 || !nbt_eq(filtered, clone) || nbt_eq(parsed, clone))
+                die("FAILED. Deep tree filtered wrong.");
+
+            nbt_free(filtered);
+
+            struct nbt_memory_stats usage;
+            nbt_memory_usage(parsed, &usage);
+
+            if(usage.nodes != 100000 || nbt_encode_arrays(parsed, NULL) != NBT_OK)
+                die("FAILED. Deep tree added up wrong.");
+
+            nbt_free(clone);
+            nbt_free(parsed);
+            buffer_free(&deep);
+
+            /* Printing a tree takes space quadratic in its depth, so that's done with a shallower one. */
+            deep = deep_tree(2000, lists);
+
+            parsed = nbt_parse_opts(deep.data, deep.len, &options);
+            if(parsed == NULL) die_with_err(errno);
+
+            char* ascii = nbt_dump_ascii(parsed);
+            if(ascii == NULL) die_with_err(errno);
+
+            size_t lines = 0;
+            for(const char* c = ascii; *c; c++)
+                lines += *c == '\n';
+
+            if(lines != 3 * 2000 || strncmp(ascii + strlen(ascii) - 2, "}\n", 2) != 0)
+                die("FAILED. Deep tree printed wrong.");
+
+            free(ascii);
+            nbt_free(parsed);
+            buffer_free(&deep);
+        }
+
+        printf("OK.\n");
+    }
+
+    {
+        printf("Checking parallel lists... ");
+        struct buffer wide = wide_tree();
+
+        nbt_node* serial = nbt_parse(wide.data, wide.len);
+        if(serial == NULL) die_with_err(errno);
+
+        const struct nbt_parse_options options = { .threads = 4 };
+
+        nbt_node* parallel = nbt_parse_opts(wide.data, wide.len, &options);
+        if(parallel == NULL) die_with_err(errno);
+        if(!nbt_eq(serial, parallel))
+            die("FAILED. Parallel tree not equal.");
+
+        struct buffer redumped = nbt_dump_binary(parallel);
+        if(redumped.data == NULL) die_with_err(errno);
+        if(redumped.len != wide.len || memcmp(redumped.data, wide.data, wide.len) != 0)
+            die("FAILED. Parallel tree dumps differently.");
+
+        /* Cut short in the list of ints, then broken in the last compound. */
+        if(nbt_parse_opts(wide.data, wide.len - 4000, &options) != NULL)
+            die("FAILED. Truncated parallel list parsed.");
+
+        wide.data[3 + 9 + 19999 * 30] = 0x7f;
+        if(nbt_parse_opts(wide.data, wide.len, &options) != NULL)
+            die("FAILED. Broken parallel list parsed.");
+
+        /* A list whose first element is far deeper than any call stack would take. */
+        static const unsigned char header[] = { TAG_LIST, 0, 0, TAG_LIST, 0, 0, 0x13, 0x88 };
+        static const unsigned char nested[] = { TAG_LIST, 0, 0, 0, 1 };
+        static const unsigned char empty[]  = { TAG_BYTE, 0, 0, 0, 0 };
+        struct buffer deep = BUFFER_INIT;
+        int failed = buffer_append(&deep, header, sizeof header);
+
+        for(int i = 0; i < 100000; i++)
+            failed |= buffer_append(&deep, nested, sizeof nested);
+        for(int i = 0; i < 5000; i++)
+            failed |= buffer_append(&deep, empty, sizeof empty);
+        if(failed) die_with_err(NBT_EMEM);
+
+        const struct nbt_parse_options deep_serial   = { .max_depth = SIZE_MAX, .threads = 1 };
+        const struct nbt_parse_options deep_parallel = { .max_depth = SIZE_MAX, .threads = 2 };
+
+        nbt_node* deep_one = nbt_parse_opts(deep.data, deep.len, &deep_serial);
+        nbt_node* deep_two = nbt_parse_opts(deep.data, deep.len, &deep_parallel);
+        if(deep_one == NULL || deep_two == NULL) die_with_err(errno);
+
+        struct buffer dumped_one = nbt_dump_binary(deep_one);
+        struct buffer dumped_two = nbt_dump_binary(deep_two);
+        if(dumped_one.data == NULL || dumped_two.data == NULL) die_with_err(errno);
+        if(dumped_one.len != deep.len || dumped_two.len != deep.len ||
+           memcmp(dumped_two.data, deep.data, deep.len) != 0)
+            die("FAILED. Deep parallel list.");
+
+        buffer_free(&dumped_one);
+        buffer_free(&dumped_two);
+        nbt_free(deep_one);
+        nbt_free(deep_two);
+        buffer_free(&deep);
+
+        buffer_free(&redumped);
+        nbt_free(parallel);
+        nbt_free(serial);
+        buffer_free(&wide);
+        printf("OK.\n");
+    }
+
+    {
+        printf("Checking budgets... ");
+
+        /* Headers that promise far more than what follows: a gigabyte int array, and a huge list. */
+        static const unsigned char big_array[] = { TAG_INT_ARRAY, 0, 0, 0x3f, 0xff, 0xff, 0xff, 1, 2, 3, 4 };
+        static const unsigned char big_list[]  = { TAG_LIST, 0, 0, TAG_LONG, 0x7f, 0xff, 0xff, 0xff, 1, 2, 3, 4 };
+
+        if(nbt_parse(big_array, sizeof big_array) != NULL || errno != NBT_ERR ||
+           nbt_parse(big_list, sizeof big_list) != NULL || errno != NBT_ERR)
+            die("FAILED. Impossible length accepted.");
+
+        nbt_push_parser* p = nbt_push_parser_new();
+        if(p == NULL) die_with_err(errno);
+        if(nbt_push_parser_feed(p, big_array, sizeof big_array) != NBT_OK ||
+           nbt_push_parser_finish(p) != NULL)
+            die("FAILED. Impossible length pushed.");
+        nbt_push_parser_free(p);
+
+        struct buffer wide = wide_tree();
+
+        nbt_node* serial = nbt_parse(wide.data, wide.len);
+        if(serial == NULL) die_with_err(errno);
+
+        struct nbt_parse_options options = { .max_nodes = nbt_size(serial) };
+        nbt_node* limited = nbt_parse_opts(wide.data, wide.len, &options);
+        if(limited == NULL) die_with_err(errno);
+        nbt_free(limited);
+
+        options.max_nodes--;
+        if(nbt_parse_opts(wide.data, wide.len, &options) != NULL || errno != NBT_ELIMIT)
+            die("FAILED. Too many nodes.");
+
+        options = (struct nbt_parse_options) { .max_array_length = 20000 };
+        limited = nbt_parse_opts(wide.data, wide.len, &options);
+        if(limited == NULL) die_with_err(errno);
+        nbt_free(limited);
+
+        options.max_array_length--;
+        if(nbt_parse_opts(wide.data, wide.len, &options) != NULL || errno != NBT_ELIMIT)
+            die("FAILED. List too long.");
+
+        /* The fewest bytes it fits in. Threads must draw the line in exactly the same place. */
+        size_t low = 1, high = SIZE_MAX / 2;
+        while(low < high)
+        {
+            options = (struct nbt_parse_options) { .max_bytes = low + (high - low) / 2 };
+            limited = nbt_parse_opts(wide.data, wide.len, &options);
+
+            if(limited) high = options.max_bytes;
+            else        low  = options.max_bytes + 1;
+
+            if(limited == NULL && errno != NBT_ELIMIT) die_with_err(errno);
+            nbt_free(limited);
+        }
+
+        options = (struct nbt_parse_options) { .max_bytes = low, .threads = 4 };
+        limited = nbt_parse_opts(wide.data, wide.len, &options);
+        if(limited == NULL) die_with_err(errno);
+        nbt_free(limited);
+
+        options.max_bytes--;
+        if(nbt_parse_opts(wide.data, wide.len, &options) != NULL || errno != NBT_ELIMIT)
+            die("FAILED. Too many bytes on threads.");
+
+        /* Inflating counts too. */
+        struct buffer gz = nbt_dump_compressed(serial, STRAT_INFLATE);
+        if(gz.data == NULL) die_with_err(errno);
+
+        options = (struct nbt_parse_options) { .max_bytes = wide.len - 1 };
+        if(nbt_parse_compressed_opts(gz.data, gz.len, &options) != NULL || errno != NBT_ELIMIT)
+            die("FAILED. Inflated too much.");
+
+        buffer_free(&gz);
+        nbt_free(serial);
+        buffer_free(&wide);
+        printf("OK.\n");
+    }
+
+    {
+        printf("Checking vector lists... ");
+        struct buffer wide = wide_tree();
+
+        nbt_node* linked = nbt_parse(wide.data, wide.len);
+        if(linked == NULL) die_with_err(errno);
+
+        struct nbt_parse_options options = { .vector_lists = true };
+        nbt_node* vector = nbt_parse_opts(wide.data, wide.len, &options);
+        if(vector == NULL) die_with_err(errno);
+
+        options.threads = 4;
+        nbt_node* parallel = nbt_parse_opts(wide.data, wide.len, &options);
+        if(parallel == NULL) die_with_err(errno);
+
+        if(!nbt_eq(linked, vector) || !nbt_eq(linked, parallel))
+            die("FAILED. Vector tree not equal.");
+
+        struct buffer redumped = nbt_dump_binary(parallel);
+        if(redumped.data == NULL) die_with_err(errno);
+        if(redumped.len != wide.len || memcmp(redumped.data, wide.data, wide.len) != 0)
+            die("FAILED. Vector tree dumps differently.");
+        buffer_free(&redumped);
+        nbt_free(parallel);
+
+        nbt_node* l = nbt_find_by_path(linked, ".c");
+        nbt_node* v = nbt_find_by_path(vector, ".c");
+
+        if(!(v->flags & NBT_NODE_VECTOR) || (l->flags & NBT_NODE_VECTOR) ||
+           nbt_list_length(l) != 20000 || nbt_list_length(v) != 20000 ||
+           !nbt_eq(nbt_list_item(l, 19999), nbt_list_item(v, 19999)) ||
+           nbt_list_item(l, 20000) != NULL || nbt_list_item(v, 20000) != NULL ||
+           nbt_list_item(l, -1) != NULL || nbt_list_item(v, -1) != NULL)
+            die("FAILED. Bad list item or length.");
+
+        nbt_node* clone = nbt_clone(vector);
+        if(clone == NULL) die_with_err(errno);
+        if(!nbt_eq(clone, vector) || !(nbt_find_by_path(clone, ".c")->flags & NBT_NODE_VECTOR))
+            die("FAILED. Vector clone.");
+        nbt_free(clone);
+
+        /* Wrong type, then one past what was made room for. */
+        nbt_node* x = nbt_find_by_path(nbt_list_item(v, 0), ".x");
+        nbt_node* items[2] = { nbt_clone(nbt_list_item(l, 7)), nbt_clone(nbt_list_item(v, 7)) };
+        if(items[0] == NULL || items[1] == NULL) die_with_err(NBT_EMEM);
+
+        if(x == NULL || nbt_list_append(l, x) != NBT_ERR || nbt_list_append(v, x) != NBT_ERR ||
+           nbt_list_append(l, items[0]) != NBT_OK || nbt_list_append(v, items[1]) != NBT_OK ||
+           nbt_list_length(v) != 20001 || nbt_list_item(v, 20000) != items[1] ||
+           !nbt_eq(linked, vector))
+            die("FAILED. Appending.");
+
+        linked = nbt_filter_inplace(linked, not_odd_element, NULL);
+        vector = nbt_filter_inplace(vector, not_odd_element, NULL);
+
+        if(nbt_list_length(nbt_find_by_path(vector, ".i")) != 5000 || !nbt_eq(linked, vector))
+            die("FAILED. Filtering a vector.");
+
+        l = nbt_find_by_path(linked, ".i");
+        if(nbt_list_vectorize(l, 0) != NBT_OK || !(l->flags & NBT_NODE_VECTOR) ||
+           nbt_list_length(l) != 5000 || !nbt_eq(linked, vector))
+            die("FAILED. Vectorizing.");
+
+        nbt_free(vector);
+        nbt_free(linked);
+        buffer_free(&wide);
+        printf("OK.\n");
+    }
+
+    {
+        printf("Checking compound indexes... ");
+        static const unsigned char empty[] = { TAG_COMPOUND, 0, 0, 0 };
+
+        nbt_node* plain = nbt_parse(empty, sizeof empty);
+        nbt_node* indexed = nbt_parse(empty, sizeof empty);
+        if(plain == NULL || indexed == NULL) die_with_err(errno);
+
+        if(nbt_compound_index(indexed) != NBT_OK || !(indexed->flags & NBT_NODE_INDEXED))
+            die("FAILED. Not indexed.");
+
+        /* Enough to make the table grow a few times. */
+        for(int32_t i = 0; i < 100; i++)
+            if(nbt_compound_add(plain, int_node(i)) != NBT_OK ||
+               nbt_compound_add(indexed, int_node(i)) != NBT_OK)
+                die_with_err(errno);
+
+        for(int32_t i = 0; i < 100; i++)
+            if(!has_key(plain, i) || !has_key(indexed, i))
+                die("FAILED. Lookup.");
+
+        if(nbt_compound_get(indexed, "k100") != NULL || nbt_find_by_path(indexed, ".k100") != NULL ||
+           nbt_compound_remove(indexed, "k100") != NULL)
+            die("FAILED. Found what isn't there.");
+
+        for(int32_t i = 0; i < 100; i += 3)
+        {
+            char name[16];
+            sprintf(name, "k%d", (int)i);
+
+            nbt_free(nbt_compound_remove(plain, name));
+            nbt_node* removed = nbt_compound_remove(indexed, name);
+
+            if(removed == NULL || removed->payload.tag_int != i) die("FAILED. Removal.");
+            nbt_free(removed);
+        }
+
+        for(int32_t i = 0; i < 100; i++)
+            if(has_key(indexed, i) != (i % 3 != 0))
+                die("FAILED. Lookup after removal.");
+
+        /* The first by a name is the one found, and the next takes over once it's gone. */
+        nbt_node* second = int_node(1);
+        second->payload.tag_int = -1;
+
+        if(nbt_compound_add(indexed, second) != NBT_OK) die_with_err(errno);
+        if(nbt_compound_get(indexed, "k1")->payload.tag_int != 1)
+            die("FAILED. Duplicate names.");
+
+        nbt_node* first = nbt_compound_remove(indexed, "k1");
+        if(first == NULL || first->payload.tag_int != 1 || nbt_compound_get(indexed, "k1") != second)
+            die("FAILED. Duplicate names.");
+
+        /* Catch the plain one up, so the two can be compared. */
+        nbt_free(nbt_compound_remove(plain, "k1"));
+        first->payload.tag_int = -1;
+        if(nbt_compound_add(plain, first) != NBT_OK) die_with_err(errno);
+        if(!nbt_eq(plain, indexed)) die("FAILED. Indexed tree not equal.");
+
+        /* The same again, but parsed that way. */
+        struct buffer dumped = nbt_dump_binary(indexed);
+        if(dumped.data == NULL) die_with_err(errno);
+
+        const struct nbt_parse_options options = { .index_compounds = true };
+        nbt_node* parsed = nbt_parse_opts(dumped.data, dumped.len, &options);
+        if(parsed == NULL) die_with_err(errno);
+
+        nbt_node* clone = nbt_clone(parsed);
+        if(clone == NULL) die_with_err(errno);
+
+        if(!(parsed->flags & NBT_NODE_INDEXED) || !(clone->flags & NBT_NODE_INDEXED) ||
+           !nbt_eq(parsed, indexed) || !nbt_eq(clone, indexed) ||
+           !has_key(parsed, 98) || !has_key(clone, 98) || has_key(parsed, 99))
+            die("FAILED. Parsed index.");
+
+        nbt_free(clone);
+        nbt_free(parsed);
+        buffer_free(&dumped);
+        nbt_free(indexed);
+        nbt_free(plain);
+        printf("OK.\n");
+    }
+
+    {
+        printf("Checking interning... ");
+        nbt_intern_table* names = nbt_intern_table_new();
+        if(names == NULL) die_with_err(errno);
+
+        const char* pos = nbt_intern_find(names, "Pos", 3);
+        const char* abc = nbt_intern(names, "abcdef", 3);
+
+        if(pos == NULL || strcmp(pos, "Pos") != 0 || nbt_intern(names, "Pos", 3) != pos ||
+           abc == NULL || strcmp(abc, "abc") != 0 || nbt_intern_find(names, "abc", 3) != abc ||
+           nbt_intern_find(names, "herobrine", 9) != NULL)
+            die("FAILED. Intern table.");
+
+        struct buffer wide = wide_tree();
+
+        nbt_node* plain = nbt_parse(wide.data, wide.len);
+        if(plain == NULL) die_with_err(errno);
+
+        struct nbt_parse_options options = { .intern = names, .utf8 = true };
+        nbt_node* interned = nbt_parse_opts(wide.data, wide.len, &options);
+        if(interned == NULL) die_with_err(errno);
+
+        /* The threads can only use what's there, but what isn't still has to come out right. */
+        options.threads = 4;
+        nbt_node* parallel = nbt_parse_opts(wide.data, wide.len, &options);
+        if(parallel == NULL) die_with_err(errno);
+
+        nbt_node* clone = nbt_clone(interned);
+        if(clone == NULL) die_with_err(errno);
+
+        if(!nbt_eq(plain, interned) || !nbt_eq(plain, parallel) || !nbt_eq(plain, clone))
+            die("FAILED. Interned tree not equal.");
+
+        nbt_node* a = nbt_list_item(nbt_find_by_path(interned, ".c"), 0);
+        nbt_node* b = nbt_list_item(nbt_find_by_path(clone, ".c"), 1);
+        nbt_node* s = nbt_find_by_path(b, ".s");
+
+        if(nbt_find_by_path(a, ".s")->name != s->name || !(s->flags & NBT_NODE_INTERNED_NAME) ||
+           s->payload.tag_string != abc || !(s->flags & NBT_NODE_INTERNED_STRING))
+            die("FAILED. Not shared.");
+
+        struct buffer redumped = nbt_dump_binary(parallel);
+        if(redumped.data == NULL) die_with_err(errno);
+        if(redumped.len != wide.len || memcmp(redumped.data, wide.data, wide.len) != 0)
+            die("FAILED. Interned tree dumps differently.");
+
+        buffer_free(&redumped);
+        nbt_free(clone);
+        nbt_free(parallel);
+        nbt_free(interned);
+        nbt_free(plain);
+        nbt_intern_table_free(names);
+        buffer_free(&wide);
+        printf("OK.\n");
+    }
+
+    {
+        printf("Checking packed lists... ");
+        struct buffer wide = wide_tree();
+
+        nbt_node* plain = nbt_parse(wide.data, wide.len);
+        if(plain == NULL) die_with_err(errno);
+
+        struct nbt_parse_options options = { .pack_lists = true };
+        nbt_node* packed = nbt_parse_opts(wide.data, wide.len, &options);
+        if(packed == NULL) die_with_err(errno);
+
+        options.threads = 4;
+        nbt_node* parallel = nbt_parse_opts(wide.data, wide.len, &options);
+        if(parallel == NULL) die_with_err(errno);
+
+        nbt_node* i = nbt_find_by_path(packed, ".i");
+
+        if(!(i->flags & NBT_NODE_PACKED) || nbt_list_length(i) != 10000 ||
+           nbt_size(packed) != nbt_size(plain) ||
+           !nbt_eq(plain, packed) || !nbt_eq(packed, plain) || !nbt_eq(plain, parallel))
+            die("FAILED. Packed tree not equal.");
+
+        struct buffer redumped = nbt_dump_binary(parallel);
+        if(redumped.data == NULL) die_with_err(errno);
+        if(redumped.len != wide.len || memcmp(redumped.data, wide.data, wide.len) != 0)
+            die("FAILED. Packed tree dumps differently.");
+        buffer_free(&redumped);
+
+        char* plain_ascii = nbt_dump_ascii(plain);
+        char* packed_ascii = nbt_dump_ascii(packed);
+        if(plain_ascii == NULL || packed_ascii == NULL) die_with_err(errno);
+        if(strcmp(plain_ascii, packed_ascii) != 0 || !(i->flags & NBT_NODE_PACKED))
+            die("FAILED. Packed tree prints differently.");
+        free(packed_ascii);
+        free(plain_ascii);
+
+        /* Read and written where they are, on packed lists and linked ones alike. */
+        nbt_node* l = nbt_find_by_path(plain, ".i");
+
+        nbt_list_set_long(i, 0, -5);
+        nbt_list_set_double(l, 0, -5.9);
+
+        if(nbt_list_get_long(i, 9999) != 9999 || nbt_list_get_double(i, 0) != -5.0 ||
+           nbt_list_get_long(l, 0) != -5 || !(i->flags & NBT_NODE_PACKED) || !nbt_eq(plain, packed))
+            die("FAILED. Packed list accessors.");
+
+        nbt_node* clone = nbt_clone(packed);
+        if(clone == NULL) die_with_err(errno);
+        if(!(nbt_find_by_path(clone, ".i")->flags & NBT_NODE_PACKED) || !nbt_eq(clone, packed))
+            die("FAILED. Packed clone.");
+        nbt_free(clone);
+
+        /* Anything wanting nodes gets them. */
+        nbt_node* item = nbt_list_item(i, 7);
+        if(item == NULL || item->payload.tag_int != 7 || (i->flags & NBT_NODE_PACKED) ||
+           nbt_list_get_long(i, 0) != -5 || !nbt_eq(plain, packed))
+            die("FAILED. Unpacking.");
+
+        /* Both byte orders come out in the native one. */
+        struct buffer little = variant_tree(true, true);
+        struct nbt_parse_options le = { .format = NBT_LITTLE_ENDIAN, .pack_lists = true };
+
+        nbt_node* packed_le = nbt_parse_opts(little.data, little.len, &le);
+        if(packed_le == NULL) die_with_err(errno);
+
+        nbt_node* longs = nbt_find_by_path(packed_le, "r.l");
+        if(!(longs->flags & NBT_NODE_PACKED) || nbt_list_get_long(longs, 1) != 2 ||
+           nbt_list_get_double(longs, 0) != 1.0)
+            die("FAILED. Little-endian packed list.");
+
+        nbt_free(packed_le);
+        buffer_free(&little);
+        nbt_free(parallel);
+        nbt_free(packed);
+        nbt_free(plain);
+        buffer_free(&wide);
+        printf("OK.\n");
+    }
+
+    {
+        printf("Checking compact nodes... ");
+        struct buffer wide = wide_tree();
+
+        /* A name too long to go inline, just before the root's TAG_End. */
+        wide.len--;
+        put_name(&wide, TAG_INT, "a_rather_long_name", false);
+        put_number(&wide, 42, 4, false);
+        put_number(&wide, TAG_INVALID, 1, false);
+
+        nbt_node* plain = nbt_parse(wide.data, wide.len);
+        if(plain == NULL) die_with_err(errno);
+
+        struct nbt_parse_options options = { .compact_nodes = true };
+        nbt_node* compact = nbt_parse_opts(wide.data, wide.len, &options);
+        if(compact == NULL) die_with_err(errno);
+
+        options.threads = 4;
+        options.vector_lists = true;
+        nbt_node* parallel = nbt_parse_opts(wide.data, wide.len, &options);
+        if(parallel == NULL) die_with_err(errno);
+
+        if(!nbt_eq(plain, compact) || !nbt_eq(plain, parallel))
+            die("FAILED. Compact tree not equal.");
+
+        struct buffer redumped = nbt_dump_binary(compact);
+        if(redumped.data == NULL) die_with_err(errno);
+        if(redumped.len != wide.len || memcmp(redumped.data, wide.data, wide.len) != 0)
+            die("FAILED. Compact tree dumps differently.");
+        buffer_free(&redumped);
+
+        nbt_node* c = nbt_find_by_path(compact, ".c");
+        nbt_node* x = nbt_find_by_path(nbt_list_item(c, 3), ".x");
+        nbt_node* longer = nbt_find_by_path(compact, ".a_rather_long_name");
+
+        if(!(c->flags & NBT_NODE_COMPACT) || !(c->flags & NBT_NODE_INLINE_NAME) ||
+           !(nbt_list_item(c, 3)->flags & NBT_NODE_COMPACT) || x == NULL || x->payload.tag_int != 3 ||
+           longer == NULL || !(longer->flags & NBT_NODE_COMPACT) || (longer->flags & NBT_NODE_INLINE_NAME) ||
+           longer->payload.tag_int != 42)
+            die("FAILED. Not compact.");
+
+        nbt_node* clone = nbt_clone(compact);
+        if(clone == NULL) die_with_err(errno);
+        if(!nbt_eq(clone, compact)) die("FAILED. Compact clone.");
+        nbt_free(clone);
+
+        /* Taken out, moved about, and filtered: every entry has to be freed exactly once. */
+        nbt_node* removed = nbt_compound_remove(compact, "a_rather_long_name");
+        nbt_node* removed_plain = nbt_compound_remove(plain, "a_rather_long_name");
+        if(removed == NULL || removed_plain == NULL || !nbt_eq(removed, removed_plain) ||
+           nbt_compound_add(parallel, removed) != NBT_OK || !nbt_eq(plain, compact))
+            die("FAILED. Removing a compact node.");
+        nbt_free(removed_plain);
+
+        plain = nbt_filter_inplace(plain, not_odd_element, NULL);
+        compact = nbt_filter_inplace(compact, not_odd_element, NULL);
+        if(!nbt_eq(plain, compact)) die("FAILED. Filtering compact nodes.");
+
+        if(nbt_list_vectorize(c, 0) != NBT_OK || nbt_list_length(c) != 20000 ||
+           !nbt_eq(plain, compact))
+            die("FAILED. Vectorizing compact nodes.");
+
+        nbt_free(parallel);
+        nbt_free(compact);
+        nbt_free(plain);
+        buffer_free(&wide);
+        printf("OK.\n");
+    }
+
+    {
+        printf("Checking tree indexes... ");
+        struct index_check check = { nbt_index_new(tree, false), tree };
+        if(check.index == NULL) die_with_err(errno);
+
+        if(!nbt_map(tree, index_agrees, &check))
+            die("FAILED. Index disagrees with nbt_find_by_name.");
+        nbt_index_free(check.index);
+
+        struct buffer wide = wide_tree();
+        nbt_node* w = nbt_parse(wide.data, wide.len);
+        if(w == NULL) die_with_err(errno);
+
+        nbt_index* index = nbt_index_new(w, true);
+        if(index == NULL) die_with_err(errno);
+
+        nbt_node* const* nodes;
+
+        if(nbt_index_all_by_name(index, "x", &nodes) != 20000 || nodes[0] != nbt_find_by_name(w, "x") ||
+           nodes[19999]->payload.tag_int != 19999 ||
+           nbt_index_all_by_name(index, NULL, &nodes) != 20000 + 10000 + 20000 * 3 ||
+           nodes[0] != nbt_find_by_name(w, NULL) || nbt_index_find_by_name(index, "") != w ||
+           nbt_index_all_by_name(index, "herobrine", &nodes) != 0 || nodes != NULL ||
+           nbt_index_all_by_path(index, ".c..x", &nodes) != 20000 || nodes[0] != nbt_find_by_path(w, ".c..x") ||
+           nbt_index_all_by_path(index, ".i.", &nodes) != 10000 || nodes[9]->payload.tag_int != 9 ||
+           nbt_index_find_by_path(index, "") != w || nbt_index_find_by_path(index, ".x") != NULL)
+            die("FAILED. Index lookups.");
+
+        /*
+         * Changing another tree leaves this index as it was, so a change made
+         * behind its back only shows up once it's touched.
+         */
+        nbt_index* other = nbt_index_new(tree, false);
+        if(other == NULL) die_with_err(errno);
+
+        nbt_node* c = nbt_compound_get(w, "c");
+        nbt_node* ints = nbt_compound_get(w, "i");
+        char* name = c->name;
+
+        c->name = ints->name, ints->name = name;
+        nbt_index_touch(tree);
+
+        if(nbt_index_find_by_name(index, "c") != c || nbt_index_find_by_name(other, tree->name) != tree)
+            die("FAILED. Index rebuilt for another tree.");
+
+        nbt_index_touch(w);
+
+        if(nbt_index_find_by_name(index, "c") != ints || nbt_index_find_by_path(index, ".i") != c)
+            die("FAILED. Index not rebuilt when touched.");
+
+        ints->name = c->name, c->name = name;
+        nbt_index_touch(w);
+        nbt_index_free(other);
+
+        /* Changes made through the library show up in the next lookup. */
+        nbt_node* i = nbt_compound_remove(w, "i");
+        if(i == NULL || nbt_index_find_by_name(index, "i") != NULL ||
+           nbt_index_all_by_path(index, ".i.", &nodes) != 0)
+            die("FAILED. Index after removing.");
+
+        if(nbt_compound_add(w, i) != NBT_OK || nbt_index_find_by_path(index, ".i") != i)
+            die("FAILED. Index after adding.");
+
+        w = nbt_filter_inplace(w, not_odd_element, NULL);
+        if(nbt_index_all_by_path(index, ".i.", &nodes) != 5000 || nodes[1]->payload.tag_int != 2)
+            die("FAILED. Index after filtering.");
+
+        nbt_index_free(index);
+        nbt_free(w);
+        buffer_free(&wide);
+
+        /* Paths as deep as they go, where every name along the way is the same. */
+        struct buffer deep = deep_tree(NBT_DEFAULT_MAX_DEPTH, false);
+        nbt_node* d = nbt_parse(deep.data, deep.len);
+        if(d == NULL) die_with_err(errno);
+
+        if((index = nbt_index_new(d, true)) == NULL) die_with_err(errno);
+
+        char path[2 * NBT_DEFAULT_MAX_DEPTH];
+        for(size_t depth = 0; depth < NBT_DEFAULT_MAX_DEPTH; depth++)
+        {
+            memcpy(path + 2 * depth, "c.", 2);
+            path[2 * depth + 1] = '\0';
+
+            if(nbt_index_find_by_path(index, path) != nbt_find_by_path(d, path) ||
+               nbt_index_all_by_path(index, path, &nodes) != 1)
+                die("FAILED. Index lookups of deep paths.");
+
+            path[2 * depth + 1] = '.';
+        }
+
+        if(nbt_index_all_by_name(index, "c", &nodes) != NBT_DEFAULT_MAX_DEPTH ||
+           nbt_index_find_by_path(index, "c.c.") != NULL || nbt_index_find_by_path(index, "c..c") != NULL)
+            die("FAILED. Index lookups of deep paths.");
+
+        nbt_index_free(index);
+        nbt_free(d);
+        buffer_free(&deep);
+        printf("OK.\n");
+    }
+
+    {
+        printf("Checking shared clones... ");
+        struct buffer wide = wide_tree();
+
+        struct nbt_parse_options options = { .compact_nodes = true, .pack_lists = true };
+        nbt_node* original = nbt_parse_opts(wide.data, wide.len, &options);
+        if(original == NULL) die_with_err(errno);
+
+        nbt_node* expected = nbt_clone(original);
+        nbt_node* changed = nbt_clone(original);
+        if(expected == NULL || changed == NULL) die_with_err(errno);
+
+        nbt_find_by_path(changed, ".c..x")->payload.tag_int = -1;
+        nbt_list_set_long(nbt_find_by_path(changed, ".c..l"), 2, -3);
+
+        nbt_node* shared = nbt_clone_shared(original);
+        if(shared != original) die("FAILED. Shared clone copied.");
+
+        /* Only the way down to what's changed is copied. Everything else is in both trees. */
+        nbt_node* x = nbt_unshare(&shared, ".c..x");
+        if(x == NULL || shared == original || x == nbt_find_by_path(original, ".c..x"))
+            die("FAILED. Unsharing.");
+        x->payload.tag_int = -1;
+
+        nbt_node* l = nbt_unshare(&shared, ".c..l");
+        if(l == NULL || l == nbt_find_by_path(original, ".c..l")) die("FAILED. Unsharing again.");
+        nbt_list_set_long(l, 2, -3);
+
+        if(nbt_unshare(&shared, ".c..herobrine") != NULL || errno != NBT_OK)
+            die("FAILED. Unsharing nothing.");
+
+        if(!nbt_eq(original, expected) || !nbt_eq(shared, changed) ||
+           nbt_find_by_path(shared, ".i") != nbt_find_by_path(original, ".i") ||
+           nbt_list_item(nbt_find_by_path(shared, ".c"), 1) != nbt_list_item(nbt_find_by_path(original, ".c"), 1))
+            die("FAILED. Shared trees differ.");
+
+        /* Filtering a shared tree leaves the other alone. */
+        nbt_node* filtered = nbt_filter_inplace(nbt_clone_shared(original), not_odd_element, NULL);
+        nbt_node* filtered_copy = nbt_filter_inplace(nbt_clone(expected), not_odd_element, NULL);
+        if(filtered == NULL || filtered_copy == NULL || !nbt_eq(filtered, filtered_copy) ||
+           !nbt_eq(original, expected))
+            die("FAILED. Filtering a shared tree.");
+
+        /* The original goes first, compact entries and all, and takes only what's its alone. */
+        nbt_free(original);
+        if(!nbt_eq(shared, changed)) die("FAILED. Shared tree after freeing the original.");
+
+        /* A node shared as widely as it can be is copied instead. */
+        nbt_node* k = int_node(7);
+        for(unsigned i = 0; i < NBT_NODE_REFS_MAX; i++)
+            if(nbt_clone_shared(k) != k)
+                die("FAILED. Sharing a node.");
+
+        nbt_node* k_copy = nbt_clone_shared(k);
+        if(k_copy == NULL || k_copy == k || !nbt_eq(k, k_copy))
+            die("FAILED. Sharing a node too widely.");
+
+        for(unsigned i = 0; i <= NBT_NODE_REFS_MAX; i++)
+            nbt_free(k);
+
+        nbt_free(k_copy);
+        nbt_free(filtered);
+        nbt_free(filtered_copy);
+        nbt_free(shared);
+        nbt_free(changed);
+        nbt_free(expected);
+        buffer_free(&wide);
+        printf("OK.\n");
+    }
+
+    {
+        printf("Checking encoded arrays... ");
+        struct buffer arrays = array_tree();
+
+        nbt_node* plain = nbt_parse(arrays.data, arrays.len);
+        nbt_node* encoded = nbt_parse(arrays.data, arrays.len);
+        if(plain == NULL || encoded == NULL) die_with_err(errno);
+
+        struct nbt_memory_stats before, after;
+        nbt_memory_usage(encoded, &before);
+
+        /* Without a pool, only what gets smaller is encoded. */
+        if(nbt_encode_arrays(encoded, NULL) != NBT_OK) die_with_err(errno);
+
+        nbt_node* fill = nbt_find_by_name(encoded, "fill");
+        nbt_node* runs = nbt_find_by_name(encoded, "runs");
+        nbt_node* raw  = nbt_find_by_name(encoded, "raw");
+        nbt_node* tiny = nbt_find_by_name(encoded, "tiny");
+
+        if(!(fill->flags & NBT_NODE_ENCODED) || !(runs->flags & NBT_NODE_ENCODED) ||
+           (raw->flags & NBT_NODE_ENCODED) || (tiny->flags & NBT_NODE_ENCODED))
+            die("FAILED. Encoding without a pool.");
+
+        int32_t ints[1024];
+        nbt_int_array_copy(runs, ints);
+
+        if(fill->payload.tag_encoded.length != 4096 || nbt_byte_array_get(fill, 4095) != 0 ||
+           nbt_int_array_get(runs, 0) != -2 || nbt_int_array_get(runs, 255) != -2 ||
+           nbt_int_array_get(runs, 256) != -1 || nbt_int_array_get(runs, 1023) != 1 ||
+           ints[511] != -1 || ints[512] != 0)
+            die("FAILED. Reading encoded arrays.");
+
+        nbt_memory_usage(encoded, &after);
+        if(after.encoded != 2 || after.decoded_arrays != before.arrays ||
+           after.arrays >= before.arrays / 8 || after.bytes >= before.bytes / 4 || after.nodes != before.nodes)
+            die("FAILED. Memory usage of encoded arrays.");
+
+        /* They read, compare and dump as they always did. */
+        struct buffer dumped = nbt_dump_binary(encoded);
+        if(dumped.data == NULL) die_with_err(errno);
+
+        if(!nbt_eq(plain, encoded) || !nbt_eq(encoded, plain) ||
+           dumped.len != arrays.len || memcmp(dumped.data, arrays.data, arrays.len) != 0)
+            die("FAILED. Encoded arrays differ.");
+
+        nbt_node* copy = nbt_clone(encoded);
+        if(copy == NULL) die_with_err(errno);
+        if(nbt_find_by_name(copy, "runs")->payload.tag_encoded.data != runs->payload.tag_encoded.data)
+            die("FAILED. Cloning an encoded array copied it.");
+
+        if(nbt_decode(runs) != NBT_OK) die_with_err(errno);
+        if(runs->flags & NBT_NODE_ENCODED) die("FAILED. Decoding.");
+
+        runs->payload.tag_int_array.data[0] = 5;
+        if(nbt_int_array_get(nbt_find_by_name(copy, "runs"), 0) != -2 || nbt_eq(copy, encoded))
+            die("FAILED. Writing to a decoded array.");
+
+        nbt_free(copy);
+
+        /* With a pool, equal arrays in different trees are kept once. */
+        nbt_array_pool* pool = nbt_array_pool_new();
+        if(pool == NULL) die_with_err(errno);
+
+        struct nbt_parse_options options = { .encode_arrays = true, .array_pool = pool };
+        nbt_node* a = nbt_parse_opts(arrays.data, arrays.len, &options);
+        nbt_node* b = nbt_parse_opts(arrays.data, arrays.len, &options);
+        if(a == NULL || b == NULL) die_with_err(errno);
+
+        static const char* const names[] = { "fill", "runs", "raw", "tiny" };
+        for(size_t i = 0; i < 4; i++)
+        {
+            nbt_node* x = nbt_find_by_name(a, names[i]);
+            nbt_node* y = nbt_find_by_name(b, names[i]);
+
+            if(!(x->flags & NBT_NODE_ENCODED) || x->payload.tag_encoded.data != y->payload.tag_encoded.data)
+                die("FAILED. Pooled arrays not shared.");
+        }
+
+        struct nbt_memory_stats one, both;
+        nbt_memory_usage(a, &one);
+        nbt_memory_usage(b, &both);
+        if(one.arrays != both.arrays || one.encoded != 4 || !nbt_eq(a, plain) || !nbt_eq(a, b))
+            die("FAILED. Pooled arrays.");
+
+        /* Each of two arrays sharing a payload counts half of it. */
+        nbt_free(b);
+        nbt_memory_usage(a, &both);
+        if(both.arrays <= one.arrays) die("FAILED. Memory usage of shared arrays.");
+
+        /* The pool can go before the trees encoded through it. */
+        nbt_array_pool_free(pool);
+
+        b = nbt_parse_opts(arrays.data, arrays.len, &(struct nbt_parse_options){ .encode_arrays = true });
+        if(b == NULL) die_with_err(errno);
+        if(!nbt_eq(a, b) || (nbt_find_by_name(b, "raw")->flags & NBT_NODE_ENCODED))
+            die("FAILED. Encoding while parsing.");
+
+        nbt_free(a);
+        nbt_free(b);
+        buffer_free(&dumped);
+        nbt_free(encoded);
+        nbt_free(plain);
+        buffer_free(&arrays);
+        printf("OK.\n");
+    }
+
+    FILE* temp = fopen("delete_me.nbt", "wb");
+    if(temp == NULL) die("Could not open a temporary file.");
 
     printf("Dumping binary... ");
     if((err = nbt_dump_file(tree, temp, STRAT_GZIP)) != NBT_OK)
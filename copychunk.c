@@ -310,8 +310,9 @@ void move_entities(nbt_node *chunk_data, struct Coord offset) {
             nbt_node *entry = list_entry(pos, struct tag_list, entry)->data;
             if (entry->type == TAG_COMPOUND) {
                 //say("Moving Entity\n");
-                nbt_list_item(nbt_find_by_path(entry, ".Pos"),0)->payload.tag_double -= offset.x*16; 
-                nbt_list_item(nbt_find_by_path(entry, ".Pos"),2)->payload.tag_double -= offset.y*16; 
+                nbt_node *pos_list = nbt_find_by_path(entry, ".Pos");
+                nbt_list_set_double(pos_list, 0, nbt_list_get_double(pos_list, 0) - offset.x*16);
+                nbt_list_set_double(pos_list, 2, nbt_list_get_double(pos_list, 2) - offset.y*16);
             }
         }
     }
@@ -53,6 +53,27 @@ static inline void list_del(struct list_head* loc)
     loc->blink = NULL;
 }
 
+/*
+ * Moves every element of `list' to the beginning of `head', in O(1). `list' is
+ * left empty. Returns the head of the list so that calls may be chained.
+ */
+static inline struct list_head* list_splice_head(struct list_head* restrict list,
+                                                 struct list_head* restrict head)
+{
+    if(list->flink != list)
+    {
+        list->flink->blink = head;
+        list->blink->flink = head->flink;
+
+        head->flink->blink = list->blink;
+        head->flink        = list->flink;
+
+        INIT_LIST_HEAD(list);
+    }
+
+    return head;
+}
+
 /* Tests if the list is empty */
 #define list_empty(head) ((head)->flink == (head))
 
@@ -195,6 +195,16 @@ nbt_node *mcr_chunk_get(MCR *mcr, int x, int z)
     return nbt_parse_compressed(chunk->data+1, chunk->len-1);
 }
 
+const void *mcr_chunk_data(MCR *mcr, int x, int z, size_t *length)
+{
+    assert(mcr && length && x < 32 && z < 32 && x >= 0 && z >= 0);
+    struct MCRChunk *chunk = &mcr->chunk[x][z];
+    if (chunk->data == NULL || chunk->len < 1) return NULL;
+    // skip the compression type
+    *length = chunk->len-1;
+    return chunk->data+1;
+}
+
 int mcr_chunk_set(MCR *mcr, int x, int z, nbt_node *root)
 {
     assert(mcr && x < 32 && z < 32 && x >= 0 && z >= 0);
@@ -29,7 +29,10 @@ typedef enum {
     NBT_ERR  = -1, /* Generic error, most likely of the parsing variety. */
     NBT_EMEM = -2, /* Out of memory. */
     NBT_EIO  = -3, /* IO error. */
-    NBT_EZ   = -4  /* Zlib compression/decompression error. */
+    NBT_EZ   = -4, /* Zlib compression/decompression error. */
+    NBT_ELIMIT = -5, /* Over one of the budgets in nbt_parse_options. */
+
+    NBT_AGAIN = 1  /* Not an error: the work isn't finished. Call again. */
 } nbt_status;
 
 typedef enum {
@@ -56,6 +59,100 @@ typedef enum {
                      compressed like a chunk. */
 } nbt_compression_strategy;
 
+/*
+ * Bits of nbt_node.flags. They describe how a node's memory is laid out, so
+ * you can almost always ignore them unless you're building nodes by hand, in
+ * which case `flags' MUST be zero.
+ */
+typedef enum {
+    /*
+     * The name, string and array payload point into a buffer owned by someone
+     * else (see nbt_parse_borrowed). Nothing but the node itself is freed by
+     * nbt_free, and int and long arrays are left in big-endian byte order. Read
+     * them with nbt_int_array_get and friends.
+     */
+    NBT_NODE_BORROWED = 1 << 0,
+
+    /*
+     * A compound that hasn't been parsed yet (see nbt_parse_lazy). Its payload
+     * is tag_lazy instead of tag_compound until nbt_materialize is called on
+     * it. The library does that for you wherever it looks inside a compound.
+     */
+    NBT_NODE_LAZY     = 1 << 1,
+
+    /*
+     * A list laid out as one struct tag_vector instead of an entry per element
+     * (see nbt_parse_options.vector_lists and nbt_list_vectorize). list_for_each
+     * reads it like any other list, but elements may only be added with
+     * nbt_list_append, and never unlinked or freed one by one.
+     */
+    NBT_NODE_VECTOR   = 1 << 2,
+
+    /*
+     * A compound whose children can be looked up by name through a hash table
+     * (see nbt_parse_options.index_compounds and nbt_compound_index), built the
+     * first time it's needed. Once it has been, add and remove children only
+     * with nbt_compound_add and nbt_compound_remove.
+     */
+    NBT_NODE_INDEXED  = 1 << 3,
+
+    /*
+     * The name, or a string's payload, belongs to an nbt_intern_table (see
+     * nbt_parse_options.intern) and is shared with every other node that has
+     * the same one. Don't write to it, and don't free it.
+     */
+    NBT_NODE_INTERNED_NAME   = 1 << 4,
+    NBT_NODE_INTERNED_STRING = 1 << 5,
+
+    /*
+     * A list of numbers kept as one array (see nbt_parse_options.pack_lists).
+     * Its payload is tag_packed instead of tag_list until nbt_unpack is called
+     * on it, which the library does wherever it needs the elements as nodes.
+     * nbt_list_get_long and friends read and write it where it is.
+     */
+    NBT_NODE_PACKED          = 1 << 6,
+
+    /*
+     * The node shares one allocation with the list entry it was parsed into
+     * (see nbt_parse_options.compact_nodes): it's the `node' of a struct
+     * tag_compact. That entry goes when the node does, so never free it on
+     * its own. Move the node elsewhere, and it just goes unused.
+     */
+    NBT_NODE_COMPACT         = 1 << 7,
+
+    /* The name is in the node's struct tag_compact too. Don't free it. */
+    NBT_NODE_INLINE_NAME     = 1 << 8,
+
+    /*
+     * An nbt_index has looked at this node, so changing it has to be
+     * reported with nbt_index_touch. The library does that for you.
+     */
+    NBT_NODE_WATCHED         = 1 << 9,
+
+    /*
+     * A byte, int or long array kept in less memory than it takes up (see
+     * nbt_encode_arrays). Its payload is tag_encoded instead, with `length'
+     * where it always is, until nbt_decode is called on it. Read it with
+     * nbt_byte_array_get and friends, and decode it before writing to it.
+     */
+    NBT_NODE_ENCODED         = 1 << 10
+} nbt_node_flag;
+
+/*
+ * The bits of `flags' from here up aren't flags, but a count of how many trees
+ * besides the first a node is part of (see nbt_clone_shared). A node is freed
+ * when it's down to its last one.
+ */
+#define NBT_NODE_REFS_SHIFT 16
+#define NBT_NODE_REFS_MAX   0xFFFFu
+
+/*
+ * Nor are the five below them in an NBT_NODE_WATCHED node: they say which
+ * index (or indexes) nbt_index_touch has to tell about it.
+ */
+#define NBT_NODE_WATCHER_SHIFT 11
+#define NBT_NODE_WATCHER_MASK  (0x1Fu << NBT_NODE_WATCHER_SHIFT)
+
 /*
  * Represents a single node in the tree. You should switch on `type' and ONLY
  * access the union member it signifies. tag_compound and tag_list contain
@@ -65,6 +162,7 @@ typedef enum {
  */
 typedef struct nbt_node {
     nbt_type type;
+    unsigned flags; /* A combination of nbt_node_flag. Usually 0. */
     char* name; /* This may be NULL. Check your damn pointers. */
 
     union { /* payload */
@@ -92,7 +190,7 @@ typedef struct nbt_node {
             int32_t length;
         } tag_long_array;
 
-        char* tag_string; /* TODO: technically, this should be a UTF-8 string */
+        char* tag_string; /* Modified UTF-8, unless parsed with nbt_parse_options.utf8 */
 
         /*
          * Design addendum: we make tag_list a linked list instead of an array
@@ -103,7 +201,8 @@ typedef struct nbt_node {
          * list packing when memory is a concern and huge lists are created.
          *
          * For more information on using the linked list, see `list.h'. The API
-         * is well documented.
+         * is well documented. Lists that want packing anyway can be laid out
+         * as NBT_NODE_VECTOR, which still looks like a linked list from here.
          */
         struct nbt_list {
             nbt_type type;
@@ -115,15 +214,77 @@ typedef struct nbt_node {
         
         struct tag_list *tag_compound;
 
+        /* NBT_NODE_PACKED lists only. `type' is where tag_list's is. */
+        struct nbt_packed_list {
+            nbt_type type;
+            int32_t length;
+            void* data; /* `length' numbers of type `type', in native byte order. */
+        } tag_packed;
+
+        /* NBT_NODE_ENCODED arrays only. `length' is where the array's is. */
+        struct nbt_encoded_array {
+            struct nbt_array_blob* data; /* Private to the library. */
+            int32_t length;
+        } tag_encoded;
+
+        /* NBT_NODE_LAZY compounds only. */
+        struct nbt_lazy_compound {
+            char* data; /* Its children, up to and including the TAG_End. */
+            size_t length;
+        } tag_lazy;
+
     } payload;
 } nbt_node;
 
+/*
+ * What an NBT_NODE_VECTOR list's payload.tag_list.list points at: the usual
+ * sentinel, and right behind it, every entry in order, linked up as always.
+ * All of them are of the list's type.
+ */
+struct tag_vector {
+    struct tag_list head;
+    size_t length;
+    size_t capacity;
+    struct tag_list items[];
+};
+
+/*
+ * What an NBT_NODE_INDEXED compound's payload.tag_compound points at: the usual
+ * sentinel, and a table of its children's entries by name. Compounds too small
+ * to be worth hashing never get a table at all.
+ */
+struct tag_index {
+    struct tag_list head;
+    struct tag_list** table; /* Open addressing. NULL until the first lookup. */
+    size_t mask;             /* The table's size, less one. */
+    size_t used;
+    bool duplicates;         /* Names aren't unique, so lookups have to scan anyway. */
+};
+
+/* The longest name an NBT_NODE_COMPACT node keeps inline. */
+#define NBT_INLINE_NAME_MAX 15
+
+/*
+ * An NBT_NODE_COMPACT node, along with the entry that links it into its
+ * parent and, if it's NBT_NODE_INLINE_NAME, its name: one malloc where there
+ * would have been three.
+ */
+struct tag_compact {
+    struct tag_list entry;
+    nbt_node node;
+    char name[];
+};
+
                /***** High Level Loading/Saving Functions *****/
 
 /*
  * Loads a NBT tree from a compressed file. The file must have been opened with
  * a mode of "rb". If an error occurs, NULL will be returned and errno will be
  * set to the appropriate nbt_status. Check your danm pointers.
+ *
+ * The file is inflated and parsed a few kilobytes at a time, so neither the
+ * compressed nor the decompressed file is ever in memory all at once: it
+ * takes the tree, and not much more.
  */
 nbt_node* nbt_parse_file(FILE* fp);
 
@@ -172,6 +333,130 @@ struct buffer nbt_dump_compressed(const nbt_node* tree,
  */
 nbt_node* nbt_parse(const void* memory, size_t length);
 
+/*
+ * Lists and compounds nested any deeper than this are taken to be corrupt (or
+ * malicious), unless you say otherwise. Minecraft itself gives up at 512. Only
+ * nbt_parse_opts (and nbt_parse_compressed_opts) let you say otherwise: every
+ * other parser (events, push, lazy, arena, paths, nbt_validate, nbt_loader)
+ * always stops here.
+ */
+#define NBT_DEFAULT_MAX_DEPTH 512
+
+/* The dialects of NBT nbt_parse_opts can read. */
+typedef enum {
+    NBT_JAVA = 0,     /* Big-endian, with a named root. Every file Java writes. */
+    NBT_NETWORK,      /* Big-endian, with no name on the root. Java's protocol, since 1.20.2. */
+    NBT_LITTLE_ENDIAN /* Little-endian, with a named root. Bedrock's files. */
+} nbt_format;
+
+typedef struct nbt_intern_table nbt_intern_table; /* See "Interning", below. */
+typedef struct nbt_array_pool nbt_array_pool;     /* See "Encoded Arrays", below. */
+
+/*
+ * Knobs for nbt_parse_opts. Zero everything you don't care about; zero always
+ * means the default.
+ */
+struct nbt_parse_options {
+    size_t max_depth; /* How deep lists and compounds may nest. The root is 1. */
+
+    /*
+     * Lists with thousands of elements are split up and parsed on this many
+     * threads (at most 64), which only pays off for big files: think
+     * structure exports, not chunks. 0 or 1 parses everything on the calling
+     * thread. The tree is the same either way.
+     */
+    size_t threads;
+
+    /*
+     * Names and strings are stored as Java wrote them: Modified UTF-8. Set
+     * this to have them turned into UTF-8 as they're read, and to reject any
+     * that aren't MUTF-8 at all with NBT_ERR. See nbt_mutf8_to_utf8.
+     */
+    bool utf8;
+
+    /*
+     * Which dialect the input is in. In network NBT, a lone TAG_END stands for
+     * no tree at all, and gets you NULL with errno set to NBT_OK. Threads are
+     * only used for big-endian input.
+     */
+    nbt_format format;
+
+    /*
+     * Budgets, for input you don't trust. A tree that would go over any of
+     * them fails with NBT_ELIMIT, and every length is checked before anything
+     * is allocated for it, so a crafted header can't make us try. 0 means no
+     * limit.
+     *
+     * max_bytes covers everything the tree allocates: nodes, list entries,
+     * names, strings and arrays. nbt_parse_compressed_opts won't inflate more
+     * than that either. With threads, they share what's left of the budget
+     * as they go, so between them they're stopped at most 64 KiB and 1024
+     * nodes each past it. Whether the tree fits is decided exactly, either way.
+     */
+    size_t max_bytes;
+    size_t max_nodes;        /* Tags in the tree, the root included. */
+    size_t max_array_length; /* Elements in any one array or list. */
+
+    /*
+     * Lay every list out as an NBT_NODE_VECTOR, so nbt_list_item and
+     * nbt_list_length don't have to walk it. That's one allocation per list,
+     * rather than one per element, too.
+     */
+    bool vector_lists;
+
+    /*
+     * Make every compound NBT_NODE_INDEXED, so that nbt_compound_get and
+     * nbt_find_by_path can go straight to a child instead of comparing names
+     * with each one. Nothing is hashed until a compound is first searched,
+     * which writes to it (see nbt_materialize).
+     */
+    bool index_compounds;
+
+    /*
+     * Take names, and string values, from this table (adding any it doesn't
+     * have yet) rather than giving every node its own copy. Only those up to
+     * NBT_INTERN_MAX_LENGTH bytes long are, and with threads, only the ones
+     * already in it. The table must outlive the tree.
+     */
+    nbt_intern_table* intern;
+
+    /*
+     * Keep lists of bytes, shorts, ints, longs, floats and doubles as
+     * NBT_NODE_PACKED arrays: 8 bytes for a double instead of a node and a
+     * list entry. Read and written in one go, with no node per element.
+     */
+    bool pack_lists;
+
+    /*
+     * Make nodes NBT_NODE_COMPACT, with names up to NBT_INLINE_NAME_MAX bytes
+     * inline, so most cost one allocation instead of three. Code that unlinks
+     * and frees list entries by hand has to check for it.
+     */
+    bool compact_nodes;
+
+    /*
+     * Keep byte, int and long arrays NBT_NODE_ENCODED wherever that takes less
+     * memory (see nbt_encode_arrays), sharing them through `array_pool' if
+     * it isn't NULL. They're encoded once the tree's been parsed.
+     */
+    bool encode_arrays;
+    nbt_array_pool* array_pool;
+};
+
+/*
+ * The same as nbt_parse, but with `options' (which may be NULL). The parser
+ * never recurses, however deep the tree goes, and neither does anything that
+ * walks the tree afterwards (nbt_free, nbt_clone, nbt_eq, nbt_map, nbt_find,
+ * nbt_filter, the dumps, ...), so max_depth can safely be as large as you
+ * like. Mind that nbt_dump_ascii indents every level, though.
+ */
+nbt_node* nbt_parse_opts(const void* memory, size_t length,
+                         const struct nbt_parse_options* options);
+
+/* The same as nbt_parse_opts, but for compressed data. */
+nbt_node* nbt_parse_compressed_opts(const void* chunk_start, size_t length,
+                                    const struct nbt_parse_options* options);
+
 /*
  * Returns a NULL-terminated string as the ascii representation of the tree. If
  * an error occurs, NULL will be returned and errno will be set.
@@ -192,10 +477,518 @@ char* nbt_dump_ascii(const nbt_node* tree);
  */
 struct buffer nbt_dump_binary(const nbt_node* tree);
 
+                       /***** Arena Allocation *****/
+
+/*
+ * An arena hands out memory from a few big blocks and gives all of it back in
+ * one go. Parsing a tree into an arena costs next to nothing in malloc traffic,
+ * and throwing the tree away is a single call instead of a walk over every
+ * node. Great for scanning worlds, where a tree lives for a few microseconds.
+ *
+ * Trees parsed into an arena belong to the arena. NEVER call nbt_free (or any
+ * other function that frees nodes, like nbt_filter_inplace) on them. Do call
+ * nbt_arena_reset or nbt_arena_free when you're done with them.
+ */
+typedef struct nbt_arena nbt_arena;
+
+/* Creates an empty arena. Returns NULL and sets errno if out of memory. */
+nbt_arena* nbt_arena_new(void);
+
+/*
+ * Gets `n' bytes out of the arena, aligned for any NBT payload. Returns NULL
+ * and sets errno if out of memory. There's no way to free a single allocation.
+ */
+void* nbt_arena_alloc(nbt_arena* arena, size_t n);
+
+/*
+ * Releases everything allocated from the arena, but keeps a block around so
+ * that the next tree doesn't have to go back to malloc. All trees parsed into
+ * the arena are invalid after this.
+ */
+void nbt_arena_reset(nbt_arena* arena);
+
+/* Releases the arena and everything ever allocated from it. */
+void nbt_arena_free(nbt_arena* arena);
+
+/*
+ * Hands a malloc'd block over to the arena, which will free it when it's reset
+ * or freed. Returns non-zero (and frees nothing) if out of memory.
+ */
+int nbt_arena_adopt(nbt_arena* arena, void* block);
+
+/*
+ * The same as nbt_parse, except every node, name, string and array of the tree
+ * is allocated from `arena'. On error, whatever was allocated stays in the
+ * arena until it's reset.
+ */
+nbt_node* nbt_parse_arena(const void* memory, size_t length, nbt_arena* arena);
+
+/* The same as nbt_parse_compressed, except the tree is put into `arena'. */
+nbt_node* nbt_parse_compressed_arena(const void* chunk_start, size_t length,
+                                     nbt_arena* arena);
+
+                     /***** Zero-Copy (Borrowed) Parsing *****/
+
+/*
+ * Parses an uncompressed tree without copying strings and arrays out of
+ * `memory'. Every name, string and array in the tree points straight into the
+ * buffer, so it has to outlive the tree. Nodes are flagged NBT_NODE_BORROWED.
+ *
+ * The buffer is modified: strings are shifted two bytes to the left, over
+ * their length prefix, to make room for a NULL-terminator. Don't parse the
+ * same buffer twice. Int and long arrays are NOT byte-swapped, use
+ * nbt_int_array_get and nbt_long_array_get to read them.
+ *
+ * If `arena' is non-NULL, the nodes are allocated from it as with
+ * nbt_parse_arena. Otherwise, free the tree with nbt_free as usual.
+ */
+nbt_node* nbt_parse_borrowed(void* memory, size_t length, nbt_arena* arena);
+
+/*
+ * The same as nbt_parse_borrowed, but for compressed data. The decompressed
+ * buffer is owned by the tree: it goes away with nbt_free on the root (or with
+ * the arena, if one is given). Don't free the root while you're still using
+ * one of its children.
+ */
+nbt_node* nbt_parse_compressed_borrowed(const void* chunk_start, size_t length,
+                                        nbt_arena* arena);
+
+                       /***** Event (SAX) Parsing *****/
+
+/*
+ * The event parser walks a tree in its binary form and tells you about every
+ * tag it comes across, without building a single nbt_node or allocating any
+ * memory at all. If you only want to count or filter things, it's MUCH faster
+ * than nbt_parse followed by a walk over the tree.
+ */
+
+/* What to do after an event. */
+typedef enum {
+    NBT_EVENT_CONTINUE = 0, /* Keep going. */
+    NBT_EVENT_SKIP     = 1, /* From compound_begin or list_begin: skip everything
+                               inside. The matching end event isn't sent. */
+    NBT_EVENT_STOP     = 2  /* Stop parsing. nbt_parse_events returns NBT_OK. */
+} nbt_event_action;
+
+/*
+ * A single tag, as seen by the event parser. Everything in here points into the
+ * input and is only valid for the duration of the callback. NOTHING is
+ * NULL-terminated, and arrays are still in big-endian byte order.
+ */
+struct nbt_event {
+    nbt_type type;
+    const char* name;   /* NULL for list elements. */
+    size_t name_length;
+    size_t depth;       /* 0 for the root, 1 for its children, and so on. */
+
+    union {
+        int8_t  tag_byte;
+        int16_t tag_short;
+        int32_t tag_int;
+        int64_t tag_long;
+        float   tag_float;
+        double  tag_double;
+
+        struct {
+            const char* data;
+            size_t length;
+        } tag_string;
+
+        /* Byte, int and long arrays. `length' counts elements, not bytes. */
+        struct {
+            const void* data;
+            int32_t length;
+        } tag_array;
+
+        struct {
+            nbt_type type; /* The type of the elements. */
+            int32_t length;
+        } tag_list;
+
+    } payload;
+};
+
+/*
+ * Callbacks for the event parser. Any of them may be NULL, which is the same
+ * as a callback that always returns NBT_EVENT_CONTINUE. `value' is called for
+ * everything that isn't a compound or a list.
+ */
+struct nbt_event_handler {
+    nbt_event_action (*compound_begin)(const struct nbt_event* ev, void* aux);
+    nbt_event_action (*compound_end)  (const struct nbt_event* ev, void* aux);
+    nbt_event_action (*list_begin)    (const struct nbt_event* ev, void* aux);
+    nbt_event_action (*list_end)      (const struct nbt_event* ev, void* aux);
+    nbt_event_action (*value)         (const struct nbt_event* ev, void* aux);
+};
+
+/*
+ * Walks an uncompressed tree, calling `handler' for every tag. Returns NBT_OK
+ * if the whole tree was walked or a callback said stop, and NBT_ERR if the
+ * tree is corrupt. Skipped subtrees are still bounds-checked.
+ */
+nbt_status nbt_parse_events(const void* memory, size_t length,
+                            const struct nbt_event_handler* handler, void* aux);
+
+/* The same as nbt_parse_events, but for compressed data. */
+nbt_status nbt_parse_compressed_events(const void* chunk_start, size_t length,
+                                       const struct nbt_event_handler* handler,
+                                       void* aux);
+
+/*
+ * The same as nbt_parse_events, but for a compressed file, which is streamed
+ * through a small fixed-size buffer. Memory use doesn't grow with the file,
+ * only with the biggest string or array the handler is shown. Strings and
+ * arrays are only valid for the duration of the callback.
+ */
+nbt_status nbt_parse_file_events(FILE* fp, const struct nbt_event_handler* handler, void* aux);
+
+                            /***** Validation *****/
+
+/* What nbt_validate found out about a tree. */
+struct nbt_stats {
+    size_t nodes;     /* Every tag in the tree, the root included. */
+    size_t max_depth; /* How deep lists and compounds nest, counted the same
+                         way as nbt_parse_options.max_depth. */
+
+    /*
+     * How many bytes of the input each type of tag takes up, type and name
+     * included. Lists and compounds only count their own headers, not their
+     * contents, and bytes[TAG_INVALID] counts the TAG_Ends closing compounds.
+     * It all adds up to the size of the tree.
+     */
+    size_t bytes[TAG_LONG_ARRAY + 1];
+
+    size_t error_offset; /* Where the first error is, if there's an error. */
+};
+
+/*
+ * Checks whether an uncompressed tree would parse, with the same bounds checks
+ * (and the default depth limit) as nbt_parse, without building the tree or
+ * allocating anything. Returns NBT_OK or NBT_ERR. `stats' may be NULL; if not,
+ * it's filled in with whatever was seen up to the first error.
+ */
+nbt_status nbt_validate(const void* memory, size_t length, struct nbt_stats* stats);
+
+/*
+ * The same as nbt_validate, but for compressed data. The decompressed tree
+ * still has to be put somewhere, so this one does allocate. Returns NBT_EZ if
+ * the compression itself is broken, and error_offset is an offset into the
+ * decompressed data.
+ */
+nbt_status nbt_validate_compressed(const void* chunk_start, size_t length,
+                                   struct nbt_stats* stats);
+
+                          /***** Prefiltering *****/
+
+/*
+ * Most scans are after something rare: a sign, a block entity, a name. A
+ * prefilter looks for the bytes that have to be in a chunk for it to be of
+ * interest, all of them at once in a single pass, so the chunks that can't be
+ * aren't parsed at all. It can only rule chunks out; a chunk that gets past it
+ * may still turn out not to be what you're after.
+ */
+typedef struct nbt_prefilter nbt_prefilter;
+
+#define NBT_PREFILTER_MAX_PATTERNS 64
+
+/*
+ * Builds a prefilter for `count' byte strings. If `lengths' is NULL, the
+ * patterns are NUL-terminated. With `ignore_case', ASCII letters match either
+ * case. Returns NULL and sets errno to NBT_EMEM, or to NBT_ERR if there are
+ * more than NBT_PREFILTER_MAX_PATTERNS patterns.
+ */
+nbt_prefilter* nbt_prefilter_new(const char* const* patterns, const size_t* lengths,
+                                 size_t count, bool ignore_case);
+
+void nbt_prefilter_free(nbt_prefilter* f);
+
+/*
+ * Returns how many of the patterns appear in `data', stopping as soon as
+ * they all have. If `seen' isn't NULL, seen[i] says whether pattern i did.
+ */
+size_t nbt_prefilter_scan(const nbt_prefilter* f, const void* data, size_t length, bool* seen);
+
+/* Returns true if every one of the patterns appears in `data'. */
+bool nbt_prefilter_match(const nbt_prefilter* f, const void* data, size_t length);
+
+/*
+ * The same as nbt_prefilter_scan and nbt_prefilter_match, but for an
+ * uncompressed tree, and only looking inside its names and strings. A pattern
+ * has to be in one of them to count, but arrays and lists of numbers (most of
+ * a chunk) are stepped over without being read. A corrupt tree can't be ruled
+ * out, so every pattern is reported as seen.
+ */
+size_t nbt_prefilter_scan_tree(const nbt_prefilter* f, const void* data, size_t length, bool* seen);
+bool nbt_prefilter_match_tree(const nbt_prefilter* f, const void* data, size_t length);
+
+/*
+ * The same as nbt_parse_compressed and nbt_parse_compressed_events, but only
+ * if nbt_prefilter_match_tree passes the decompressed tree. If not, they
+ * return NULL with errno set to NBT_OK, and NBT_OK without calling anything,
+ * respectively.
+ */
+nbt_node* nbt_parse_compressed_filtered(const void* chunk_start, size_t length,
+                                        const nbt_prefilter* f);
+
+nbt_status nbt_parse_compressed_events_filtered(const void* chunk_start, size_t length,
+                                                const nbt_prefilter* f,
+                                                const struct nbt_event_handler* handler,
+                                                void* aux);
+
+                          /***** Modified UTF-8 *****/
+
+/*
+ * Java, and so every NBT file, writes strings in Modified UTF-8: NUL is the
+ * two bytes C0 80, and characters outside the BMP are surrogate pairs, each
+ * half encoded as three bytes of its own. ASCII is the same in all of them,
+ * and goes by about as fast as memcpy.
+ */
+
+/*
+ * Returns true if `data' is well-formed Modified UTF-8. Unpaired surrogates
+ * are allowed, since Java allows them.
+ */
+bool nbt_mutf8_valid(const void* data, size_t length);
+
+/*
+ * Transcodes Modified UTF-8 into UTF-8, and returns the new length, which is
+ * never longer than `length'. `dest' may be `src', to do it in place. An
+ * unpaired surrogate becomes U+FFFD, and NUL stays C0 80 so the result can
+ * still be NUL-terminated. Returns SIZE_MAX if `src' isn't valid, leaving
+ * `dest' half-written.
+ */
+size_t nbt_mutf8_to_utf8(char* dest, const void* src, size_t length);
+
+/*
+ * The other way: surrogate pairs for characters outside the BMP, and C0 80 for
+ * NUL. Everything else, valid UTF-8 or not, is copied as it is, so MUTF-8 goes
+ * through unchanged. nbt_utf8_to_mutf8_length says how long the result will
+ * be, and nbt_utf8_to_mutf8 writes it to `dest' and returns that again.
+ * nbt_dump_binary does this to every name and string.
+ */
+size_t nbt_utf8_to_mutf8_length(const void* src, size_t length);
+size_t nbt_utf8_to_mutf8(char* dest, const void* src, size_t length);
+
+                           /***** Interning *****/
+
+/*
+ * A chunk has the same few hundred names ("id", "Pos", "x", ...) and ids
+ * ("minecraft:stone") thousands of times over. An intern table keeps a single
+ * copy of each, which every tree parsed with it points into, so they cost no
+ * allocation or memory per node, and equal ones are the same pointer.
+ *
+ * Nothing is ever taken out, so a table used on untrusted input grows with
+ * every name it hasn't seen before, up to the size of the input. It's not safe
+ * to use from two threads at once, except for nbt_parse_opts's own threads,
+ * which only ever look things up.
+ */
+
+/* Names and strings any longer than this are always copied. */
+#define NBT_INTERN_MAX_LENGTH 64
+
+/*
+ * A new table, already holding the names and ids found all over Minecraft's
+ * worlds. Returns NULL with errno set to NBT_EMEM on failure.
+ */
+nbt_intern_table* nbt_intern_table_new(void);
+
+/* Frees the table and every string in it. Trees still using them are left dangling. */
+void nbt_intern_table_free(nbt_intern_table* in);
+
+/*
+ * Returns the table's NUL-terminated copy of the `length' bytes at `s',
+ * adding one if there isn't one already. NULL, with errno set to NBT_EMEM, if
+ * we ran out of memory. That's how to name nodes you build yourself, and flag
+ * them NBT_NODE_INTERNED_NAME.
+ */
+const char* nbt_intern(nbt_intern_table* in, const char* s, size_t length);
+
+/* The same, but returns NULL instead of adding anything. */
+const char* nbt_intern_find(const nbt_intern_table* in, const char* s, size_t length);
+
+                        /***** Projected Parsing *****/
+
+/*
+ * Parses only the parts of a tree that lie along or under `paths', which are
+ * in the same format nbt_find_by_path takes. Everything else is skipped over
+ * without being allocated. For example, with the paths
+ *
+ *   ".Level.xPos", ".Level.zPos", ".Level.Entities"
+ *
+ * you get back the root holding Level, which holds xPos, zPos and all of
+ * Entities, and nothing else. Lists and compounds that a path goes into are
+ * left out if nothing in them was wanted, except for the root, which always
+ * comes back (even if empty). Returns NULL and sets errno on errors, just like
+ * nbt_parse.
+ */
+nbt_node* nbt_parse_paths(const void* memory, size_t length,
+                          const char* const* paths, size_t count);
+
+/* The same as nbt_parse_paths, but for compressed data. */
+nbt_node* nbt_parse_compressed_paths(const void* chunk_start, size_t length,
+                                     const char* const* paths, size_t count);
+
+/*
+ * Finds what nbt_find_by_path would find for each of `paths', and stops
+ * looking as soon as everything's been found. `found[i]' is set to a tree of
+ * its own (which you free with nbt_free), or to NULL if `paths[i]' isn't
+ * there. Returns NBT_OK, or an error with every `found[i]' set to NULL.
+ */
+nbt_status nbt_extract(const void* memory, size_t length,
+                       const char* const* paths, size_t count, nbt_node** found);
+
+/*
+ * The same as nbt_extract, but for compressed data. Only as much of it is
+ * inflated as it takes to find everything, which for a field near the start of
+ * a chunk is a small part of the whole. If a path isn't there, we can't be
+ * sure until the end, though.
+ */
+nbt_status nbt_extract_compressed(const void* chunk_start, size_t length,
+                                  const char* const* paths, size_t count, nbt_node** found);
+
+                           /***** Lazy Parsing *****/
+
+/*
+ * Parses a tree whose compounds are only parsed when something first looks
+ * inside them. Until then, a compound is just a range of the input (see
+ * NBT_NODE_LAZY), and nbt_dump_binary copies that range straight back out.
+ *
+ * Whatever does get parsed is borrowed from `memory', exactly like with
+ * nbt_parse_borrowed: the same rules about modifying and freeing it apply, and
+ * every node is NBT_NODE_BORROWED. The whole input is bounds-checked up front,
+ * so corrupt data is still caught here.
+ */
+nbt_node* nbt_parse_lazy(void* memory, size_t length);
+
+/*
+ * The same as nbt_parse_lazy, but for compressed data. The tree holds on to
+ * the decompressed buffer, which is freed along with the root. Don't free the
+ * root while you're still using a subtree you've taken out of it.
+ */
+nbt_node* nbt_parse_compressed_lazy(const void* chunk_start, size_t length);
+
+/*
+ * Parses the children of a lazy compound (which are themselves lazy if they're
+ * compounds). Does nothing to any other node. You only need this to walk
+ * payload.tag_compound yourself: nbt_find, nbt_find_by_path, nbt_map and
+ * friends materialize whatever they look inside, even the ones that take a
+ * const tree. That also means a lazy tree can't be shared between threads.
+ *
+ * Nor can a tree parsed with index_compounds or pack_lists, for the same
+ * reason: a compound's table is built the first time it's searched (and
+ * again after it changes), and a packed list is unpacked by whatever looks
+ * at its elements one by one. Searching one from two threads at once, even
+ * with nbt_compound_get, is a race.
+ */
+nbt_status nbt_materialize(nbt_node* node);
+
+                          /***** Push Parsing *****/
+
+/*
+ * A push parser builds the same tree as nbt_parse, but out of input that
+ * arrives in pieces: off a socket, or out of inflate() a buffer at a time.
+ * Slices can be cut anywhere, even in the middle of a number.
+ *
+ *   nbt_push_parser* p = nbt_push_parser_new();
+ *   while(there's more input)
+ *       if(nbt_push_parser_feed(p, slice, slice_length) != NBT_OK)
+ *           give up;
+ *   nbt_node* tree = nbt_push_parser_finish(p);
+ *   nbt_push_parser_free(p);
+ */
+typedef struct nbt_push_parser nbt_push_parser;
+
+/* Returns NULL and sets errno to NBT_EMEM if we're out of memory. */
+nbt_push_parser* nbt_push_parser_new(void);
+
+/*
+ * A push parser that builds no tree, but calls `handler' for every tag the way
+ * nbt_parse_events does (skipping and stopping included) as soon as it's been
+ * fed the whole tag. nbt_push_parser_finish returns NULL with errno set to
+ * NBT_OK once the tree is done.
+ */
+nbt_push_parser* nbt_push_parser_new_events(const struct nbt_event_handler* handler, void* aux);
+
+/*
+ * Parses as much of the tree as `length' more bytes allow. Returns NBT_ERR if
+ * the input is corrupt and NBT_EMEM if we're out of memory, after which every
+ * feed returns the same error. Bytes after the end of the tree are ignored.
+ */
+nbt_status nbt_push_parser_feed(nbt_push_parser* p, const void* data, size_t length);
+
+/*
+ * The same as nbt_push_parser_feed, but stops once it has created `max_nodes'
+ * more nodes. `*used' is set to how many bytes were consumed; feed the rest
+ * next time. `used' may be NULL.
+ */
+nbt_status nbt_push_parser_feed_some(nbt_push_parser* p, const void* data, size_t length,
+                                     size_t max_nodes, size_t* used);
+
+/* Returns true once the whole tree has been fed. */
+bool nbt_push_parser_done(const nbt_push_parser* p);
+
+/* How many nodes have been built so far. */
+size_t nbt_push_parser_nodes(const nbt_push_parser* p);
+
+/*
+ * Hands the finished tree over to the caller, who frees it with nbt_free.
+ * Returns NULL and sets errno to NBT_ERR if the input stopped short of the end
+ * of the tree, or to the error the parser failed with.
+ */
+nbt_node* nbt_push_parser_finish(nbt_push_parser* p);
+
+/* Frees the parser, and whatever it built that nobody asked for. */
+void nbt_push_parser_free(nbt_push_parser* p);
+
+                        /***** Time-Sliced Loading *****/
+
+/*
+ * A loader parses a tree a little at a time, so a big load can be spread over
+ * several frames of a game loop without a helper thread. Each step stops after
+ * a budget of work, and the next one picks up where it left off.
+ *
+ *   nbt_loader* l = nbt_loader_new(data, length, true);
+ *   while((err = nbt_loader_step(l, &budget)) == NBT_AGAIN)
+ *       do something else for a while;
+ *   nbt_node* tree = nbt_loader_finish(l);
+ *   nbt_loader_free(l);
+ */
+typedef struct nbt_loader nbt_loader;
+
+/* How much a step may do. A zero means no limit. */
+struct nbt_budget {
+    size_t bytes; /* Uncompressed bytes to parse. */
+    size_t nodes; /* Nodes to build. */
+};
+
+/*
+ * Starts loading the tree in `data', which is zlib- or gzip-compressed if
+ * `compressed' is true. `data' is not copied, and must stay put until the
+ * loader is freed. Returns NULL and sets errno to NBT_EMEM or NBT_EZ on error.
+ */
+nbt_loader* nbt_loader_new(const void* data, size_t length, bool compressed);
+
+/*
+ * Inflates and parses up to `budget' worth of the tree. Returns NBT_AGAIN if
+ * there's more to do, NBT_OK once the tree is complete, and an error (which
+ * every later step returns too) if it's corrupt. `budget' may be NULL, in
+ * which case the rest of the tree is loaded in one go.
+ */
+nbt_status nbt_loader_step(nbt_loader* l, const struct nbt_budget* budget);
+
+/*
+ * Hands the finished tree over to the caller. Returns NULL and sets errno if
+ * the last step didn't return NBT_OK.
+ */
+nbt_node* nbt_loader_finish(nbt_loader* l);
+
+void nbt_loader_free(nbt_loader* l);
+
                    /***** Tree Manipulation Functions *****/
 
 /*
- * Clones an existing tree. Returns NULL on memory errors.
+ * Clones an existing tree. Returns NULL on memory errors. See nbt_clone_shared
+ * for a clone that copies nothing up front.
  */
 nbt_node* nbt_clone(nbt_node*);
 
@@ -207,6 +1000,8 @@ void nbt_free(nbt_node*);
 
 /*
  * Recursively frees all the elements of a list, and then frees the list itself.
+ * Not for NBT_NODE_VECTOR lists or NBT_NODE_INDEXED compounds, whose entries
+ * and sentinels aren't allocated one by one.
  */
 void nbt_free_list(struct tag_list*);
 
@@ -246,7 +1041,9 @@ nbt_node* nbt_filter(const nbt_node* tree, nbt_predicate_t, void* aux);
 
 /*
  * The exact same as nbt_filter, except instead of returning a new tree, the
- * existing tree is modified in place, and then returned for convenience.
+ * existing tree is modified in place, and then returned for convenience. In a
+ * shared tree (see nbt_clone_shared), lists and compounds are filtered in a
+ * copy of their own instead, so what's returned may not be `tree' at all.
  */
 nbt_node* nbt_filter_inplace(nbt_node* tree, nbt_predicate_t, void* aux);
 
@@ -284,20 +1081,263 @@ nbt_node* nbt_find_by_name(nbt_node* tree, const char* name);
  */
 nbt_node* nbt_find_by_path(nbt_node* tree, const char* path);
 
-/* Returns the number of nodes in the tree. */
+/*
+ * Returns the first child of a compound named `name', or NULL if there isn't
+ * one. On a wide NBT_NODE_INDEXED compound, that's a single hash probe.
+ */
+nbt_node* nbt_compound_get(nbt_node* compound, const char* name);
+
+/*
+ * Makes a compound NBT_NODE_INDEXED, and builds its table right away. If we
+ * run out of memory doing that, lookups still work, just without it.
+ */
+nbt_status nbt_compound_index(nbt_node* compound);
+
+/*
+ * Adds `child' to the end of a compound, which owns it from then on, keeping
+ * its index (if it has one) up to date.
+ */
+nbt_status nbt_compound_add(nbt_node* compound, nbt_node* child);
+
+/*
+ * Takes the first child named `name' out of a compound, keeping its index (if
+ * it has one) up to date, and returns it. It's yours to nbt_free. NULL if
+ * there's no such child.
+ */
+nbt_node* nbt_compound_remove(nbt_node* compound, const char* name);
+
+/*
+ * Returns the number of nodes in the tree. A really deep tree takes memory to
+ * walk, so if we run out of it, this returns 0 with errno set to NBT_EMEM.
+ */
 size_t nbt_size(const nbt_node* tree);
 
 /*
- * Returns the Nth item of a list
- * Don't use this to iterate through a list, it would be very inefficient
+ * Returns the Nth item of a list, or NULL if there isn't one. That's O(1) for
+ * an NBT_NODE_VECTOR list. Any other has to be walked, so don't use this to
+ * iterate through one.
  */
 nbt_node* nbt_list_item(nbt_node* list, int n);
 
+/* Returns how many elements a list has. Also O(1) for NBT_NODE_VECTOR lists. */
+size_t nbt_list_length(const nbt_node* list);
+
+/*
+ * Adds `item' to the end of `list', which owns it from then on. An empty list
+ * takes on the item's type. Otherwise, it has to be of the list's type, or you
+ * get NBT_ERR and nothing changes. This is the only safe way to grow an
+ * NBT_NODE_VECTOR list.
+ */
+nbt_status nbt_list_append(nbt_node* list, nbt_node* item);
+
+/*
+ * Lays a list out as an NBT_NODE_VECTOR, with room for at least `capacity'
+ * elements before nbt_list_append has to move it. Its elements stay where
+ * they are; only the entries pointing at them are replaced. Returns NBT_ERR,
+ * leaving the list alone, if they aren't all of the list's type.
+ */
+nbt_status nbt_list_vectorize(nbt_node* list, size_t capacity);
+
+/*
+ * Turns an NBT_NODE_PACKED list into an ordinary list of nodes. Does nothing
+ * to any other node. Returns NBT_EMEM, leaving the list packed, if we run out
+ * of memory.
+ */
+nbt_status nbt_unpack(nbt_node* list);
+
+/*
+ * Read and write the Nth number of a list of numbers, packed or not, without
+ * unpacking it. Both work on any of them, converting the way C would, but
+ * _long is the one for bytes, shorts, ints and longs, and _double the one for
+ * floats and doubles. N must be in range.
+ */
+int64_t nbt_list_get_long(const nbt_node* list, int32_t n);
+double  nbt_list_get_double(const nbt_node* list, int32_t n);
+void    nbt_list_set_long(nbt_node* list, int32_t n, int64_t value);
+void    nbt_list_set_double(nbt_node* list, int32_t n, double value);
+
+/*
+ * Returns the Nth element of a byte, int or long array. Unlike indexing into
+ * payload.tag_int_array.data directly, these also work on NBT_NODE_BORROWED
+ * nodes, whose arrays are still big-endian, and on NBT_NODE_ENCODED ones.
+ */
+unsigned char nbt_byte_array_get(const nbt_node* array, int32_t n);
+int32_t nbt_int_array_get(const nbt_node* array, int32_t n);
+int64_t nbt_long_array_get(const nbt_node* array, int32_t n);
+
+/*
+ * Copies the whole array into `dest' in native byte order. `dest' must have
+ * room for payload.tag_int_array.length (or tag_long_array.length) elements.
+ */
+void nbt_byte_array_copy(const nbt_node* array, unsigned char* dest);
+void nbt_int_array_copy(const nbt_node* array, int32_t* dest);
+void nbt_long_array_copy(const nbt_node* array, int64_t* dest);
+
 /* TODO: More utilities as requests are made and patches contributed. */
 
+                         /***** Encoded Arrays *****/
+
+/*
+ * Most of a chunk's memory is its arrays, and most of those are all zeros,
+ * or long runs of a few values. An encoded array is kept as whichever of these
+ * is smallest:
+ *
+ *   - one value, if that's all there is (a section of nothing but air);
+ *   - runs of values, if there are few enough of them;
+ *   - the array as it was.
+ *
+ * Arrays encoded through the same pool share their memory with every other
+ * array in it that's the same, in whichever tree it is. The library decodes
+ * arrays wherever it reads them, without changing the tree.
+ *
+ * None of that sharing is locked. A pool, and every tree with arrays encoded
+ * through it, belong to one thread at a time, as if they were all one tree;
+ * so do trees whose encoded arrays came from each other through nbt_clone.
+ * Encoding, decoding, cloning or freeing any of them changes memory the rest
+ * are using. Just reading them is fine from as many threads as you like.
+ */
+
+/* Returns NULL with errno set to NBT_EMEM on failure. */
+nbt_array_pool* nbt_array_pool_new(void);
+
+/*
+ * Frees the pool. Arrays already encoded through it are still fine, and still
+ * shared, but nothing encoded from now on will share their memory.
+ */
+void nbt_array_pool_free(nbt_array_pool* pool);
+
+/*
+ * Encodes every byte, int and long array in `tree' that takes up less memory
+ * that way, or in any case if `pool' isn't NULL and it can be shared. Arrays
+ * that are NBT_NODE_BORROWED, or in lazy compounds, are left as they are, and
+ * trees in an arena can't be encoded at all. Returns NBT_EMEM if we ran out of
+ * memory, with whatever was encoded by then left encoded.
+ */
+nbt_status nbt_encode_arrays(nbt_node* tree, nbt_array_pool* pool);
+
+/*
+ * Turns an NBT_NODE_ENCODED array back into an ordinary one. Does nothing to
+ * any other node. Returns NBT_EMEM, leaving the array encoded, if we run out
+ * of memory.
+ */
+nbt_status nbt_decode(nbt_node* array);
+
+/* What nbt_memory_usage found out about a tree. */
+struct nbt_memory_stats {
+    size_t nodes; /* Every node, the root included. */
+
+    /*
+     * What the tree asked malloc for: nodes, list entries, names, strings,
+     * tables and payloads. Memory that's borrowed or interned isn't the
+     * tree's, and isn't counted; a tree in an arena is counted as if it had
+     * been malloc'd. A payload shared by N arrays counts 1/N towards each, so
+     * adding up several trees' figures gives what they take up between them.
+     * Subtrees shared with nbt_clone_shared count in full towards every tree
+     * that has them.
+     */
+    size_t bytes;
+
+    size_t arrays;         /* How much of `bytes' is byte, int and long arrays. */
+    size_t decoded_arrays; /* How much they'd take up as ordinary arrays. */
+    size_t encoded;        /* How many arrays are NBT_NODE_ENCODED. */
+};
+
+/*
+ * Adds up what `tree' takes up in memory, without parsing or decoding any of
+ * it. Walking a really deep tree takes memory of its own: if we run out, errno
+ * is set to NBT_EMEM, and `stats' only covers what we got through.
+ */
+void nbt_memory_usage(const nbt_node* tree, struct nbt_memory_stats* stats);
+
+                          /***** Shared Trees *****/
+
+/*
+ * nbt_clone copies everything, arrays and all, even when all you're going to
+ * change is a number or two. A shared clone copies nothing until something's
+ * changed, and then only the nodes from the root down to what changed: the
+ * rest stay part of both trees, and each node is freed along with the last
+ * tree it's part of.
+ *
+ *   nbt_node* copy = nbt_clone_shared(template);
+ *   nbt_unshare(&copy, ".Level.xPos")->payload.tag_int = x;
+ *   ...
+ *   nbt_free(copy);
+ *
+ * Nodes don't know their parents, so none of the other functions here can
+ * tell that a node is shared. Before changing anything in a shared tree, get
+ * it from nbt_unshare; nbt_filter_inplace is the only exception. Sharing is no
+ * more thread-safe than the trees themselves, and trees in an arena can't be
+ * shared at all.
+ */
+
+/*
+ * Returns a clone of `tree' in O(1): `tree' itself, which is now shared, and
+ * has to be nbt_free'd once more. A tree parsed with nbt_parse_borrowed or
+ * nbt_parse_lazy, or one already shared NBT_NODE_REFS_MAX times, is copied
+ * with nbt_clone instead. Returns NULL on memory errors.
+ */
+nbt_node* nbt_clone_shared(nbt_node* tree);
+
+/*
+ * Finds what nbt_find_by_path would, and makes sure it and everything on the
+ * way to it is part of `*tree' alone, copying whichever of them aren't. If the
+ * root is copied, `*tree' is pointed at its copy. The node that's returned may
+ * be changed however you like, and so may the numbers in it, but its other
+ * children are still shared: unshare your way down to them too.
+ * Returns NULL if there's nothing at `path', with errno set to NBT_OK, or to
+ * NBT_EMEM if we ran out of memory part of the way down.
+ */
+nbt_node* nbt_unshare(nbt_node** tree, const char* path);
+
+                          /***** Tree Indexes *****/
+
+/*
+ * nbt_find_by_name and nbt_find_by_path walk the tree every time. An index
+ * walks it once, and after that finds every node with a given name (or path)
+ * with a single hash lookup.
+ *
+ * Adding, removing or filtering nodes with the functions above makes every
+ * index rebuild itself the next time it's asked anything. Change a tree any
+ * other way, and call nbt_index_touch on what you changed. Never free a tree
+ * and then ask its index anything. A tree and its indexes belong to one
+ * thread at a time, but different trees' indexes can be used from different
+ * threads. Changing one tree doesn't make another's indexes rebuild, unless
+ * they share nodes, or there are more than 31 indexes at once.
+ */
+typedef struct nbt_index nbt_index;
+
+/*
+ * Indexes every node in `tree' by name, and if `paths' is set, by the path
+ * nbt_find_by_path would find it at too. Lazy compounds are materialized and
+ * packed lists unpacked, as nbt_find would. Returns NULL with errno set on
+ * failure.
+ */
+nbt_index* nbt_index_new(nbt_node* tree, bool paths);
+
+void nbt_index_free(nbt_index* index);
+
+/*
+ * The nodes named `name' (or at `path'), in the order nbt_find would come
+ * across them. Returns how many there are, and points `*nodes' at them until
+ * the index is next asked anything. Returns 0 with errno set if rebuilding
+ * the index failed.
+ */
+size_t nbt_index_all_by_name(nbt_index* index, const char* name, nbt_node* const** nodes);
+size_t nbt_index_all_by_path(nbt_index* index, const char* path, nbt_node* const** nodes);
+
+/* What nbt_find_by_name and nbt_find_by_path would return. */
+nbt_node* nbt_index_find_by_name(nbt_index* index, const char* name);
+nbt_node* nbt_index_find_by_path(nbt_index* index, const char* path);
+
+/* Makes every index that has seen `node' rebuild itself before it's next used. */
+void nbt_index_touch(const nbt_node* node);
+
                       /***** Utility Functions *****/
 
-/* Returns true if the trees are identical. */
+/*
+ * Returns true if the trees are identical. If we run out of memory walking
+ * really deep ones, it returns false with errno set to NBT_EMEM.
+ */
 bool nbt_eq(const nbt_node* restrict a, const nbt_node* restrict b);
 
 /*
@@ -352,6 +1392,14 @@ nbt_node *mcr_chunk_get(MCR *mcr, int x, int z);
  */
 int mcr_chunk_set(MCR *mcr, int x, int z, nbt_node *root);
 
+/*
+ * Gets a chunk's raw compressed data, ready to be passed to one of the
+ * nbt_parse_compressed functions, or NULL if the chunk doesn't exist. The data
+ * belongs to the MCR and is only valid until the chunk is set or the file is
+ * closed.
+ */
+const void *mcr_chunk_data(MCR *mcr, int x, int z, size_t *length);
+
 #ifdef __cplusplus
 }
 #endif
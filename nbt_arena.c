@@ -0,0 +1,185 @@
+/*
+ * -----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * Lukas Niederbremer <webmaster@flippeh.de> and Clark Gaebel <cg.wowus.cg@gmail.com>
+ * wrote this file. As long as you retain this notice you can do whatever you
+ * want with this stuff. If we meet some day, and you think this stuff is worth
+ * it, you can buy us a beer in return.
+ * -----------------------------------------------------------------------------
+ */
+#include "nbt.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+
+#ifdef __GNUC__
+#define likely(x)   __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(  (x), 0)
+#else
+#define likely(x)   (x)
+#define unlikely(x) (x)
+#endif
+
+/* The size of a regular arena block. Bigger requests get a block of their own. */
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+/* Every allocation is aligned to this. Enough for int64_t and double. */
+#define ARENA_ALIGN 16
+
+#define ALIGN_UP(n) (((n) + (ARENA_ALIGN - 1)) & ~(size_t)(ARENA_ALIGN - 1))
+
+struct arena_block {
+    struct arena_block* next; /* The previously filled block. */
+    size_t cap;               /* Usable bytes after the header. */
+    size_t used;
+};
+
+/* The header is padded so that the first allocation is aligned too. */
+#define BLOCK_HEADER ALIGN_UP(sizeof(struct arena_block))
+
+#define BLOCK_DATA(blk) ((unsigned char*)(blk) + BLOCK_HEADER)
+
+/* A block from somewhere else that's freed along with the arena. */
+struct adopted_block {
+    struct adopted_block* next;
+    void* block;
+};
+
+struct nbt_arena {
+    struct arena_block*  head;    /* The block we're currently bumping through. */
+    struct adopted_block* adopted; /* Allocated from the arena itself. */
+};
+
+static struct arena_block* new_block(size_t cap)
+{
+    struct arena_block* b = malloc(BLOCK_HEADER + cap);
+
+    if(unlikely(b == NULL))
+        return NULL;
+
+    b->next = NULL;
+    b->cap  = cap;
+    b->used = 0;
+
+    return b;
+}
+
+nbt_arena* nbt_arena_new(void)
+{
+    nbt_arena* ret = malloc(sizeof *ret);
+
+    if(ret == NULL)
+        return (errno = NBT_EMEM), NULL;
+
+    ret->head    = NULL;
+    ret->adopted = NULL;
+    return ret;
+}
+
+void* nbt_arena_alloc(nbt_arena* arena, size_t n)
+{
+    assert(arena);
+
+    n = ALIGN_UP(n);
+
+    struct arena_block* head = arena->head;
+
+    if(likely(head != NULL) && likely(head->cap - head->used >= n))
+    {
+        void* ret = BLOCK_DATA(head) + head->used;
+        head->used += n;
+        return ret;
+    }
+
+    /*
+     * Oversized requests get their own block, which is slipped in *behind* the
+     * current one so we can keep filling what's left of it.
+     */
+    if(n > ARENA_BLOCK_SIZE / 4 && head != NULL)
+    {
+        struct arena_block* big = new_block(n);
+        if(unlikely(big == NULL))
+            return (errno = NBT_EMEM), NULL;
+
+        big->used = n;
+        big->next = head->next;
+        head->next = big;
+
+        return BLOCK_DATA(big);
+    }
+
+    struct arena_block* b = new_block(n > ARENA_BLOCK_SIZE ? n : ARENA_BLOCK_SIZE);
+    if(unlikely(b == NULL))
+        return (errno = NBT_EMEM), NULL;
+
+    b->used = n;
+    b->next = head;
+    arena->head = b;
+
+    return BLOCK_DATA(b);
+}
+
+int nbt_arena_adopt(nbt_arena* arena, void* block)
+{
+    assert(arena);
+
+    struct adopted_block* a = nbt_arena_alloc(arena, sizeof *a);
+    if(a == NULL)
+        return 1;
+
+    a->block = block;
+    a->next  = arena->adopted;
+    arena->adopted = a;
+
+    return 0;
+}
+
+static void free_adopted(nbt_arena* arena)
+{
+    for(struct adopted_block* a = arena->adopted; a; a = a->next)
+        free(a->block);
+
+    arena->adopted = NULL;
+}
+
+void nbt_arena_reset(nbt_arena* arena)
+{
+    assert(arena);
+
+    free_adopted(arena);
+
+    if(arena->head == NULL)
+        return;
+
+    /* Hang on to the newest block, it's the one most likely to be reused. */
+    struct arena_block* b = arena->head->next;
+
+    while(b)
+    {
+        struct arena_block* next = b->next;
+        free(b);
+        b = next;
+    }
+
+    arena->head->next = NULL;
+    arena->head->used = 0;
+}
+
+void nbt_arena_free(nbt_arena* arena)
+{
+    if(arena == NULL) return;
+
+    free_adopted(arena);
+
+    struct arena_block* b = arena->head;
+
+    while(b)
+    {
+        struct arena_block* next = b->next;
+        free(b);
+        b = next;
+    }
+
+    free(arena);
+}
@@ -0,0 +1,576 @@
+/*
+ * -----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * Lukas Niederbremer <webmaster@flippeh.de> and Clark Gaebel <cg.wowus.cg@gmail.com>
+ * wrote this file. As long as you retain this notice you can do whatever you
+ * want with this stuff. If we meet some day, and you think this stuff is worth
+ * it, you can buy us a beer in return.
+ * -----------------------------------------------------------------------------
+ */
+#include "nbt.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * An index is a hash table of keys (names, paths, and one for "no name at
+ * all"), open addressed with linear probing and kept at most half full. Each
+ * key gets a number in the order it was first seen, and every node with that
+ * key sits in one run of `nodes', so looking a key up is all a query does.
+ *
+ * A path's key is its parent's key and its own name, not the whole dotted
+ * path, so keys take up no more room however deep the tree goes. Its hash
+ * carries on from its parent's.
+ *
+ * It's built by walking the tree once, noting down every (key, node) pair as
+ * it goes, and then sorting those by key with a counting sort, which keeps
+ * each key's nodes in the order they were found.
+ */
+
+enum key_kind { KEY_NAME, KEY_UNNAMED, KEY_PATH };
+
+struct index_key {
+    const char* s;      /* The name, or a path's last one. NULL if the slot's empty. */
+    size_t length;
+    size_t hash;
+    enum key_kind kind;
+    size_t parent;      /* A path's parent's id. NO_PATH for the root's, and for names. */
+};
+
+struct index_slot {
+    struct index_key key;
+    size_t id;
+};
+
+/* Where a key's nodes are in `nodes'. */
+struct index_run {
+    size_t first;
+    size_t count;
+};
+
+struct nbt_index {
+    nbt_node* tree;
+    bool paths;
+
+    unsigned watcher;                /* Our number in the nodes we've seen. See watch. */
+    unsigned long generation;        /* What our watcher's generation was when we were built... */
+    unsigned long shared_generation; /* ...and what watcher 0's was. */
+
+    struct index_slot* table;
+    size_t mask;              /* The table's size, less one. */
+
+    struct index_run* runs;   /* One per key, by id. */
+    size_t keys;
+
+    nbt_node** nodes;
+    nbt_arena* strings;       /* The names in the keys. */
+};
+
+/* A key, and a node that has it. */
+struct index_pair {
+    size_t id;
+    nbt_node* node;
+};
+
+struct index_pairs {
+    struct index_pair* pairs;
+    size_t length;
+    size_t capacity;
+};
+
+/* A list or compound the walk is in the middle of. */
+struct index_frame {
+    const struct list_head* head;
+    const struct list_head* pos;
+    size_t path;        /* Its own path's id, or NO_PATH... */
+    size_t path_hash;   /* ...and that path's hash. */
+};
+
+/* A node no path leads to, since a name along the way has a dot in it. */
+#define NO_PATH SIZE_MAX
+
+/*
+ * Each live index has a number of its own (up to 31 of them at a time), which
+ * it leaves in the flags of every node it sees (see NBT_NODE_WATCHER_SHIFT).
+ * Changing a node bumps that number's generation, so only the index that saw
+ * it goes stale. Watcher 0 is for nodes more than one index may have seen,
+ * and for indexes that didn't get a number: bumping it makes every index
+ * stale. Indexes of different trees can be used from different threads, so
+ * all of this is atomic.
+ */
+#define WATCHERS 32
+
+static unsigned long generations[WATCHERS];
+static uint32_t watchers_in_use = 1; /* Watcher 0 always is. */
+static unsigned next_watcher;
+
+/*
+ * Numbers are handed out in turn, rather than lowest first, so that nodes an
+ * index that's been freed left its number in are unlikely to find it taken
+ * again by the time they're next indexed.
+ */
+static unsigned claim_watcher(void)
+{
+    for(unsigned tries = 0; tries < WATCHERS - 1; tries++)
+    {
+        unsigned w = 1 + __atomic_fetch_add(&next_watcher, 1, __ATOMIC_RELAXED) % (WATCHERS - 1);
+        uint32_t bit = UINT32_C(1) << w;
+
+        if(!(__atomic_fetch_or(&watchers_in_use, bit, __ATOMIC_ACQ_REL) & bit))
+            return w;
+    }
+
+    return 0;
+}
+
+static void release_watcher(unsigned w)
+{
+    if(w != 0)
+        __atomic_fetch_and(&watchers_in_use, ~(UINT32_C(1) << w), __ATOMIC_ACQ_REL);
+}
+
+static inline unsigned watcher_of(const nbt_node* node)
+{
+    return (node->flags & NBT_NODE_WATCHER_MASK) >> NBT_NODE_WATCHER_SHIFT;
+}
+
+static inline unsigned long generation_of(unsigned w)
+{
+    return __atomic_load_n(&generations[w], __ATOMIC_ACQUIRE);
+}
+
+/*
+ * Marks a node as seen by us. One another live index has seen already might
+ * matter to both, so it's handed over to watcher 0. A watcher that's been
+ * released since doesn't count.
+ */
+static void watch(const nbt_index* index, nbt_node* node)
+{
+    unsigned w = watcher_of(node);
+
+    if(!(node->flags & NBT_NODE_WATCHED) || w == index->watcher ||
+       !(__atomic_load_n(&watchers_in_use, __ATOMIC_ACQUIRE) >> w & 1))
+        w = index->watcher;
+    else
+        w = 0;
+
+    node->flags = (node->flags & ~NBT_NODE_WATCHER_MASK) | NBT_NODE_WATCHED | w << NBT_NODE_WATCHER_SHIFT;
+}
+
+/* FNV-1a, carrying on from `h'. */
+static inline size_t fnv(uint64_t h, const char* s, size_t length)
+{
+    for(size_t i = 0; i < length; i++)
+        h = (h ^ (unsigned char)s[i]) * UINT64_C(1099511628211);
+
+    return (size_t)h;
+}
+
+/* Names are started off differently from each other kind of key. */
+static inline size_t hash_key(const char* s, size_t length, enum key_kind kind)
+{
+    return fnv(UINT64_C(14695981039346656037) ^ (uint64_t)kind, s, length);
+}
+
+/* A path's hash is its parent's with a dot and its own name after it. The root's parent is "". */
+static inline size_t hash_path(size_t parent_hash, const char* name, size_t length)
+{
+    return fnv(fnv((uint64_t)parent_hash, ".", 1), name, length);
+}
+
+#define ROOT_PARENT_HASH hash_key("", 0, KEY_PATH)
+
+/* The slot a key is in, or the empty one it would go in. */
+static struct index_slot* slot_for(const nbt_index* index, const struct index_key* key)
+{
+    for(size_t i = key->hash & index->mask;; i = (i + 1) & index->mask)
+    {
+        struct index_slot* slot = &index->table[i];
+
+        if(slot->key.s == NULL ||
+           (slot->key.hash == key->hash && slot->key.kind == key->kind &&
+            slot->key.parent == key->parent && slot->key.length == key->length &&
+            memcmp(slot->key.s, key->s, key->length) == 0))
+            return slot;
+    }
+}
+
+/* Doubles the table. Returns false if we're out of memory, and leaves it be. */
+static bool grow(nbt_index* index)
+{
+    struct index_slot* old = index->table;
+    size_t old_size = index->mask + 1;
+
+    if((index->table = calloc(2 * old_size, sizeof *index->table)) == NULL)
+        return (index->table = old), false;
+
+    index->mask = 2 * old_size - 1;
+
+    for(size_t i = 0; i < old_size; i++)
+        if(old[i].key.s)
+            *slot_for(index, &old[i].key) = old[i];
+
+    free(old);
+    return true;
+}
+
+/*
+ * The id of a key, giving it one if it hasn't got one yet, and pointing
+ * `key->s' at the index's own copy of its name. That's made here if `copy' is
+ * set; otherwise the name has to be one of ours already. SIZE_MAX, with errno
+ * set to NBT_EMEM, if we're out of memory.
+ */
+static size_t key_id(nbt_index* index, struct index_key* key, bool copy)
+{
+    struct index_slot* slot = slot_for(index, key);
+
+    if(slot->key.s)
+        return (key->s = slot->key.s), slot->id;
+
+    if(2 * (index->keys + 1) > index->mask + 1)
+    {
+        if(!grow(index)) return (errno = NBT_EMEM), SIZE_MAX;
+
+        slot = slot_for(index, key);
+    }
+
+    if(copy)
+    {
+        char* s = nbt_arena_alloc(index->strings, key->length + 1);
+        if(s == NULL) return (errno = NBT_EMEM), SIZE_MAX;
+
+        memcpy(s, key->s, key->length);
+        s[key->length] = '\0';
+
+        key->s = s;
+    }
+
+    slot->key = *key;
+    slot->id  = index->keys++;
+
+    return slot->id;
+}
+
+/* Notes down that `node' has the key `id'. */
+static bool add_pair(struct index_pairs* p, size_t id, nbt_node* node)
+{
+    if(p->length == p->capacity)
+    {
+        size_t capacity = p->capacity ? 2 * p->capacity : 256;
+        struct index_pair* pairs = realloc(p->pairs, capacity * sizeof *pairs);
+
+        if(pairs == NULL) return (errno = NBT_EMEM), false;
+
+        p->pairs    = pairs;
+        p->capacity = capacity;
+    }
+
+    p->pairs[p->length].id   = id;
+    p->pairs[p->length].node = node;
+    p->length++;
+
+    return true;
+}
+
+/*
+ * Notes down every key a node has. Its path is its parent's, `parent' (with
+ * the hash `parent_hash'), then a dot and its own name; the root's is just
+ * its name. Leaves the id of the node's own path in `*path', and its hash in
+ * `*hash'.
+ */
+static bool visit(nbt_index* index, struct index_pairs* p, nbt_node* node,
+                  size_t parent, size_t parent_hash, bool root, size_t* path, size_t* hash)
+{
+    watch(index, node);
+
+    /* we're about to look at everything under it anyway. */
+    nbt_status err;
+    if((err = nbt_materialize(node)) != NBT_OK || (err = nbt_unpack(node)) != NBT_OK)
+        return (errno = err), false;
+
+    struct index_key name = {
+        .s      = node->name ? node->name : "",
+        .length = node->name ? strlen(node->name) : 0,
+        .kind   = node->name ? KEY_NAME : KEY_UNNAMED,
+        .parent = NO_PATH
+    };
+
+    name.hash = hash_key(name.s, name.length, name.kind);
+
+    size_t id = key_id(index, &name, true);
+
+    *path = NO_PATH;
+    *hash = parent_hash;
+
+    if(id == SIZE_MAX || !add_pair(p, id, node))
+        return false;
+
+    if(!index->paths || (!root && parent == NO_PATH) || memchr(name.s, '.', name.length))
+        return true;
+
+    struct index_key key = {
+        .s      = name.s,
+        .length = name.length,
+        .hash   = hash_path(parent_hash, name.s, name.length),
+        .kind   = KEY_PATH,
+        .parent = parent
+    };
+
+    if((id = key_id(index, &key, false)) == SIZE_MAX)
+        return false;
+
+    *path = id;
+    *hash = key.hash;
+    return add_pair(p, id, node);
+}
+
+/* Throws everything away but the tree and what to index it by. */
+static void clear(nbt_index* index)
+{
+    free(index->table);
+    free(index->runs);
+    free(index->nodes);
+    nbt_arena_free(index->strings);
+
+    index->table   = NULL;
+    index->mask    = 0;
+    index->runs    = NULL;
+    index->keys    = 0;
+    index->nodes   = NULL;
+    index->strings = NULL;
+}
+
+static bool build(nbt_index* index)
+{
+    struct index_pairs p = { NULL, 0, 0 };
+    struct index_frame* stack = NULL;
+    size_t depth = 0, capacity = 0;
+
+    clear(index);
+
+    index->generation        = generation_of(index->watcher);
+    index->shared_generation = generation_of(0);
+    index->mask              = 255;
+    index->table      = calloc(index->mask + 1, sizeof *index->table);
+    index->strings    = nbt_arena_new();
+
+    if(index->table == NULL || index->strings == NULL)
+        goto mem_error;
+
+    nbt_node* node = index->tree;
+    size_t parent = NO_PATH, parent_hash = ROOT_PARENT_HASH, path, hash;
+    bool root = true;
+
+    for(;;)
+    {
+        if(!visit(index, &p, node, parent, parent_hash, root, &path, &hash))
+            goto build_error;
+
+        root = false;
+
+        if(node->type == TAG_LIST || node->type == TAG_COMPOUND)
+        {
+            if(depth == capacity)
+            {
+                size_t new_capacity = capacity ? 2 * capacity : 16;
+                struct index_frame* frames = realloc(stack, new_capacity * sizeof *frames);
+
+                if(frames == NULL) goto mem_error;
+
+                stack    = frames;
+                capacity = new_capacity;
+            }
+
+            const struct tag_list* children = node->type == TAG_LIST ? node->payload.tag_list.list
+                                                                     : node->payload.tag_compound;
+
+            stack[depth].head      = &children->entry;
+            stack[depth].pos       = &children->entry;
+            stack[depth].path      = path;
+            stack[depth].path_hash = hash;
+            depth++;
+        }
+
+        /* find the next node to visit, leaving everything we're done with. */
+        while(depth > 0)
+        {
+            struct index_frame* top = &stack[depth - 1];
+
+            top->pos = top->pos->flink;
+
+            if(top->pos != top->head)
+                break;
+
+            depth--;
+        }
+
+        if(depth == 0) break;
+
+        node          = list_entry(stack[depth - 1].pos, const struct tag_list, entry)->data;
+        parent      = stack[depth - 1].path;
+        parent_hash = stack[depth - 1].path_hash;
+    }
+
+    /* Count up each key's nodes, give each a run, then fill the runs in. */
+    index->runs  = calloc(index->keys ? index->keys : 1, sizeof *index->runs);
+    index->nodes = malloc((p.length ? p.length : 1) * sizeof *index->nodes);
+
+    if(index->runs == NULL || index->nodes == NULL)
+        goto mem_error;
+
+    for(size_t i = 0; i < p.length; i++)
+        index->runs[p.pairs[i].id].count++;
+
+    for(size_t id = 0, first = 0; id < index->keys; id++)
+    {
+        index->runs[id].first = first;
+        first += index->runs[id].count;
+        index->runs[id].count = 0;
+    }
+
+    for(size_t i = 0; i < p.length; i++)
+    {
+        struct index_run* run = &index->runs[p.pairs[i].id];
+        index->nodes[run->first + run->count++] = p.pairs[i].node;
+    }
+
+    free(stack);
+    free(p.pairs);
+    return true;
+
+mem_error:
+    errno = NBT_EMEM;
+
+build_error:
+    free(stack);
+    free(p.pairs);
+    clear(index);
+    return false;
+}
+
+nbt_index* nbt_index_new(nbt_node* tree, bool paths)
+{
+    assert(tree);
+
+    nbt_index* ret = calloc(1, sizeof *ret);
+    if(ret == NULL) return (errno = NBT_EMEM), NULL;
+
+    ret->tree    = tree;
+    ret->paths   = paths;
+    ret->watcher = claim_watcher();
+
+    if(!build(ret))
+    {
+        release_watcher(ret->watcher);
+        free(ret);
+        return NULL;
+    }
+
+    return ret;
+}
+
+void nbt_index_free(nbt_index* index)
+{
+    if(index == NULL) return;
+
+    clear(index);
+    release_watcher(index->watcher);
+    free(index);
+}
+
+void nbt_index_touch(const nbt_node* node)
+{
+    if(node && (node->flags & NBT_NODE_WATCHED))
+        __atomic_add_fetch(&generations[watcher_of(node)], 1, __ATOMIC_ACQ_REL);
+}
+
+/*
+ * Rebuilds the index if anything it's seen has changed since it was built. A
+ * failed rebuild leaves nothing behind, so the next query tries again.
+ */
+static bool fresh(nbt_index* index)
+{
+    errno = NBT_OK;
+
+    if(index->table != NULL && generation_of(index->watcher) == index->generation &&
+       generation_of(0) == index->shared_generation)
+        return true;
+
+    return build(index);
+}
+
+/* The nodes with a key, if it's in the index at all. */
+static size_t run_of(const nbt_index* index, const struct index_slot* slot, nbt_node* const** nodes)
+{
+    if(slot->key.s == NULL)
+        return (*nodes = NULL), 0;
+
+    const struct index_run* run = &index->runs[slot->id];
+
+    *nodes = index->nodes + run->first;
+    return run->count;
+}
+
+size_t nbt_index_all_by_name(nbt_index* index, const char* name, nbt_node* const** nodes)
+{
+    assert(index);
+    assert(nodes);
+
+    *nodes = NULL;
+
+    if(!fresh(index)) return 0;
+
+    struct index_key key = {
+        .s      = name ? name : "",
+        .length = name ? strlen(name) : 0,
+        .kind   = name ? KEY_NAME : KEY_UNNAMED,
+        .parent = NO_PATH
+    };
+
+    key.hash = hash_key(key.s, key.length, key.kind);
+
+    return run_of(index, slot_for(index, &key), nodes);
+}
+
+/* A path is looked up one name at a time, the way its key was made. */
+size_t nbt_index_all_by_path(nbt_index* index, const char* path, nbt_node* const** nodes)
+{
+    assert(index && index->paths);
+    assert(path);
+    assert(nodes);
+
+    *nodes = NULL;
+
+    if(!fresh(index)) return 0;
+
+    struct index_key key = { .kind = KEY_PATH, .parent = NO_PATH, .hash = ROOT_PARENT_HASH };
+
+    for(;;)
+    {
+        key.s      = path;
+        key.length = strcspn(path, ".");
+        key.hash   = hash_path(key.hash, key.s, key.length);
+
+        const struct index_slot* slot = slot_for(index, &key);
+
+        if(slot->key.s == NULL || path[key.length] == '\0')
+            return run_of(index, slot, nodes);
+
+        key.parent = slot->id;
+        path += key.length + 1;
+    }
+}
+
+nbt_node* nbt_index_find_by_name(nbt_index* index, const char* name)
+{
+    nbt_node* const* nodes;
+    return nbt_index_all_by_name(index, name, &nodes) ? nodes[0] : NULL;
+}
+
+nbt_node* nbt_index_find_by_path(nbt_index* index, const char* path)
+{
+    nbt_node* const* nodes;
+    return nbt_index_all_by_path(index, path, &nodes) ? nodes[0] : NULL;
+}
@@ -0,0 +1,192 @@
+/*
+ * -----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * Lukas Niederbremer <webmaster@flippeh.de> and Clark Gaebel <cg.wowus.cg@gmail.com>
+ * wrote this file. As long as you retain this notice you can do whatever you
+ * want with this stuff. If we meet some day, and you think this stuff is worth
+ * it, you can buy us a beer in return.
+ * -----------------------------------------------------------------------------
+ */
+#include "nbt.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * An intern table is a set of strings, open addressed with linear probing and
+ * kept at most half full. The strings themselves are packed into an arena, so
+ * each costs its bytes and a terminator, and nothing is freed until the whole
+ * table is.
+ */
+
+struct intern_entry {
+    const char* s;  /* NULL if the slot's empty. */
+    size_t length;
+    size_t hash;
+};
+
+struct nbt_intern_table {
+    struct intern_entry* table;
+    size_t mask;    /* The table's size, less one. */
+    size_t used;
+    nbt_arena* strings;
+};
+
+/*
+ * Names nearly every chunk has, and the ids of what most of a world is made
+ * of. Anything else is added the first time it's seen.
+ */
+static const char* const well_known[] = {
+    /* Chunks, old and new. */
+    "", "Level", "DataVersion", "xPos", "zPos", "yPos", "LastUpdate", "InhabitedTime",
+    "TerrainPopulated", "LightPopulated", "V", "Status", "isLightOn", "Biomes", "HeightMap",
+    "Heightmaps", "Sections", "sections", "Y", "Blocks", "Add", "Data", "BlockLight",
+    "SkyLight", "Palette", "palette", "BlockStates", "block_states", "biomes", "data",
+    "Name", "Properties", "Entities", "TileEntities", "block_entities", "TileTicks",
+    "LiquidTicks", "block_ticks", "fluid_ticks", "PostProcessing", "Structures",
+    "References", "Starts", "CarvingMasks", "ToBeTicked", "i", "t", "p",
+
+    /* Entities and block entities. */
+    "id", "x", "y", "z", "Pos", "Motion", "Rotation", "FallDistance", "Fire", "Air",
+    "OnGround", "Dimension", "Invulnerable", "PortalCooldown", "UUID", "UUIDMost",
+    "UUIDLeast", "CustomName", "CustomNameVisible", "Silent", "NoGravity", "Glowing",
+    "Tags", "Passengers", "Health", "HurtTime", "HurtByTimestamp", "DeathTime",
+    "AbsorptionAmount", "Attributes", "Base", "Modifiers", "Amount", "Operation",
+    "ActiveEffects", "HandItems", "ArmorItems", "HandDropChances", "ArmorDropChances",
+    "CanPickUpLoot", "PersistenceRequired", "LeftHanded", "Age", "InLove", "Items",
+    "Slot", "Count", "Damage", "tag", "Text1", "Text2", "Text3", "Text4", "keepPacked",
+    "Lock", "LootTable", "LootTableSeed",
+
+    /* Ids. */
+    "minecraft:air", "minecraft:cave_air", "minecraft:void_air", "minecraft:stone",
+    "minecraft:granite", "minecraft:diorite", "minecraft:andesite", "minecraft:deepslate",
+    "minecraft:tuff", "minecraft:dirt", "minecraft:grass_block", "minecraft:grass",
+    "minecraft:tall_grass", "minecraft:gravel", "minecraft:sand", "minecraft:sandstone",
+    "minecraft:water", "minecraft:lava", "minecraft:bedrock", "minecraft:coal_ore",
+    "minecraft:iron_ore", "minecraft:copper_ore", "minecraft:gold_ore",
+    "minecraft:redstone_ore", "minecraft:lapis_ore", "minecraft:diamond_ore",
+    "minecraft:oak_log", "minecraft:oak_leaves", "minecraft:birch_log",
+    "minecraft:birch_leaves", "minecraft:spruce_log", "minecraft:spruce_leaves",
+    "minecraft:snow", "minecraft:ice", "minecraft:clay", "minecraft:kelp",
+    "minecraft:seagrass", "minecraft:plains", "minecraft:forest", "minecraft:ocean",
+    "minecraft:deep_ocean", "minecraft:river", "minecraft:desert", "minecraft:taiga",
+    "minecraft:chest", "minecraft:sign", "minecraft:mob_spawner", "minecraft:spawner"
+};
+
+/* FNV-1a. */
+static inline size_t hash_string(const char* s, size_t length)
+{
+    uint64_t h = UINT64_C(14695981039346656037);
+
+    for(size_t i = 0; i < length; i++)
+        h = (h ^ (unsigned char)s[i]) * UINT64_C(1099511628211);
+
+    return (size_t)h;
+}
+
+/* The slot `s' is in, or the empty one it would go in. */
+static struct intern_entry* slot_for(const nbt_intern_table* in, const char* s, size_t length, size_t hash)
+{
+    for(size_t i = hash & in->mask;; i = (i + 1) & in->mask)
+    {
+        struct intern_entry* e = &in->table[i];
+
+        if(e->s == NULL ||
+           (e->hash == hash && e->length == length && memcmp(e->s, s, length) == 0))
+            return e;
+    }
+}
+
+/* Doubles the table. Returns false if we're out of memory, and leaves it be. */
+static bool grow(nbt_intern_table* in)
+{
+    size_t size = 2 * (in->mask + 1);
+    struct intern_entry* old = in->table;
+    size_t old_size = in->mask + 1;
+
+    if((in->table = calloc(size, sizeof *in->table)) == NULL)
+        return (in->table = old), false;
+
+    in->mask = size - 1;
+
+    for(size_t i = 0; i < old_size; i++)
+        if(old[i].s)
+            *slot_for(in, old[i].s, old[i].length, old[i].hash) = old[i];
+
+    free(old);
+    return true;
+}
+
+nbt_intern_table* nbt_intern_table_new(void)
+{
+    nbt_intern_table* ret = calloc(1, sizeof *ret);
+    if(ret == NULL) return (errno = NBT_EMEM), NULL;
+
+    ret->mask    = 511;
+    ret->table   = calloc(ret->mask + 1, sizeof *ret->table);
+    ret->strings = nbt_arena_new();
+
+    if(ret->table == NULL || ret->strings == NULL)
+        goto mem_error;
+
+    for(size_t i = 0; i < sizeof well_known / sizeof well_known[0]; i++)
+        if(nbt_intern(ret, well_known[i], strlen(well_known[i])) == NULL)
+            goto mem_error;
+
+    return ret;
+
+mem_error:
+    nbt_intern_table_free(ret);
+    return (errno = NBT_EMEM), NULL;
+}
+
+void nbt_intern_table_free(nbt_intern_table* in)
+{
+    if(in == NULL) return;
+
+    free(in->table);
+    nbt_arena_free(in->strings);
+    free(in);
+}
+
+const char* nbt_intern_find(const nbt_intern_table* in, const char* s, size_t length)
+{
+    assert(in);
+    assert(s);
+
+    return slot_for(in, s, length, hash_string(s, length))->s;
+}
+
+const char* nbt_intern(nbt_intern_table* in, const char* s, size_t length)
+{
+    assert(in);
+    assert(s);
+
+    size_t hash = hash_string(s, length);
+    struct intern_entry* e = slot_for(in, s, length, hash);
+
+    if(e->s)
+        return e->s;
+
+    if(2 * (in->used + 1) > in->mask + 1)
+    {
+        if(!grow(in)) return (errno = NBT_EMEM), NULL;
+
+        e = slot_for(in, s, length, hash);
+    }
+
+    char* copy = nbt_arena_alloc(in->strings, length + 1);
+    if(copy == NULL) return (errno = NBT_EMEM), NULL;
+
+    memcpy(copy, s, length);
+    copy[length] = '\0';
+
+    e->s      = copy;
+    e->length = length;
+    e->hash   = hash;
+    in->used++;
+
+    return copy;
+}
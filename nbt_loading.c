@@ -16,6 +16,7 @@
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <zlib.h>
 
 /*
@@ -29,31 +30,6 @@
 /* The number of bytes to process at a time */
 #define CHUNK_SIZE 4096
 
-/*
- * Reads a whole file into a buffer. Returns a NULL buffer and sets errno on
- * error.
- */
-static struct buffer read_file(FILE* fp)
-{
-    struct buffer ret = BUFFER_INIT;
-
-    size_t bytes_read;
-
-    do {
-        if(buffer_reserve(&ret, ret.len + CHUNK_SIZE))
-            return (errno = NBT_EMEM), buffer_free(&ret), BUFFER_INIT;
-
-        bytes_read = fread(ret.data + ret.len, 1, CHUNK_SIZE, fp);
-        ret.len += bytes_read;
-
-        if(ferror(fp))
-            return (errno = NBT_EIO), buffer_free(&ret), BUFFER_INIT;
-
-    } while(!feof(fp));
-
-    return ret;
-}
-
 static nbt_status write_file(FILE* fp, const void* data, size_t len)
 {
     const char* cdata = data;
@@ -147,8 +123,13 @@ compression_error:
 /*
  * Reads in zlib-compressed data, and returns a buffer with the decompressed
  * data within. Returns a NULL buffer on failure, and sets errno appropriately.
+ *
+ * The first `headroom' bytes of the buffer are left alone for the caller, and
+ * are counted in its length. If `limit' isn't 0, inflating more than that
+ * fails with NBT_ELIMIT.
  */
-static struct buffer __decompress(const void* mem, size_t len)
+static struct buffer __decompress_limited(const void* mem, size_t len, size_t headroom,
+                                          size_t limit)
 {
     struct buffer ret = BUFFER_INIT;
 
@@ -172,6 +153,14 @@ static struct buffer __decompress(const void* mem, size_t len)
 
     int zlib_ret;
 
+    if(buffer_reserve(&ret, headroom))
+    {
+        errno = NBT_EMEM;
+        goto decompression_error;
+    }
+
+    ret.len = headroom;
+
     do {
         if(buffer_reserve(&ret, ret.len + CHUNK_SIZE))
         {
@@ -194,6 +183,12 @@ static struct buffer __decompress(const void* mem, size_t len)
         default:
             /* update our buffer length to reflect the new data */
             ret.len += CHUNK_SIZE - stream.avail_out;
+
+            if(limit && ret.len - headroom > limit)
+            {
+                errno = NBT_ELIMIT;
+                goto decompression_error;
+            }
         }
 
     } while(stream.avail_out == 0);
@@ -217,25 +212,141 @@ decompression_error:
     return BUFFER_INIT;
 }
 
+static struct buffer __decompress(const void* mem, size_t len, size_t headroom)
+{
+    return __decompress_limited(mem, len, headroom, 0);
+}
+
+/*
+ * Starts inflating zlib or gzip data (the same automatic header detection
+ * __decompress does), for those who only want a little at a time.
+ */
+static nbt_status inflate_begin(z_stream* stream, const void* mem, size_t len)
+{
+    memset(stream, 0, sizeof *stream); /* zalloc, zfree and opaque are Z_NULL */
+
+    stream->next_in  = (void*)mem;
+    stream->avail_in = len;
+
+    return inflateInit2(stream, 15 + 32) == Z_OK ? NBT_OK : NBT_EZ;
+}
+
 /*
- * No incremental parsing goes on. We just dump the whole compressed file into
- * memory then pass the job off to nbt_parse_chunk.
+ * Inflates at most `room' bytes into `out', and says how many it got in
+ * `produced'. `ended' is set once the stream is over.
  */
+static nbt_status inflate_some(z_stream* stream, void* out, size_t room,
+                               size_t* produced, bool* ended)
+{
+    stream->next_out  = out;
+    stream->avail_out = room;
+
+    *produced = 0;
+
+    switch(inflate(stream, Z_NO_FLUSH))
+    {
+    case Z_STREAM_END:
+        *ended = true;
+        /* fall through */
+
+    case Z_OK:
+        *produced = room - stream->avail_out;
+        return NBT_OK;
+
+    case Z_MEM_ERROR:
+        return NBT_EMEM;
+
+    default:
+        /* Corrupt, or the input stopped before the stream did. */
+        return NBT_EZ;
+    }
+}
+
+/*
+ * Streams a compressed file through a push parser until the tree is done,
+ * inflating it a CHUNK_SIZE at a time. Nothing else is kept in memory.
+ */
+static nbt_status stream_file(FILE* fp, nbt_push_parser* p)
+{
+    unsigned char in[CHUNK_SIZE];
+    unsigned char out[CHUNK_SIZE];
+
+    z_stream stream;
+    nbt_status err;
+    bool ended = false;
+
+    if((err = inflate_begin(&stream, NULL, 0)) != NBT_OK)
+        return err;
+
+    while(!ended && !nbt_push_parser_done(p))
+    {
+        if(stream.avail_in == 0)
+        {
+            size_t bytes_read = fread(in, 1, sizeof in, fp);
+
+            if(ferror(fp))
+            {
+                err = NBT_EIO;
+                break;
+            }
+
+            /* The file ended before the stream did. */
+            if(bytes_read == 0)
+            {
+                err = NBT_EZ;
+                break;
+            }
+
+            stream.next_in  = in;
+            stream.avail_in = bytes_read;
+        }
+
+        size_t produced;
+
+        if((err = inflate_some(&stream, out, sizeof out, &produced, &ended)) != NBT_OK)
+            break;
+
+        if((err = nbt_push_parser_feed(p, out, produced)) != NBT_OK)
+            break;
+    }
+
+    (void)inflateEnd(&stream);
+    return err;
+}
+
 nbt_node* nbt_parse_file(FILE* fp)
 {
     errno = NBT_OK;
 
-    struct buffer compressed = read_file(fp);
+    nbt_push_parser* p = nbt_push_parser_new();
 
-    if(compressed.data == NULL)
+    if(p == NULL)
         return NULL;
 
-    nbt_node* ret = nbt_parse_compressed(compressed.data, compressed.len);
+    nbt_status err = stream_file(fp, p);
+    nbt_node* ret  = err == NBT_OK ? nbt_push_parser_finish(p) : ((errno = err), NULL);
 
-    buffer_free(&compressed);
+    nbt_push_parser_free(p);
     return ret;
 }
 
+nbt_status nbt_parse_file_events(FILE* fp, const struct nbt_event_handler* handler, void* aux)
+{
+    nbt_push_parser* p = nbt_push_parser_new_events(handler, aux);
+
+    if(p == NULL)
+        return (nbt_status)errno;
+
+    nbt_status err = stream_file(fp, p);
+
+    /* Running out of file before the end of the tree is an error here too. */
+    if(err == NBT_OK && !nbt_push_parser_done(p))
+        err = NBT_ERR;
+
+    nbt_push_parser_free(p);
+    return err;
+}
+
 nbt_node* nbt_parse_path(const char* filename)
 {
     FILE* fp = fopen(filename, "rb");
@@ -253,17 +364,398 @@ nbt_node* nbt_parse_path(const char* filename)
 
 nbt_node* nbt_parse_compressed(const void* chunk_start, size_t length)
 {
-    struct buffer decompressed = __decompress(chunk_start, length);
+    return nbt_parse_compressed_opts(chunk_start, length, NULL);
+}
+
+nbt_node* nbt_parse_compressed_opts(const void* chunk_start, size_t length,
+                                    const struct nbt_parse_options* options)
+{
+    /* Inflating a bomb is as bad as parsing one. */
+    struct buffer decompressed = __decompress_limited(chunk_start, length, 0,
+                                                      options ? options->max_bytes : 0);
+
+    if(decompressed.data == NULL)
+        return NULL;
+
+    nbt_node* ret = nbt_parse_opts(decompressed.data, decompressed.len, options);
+
+    buffer_free(&decompressed);
+    return ret;
+}
+
+nbt_node* nbt_parse_compressed_arena(const void* chunk_start, size_t length, nbt_arena* arena)
+{
+    struct buffer decompressed = __decompress(chunk_start, length, 0);
+
+    if(decompressed.data == NULL)
+        return NULL;
+
+    nbt_node* ret = nbt_parse_arena(decompressed.data, decompressed.len, arena);
+
+    buffer_free(&decompressed);
+    return ret;
+}
+
+nbt_status nbt_parse_compressed_events(const void* chunk_start, size_t length,
+                                       const struct nbt_event_handler* handler,
+                                       void* aux)
+{
+    struct buffer decompressed = __decompress(chunk_start, length, 0);
+
+    if(decompressed.data == NULL)
+        return (nbt_status)errno;
+
+    nbt_status ret = nbt_parse_events(decompressed.data, decompressed.len, handler, aux);
+
+    buffer_free(&decompressed);
+    return ret;
+}
+
+nbt_node* nbt_parse_compressed_filtered(const void* chunk_start, size_t length,
+                                        const nbt_prefilter* f)
+{
+    struct buffer decompressed = __decompress(chunk_start, length, 0);
+
+    if(decompressed.data == NULL)
+        return NULL;
+
+    nbt_node* ret = NULL;
+
+    if(nbt_prefilter_match_tree(f, decompressed.data, decompressed.len))
+        ret = nbt_parse(decompressed.data, decompressed.len);
+    else
+        errno = NBT_OK;
+
+    buffer_free(&decompressed);
+    return ret;
+}
+
+nbt_status nbt_parse_compressed_events_filtered(const void* chunk_start, size_t length,
+                                                const nbt_prefilter* f,
+                                                const struct nbt_event_handler* handler,
+                                                void* aux)
+{
+    struct buffer decompressed = __decompress(chunk_start, length, 0);
+
+    if(decompressed.data == NULL)
+        return (nbt_status)errno;
+
+    nbt_status ret = NBT_OK;
+
+    if(nbt_prefilter_match_tree(f, decompressed.data, decompressed.len))
+        ret = nbt_parse_events(decompressed.data, decompressed.len, handler, aux);
+
+    buffer_free(&decompressed);
+    return ret;
+}
+
+nbt_status nbt_validate_compressed(const void* chunk_start, size_t length,
+                                   struct nbt_stats* stats)
+{
+    if(stats)
+        memset(stats, 0, sizeof *stats);
+
+    struct buffer decompressed = __decompress(chunk_start, length, 0);
+
+    if(decompressed.data == NULL)
+        return (nbt_status)errno;
+
+    nbt_status ret = nbt_validate(decompressed.data, decompressed.len, stats);
+
+    buffer_free(&decompressed);
+    return ret;
+}
+
+nbt_node* nbt_parse_compressed_paths(const void* chunk_start, size_t length,
+                                     const char* const* paths, size_t count)
+{
+    struct buffer decompressed = __decompress(chunk_start, length, 0);
 
     if(decompressed.data == NULL)
         return NULL;
 
-    nbt_node* ret = nbt_parse(decompressed.data, decompressed.len);
+    nbt_node* ret = nbt_parse_paths(decompressed.data, decompressed.len, paths, count);
+
+    buffer_free(&decompressed);
+    return ret;
+}
+
+nbt_status nbt_extract_compressed(const void* chunk_start, size_t length,
+                                  const char* const* paths, size_t count, nbt_node** found)
+{
+    for(size_t i = 0; i < count; i++)
+        found[i] = NULL;
+
+    z_stream stream;
+    nbt_status err;
+
+    if((err = inflate_begin(&stream, chunk_start, length)) != NBT_OK)
+        return err;
+
+    struct buffer decompressed = BUFFER_INIT;
+    bool ended = false;
+
+    /*
+     * Inflate a little, and see if that's enough. Every time it isn't, inflate
+     * as much again, so the tree is walked at most about twice over in all.
+     */
+    for(size_t target = CHUNK_SIZE; ; target *= 2)
+    {
+        while(!ended && decompressed.len < target)
+        {
+            size_t produced;
+
+            if(buffer_reserve(&decompressed, decompressed.len + CHUNK_SIZE))
+            {
+                err = NBT_EMEM;
+                goto done;
+            }
+
+            err = inflate_some(&stream, decompressed.data + decompressed.len, CHUNK_SIZE,
+                               &produced, &ended);
+
+            if(err != NBT_OK)
+                goto done;
+
+            decompressed.len += produced;
+        }
+
+        err = nbt_extract(decompressed.data, decompressed.len, paths, count, found);
+
+        /*
+         * Running off the end of what's been inflated so far looks just like a
+         * corrupt tree. It's only really corrupt if that's all there is.
+         */
+        if(err != NBT_ERR || ended)
+            break;
+    }
 
+done:
+    (void)inflateEnd(&stream);
     buffer_free(&decompressed);
+    return err;
+}
+
+/* Room for the root node in front of a borrowed tree's buffer. */
+#define ROOT_HEADROOM ((sizeof(nbt_node) + 15) & ~(size_t)15)
+
+nbt_node* nbt_parse_compressed_borrowed(const void* chunk_start, size_t length, nbt_arena* arena)
+{
+    /*
+     * Without an arena, the root node gets moved into the front of the
+     * decompressed buffer when we're done. Nothing points at the root, so
+     * that's safe, and freeing the root frees the buffer along with it.
+     */
+    size_t headroom = arena ? 0 : ROOT_HEADROOM;
+
+    struct buffer decompressed = __decompress(chunk_start, length, headroom);
+
+    if(decompressed.data == NULL)
+        return NULL;
+
+    if(arena)
+    {
+        if(nbt_arena_adopt(arena, decompressed.data))
+            return buffer_free(&decompressed), (errno = NBT_EMEM), NULL;
+
+        return nbt_parse_borrowed(decompressed.data, decompressed.len, arena);
+    }
+
+    nbt_node* ret = nbt_parse_borrowed(decompressed.data + headroom,
+                                       decompressed.len  - headroom,
+                                       NULL);
+
+    if(ret == NULL)
+        return buffer_free(&decompressed), NULL;
+
+    nbt_node* root = (nbt_node*)decompressed.data;
+
+    *root = *ret;
+    free(ret);
+
+    return root;
+}
+
+/* Lazy compounds point into the buffer, so it's kept the same way. */
+nbt_node* nbt_parse_compressed_lazy(const void* chunk_start, size_t length)
+{
+    struct buffer decompressed = __decompress(chunk_start, length, ROOT_HEADROOM);
+
+    if(decompressed.data == NULL)
+        return NULL;
+
+    nbt_node* ret = nbt_parse_lazy(decompressed.data + ROOT_HEADROOM,
+                                   decompressed.len  - ROOT_HEADROOM);
+
+    if(ret == NULL)
+        return buffer_free(&decompressed), NULL;
+
+    nbt_node* root = (nbt_node*)decompressed.data;
+
+    *root = *ret;
+    free(ret);
+
+    return root;
+}
+
+struct nbt_loader {
+    nbt_push_parser* parser;
+    nbt_status status; /* NBT_AGAIN until we're done, one way or another. */
+
+    /* Uncompressed input is fed straight from the caller's buffer... */
+    const unsigned char* in;
+    size_t in_length;
+
+    /* ...and compressed input is inflated a window at a time. */
+    bool compressed;
+    bool stream_ended;
+    z_stream stream;
+
+    unsigned char window[CHUNK_SIZE];
+    size_t window_pos;
+    size_t window_len;
+};
+
+nbt_loader* nbt_loader_new(const void* data, size_t length, bool compressed)
+{
+    nbt_loader* ret = calloc(1, sizeof *ret);
+
+    if(ret == NULL)
+        return (errno = NBT_EMEM), NULL;
+
+    if((ret->parser = nbt_push_parser_new()) == NULL)
+        return free(ret), NULL;
+
+    ret->status     = NBT_AGAIN;
+    ret->compressed = compressed;
+
+    if(!compressed)
+    {
+        ret->in        = data;
+        ret->in_length = length;
+        return ret;
+    }
+
+    if(inflate_begin(&ret->stream, data, length) != NBT_OK)
+    {
+        nbt_push_parser_free(ret->parser);
+        free(ret);
+        return (errno = NBT_EZ), NULL;
+    }
+
     return ret;
 }
 
+void nbt_loader_free(nbt_loader* l)
+{
+    if(l == NULL) return;
+
+    if(l->compressed)
+        (void)inflateEnd(&l->stream);
+
+    nbt_push_parser_free(l->parser);
+    free(l);
+}
+
+/*
+ * Inflates at most `limit' bytes into the (empty) window. There's no point
+ * inflating more than the step is allowed to parse.
+ */
+static nbt_status refill(nbt_loader* l, size_t limit)
+{
+    l->window_pos = 0;
+
+    return inflate_some(&l->stream, l->window, limit < CHUNK_SIZE ? limit : CHUNK_SIZE,
+                        &l->window_len, &l->stream_ended);
+}
+
+nbt_status nbt_loader_step(nbt_loader* l, const struct nbt_budget* budget)
+{
+    assert(l);
+
+    if(l->status != NBT_AGAIN)
+        return l->status;
+
+    size_t bytes = budget && budget->bytes ? budget->bytes : SIZE_MAX;
+    size_t nodes = budget && budget->nodes ? budget->nodes : SIZE_MAX;
+
+    while(bytes > 0 && nodes > 0)
+    {
+        const unsigned char* next;
+        size_t available;
+
+        if(l->compressed)
+        {
+            if(l->window_pos == l->window_len)
+            {
+                if(l->stream_ended)
+                    break;
+
+                nbt_status err = refill(l, bytes);
+
+                if(err != NBT_OK)
+                    return l->status = err;
+            }
+
+            next      = l->window + l->window_pos;
+            available = l->window_len - l->window_pos;
+        }
+        else
+        {
+            if(l->in_length == 0)
+                break;
+
+            next      = l->in;
+            available = l->in_length;
+        }
+
+        if(available > bytes)
+            available = bytes;
+
+        size_t used;
+        size_t before = nbt_push_parser_nodes(l->parser);
+
+        nbt_status err = nbt_push_parser_feed_some(l->parser, next, available, nodes, &used);
+
+        if(err != NBT_OK)
+            return l->status = err;
+
+        size_t built = nbt_push_parser_nodes(l->parser) - before;
+
+        nodes -= built < nodes ? built : nodes;
+        bytes -= used;
+
+        if(l->compressed)
+            l->window_pos += used;
+        else
+            l->in += used, l->in_length -= used;
+
+        /* Whatever's left over after the tree is ignored, like nbt_parse does. */
+        if(nbt_push_parser_done(l->parser))
+            return l->status = NBT_OK;
+    }
+
+    bool exhausted = l->compressed ? l->stream_ended && l->window_pos == l->window_len
+                                   : l->in_length == 0;
+
+    /* The input ran out before the tree did. */
+    if(exhausted)
+        return l->status = NBT_ERR;
+
+    return NBT_AGAIN;
+}
+
+nbt_node* nbt_loader_finish(nbt_loader* l)
+{
+    if(l->status == NBT_AGAIN)
+        return (errno = NBT_ERR), NULL;
+
+    if(l->status != NBT_OK)
+        return (errno = l->status), NULL;
+
+    return nbt_push_parser_finish(l->parser);
+}
+
 /*
  * Once again, all we're doing is handing the actual compression off to
  * nbt_dump_compressed, then dumping it into the file.
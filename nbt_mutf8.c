@@ -0,0 +1,264 @@
+/*
+ * -----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * Lukas Niederbremer <webmaster@flippeh.de> and Clark Gaebel <cg.wowus.cg@gmail.com>
+ * wrote this file. As long as you retain this notice you can do whatever you
+ * want with this stuff. If we meet some day, and you think this stuff is worth
+ * it, you can buy us a beer in return.
+ * -----------------------------------------------------------------------------
+ */
+#include "nbt.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Java writes strings in "Modified UTF-8": the same as UTF-8, except that NUL
+ * is the overlong C0 80, and anything outside the BMP is a pair of surrogates,
+ * each encoded on its own in three bytes. Nearly every string in a chunk is
+ * plain ASCII, which is the same in all three, so everything below looks at
+ * eight bytes at a time until it finds one that isn't.
+ */
+
+#define LOW_BITS  UINT64_C(0x0101010101010101)
+#define HIGH_BITS UINT64_C(0x8080808080808080)
+
+/*
+ * How many bytes at the start of `p' are ASCII, and not NUL either if
+ * `stop_at_nul' says so.
+ */
+static inline size_t ascii_run(const unsigned char* p, size_t length, bool stop_at_nul)
+{
+    size_t i = 0;
+
+    for(; i + 8 <= length; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, p + i, sizeof word);
+
+        /* (word - LOW_BITS) & ~word sets the high bit of every zero byte. */
+        if((word | (stop_at_nul ? (word - LOW_BITS) & ~word : 0)) & HIGH_BITS)
+            break;
+    }
+
+    while(i < length && p[i] < 0x80 && !(stop_at_nul && p[i] == 0x00))
+        i++;
+
+    return i;
+}
+
+static inline bool continuation(unsigned char c)
+{
+    return (c & 0xC0) == 0x80;
+}
+
+/*
+ * Decodes the multi-byte sequence at the start of `p' into `c'. Returns how
+ * long it was, or 0 if it isn't Modified UTF-8. Surrogates come back as they
+ * are; pairing them up is the caller's business.
+ */
+static inline size_t decode(const unsigned char* p, size_t length, uint32_t* c)
+{
+    if(p[0] == 0xC0)
+    {
+        /* The only overlong form allowed: NUL. */
+        if(length < 2 || p[1] != 0x80)
+            return 0;
+
+        return *c = 0, 2;
+    }
+
+    if(p[0] >= 0xC2 && p[0] <= 0xDF)
+    {
+        if(length < 2 || !continuation(p[1]))
+            return 0;
+
+        return *c = (uint32_t)(p[0] & 0x1F) << 6 | (p[1] & 0x3F), 2;
+    }
+
+    if(p[0] >= 0xE0 && p[0] <= 0xEF)
+    {
+        if(length < 3 || !continuation(p[1]) || !continuation(p[2]))
+            return 0;
+
+        *c = (uint32_t)(p[0] & 0x0F) << 12 | (uint32_t)(p[1] & 0x3F) << 6 | (p[2] & 0x3F);
+
+        return *c < 0x800 ? 0 : 3; /* Overlong. */
+    }
+
+    /* Stray continuation bytes, C1, and four-byte sequences. */
+    return 0;
+}
+
+static inline bool is_high_surrogate(uint32_t c) { return c >= 0xD800 && c <= 0xDBFF; }
+static inline bool is_low_surrogate(uint32_t c)  { return c >= 0xDC00 && c <= 0xDFFF; }
+
+bool nbt_mutf8_valid(const void* data, size_t length)
+{
+    assert(data || length == 0);
+
+    const unsigned char* p = data;
+    size_t i = 0;
+
+    while((i += ascii_run(p + i, length - i, false)) < length)
+    {
+        uint32_t c;
+        size_t n = decode(p + i, length - i, &c);
+
+        if(n == 0)
+            return false;
+
+        i += n;
+    }
+
+    return true;
+}
+
+size_t nbt_mutf8_to_utf8(char* dest, const void* src, size_t length)
+{
+    assert(dest);
+    assert(src || length == 0);
+
+    const unsigned char* p = src;
+    unsigned char* out = (unsigned char*)dest;
+    size_t i = 0, o = 0;
+
+    /*
+     * Nothing ever gets longer, so `o' never passes `i', and a string can be
+     * transcoded where it lies. Until something changes, there's nothing to
+     * move at all.
+     */
+    for(;;)
+    {
+        size_t run = ascii_run(p + i, length - i, false);
+
+        if(out + o != p + i)
+            memmove(out + o, p + i, run);
+
+        i += run, o += run;
+
+        if(i == length)
+            return o;
+
+        uint32_t c, low;
+        size_t n = decode(p + i, length - i, &c);
+
+        if(n == 0)
+            return SIZE_MAX;
+
+        if(is_high_surrogate(c) && length - i >= 6 &&
+           decode(p + i + 3, length - i - 3, &low) == 3 && is_low_surrogate(low))
+        {
+            c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+
+            out[o++] = (unsigned char)(0xF0 | c >> 18);
+            out[o++] = (unsigned char)(0x80 | (c >> 12 & 0x3F));
+            out[o++] = (unsigned char)(0x80 | (c >> 6 & 0x3F));
+            out[o++] = (unsigned char)(0x80 | (c & 0x3F));
+
+            i += 6;
+        }
+        else if(is_high_surrogate(c) || is_low_surrogate(c))
+        {
+            /* Java is happy to write half a pair. UTF-8 can't hold one. */
+            out[o++] = 0xEF;
+            out[o++] = 0xBF;
+            out[o++] = 0xBD;
+
+            i += 3;
+        }
+        else
+        {
+            /* Including C0 80, which a NUL-terminated string can't do without. */
+            memmove(out + o, p + i, n);
+
+            i += n, o += n;
+        }
+    }
+}
+
+/*
+ * If `p' starts with a well-formed four-byte UTF-8 sequence, returns its code
+ * point. Otherwise, 0.
+ */
+static inline uint32_t supplementary(const unsigned char* p, size_t length)
+{
+    if(length < 4 || p[0] < 0xF0 || p[0] > 0xF4 ||
+       !continuation(p[1]) || !continuation(p[2]) || !continuation(p[3]))
+        return 0;
+
+    uint32_t c = (uint32_t)(p[0] & 0x07) << 18 | (uint32_t)(p[1] & 0x3F) << 12 |
+                 (uint32_t)(p[2] & 0x3F) << 6  | (p[3] & 0x3F);
+
+    return c >= 0x10000 && c <= 0x10FFFF ? c : 0;
+}
+
+size_t nbt_utf8_to_mutf8_length(const void* src, size_t length)
+{
+    assert(src || length == 0);
+
+    const unsigned char* p = src;
+    size_t i = 0, ret = length;
+
+    while((i += ascii_run(p + i, length - i, true)) < length)
+    {
+        if(p[i] == 0x00)
+            ret += 1, i += 1;
+        else if(supplementary(p + i, length - i))
+            ret += 2, i += 4;
+        else
+            i += 1;
+    }
+
+    return ret;
+}
+
+size_t nbt_utf8_to_mutf8(char* dest, const void* src, size_t length)
+{
+    assert(dest);
+    assert(src || length == 0);
+
+    const unsigned char* p = src;
+    unsigned char* out = (unsigned char*)dest;
+    size_t i = 0, o = 0;
+
+    for(;;)
+    {
+        size_t run = ascii_run(p + i, length - i, true);
+
+        memcpy(out + o, p + i, run);
+        i += run, o += run;
+
+        if(i == length)
+            return o;
+
+        uint32_t c;
+
+        if(p[i] == 0x00)
+        {
+            out[o++] = 0xC0;
+            out[o++] = 0x80;
+
+            i += 1;
+        }
+        else if((c = supplementary(p + i, length - i)) != 0)
+        {
+            uint32_t units[2] = { 0xD800 + ((c - 0x10000) >> 10), 0xDC00 + (c & 0x3FF) };
+
+            for(size_t u = 0; u < 2; u++)
+            {
+                out[o++] = (unsigned char)(0xE0 | units[u] >> 12);
+                out[o++] = (unsigned char)(0x80 | (units[u] >> 6 & 0x3F));
+                out[o++] = (unsigned char)(0x80 | (units[u] & 0x3F));
+            }
+
+            i += 4;
+        }
+        else
+        {
+            /* Already fine, or not ours to fix. */
+            out[o++] = p[i++];
+        }
+    }
+}
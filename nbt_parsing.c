@@ -9,6 +9,7 @@
  */
 #include "nbt.h"
 
+#include "bswap.h"
 #include "buffer.h"
 #include "list.h"
 
@@ -19,46 +20,10 @@
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
-#ifdef __WIN32__
-#include <windows.h>
-#include <winsock.h>
-#else
-#include <netinet/in.h>
-#endif
-#define ntohll(x) ( ( (uint64_t)(ntohl( (uint32_t)((x << 32) >> 32) )) << 32) | ntohl( ((uint32_t)(x >> 32)) ) )     
-
-/* are we running on a little-endian system? */
-static inline int little_endian()
-{
-    uint16_t t = 0x0001;
-    char*    c = (char*)&t;
-    return  *c ==  0x01;
-}
-
-static inline void* swap_bytes(void* s, size_t len)
-{
-    for(char* b = s,
-            * e = b + len - 1;
-        b < e;
-        b++, e--)
-    {
-        char t = *b;
 
-        *b = *e;
-        *e = t;
-    }
-
-    return s;
-}
-
-/* big endian to native endian. works in-place */
-static inline void* be2ne(void* s, size_t len)
-{
-    return little_endian() ? swap_bytes(s, len) : s;
-}
-
-/* native endian to big endian. works the exact same as its inverse */
-#define ne2be be2ne
+#ifndef NBT_NO_THREADS
+#include <pthread.h>
+#endif
 
 /* A special form of memcpy which copies `n' bytes into `dest', then returns
  * `src' + n.
@@ -78,6 +43,13 @@ static inline const void* swapped_memscan(void* dest, const void* src, size_t n)
     return be2ne(dest, n), ret;
 }
 
+/* The same, for little endian. */
+static inline const void* le_swapped_memscan(void* dest, const void* src, size_t n)
+{
+    const void* ret = memscan(dest, src, n);
+    return le2ne(dest, n), ret;
+}
+
 #define CHECKED_MALLOC(var, n, on_error) do { \
     if((var = malloc(n)) == NULL)             \
     {                                         \
@@ -91,8 +63,141 @@ static inline const void* swapped_memscan(void* dest, const void* src, size_t n)
         return NBT_EMEM;                 \
 } while(0)
 
-/* Parses a tag, given a name (may be NULL) and a type. Fills in the payload. */
-static nbt_node* parse_unnamed_tag(nbt_type type, char* name, const char** memory, size_t* length);
+/*
+ * Everything the parser needs to know besides where it is in the input. One of
+ * these is passed down to every reader.
+ */
+struct parse_ctx {
+    nbt_arena* arena; /* If non-NULL, every allocation comes out of here. */
+    bool borrowed;    /* Point into the input instead of copying out of it. */
+    bool lazy;        /* Leave compounds unparsed. See nbt_parse_lazy. */
+    size_t max_depth; /* How deep lists and compounds may nest. */
+    size_t depth;     /* How many are open above the tag being parsed. */
+    size_t threads;   /* Parse big lists on this many threads. See nbt_parse_options. */
+    bool utf8;        /* Transcode names and strings from MUTF-8 as they're read. */
+    bool vectors;     /* Lay lists out as NBT_NODE_VECTOR. Never with an arena. */
+    bool indexes;     /* Make compounds NBT_NODE_INDEXED. Never with an arena either. */
+    bool pack;        /* Make lists of numbers NBT_NODE_PACKED. Nor this. */
+    bool compact;     /* Make nodes in lists and compounds NBT_NODE_COMPACT. Nor this. */
+
+    /* Where names and short strings come from, if anywhere. See nbt_parse_options. */
+    nbt_intern_table* intern;
+    bool intern_readonly; /* Only look them up: the table's being shared between threads. */
+
+    /* Budgets (0 for none), and what's been spent of them. See nbt_parse_options. */
+    size_t max_bytes;
+    size_t max_nodes;
+    size_t max_array_length;
+    size_t bytes;
+    size_t nodes;
+
+    /* The budget a list's runs share, and how much of what we've spent is in it. See parse_list_parallel. */
+    struct shared_budget* shared;
+    size_t shared_bytes;
+    size_t shared_nodes;
+};
+
+/*
+ * What the threads parsing a list have spent between them, on top of what had
+ * been spent before the list was split up. Each only adds its own spending to
+ * it every so often, so it's never behind by more than a step per thread.
+ */
+struct shared_budget {
+    size_t base_bytes;
+    size_t base_nodes;
+    size_t bytes;       /* Atomic. */
+    size_t nodes;       /* Atomic. */
+};
+
+#define SHARED_BYTES_STEP 65536
+#define SHARED_NODES_STEP 1024
+
+/* Adds what we've spent since last time to the shared budget, and sees if that's over it. */
+static bool charge_shared(struct parse_ctx* ctx)
+{
+    struct shared_budget* shared = ctx->shared;
+
+    size_t bytes = __atomic_add_fetch(&shared->bytes, ctx->bytes - ctx->shared_bytes, __ATOMIC_RELAXED);
+    size_t nodes = __atomic_add_fetch(&shared->nodes, ctx->nodes - ctx->shared_nodes, __ATOMIC_RELAXED);
+
+    ctx->shared_bytes = ctx->bytes;
+    ctx->shared_nodes = ctx->nodes;
+
+    if((ctx->max_bytes && shared->base_bytes + bytes > ctx->max_bytes) ||
+       (ctx->max_nodes && shared->base_nodes + nodes > ctx->max_nodes))
+        return (errno = NBT_ELIMIT), false;
+
+    return true;
+}
+
+/*
+ * Spends `bytes' and `nodes' of the budgets, before they're allocated. Returns
+ * false, with errno set to NBT_ELIMIT, if that's more than there is.
+ */
+static inline bool charge(struct parse_ctx* ctx, size_t bytes, size_t nodes)
+{
+    ctx->bytes += bytes;
+    ctx->nodes += nodes;
+
+    if((ctx->max_bytes && ctx->bytes > ctx->max_bytes) ||
+       (ctx->max_nodes && ctx->nodes > ctx->max_nodes))
+        return (errno = NBT_ELIMIT), false;
+
+    if(ctx->shared && (ctx->bytes - ctx->shared_bytes >= SHARED_BYTES_STEP ||
+                       ctx->nodes - ctx->shared_nodes >= SHARED_NODES_STEP))
+        return charge_shared(ctx);
+
+    return true;
+}
+
+/* Whether an array or list may have `elems' elements. Sets errno if not. */
+static inline bool allowed_length(struct parse_ctx* ctx, int32_t elems)
+{
+    if(ctx->max_array_length && (size_t)elems > ctx->max_array_length)
+        return (errno = NBT_ELIMIT), false;
+
+    return true;
+}
+
+/* Allocates from the arena if there is one, and with malloc otherwise. */
+static inline void* ctx_alloc(struct parse_ctx* ctx, size_t n)
+{
+    return ctx->arena ? nbt_arena_alloc(ctx->arena, n) : malloc(n);
+}
+
+/* Arena allocations are only ever released along with the arena. */
+static inline void ctx_free(struct parse_ctx* ctx, void* p)
+{
+    if(ctx->arena == NULL)
+        free(p);
+}
+
+/* Names, strings and arrays aren't ours to free when they're borrowed. */
+static inline void ctx_free_data(struct parse_ctx* ctx, void* p)
+{
+    if(!ctx->borrowed)
+        ctx_free(ctx, p);
+}
+
+static inline void ctx_free_list(struct parse_ctx* ctx, struct tag_list* list)
+{
+    if(ctx->arena == NULL)
+        nbt_free_list(list);
+}
+
+static inline void ctx_free_node(struct parse_ctx* ctx, nbt_node* node)
+{
+    if(ctx->arena == NULL)
+        nbt_free(node);
+}
+
+#define CTX_MALLOC(ctx, var, n, on_error) do { \
+    if((var = ctx_alloc((ctx), (n))) == NULL)  \
+    {                                          \
+        errno = NBT_EMEM;                      \
+        on_error;                              \
+    }                                          \
+} while(0)
 
 /*
  * Reads some bytes from the memory stream. This macro will read `n'
@@ -106,6 +211,45 @@ static nbt_node* parse_unnamed_tag(nbt_type type, char* name, const char** memor
     *length -= (n);                                     \
 } while(0)
 
+/*
+ * The size of a payload of type `type', if every payload of that type has the
+ * same size. Otherwise, 0.
+ */
+static inline size_t fixed_payload_size(nbt_type type)
+{
+    switch(type)
+    {
+    case TAG_BYTE:   return 1;
+    case TAG_SHORT:  return 2;
+    case TAG_INT:    return 4;
+    case TAG_LONG:   return 8;
+    case TAG_FLOAT:  return 4;
+    case TAG_DOUBLE: return 8;
+    default:         return 0;
+    }
+}
+
+/*
+ * The fewest bytes a payload of type `type' can take up, or 0 if it's not a
+ * type at all. A list can't have more elements than fit in what's left.
+ */
+static inline size_t min_payload_size(nbt_type type)
+{
+    switch(type)
+    {
+    case TAG_BYTE_ARRAY: case TAG_INT_ARRAY: case TAG_LONG_ARRAY:
+        return 4;          /* the length */
+    case TAG_STRING:
+        return 2;          /* the length */
+    case TAG_LIST:
+        return 5;          /* the type and the length */
+    case TAG_COMPOUND:
+        return 1;          /* the TAG_END */
+    default:
+        return fixed_payload_size(type);
+    }
+}
+
 /* printfs into the end of a buffer. Note: no null-termination! */
 static inline void bprintf(struct buffer* b, const char* restrict format, ...)
 {
@@ -127,423 +271,1753 @@ static inline void bprintf(struct buffer* b, const char* restrict format, ...)
 }
 
 /*
- * Reads a string from memory, moving the pointer and updating the length
- * appropriately. Returns NULL on failure.
+ * A borrowed string has no room for a NULL-terminator, so we slide it back over
+ * its two-byte length prefix (which has already been read) and terminate it in
+ * the byte that frees up at the end. The input has to be writable for this.
  */
-static inline char* read_string(const char** memory, size_t* length)
+static inline char* borrow_string(const char** memory, size_t* length, size_t string_length)
 {
-    int16_t string_length;
-    char* ret = NULL;
+    char* ret = (char*)*memory - sizeof(int16_t);
 
-    READ_GENERIC(&string_length, sizeof string_length, swapped_memscan, goto parse_error);
+    memmove(ret, *memory, string_length);
+    ret[string_length] = '\0';
 
-    if(string_length < 0)               goto parse_error;
-    if(*length < (size_t)string_length) goto parse_error;
+    *memory += string_length;
+    *length -= string_length;
 
-    CHECKED_MALLOC(ret, string_length + 1, goto parse_error);
+    return ret;
+}
 
-    READ_GENERIC(ret, (size_t)string_length, memscan, goto parse_error);
+/*
+ * Is the list all one type? If yes, return the type. Otherwise, return
+ * TAG_INVALID
+ */
+static inline nbt_type list_is_homogenous(struct nbt_list list)
+{
+    nbt_type type = TAG_INVALID;
+    
+    const struct list_head* pos;
+    list_for_each(pos, &list.list->entry)
+    {
+        const struct tag_list* cur = list_entry(pos, const struct tag_list, entry);
 
-    ret[string_length] = '\0'; /* don't forget to NULL-terminate ;) */
-    return ret;
+        assert(cur->data->type != TAG_INVALID);
 
-parse_error:
-    if(errno == NBT_OK)
-        errno = NBT_ERR;
+        if(cur->data->type == TAG_INVALID)
+            return TAG_INVALID;
 
-    free(ret);
-    return NULL;
+        /* if we're the first type, just set it to our current type */
+        if(type == TAG_INVALID) type = cur->data->type;
+
+        if(type != cur->data->type)
+            return TAG_INVALID;
+    }
+    
+    /* if the list was empty, use its current type */
+    if (type == TAG_INVALID) type = list.type;
+
+    return type;
 }
 
-static inline struct nbt_byte_array read_byte_array(const char** memory, size_t* length)
+/*
+ * The tree parser keeps its own stack of the lists and compounds it's in the
+ * middle of, instead of recursing into them. That way, no input can run us out
+ * of call stack, and how deep a tree may go is up to the caller.
+ */
+struct parse_frame {
+    nbt_node* node;    /* The list or compound being filled in. */
+    int32_t remaining; /* Lists only: how many elements are still to come. */
+};
+
+struct parse_stack {
+    struct parse_frame* frames;
+    size_t depth;
+    size_t capacity;
+};
+
+static bool push_frame(struct parse_stack* stack, nbt_node* node, int32_t remaining)
 {
-    struct nbt_byte_array ret;
-    ret.data = NULL;
+    if(stack->depth == stack->capacity)
+    {
+        size_t capacity = stack->capacity ? 2 * stack->capacity : 16;
+        struct parse_frame* frames = realloc(stack->frames, capacity * sizeof *frames);
 
-    READ_GENERIC(&ret.length, sizeof ret.length, swapped_memscan, goto parse_error);
+        if(frames == NULL)
+            return (errno = NBT_EMEM), false;
 
-    if(ret.length < 0) goto parse_error;
+        stack->frames   = frames;
+        stack->capacity = capacity;
+    }
 
-    CHECKED_MALLOC(ret.data, ret.length, goto parse_error);
+    stack->frames[stack->depth].node      = node;
+    stack->frames[stack->depth].remaining = remaining;
+    stack->depth++;
 
-    READ_GENERIC(ret.data, (size_t)ret.length, memscan, goto parse_error);
+    return true;
+}
 
-    return ret;
+/*
+ * Allocates a node with an empty payload, which is safe to nbt_free no matter
+ * what its type is. Returns NULL on failure, in which case `name' is still the
+ * caller's.
+ */
+static inline nbt_node* new_node(struct parse_ctx* ctx, nbt_type type, char* name)
+{
+    nbt_node* node;
 
-parse_error:
-    if(errno == NBT_OK)
-        errno = NBT_ERR;
+    CTX_MALLOC(ctx, node, sizeof *node, return NULL);
 
-    free(ret.data);
-    ret.data = NULL;
-    return ret;
+    node->type  = type;
+    node->flags = ctx->borrowed ? NBT_NODE_BORROWED : 0;
+    node->name  = name;
+    memset(&node->payload, 0, sizeof node->payload);
+
+    return node;
 }
 
-static inline struct nbt_int_array read_int_array(const char** memory, size_t* length)
+/*
+ * Allocates an NBT_NODE_COMPACT node, the same way new_node does, along with
+ * its entry and, if it's in `small', a copy of its name. Adding it to a list or
+ * compound is just linking the entry in.
+ */
+static inline nbt_node* new_compact_node(struct parse_ctx* ctx, nbt_type type, char* name, const char* small)
 {
-    struct nbt_int_array ret;
-    ret.data = NULL;
+    size_t inline_name = name && name == small ? strlen(name) + 1 : 0;
+    struct tag_compact* c;
 
-    READ_GENERIC(&ret.length, sizeof ret.length, swapped_memscan, goto parse_error);
+    CTX_MALLOC(ctx, c, sizeof *c + inline_name, return NULL);
 
-    if(ret.length < 0) goto parse_error;
+    c->entry.data = &c->node;
 
-    CHECKED_MALLOC(ret.data, 4*ret.length, goto parse_error);
+    c->node.type  = type;
+    c->node.flags = NBT_NODE_COMPACT;
+    c->node.name  = name;
+    memset(&c->node.payload, 0, sizeof c->node.payload);
 
-    READ_GENERIC(ret.data, (size_t)4*ret.length, memscan, goto parse_error);
-    // swap
-    if (little_endian()) for(int i=0; i < ret.length; i++)
-        ret.data[i] = ntohl(ret.data[i]);
+    if(inline_name)
+    {
+        memcpy(c->name, name, inline_name);
 
-    return ret;
+        c->node.flags |= NBT_NODE_INLINE_NAME;
+        c->node.name   = c->name;
+    }
 
-parse_error:
-    if(errno == NBT_OK)
+    return &c->node;
+}
+
+/* Adds a node to the end of a list or compound. */
+static inline bool append_child(struct parse_ctx* ctx, struct tag_list* children, nbt_node* child)
+{
+    struct tag_list* entry;
+
+    CTX_MALLOC(ctx, entry, sizeof *entry, return false);
+
+    entry->data = child;
+    list_add_tail(&entry->entry, &children->entry);
+
+    return true;
+}
+
+static bool skip_compound_contents(size_t levels, const char** memory, size_t* length);
+static bool skip_payload(nbt_type type, size_t levels, const char** memory, size_t* length);
+
+/* Lists with fewer elements than this aren't worth handing out to threads. */
+#define PARALLEL_MIN_ELEMENTS 4096
+
+static bool parse_list_parallel(struct parse_ctx* ctx, nbt_node* node, int32_t elems,
+                                const char** memory, size_t* length);
+
+/*
+ * Remembers where a compound's contents are, and moves past them. `levels' is
+ * how many more lists and compounds may be nested inside.
+ */
+static struct nbt_lazy_compound read_lazy_compound(size_t levels, const char** memory, size_t* length)
+{
+    struct nbt_lazy_compound ret = { (char*)*memory, 0 };
+
+    if(!skip_compound_contents(levels, memory, length))
+    {
         errno = NBT_ERR;
+        return ret;
+    }
 
-    free(ret.data);
-    ret.data = NULL;
+    ret.length = (size_t)(*memory - ret.data);
     return ret;
 }
 
-static inline struct nbt_long_array read_long_array(const char** memory, size_t* length)
+/* Java's NBT, and network NBT (which only differs at the root): big-endian. */
+#define READER(name)      name
+#define READER_SCAN       swapped_memscan
+#define READER_ARRAY16    be2ne_array16
+#define READER_ARRAY32    be2ne_array32
+#define READER_ARRAY64    be2ne_array64
+#define READER_BIG_ENDIAN 1
+#include "nbt_reader.h"
+
+/* Bedrock's: little-endian. */
+#define READER(name)      name##_le
+#define READER_SCAN       le_swapped_memscan
+#define READER_ARRAY16    le2ne_array16
+#define READER_ARRAY32    le2ne_array32
+#define READER_ARRAY64    le2ne_array64
+#define READER_BIG_ENDIAN 0
+#include "nbt_reader.h"
+
+/*
+ * A run of a big list's elements, for one thread to parse. Each run gets its
+ * own list to put them in, and they're all spliced together at the end.
+ */
+struct list_run {
+    struct parse_ctx ctx;
+    nbt_type type;
+    int32_t elems;
+    const char* start;        /* The run's elements, and nothing else. */
+    size_t length;
+    struct tag_list* children;
+    nbt_status status;
+};
+
+static void* parse_run(void* arg)
 {
-    struct nbt_long_array ret;
-    ret.data = NULL;
+    struct list_run* run = arg;
+
+    const char* mem = run->start;
+    size_t len = run->length;
+
+    errno = NBT_OK;
 
-    READ_GENERIC(&ret.length, sizeof ret.length, swapped_memscan, goto parse_error);
+    for(int32_t i = 0; i < run->elems; i++)
+    {
+        nbt_node* child = parse_unnamed_tag(&run->ctx, run->type, NULL, &mem, &len);
 
-    if(ret.length < 0) goto parse_error;
+        if(child == NULL)
+            goto parse_error;
 
-    CHECKED_MALLOC(ret.data, 8*ret.length, goto parse_error);
+        if(!append_child(&run->ctx, run->children, child))
+        {
+            nbt_free(child);
+            goto parse_error;
+        }
+    }
 
-    READ_GENERIC(ret.data, (size_t)8*ret.length, memscan, goto parse_error);
-    // swap
-    if (little_endian()) for(int i=0; i < ret.length; i++)
-        ret.data[i] = ntohll(ret.data[i]);
+    /* The prescan and the parser had better agree on where the run ends. */
+    assert(len == 0);
 
-    return ret;
+    run->status = NBT_OK;
+    return NULL;
 
 parse_error:
-    if(errno == NBT_OK)
-        errno = NBT_ERR;
-
-    free(ret.data);
-    ret.data = NULL;
-    return ret;
+    run->status = errno != NBT_OK ? (nbt_status)errno : NBT_ERR;
+    return NULL;
 }
 
 /*
- * Is the list all one type? If yes, return the type. Otherwise, return
- * TAG_INVALID
+ * Parses the elements of a big list on ctx->threads threads. A quick prescan
+ * (the same one the lazy parser does) finds where each thread's run of
+ * elements starts, then every thread parses its run into a list of its own,
+ * and the runs are spliced together in order. The tree comes out exactly as
+ * if the list had been parsed serially.
+ *
+ * `node' has its type and its (empty) list of elements already, and `ctx'
+ * counts the list itself in its depth.
  */
-static inline nbt_type list_is_homogenous(struct nbt_list list)
+static bool parse_list_parallel(struct parse_ctx* ctx, nbt_node* node, int32_t elems,
+                                const char** memory, size_t* length)
 {
-    nbt_type type = TAG_INVALID;
-    
-    const struct list_head* pos;
-    list_for_each(pos, &list.list->entry)
+    struct nbt_list* list = &node->payload.tag_list;
+
+    /* Threads share nothing but malloc: arenas and borrowed input aren't safe. */
+    assert(ctx->arena == NULL && !ctx->borrowed && !ctx->lazy);
+
+    size_t nruns = ctx->threads < 64 ? ctx->threads : 64;
+    struct list_run runs[64];
+
+    struct shared_budget shared = { ctx->bytes, ctx->nodes, 0, 0 };
+    bool budgeted = ctx->max_bytes || ctx->max_nodes;
+
+    size_t levels = ctx->max_depth - ctx->depth;
+    size_t size = fixed_payload_size(list->type);
+
+    const char* cursor = *memory;
+    size_t left = *length;
+    size_t started = 0;
+    bool ok = true;
+
+    for(size_t r = 0; r < nruns; r++)
     {
-        const struct tag_list* cur = list_entry(pos, const struct tag_list, entry);
+        struct list_run* run = &runs[r];
+
+        run->ctx         = *ctx;
+        run->ctx.threads = 1; /* one level of threads is plenty. */
+        run->ctx.intern_readonly = true;
+        run->ctx.shared       = budgeted ? &shared : NULL;
+        run->ctx.shared_bytes = ctx->bytes;
+        run->ctx.shared_nodes = ctx->nodes;
+        run->type        = list->type;
+        run->elems       = (int32_t)((size_t)elems * (r + 1) / nruns - (size_t)elems * r / nruns);
+        run->start       = cursor;
+        run->status      = NBT_OK;
+
+        /* Fixed-size elements can be counted off, anything else has to be skipped over. */
+        if(size)
+        {
+            if((size_t)run->elems > left / size)
+                ok = false;
+            else
+                cursor += size * (size_t)run->elems, left -= size * (size_t)run->elems;
+        }
+        else
+        {
+            for(int32_t i = 0; ok && i < run->elems; i++)
+                ok = skip_payload(run->type, levels, &cursor, &left);
+        }
 
-        assert(cur->data->type != TAG_INVALID);
+        run->length = (size_t)(cursor - run->start);
 
-        if(cur->data->type == TAG_INVALID)
-            return TAG_INVALID;
+        if(!ok || (run->children = malloc(sizeof *run->children)) == NULL)
+        {
+            if(ok) errno = NBT_EMEM;
+            break;
+        }
 
-        /* if we're the first type, just set it to our current type */
-        if(type == TAG_INVALID) type = cur->data->type;
+        run->children->data = NULL;
+        INIT_LIST_HEAD(&run->children->entry);
+        started++;
+    }
+
+    if(started == nruns)
+    {
+#ifndef NBT_NO_THREADS
+        pthread_t threads[64];
+        bool spawned[64] = { false };
+
+        /* This thread takes the first run. If a thread can't be had, it takes that run too. */
+        for(size_t r = 1; r < nruns; r++)
+            spawned[r] = pthread_create(&threads[r], NULL, parse_run, &runs[r]) == 0;
+
+        parse_run(&runs[0]);
+
+        for(size_t r = 1; r < nruns; r++)
+        {
+            if(spawned[r])
+                pthread_join(threads[r], NULL);
+            else
+                parse_run(&runs[r]);
+        }
+#else
+        for(size_t r = 0; r < nruns; r++)
+            parse_run(&runs[r]);
+#endif
+
+        for(size_t r = 0; r < nruns; r++)
+            if(runs[r].status != NBT_OK)
+            {
+                errno = runs[r].status;
+                ok = false;
+                break;
+            }
+
+        /*
+         * Each run started out with what the list had spent, and shared the
+         * rest of the budget with the others a step at a time. Whatever they
+         * spent since their last step is only counted now, all together.
+         */
+        if(ok)
+        {
+            size_t bytes = 0, nodes = 0;
+
+            for(size_t r = 0; r < nruns; r++)
+            {
+                bytes += runs[r].ctx.bytes - ctx->bytes;
+                nodes += runs[r].ctx.nodes - ctx->nodes;
+            }
+
+            ok = charge(ctx, bytes, nodes);
+        }
+    }
+    else
+    {
+        ok = false;
+    }
+
+    /* A vector has room for every element already. Only its entries need filling in. */
+    if(ok && (node->flags & NBT_NODE_VECTOR))
+        for(size_t r = 0; r < nruns; r++)
+        {
+            struct list_head* pos;
+
+            list_for_each(pos, &runs[r].children->entry)
+            {
+                struct tag_list* entry = list_entry(pos, struct tag_list, entry);
+
+                if(nbt_list_append(node, entry->data) == NBT_OK)
+                    entry->data = NULL;
+                else
+                    ok = false; /* can't happen, but the list still has to be freeable. */
+            }
+        }
+
+    /* Splice the runs in back to front, each onto the front of the list, so they end up in order. */
+    for(size_t r = started; r-- > 0;)
+    {
+        if(ok && !(node->flags & NBT_NODE_VECTOR))
+            list_splice_head(&runs[r].children->entry, &list->list->entry);
+
+        nbt_free_list(runs[r].children);
+    }
+
+    if(!ok)
+    {
+        if(errno == NBT_OK)
+            errno = NBT_ERR;
+
+        return false;
+    }
+
+    *memory = cursor;
+    *length = left;
+
+    return true;
+}
+
+
+nbt_node* nbt_parse(const void* mem, size_t len)
+{
+    return nbt_parse_opts(mem, len, NULL);
+}
+
+nbt_node* nbt_parse_opts(const void* mem, size_t len, const struct nbt_parse_options* options)
+{
+    struct parse_ctx ctx = { .arena = NULL, .borrowed = false, .max_depth = NBT_DEFAULT_MAX_DEPTH };
+
+    if(options && options->max_depth)
+        ctx.max_depth = options->max_depth;
+
+    if(options)
+    {
+        ctx.threads = options->threads;
+        ctx.utf8    = options->utf8;
+        ctx.vectors = options->vector_lists;
+        ctx.indexes = options->index_compounds;
+        ctx.pack    = options->pack_lists;
+        ctx.compact = options->compact_nodes;
+        ctx.intern  = options->intern;
+
+        ctx.max_bytes        = options->max_bytes;
+        ctx.max_nodes        = options->max_nodes;
+        ctx.max_array_length = options->max_array_length;
+    }
+
+    nbt_node* ret;
+
+    switch(options ? options->format : NBT_JAVA)
+    {
+    case NBT_JAVA:          ret = parse_root(&ctx, mem, len, true);    break;
+    case NBT_NETWORK:       ret = parse_root(&ctx, mem, len, false);   break;
+    case NBT_LITTLE_ENDIAN: ret = parse_root_le(&ctx, mem, len, true); break;
+    default:                return (errno = NBT_ERR), NULL;
+    }
+
+    if(ret && options && options->encode_arrays)
+    {
+        nbt_status err = nbt_encode_arrays(ret, options->array_pool);
+
+        if(err != NBT_OK)
+        {
+            nbt_free(ret);
+            return (errno = err), NULL;
+        }
+    }
+
+    return ret;
+}
+
+nbt_node* nbt_parse_arena(const void* mem, size_t len, nbt_arena* arena)
+{
+    assert(arena);
+
+    struct parse_ctx ctx = { .arena = arena, .borrowed = false, .max_depth = NBT_DEFAULT_MAX_DEPTH };
+
+    return parse_root(&ctx, mem, len, true);
+}
+
+nbt_node* nbt_parse_borrowed(void* mem, size_t len, nbt_arena* arena)
+{
+    struct parse_ctx ctx = { .arena = arena, .borrowed = true, .max_depth = NBT_DEFAULT_MAX_DEPTH };
+
+    return parse_root(&ctx, mem, len, true);
+}
+
+nbt_node* nbt_parse_lazy(void* mem, size_t len)
+{
+    struct parse_ctx ctx = { .arena = NULL, .borrowed = true, .lazy = true, .max_depth = NBT_DEFAULT_MAX_DEPTH };
+
+    return parse_root(&ctx, mem, len, true);
+}
+
+nbt_status nbt_materialize(nbt_node* node)
+{
+    assert(node);
+
+    if(!(node->flags & NBT_NODE_LAZY))
+        return NBT_OK;
+
+    /* Its contents were already checked for depth when they were skipped. */
+    struct parse_ctx ctx = {
+        .arena     = NULL,
+        .borrowed  = (node->flags & NBT_NODE_BORROWED) != 0,
+        .lazy      = true,
+        .max_depth = SIZE_MAX
+    };
+
+    const char* mem = node->payload.tag_lazy.data;
+    size_t len = node->payload.tag_lazy.length;
+
+    errno = NBT_OK;
+
+    /* Fill in a stand-in, so that `node' is still lazy if we fail. */
+    nbt_node compound = { .type = TAG_COMPOUND };
+    struct parse_stack stack = { NULL, 0, 0 };
+
+    CTX_MALLOC(&ctx, compound.payload.tag_compound, sizeof(struct tag_list), return NBT_EMEM);
+
+    compound.payload.tag_compound->data = NULL;
+    INIT_LIST_HEAD(&compound.payload.tag_compound->entry);
+
+    bool ok = push_frame(&stack, &compound, 0)
+           && parse_children(&ctx, &stack, &mem, &len);
+
+    free(stack.frames);
+
+    if(!ok)
+        return nbt_free_list(compound.payload.tag_compound), (nbt_status)errno;
+
+    node->flags &= ~(unsigned)NBT_NODE_LAZY;
+    node->payload.tag_compound = compound.payload.tag_compound;
+
+    return NBT_OK;
+}
+
+/* Moves past `n' bytes, if there are that many left. */
+#define SKIP_GENERIC(n, on_failure) do { \
+    if(*length < (n)) { on_failure; }    \
+    *memory += (n);                      \
+    *length -= (n);                      \
+} while(0)
+
+/*
+ * Moves past a payload that has no tags inside it. Returns false if it's
+ * corrupt, runs off the end, or is a list or compound after all.
+ */
+static bool skip_flat_payload(nbt_type type, const char** memory, size_t* length)
+{
+    size_t size = fixed_payload_size(type);
+
+    if(size)
+    {
+        SKIP_GENERIC(size, return false);
+        return true;
+    }
+
+    switch(type)
+    {
+    case TAG_STRING:
+    {
+        uint16_t string_length;
+        READ_GENERIC(&string_length, sizeof string_length, swapped_memscan, return false);
+
+        /* read_string refuses anything that would be negative as an int16_t. */
+        if(string_length > 32767) return false;
+
+        SKIP_GENERIC(string_length, return false);
+        return true;
+    }
+    case TAG_BYTE_ARRAY:
+    case TAG_INT_ARRAY:
+    case TAG_LONG_ARRAY:
+    {
+        int32_t elems;
+        READ_GENERIC(&elems, sizeof elems, swapped_memscan, return false);
+
+        if(elems < 0) return false;
+
+        size_t elem_size = type == TAG_BYTE_ARRAY ? 1 : type == TAG_INT_ARRAY ? 4 : 8;
+        if((size_t)elems > *length / elem_size) return false;
+
+        SKIP_GENERIC(elem_size * (size_t)elems, return false);
+        return true;
+    }
+    default:
+        return false; /* Unknown tag, TAG_End, or a list or compound. */
+    }
+}
+
+/* A list or compound being skipped over. */
+struct skip_frame {
+    bool compound;
+    nbt_type elem_type; /* Lists only. */
+    int32_t remaining;  /* Lists only: elements still to skip. */
+};
+
+/*
+ * Skips the contents of a list or compound whose header has been read: a
+ * compound's up to and including its TAG_End, or a list's `elems' elements
+ * of `elem_type'. `levels' is how many more lists and compounds may be nested
+ * inside. Like the parser, it keeps its own stack instead of recursing, so
+ * any depth `levels' allows is fine.
+ */
+static bool skip_contents(bool compound, nbt_type elem_type, int32_t elems, size_t levels,
+                          const char** memory, size_t* length)
+{
+    /* Only really deep trees need more than this. */
+    struct skip_frame shallow[32];
+    struct skip_frame* stack = shallow;
+    size_t depth = 1, capacity = sizeof shallow / sizeof *shallow;
+
+    stack[0] = (struct skip_frame){ compound, elem_type, elems };
+
+    while(depth > 0)
+    {
+        struct skip_frame* top = &stack[depth - 1];
+        nbt_type type;
+
+        if(top->compound)
+        {
+            uint8_t t;
+            uint16_t name_length;
+
+            READ_GENERIC(&t, sizeof t, memscan, goto skip_error);
+
+            if(t == 0)
+            {
+                depth--;
+                continue;
+            }
+
+            READ_GENERIC(&name_length, sizeof name_length, swapped_memscan, goto skip_error);
+            SKIP_GENERIC(name_length, goto skip_error);
+
+            type = (nbt_type)t;
+        }
+        else
+        {
+            if(top->remaining <= 0)
+            {
+                depth--;
+                continue;
+            }
+
+            top->remaining--;
+            type = top->elem_type;
+        }
+
+        if(type != TAG_LIST && type != TAG_COMPOUND)
+        {
+            if(!skip_flat_payload(type, memory, length)) goto skip_error;
+            continue;
+        }
+
+        struct skip_frame next = { type == TAG_COMPOUND, TAG_INVALID, 0 };
+
+        if(type == TAG_LIST)
+        {
+            uint8_t t;
+
+            READ_GENERIC(&t, sizeof t, memscan, goto skip_error);
+            READ_GENERIC(&next.remaining, sizeof next.remaining, swapped_memscan, goto skip_error);
+
+            next.elem_type = (nbt_type)t;
+
+            if(next.remaining > 0 && next.elem_type == TAG_INVALID) goto skip_error;
+        }
+
+        if(depth > levels) goto skip_error;
+
+        /* Lists of numbers are skipped in one go. */
+        size_t size = fixed_payload_size(next.elem_type);
+
+        if(!next.compound && size)
+        {
+            if(next.remaining > 0)
+            {
+                if((size_t)next.remaining > *length / size) goto skip_error;
+                SKIP_GENERIC(size * (size_t)next.remaining, goto skip_error);
+            }
+
+            continue;
+        }
+
+        if(depth == capacity)
+        {
+            struct skip_frame* frames = realloc(stack == shallow ? NULL : stack, 2 * capacity * sizeof *frames);
+            if(frames == NULL) goto skip_error;
+
+            if(stack == shallow)
+                memcpy(frames, shallow, sizeof shallow);
+
+            stack     = frames;
+            capacity *= 2;
+        }
+
+        stack[depth++] = next;
+    }
+
+    if(stack != shallow) free(stack);
+    return true;
+
+skip_error:
+    if(stack != shallow) free(stack);
+    return false;
+}
+
+/*
+ * Skips a list's elements, once its header has been read. Like everywhere else
+ * in here, `levels' is how many more lists and compounds may be nested inside.
+ */
+static bool skip_list_elements(nbt_type type, int32_t elems, size_t levels, const char** memory, size_t* length)
+{
+    if(elems <= 0) return true;
+
+    size_t size = fixed_payload_size(type);
+
+    if(size)
+    {
+        if((size_t)elems > *length / size) return false;
+
+        SKIP_GENERIC(size * (size_t)elems, return false);
+        return true;
+    }
+
+    return skip_contents(false, type, elems, levels, memory, length);
+}
+
+/* Skips over the contents of a compound, up to and including its TAG_End. */
+static bool skip_compound_contents(size_t levels, const char** memory, size_t* length)
+{
+    return skip_contents(true, TAG_INVALID, 0, levels, memory, length);
+}
+
+/*
+ * Moves past a payload of type `type' without looking at it any more than it
+ * has to. Returns false if the payload is corrupt or runs off the end.
+ */
+static bool skip_payload(nbt_type type, size_t levels, const char** memory, size_t* length)
+{
+    switch(type)
+    {
+    case TAG_LIST:
+    {
+        uint8_t elem_type;
+        int32_t elems;
+
+        READ_GENERIC(&elem_type, sizeof elem_type, memscan, return false);
+        READ_GENERIC(&elems, sizeof elems, swapped_memscan, return false);
+
+        if(elems > 0 && elem_type == TAG_INVALID) return false;
+        if(levels == 0) return false;
+
+        return skip_list_elements((nbt_type)elem_type, elems, levels - 1, memory, length);
+    }
+    case TAG_COMPOUND:
+        if(levels == 0) return false;
+
+        return skip_compound_contents(levels - 1, memory, length);
+
+    default:
+        return skip_flat_payload(type, memory, length);
+    }
+}
+
+/* Everything the event parser carries around with it. */
+struct event_ctx {
+    const struct nbt_event_handler* handler;
+    void* aux;
+    bool stopped; /* A callback said NBT_EVENT_STOP. */
+};
+
+#define CALL_HANDLER(ctx, callback, ev) \
+    ((ctx)->handler->callback ? (ctx)->handler->callback((ev), (ctx)->aux) : NBT_EVENT_CONTINUE)
+
+static nbt_status walk_payload(struct event_ctx* ctx, struct nbt_event* ev, const char** memory, size_t* length);
+
+static nbt_status walk_list(struct event_ctx* ctx, struct nbt_event* ev, const char** memory, size_t* length)
+{
+    uint8_t type;
+    int32_t elems;
+
+    if(ev->depth >= NBT_DEFAULT_MAX_DEPTH) return NBT_ERR;
+
+    READ_GENERIC(&type,  sizeof type,  memscan,         return NBT_ERR);
+    READ_GENERIC(&elems, sizeof elems, swapped_memscan, return NBT_ERR);
+
+    if(elems > 0 && type == TAG_INVALID) return NBT_ERR;
+
+    ev->payload.tag_list.type   = (nbt_type)type;
+    ev->payload.tag_list.length = elems;
+
+    nbt_event_action action = CALL_HANDLER(ctx, list_begin, ev);
+
+    if(action == NBT_EVENT_STOP)
+        return ctx->stopped = true, NBT_OK;
+
+    if(action == NBT_EVENT_SKIP)
+        return skip_list_elements((nbt_type)type, elems, NBT_DEFAULT_MAX_DEPTH - ev->depth - 1, memory, length)
+            ? NBT_OK : NBT_ERR;
+
+    for(int32_t i = 0; i < elems; i++)
+    {
+        struct nbt_event child = {
+            .type        = (nbt_type)type,
+            .name        = NULL,
+            .name_length = 0,
+            .depth       = ev->depth + 1
+        };
+
+        nbt_status err = walk_payload(ctx, &child, memory, length);
+
+        if(err != NBT_OK || ctx->stopped)
+            return err;
+    }
+
+    if(CALL_HANDLER(ctx, list_end, ev) == NBT_EVENT_STOP)
+        ctx->stopped = true;
+
+    return NBT_OK;
+}
+
+static nbt_status walk_compound(struct event_ctx* ctx, struct nbt_event* ev, const char** memory, size_t* length)
+{
+    if(ev->depth >= NBT_DEFAULT_MAX_DEPTH) return NBT_ERR;
+
+    nbt_event_action action = CALL_HANDLER(ctx, compound_begin, ev);
+
+    if(action == NBT_EVENT_STOP)
+        return ctx->stopped = true, NBT_OK;
+
+    if(action == NBT_EVENT_SKIP)
+        return skip_compound_contents(NBT_DEFAULT_MAX_DEPTH - ev->depth - 1, memory, length)
+            ? NBT_OK : NBT_ERR;
+
+    for(;;)
+    {
+        uint8_t type;
+        uint16_t name_length;
+
+        READ_GENERIC(&type, sizeof type, memscan, return NBT_ERR);
+
+        if(type == 0) break;
+
+        READ_GENERIC(&name_length, sizeof name_length, swapped_memscan, return NBT_ERR);
+
+        if(name_length > 32767 || *length < name_length) return NBT_ERR;
+
+        struct nbt_event child = {
+            .type        = (nbt_type)type,
+            .name        = *memory,
+            .name_length = name_length,
+            .depth       = ev->depth + 1
+        };
+
+        *memory += name_length;
+        *length -= name_length;
+
+        nbt_status err = walk_payload(ctx, &child, memory, length);
+
+        if(err != NBT_OK || ctx->stopped)
+            return err;
+    }
+
+    if(CALL_HANDLER(ctx, compound_end, ev) == NBT_EVENT_STOP)
+        ctx->stopped = true;
+
+    return NBT_OK;
+}
+
+/* Decodes the payload described by `ev', and sends out the events for it. */
+static nbt_status walk_payload(struct event_ctx* ctx, struct nbt_event* ev, const char** memory, size_t* length)
+{
+#define COPY_INTO_EVENT(payload_name) \
+    READ_GENERIC(&ev->payload.payload_name, sizeof ev->payload.payload_name, swapped_memscan, return NBT_ERR);
+
+    switch(ev->type)
+    {
+    case TAG_BYTE:   COPY_INTO_EVENT(tag_byte);   break;
+    case TAG_SHORT:  COPY_INTO_EVENT(tag_short);  break;
+    case TAG_INT:    COPY_INTO_EVENT(tag_int);    break;
+    case TAG_LONG:   COPY_INTO_EVENT(tag_long);   break;
+    case TAG_FLOAT:  COPY_INTO_EVENT(tag_float);  break;
+    case TAG_DOUBLE: COPY_INTO_EVENT(tag_double); break;
+
+    case TAG_STRING:
+    {
+        int16_t string_length;
+        READ_GENERIC(&string_length, sizeof string_length, swapped_memscan, return NBT_ERR);
+
+        if(string_length < 0 || *length < (size_t)string_length) return NBT_ERR;
+
+        ev->payload.tag_string.data   = *memory;
+        ev->payload.tag_string.length = (size_t)string_length;
+
+        *memory += string_length;
+        *length -= string_length;
+        break;
+    }
+    case TAG_BYTE_ARRAY:
+    case TAG_INT_ARRAY:
+    case TAG_LONG_ARRAY:
+    {
+        int32_t elems;
+        READ_GENERIC(&elems, sizeof elems, swapped_memscan, return NBT_ERR);
+
+        size_t elem_size = ev->type == TAG_BYTE_ARRAY ? 1 : ev->type == TAG_INT_ARRAY ? 4 : 8;
+
+        if(elems < 0 || (size_t)elems > *length / elem_size) return NBT_ERR;
+
+        ev->payload.tag_array.data   = *memory;
+        ev->payload.tag_array.length = elems;
+
+        *memory += elem_size * (size_t)elems;
+        *length -= elem_size * (size_t)elems;
+        break;
+    }
+    case TAG_LIST:
+        return walk_list(ctx, ev, memory, length);
+    case TAG_COMPOUND:
+        return walk_compound(ctx, ev, memory, length);
+
+    default:
+        return NBT_ERR; /* Unknown node or TAG_END. */
+    }
+
+#undef COPY_INTO_EVENT
+
+    if(CALL_HANDLER(ctx, value, ev) == NBT_EVENT_STOP)
+        ctx->stopped = true;
+
+    return NBT_OK;
+}
+
+nbt_status nbt_parse_events(const void* mem, size_t len,
+                            const struct nbt_event_handler* handler, void* aux)
+{
+    assert(handler);
+
+    const char** memory = (const char**)&mem;
+    size_t* length = &len;
+
+    struct event_ctx ctx = {
+        .handler = handler,
+        .aux     = aux,
+        .stopped = false
+    };
+
+    uint8_t type;
+    int16_t name_length;
+
+    READ_GENERIC(&type, sizeof type, memscan, return NBT_ERR);
+    READ_GENERIC(&name_length, sizeof name_length, swapped_memscan, return NBT_ERR);
+
+    if(name_length < 0 || *length < (size_t)name_length) return NBT_ERR;
+
+    struct nbt_event root = {
+        .type        = (nbt_type)type,
+        .name        = *memory,
+        .name_length = (size_t)name_length,
+        .depth       = 0
+    };
+
+    *memory += name_length;
+    *length -= name_length;
+
+    return walk_payload(&ctx, &root, memory, length);
+}
+
+#undef CALL_HANDLER
+
+/*
+ * A list or compound nbt_validate is inside of. The depth limit means a fixed
+ * number of these is all it ever needs.
+ */
+struct validate_frame {
+    const char* type_at; /* Lists only: where the element type is, for errors. */
+    int32_t remaining;   /* Lists only: elements still to come. */
+    uint8_t type;        /* Lists only: the type of the elements. */
+    bool is_list;
+};
+
+nbt_status nbt_validate(const void* mem, size_t len, struct nbt_stats* stats)
+{
+    struct nbt_stats ignored;
+
+    if(stats == NULL)
+        stats = &ignored;
+
+    memset(stats, 0, sizeof *stats);
+
+    const char* start = mem;
+    const char** memory = (const char**)&mem;
+    size_t* length = &len;
+
+    struct validate_frame stack[NBT_DEFAULT_MAX_DEPTH];
+    size_t depth = 0;
+
+    const char* tag;     /* Where the current tag starts, type and name included. */
+    const char* type_at; /* Where its type is. */
+    const char* field;   /* Whatever we're reading right now. */
+
+    uint8_t type;
+    int16_t name_length;
+
+    tag = type_at = field = *memory;
+    READ_GENERIC(&type, sizeof type, memscan, goto parse_error);
+
+    field = *memory;
+    READ_GENERIC(&name_length, sizeof name_length, swapped_memscan, goto parse_error);
+
+    if(name_length < 0) goto parse_error;
+    SKIP_GENERIC((size_t)name_length, goto parse_error);
+
+    for(;;)
+    {
+        field = *memory;
+
+        size_t size = fixed_payload_size((nbt_type)type);
+
+        if(size)
+        {
+            SKIP_GENERIC(size, goto parse_error);
+        }
+        else switch(type)
+        {
+        case TAG_STRING:
+        {
+            int16_t string_length;
+            READ_GENERIC(&string_length, sizeof string_length, swapped_memscan, goto parse_error);
+
+            if(string_length < 0) goto parse_error;
+            SKIP_GENERIC((size_t)string_length, goto parse_error);
+            break;
+        }
+        case TAG_BYTE_ARRAY:
+        case TAG_INT_ARRAY:
+        case TAG_LONG_ARRAY:
+        {
+            int32_t elems;
+            READ_GENERIC(&elems, sizeof elems, swapped_memscan, goto parse_error);
+
+            size_t elem_size = type == TAG_BYTE_ARRAY ? 1 : type == TAG_INT_ARRAY ? 4 : 8;
+
+            if(elems < 0 || (size_t)elems > *length / elem_size) goto parse_error;
+            SKIP_GENERIC(elem_size * (size_t)elems, goto parse_error);
+            break;
+        }
+        case TAG_LIST:
+        case TAG_COMPOUND:
+        {
+            if(depth == NBT_DEFAULT_MAX_DEPTH) goto parse_error;
+
+            struct validate_frame* frame = &stack[depth];
+
+            frame->is_list   = type == TAG_LIST;
+            frame->remaining = 0;
+
+            if(frame->is_list)
+            {
+                int32_t elems;
+
+                frame->type_at = *memory;
+                READ_GENERIC(&frame->type, sizeof frame->type, memscan, goto parse_error);
+
+                field = *memory;
+                READ_GENERIC(&elems, sizeof elems, swapped_memscan, goto parse_error);
+
+                if(elems > 0 && frame->type == TAG_INVALID)
+                {
+                    field = frame->type_at;
+                    goto parse_error;
+                }
+
+                frame->remaining = elems > 0 ? elems : 0;
+            }
+
+            if(++depth > stats->max_depth)
+                stats->max_depth = depth;
+
+            break;
+        }
+
+        default: /* Unknown tag or TAG_End. */
+            field = type_at;
+            goto parse_error;
+        }
+
+        stats->nodes++;
+        stats->bytes[type] += (size_t)(*memory - tag);
+
+        /* On to the next tag, closing whatever lists and compounds are done. */
+        for(;;)
+        {
+            if(depth == 0)
+                return NBT_OK;
+
+            struct validate_frame* top = &stack[depth - 1];
+
+            if(top->is_list)
+            {
+                if(top->remaining == 0)
+                {
+                    depth--;
+                    continue;
+                }
+
+                top->remaining--;
+
+                tag     = *memory;
+                type    = top->type;
+                type_at = top->type_at;
+                break;
+            }
+
+            tag = type_at = field = *memory;
+            READ_GENERIC(&type, sizeof type, memscan, goto parse_error);
+
+            if(type == 0) /* TAG_End */
+            {
+                stats->bytes[TAG_INVALID]++;
+                depth--;
+                continue;
+            }
+
+            field = *memory;
+            READ_GENERIC(&name_length, sizeof name_length, swapped_memscan, goto parse_error);
+
+            if(name_length < 0) goto parse_error;
+            SKIP_GENERIC((size_t)name_length, goto parse_error);
+            break;
+        }
+    }
+
+parse_error:
+    stats->error_offset = (size_t)(field - start);
+    return NBT_ERR;
+}
+
+/*
+ * Projected parsing walks the requested paths down the tree in lockstep with
+ * the parser. At every level, each path that's still in play is a pointer to
+ * its next component. Anything no path goes through is skipped by length,
+ * without allocating.
+ */
+
+enum path_match {
+    PATH_NONE,    /* No path goes through here. */
+    PATH_THROUGH, /* Some paths carry on below here. */
+    PATH_WHOLE    /* A path ends here, so we want all of it. */
+};
+
+/*
+ * Matches a node's name (NULL for list elements, just like nbt_find_by_path
+ * sees them) against the next component of each path in `in'. The rest of
+ * every path that carries on below the node is put in `out'.
+ */
+static enum path_match match_paths(const char* name, size_t name_length,
+                                   const char* const* in, size_t n,
+                                   const char** out, size_t* out_n)
+{
+    enum path_match ret = PATH_NONE;
+    *out_n = 0;
+
+    for(size_t i = 0; i < n; i++)
+    {
+        const char* component = in[i];
+        const char* dot = strchr(component, '.');
+        size_t e = dot ? (size_t)(dot - component) : strlen(component);
+
+        if(e != name_length || (e && memcmp(component, name, e) != 0))
+            continue;
+
+        if(dot == NULL)
+            return PATH_WHOLE;
+
+        out[(*out_n)++] = dot + 1;
+        ret = PATH_THROUGH;
+    }
+
+    return ret;
+}
+
+static bool is_container(nbt_type type)
+{
+    return type == TAG_LIST || type == TAG_COMPOUND;
+}
+
+static nbt_node* parse_projected(struct parse_ctx* ctx, nbt_type type, char* name,
+                                 const char* const* paths, size_t n, bool keep_empty,
+                                 const char** memory, size_t* length);
+
+/* Parses the child of a projected list or compound that `m' says we want. */
+static nbt_node* parse_selected(struct parse_ctx* ctx, enum path_match m, nbt_type type, char* name,
+                                const char* const* next, size_t next_n,
+                                const char** memory, size_t* length)
+{
+    if(m == PATH_WHOLE)
+        return parse_unnamed_tag(ctx, type, name, memory, length);
+
+    return parse_projected(ctx, type, name, next, next_n, false, memory, length);
+}
+
+/*
+ * Parses a list or compound, keeping only what lies along or under `paths'.
+ * Returns NULL with errno set to NBT_OK if nothing in it was wanted, unless
+ * `keep_empty' is set. Like parse_unnamed_tag, `name' is only ours to keep if
+ * we succeed.
+ */
+static nbt_node* parse_projected(struct parse_ctx* ctx, nbt_type type, char* name,
+                                 const char* const* paths, size_t n, bool keep_empty,
+                                 const char** memory, size_t* length)
+{
+    assert(is_container(type));
+
+    nbt_node* node = NULL;
+    struct tag_list* children;
+    nbt_type elem_type = TAG_INVALID;
+
+    if(ctx->depth >= ctx->max_depth)
+        return (errno = NBT_ERR), NULL;
+
+    CTX_MALLOC(ctx, children, sizeof *children, return NULL);
+
+    /* From here on, we're one level further down. */
+    ctx->depth++;
+
+    children->data = NULL;
+    INIT_LIST_HEAD(&children->entry);
+
+    const char* next[n ? n : 1];
+    size_t next_n;
+
+    if(type == TAG_LIST)
+    {
+        uint8_t t;
+        int32_t elems;
+
+        READ_GENERIC(&t,     sizeof t,     memscan,         goto parse_error);
+        READ_GENERIC(&elems, sizeof elems, swapped_memscan, goto parse_error);
+
+        elem_type = (nbt_type)t;
+
+        if(elems > 0 && elem_type == TAG_INVALID) goto parse_error;
+
+        /* Every element has the same (lack of a) name, so they all match alike. */
+        enum path_match m = match_paths("", 0, paths, n, next, &next_n);
+
+        if(m == PATH_THROUGH && !is_container(elem_type))
+            m = PATH_NONE;
+
+        if(m == PATH_NONE)
+        {
+            if(!skip_list_elements(elem_type, elems, ctx->max_depth - ctx->depth, memory, length))
+                goto parse_error;
+
+            elems = 0;
+        }
+
+        for(int32_t i = 0; i < elems; i++)
+        {
+            struct tag_list* entry;
+            nbt_node* child = parse_selected(ctx, m, elem_type, NULL, next, next_n, memory, length);
+
+            if(child == NULL)
+            {
+                if(errno != NBT_OK) goto parse_error;
+                continue;
+            }
+
+            CTX_MALLOC(ctx, entry, sizeof *entry,
+                ctx_free_node(ctx, child);
+                goto parse_error;
+            );
+
+            entry->data = child;
+            list_add_tail(&entry->entry, &children->entry);
+        }
+
+        if(elem_type == TAG_INVALID)
+            elem_type = TAG_COMPOUND; /* the same default parse_unnamed_tag uses. */
+    }
+    else
+    {
+        for(;;)
+        {
+            uint8_t t;
+            uint16_t name_length;
+
+            READ_GENERIC(&t, sizeof t, memscan, goto parse_error);
+
+            if(t == 0) break; /* TAG_End */
+
+            READ_GENERIC(&name_length, sizeof name_length, swapped_memscan, goto parse_error);
+
+            if(name_length > 32767 || *length < name_length) goto parse_error;
+
+            const char* child_name = *memory;
+
+            *memory += name_length;
+            *length -= name_length;
+
+            enum path_match m = match_paths(child_name, name_length, paths, n, next, &next_n);
+
+            if(m == PATH_THROUGH && !is_container((nbt_type)t))
+                m = PATH_NONE;
+
+            if(m == PATH_NONE)
+            {
+                if(!skip_payload((nbt_type)t, ctx->max_depth - ctx->depth, memory, length))
+                    goto parse_error;
+
+                continue;
+            }
+
+            char* copy;
+            struct tag_list* entry;
+
+            CTX_MALLOC(ctx, copy, (size_t)name_length + 1, goto parse_error);
+
+            memcpy(copy, child_name, name_length);
+            copy[name_length] = '\0';
+
+            nbt_node* child = parse_selected(ctx, m, (nbt_type)t, copy, next, next_n, memory, length);
+
+            if(child == NULL)
+            {
+                ctx_free(ctx, copy);
+
+                if(errno != NBT_OK) goto parse_error;
+                continue;
+            }
+
+            CTX_MALLOC(ctx, entry, sizeof *entry,
+                ctx_free_node(ctx, child);
+                goto parse_error;
+            );
+
+            entry->data = child;
+            list_add_tail(&entry->entry, &children->entry);
+        }
+    }
+
+    if(list_empty(&children->entry) && !keep_empty)
+    {
+        ctx->depth--;
+        ctx_free(ctx, children);
+        return NULL;
+    }
+
+    CTX_MALLOC(ctx, node, sizeof *node, goto parse_error);
+
+    ctx->depth--;
+
+    node->type  = type;
+    node->flags = 0;
+    node->name  = name;
+
+    if(type == TAG_LIST)
+    {
+        node->payload.tag_list.type = elem_type;
+        node->payload.tag_list.list = children;
+    }
+    else
+    {
+        node->payload.tag_compound = children;
+    }
+
+    return node;
+
+parse_error:
+    if(errno == NBT_OK)
+        errno = NBT_ERR;
+
+    ctx->depth--;
+    ctx_free_list(ctx, children);
+    return NULL;
+}
+
+nbt_node* nbt_parse_paths(const void* mem, size_t len, const char* const* paths, size_t count)
+{
+    assert(paths || count == 0);
+
+    struct parse_ctx ctx = { .arena = NULL, .borrowed = false, .max_depth = NBT_DEFAULT_MAX_DEPTH };
+
+    errno = NBT_OK;
+
+    const char** memory = (const char**)&mem;
+    size_t* length = &len;
+
+    char* name = NULL;
+
+    const char* next[count ? count : 1];
+    size_t next_n;
+
+    uint8_t type;
+    READ_GENERIC(&type, sizeof type, memscan, goto parse_error);
+
+    name = read_string(&ctx, memory, length, NULL, NULL);
+    if(name == NULL) goto parse_error;
+
+    enum path_match m = match_paths(name, strlen(name), paths, count, next, &next_n);
+
+    /* The root always comes back. If it's a lone value, there's nothing to project. */
+    nbt_node* ret = m == PATH_WHOLE || !is_container((nbt_type)type)
+        ? parse_unnamed_tag(&ctx, (nbt_type)type, name, memory, length)
+        : parse_projected(&ctx, (nbt_type)type, name, next, next_n, true, memory, length);
+
+    if(errno != NBT_OK) goto parse_error;
 
-        if(type != cur->data->type)
-            return TAG_INVALID;
-    }
-    
-    /* if the list was empty, use its current type */
-    if (type == TAG_INVALID) type = list.type;
+    return ret;
 
-    return type;
+parse_error:
+    if(errno == NBT_OK)
+        errno = NBT_ERR;
+
+    free(name);
+    return NULL;
 }
 
-static struct nbt_list read_list(const char** memory, size_t* length)
-{
-    uint8_t type;
-    int32_t elems;
-    struct nbt_list ret;
+/*
+ * Extraction finds, for each path, the node nbt_find_by_path would. That's the
+ * first node along the path in the order they're laid out, so once every path
+ * has been found, the rest of the input doesn't need to be looked at at all.
+ */
 
-    READ_GENERIC(&type, sizeof type, swapped_memscan, goto parse_error);
-    READ_GENERIC(&elems, sizeof elems, swapped_memscan, goto parse_error);
+struct extract_ctx {
+    nbt_node** found;
+    size_t pending; /* Paths that haven't been found yet. */
+};
 
-    CHECKED_MALLOC(ret.list, sizeof *ret.list, goto parse_error);
+static nbt_status extract_children(struct extract_ctx* x, nbt_type type,
+                                   const size_t* live, const char* const* at, size_t n,
+                                   size_t depth, const char** memory, size_t* length);
 
-    ret.type = (nbt_type)type;
-    ret.list->data = NULL; /* the first value in a list is a sentinel. don't even try to read it. */
-    INIT_LIST_HEAD(&ret.list->entry);
+/*
+ * Hands out what the paths that matched a node whole found in it. The first
+ * one gets the node itself; the rest get copies.
+ */
+static nbt_status extract_whole(struct extract_ctx* x, nbt_node* node,
+                                const size_t* matched, const char* const* at, size_t n)
+{
+    bool taken = false;
 
-    for(int32_t i = 0; i < elems; i++)
+    for(size_t i = 0; i < n; i++)
     {
-        struct tag_list* new;
-
-        CHECKED_MALLOC(new, sizeof *new, goto parse_error);
+        nbt_node* r = nbt_find_by_path(node, at[i]);
 
-        new->data = parse_unnamed_tag((nbt_type)type, NULL, memory, length);
+        if(r == NULL)
+            continue;
 
-        if(new->data == NULL)
+        if(r == node && !taken)
+            taken = true;
+        else if((r = nbt_clone(r)) == NULL)
         {
-            free(new);
-            goto parse_error;
+            if(!taken) nbt_free(node);
+            return NBT_EMEM;
         }
 
-        list_add_tail(&new->entry, &ret.list->entry);
+        x->found[matched[i]] = r;
+        x->pending--;
     }
-    
-    /* if the list has no type set, set it now */
-    if (ret.type == TAG_INVALID && elems) ret.type = list_is_homogenous(ret);
-    /* if it's empty, an attempt to set it based on name will be done on parse_unnamed_tag */
-    
-    return ret;
 
-parse_error:
-    if(errno == NBT_OK)
-        errno = NBT_ERR;
+    if(!taken)
+        nbt_free(node);
 
-    nbt_free_list(ret.list);
-    ret.type = TAG_INVALID;
-    ret.list = NULL;
-    return ret;
+    return NBT_OK;
 }
 
-static struct tag_list* read_compound(const char** memory, size_t* length)
+/*
+ * Reads the payload of a node called `name' (NULL in a list), that's `depth'
+ * containers down. `live' are the paths still being looked for at this level,
+ * and `at' is where each of them has got to.
+ */
+static nbt_status extract_tag(struct extract_ctx* x, nbt_type type,
+                              const char* name, size_t name_length,
+                              const size_t* live, const char* const* at, size_t n,
+                              size_t depth, const char** memory, size_t* length)
 {
-    struct tag_list* ret;
+    size_t next_live[n ? n : 1];
+    const char* next_at[n ? n : 1];
+    size_t next_n = 0;
 
-    CHECKED_MALLOC(ret, sizeof *ret, goto parse_error);
+    /* Every path that matches this node, from the component naming it on. */
+    size_t matched[n ? n : 1];
+    const char* matched_at[n ? n : 1];
+    size_t matched_n = 0;
+    bool whole = false;
 
-    ret->data = NULL;
-    INIT_LIST_HEAD(&ret->entry);
-
-    for(;;)
+    for(size_t i = 0; i < n; i++)
     {
-        uint8_t type;
-        char* name = NULL;
-        struct tag_list* new_entry;
+        const char* component = at[i];
+        const char* dot = strchr(component, '.');
+        size_t e = dot ? (size_t)(dot - component) : strlen(component);
 
-        READ_GENERIC(&type, sizeof type, swapped_memscan, goto parse_error);
+        if(x->found[live[i]] != NULL)
+            continue; /* Found further back. */
 
-        if(type == 0) break; /* TAG_END == 0. We've hit the end of the list when type == TAG_END. */
+        if(e != name_length || (e && memcmp(component, name, e) != 0))
+            continue;
 
-        name = read_string(memory, length);
-        if(name == NULL) goto parse_error;
+        matched[matched_n]      = live[i];
+        matched_at[matched_n++] = component;
 
-        CHECKED_MALLOC(new_entry, sizeof *new_entry,
-            free(name);
-            goto parse_error;
-        );
+        if(dot == NULL)
+            whole = true;
+        else if(is_container(type))
+        {
+            next_live[next_n] = live[i];
+            next_at[next_n++] = dot + 1;
+        }
+    }
 
-        new_entry->data = parse_unnamed_tag((nbt_type)type, name, memory, length);
+    /*
+     * Some path wants all of this node, so we have to parse it. Any other path
+     * that goes through it finds what it's after in there.
+     */
+    if(whole)
+    {
+        struct parse_ctx ctx = { .arena = NULL, .max_depth = NBT_DEFAULT_MAX_DEPTH, .depth = depth };
+        char* copy = NULL;
 
-        if(new_entry->data == NULL)
+        if(name)
         {
-            free(new_entry);
-            free(name);
-            goto parse_error;
+            CHECKED_MALLOC(copy, name_length + 1, return NBT_EMEM);
+
+            memcpy(copy, name, name_length);
+            copy[name_length] = '\0';
         }
 
-        list_add_tail(&new_entry->entry, &ret->entry);
+        errno = NBT_OK;
+        nbt_node* node = parse_unnamed_tag(&ctx, type, copy, memory, length);
+
+        if(node == NULL)
+        {
+            free(copy);
+            return errno == NBT_OK ? NBT_ERR : (nbt_status)errno;
+        }
+
+        return extract_whole(x, node, matched, matched_at, matched_n);
     }
 
-    return ret;
+    if(next_n)
+    {
+        if(depth >= NBT_DEFAULT_MAX_DEPTH) return NBT_ERR;
 
-parse_error:
-    if(errno == NBT_OK)
-        errno = NBT_ERR;
-    nbt_free_list(ret);
+        return extract_children(x, type, next_live, next_at, next_n, depth, memory, length);
+    }
 
-    return NULL;
+    if(!skip_payload(type, NBT_DEFAULT_MAX_DEPTH - depth, memory, length))
+        return NBT_ERR;
+
+    return NBT_OK;
 }
 
-/*
- * Parses a tag, given a name (may be NULL) and a type. Fills in the payload.
- */
-static inline nbt_node* parse_unnamed_tag(nbt_type type, char* name, const char** memory, size_t* length)
+/* Walks a list or compound `depth' containers down, until everything's found. */
+static nbt_status extract_children(struct extract_ctx* x, nbt_type type,
+                                   const size_t* live, const char* const* at, size_t n,
+                                   size_t depth, const char** memory, size_t* length)
 {
-    nbt_node* node;
+    nbt_status err;
 
-    CHECKED_MALLOC(node, sizeof *node, goto parse_error);
+    if(type == TAG_LIST)
+    {
+        uint8_t elem_type;
+        int32_t elems;
 
-    node->type = type;
-    node->name = name;
+        READ_GENERIC(&elem_type, sizeof elem_type, memscan,         return NBT_ERR);
+        READ_GENERIC(&elems,     sizeof elems,     swapped_memscan, return NBT_ERR);
 
-#define COPY_INTO_PAYLOAD(payload_name) \
-    READ_GENERIC(&node->payload.payload_name, sizeof node->payload.payload_name, swapped_memscan, goto parse_error);
+        if(elems > 0 && elem_type == TAG_INVALID) return NBT_ERR;
 
-    switch(type)
-    {
-    case TAG_BYTE:
-        COPY_INTO_PAYLOAD(tag_byte);
-        break;
-    case TAG_SHORT:
-        COPY_INTO_PAYLOAD(tag_short);
-        break;
-    case TAG_INT:
-        COPY_INTO_PAYLOAD(tag_int);
-        break;
-    case TAG_LONG:
-        COPY_INTO_PAYLOAD(tag_long);
-        break;
-    case TAG_FLOAT:
-        COPY_INTO_PAYLOAD(tag_float);
-        break;
-    case TAG_DOUBLE:
-        COPY_INTO_PAYLOAD(tag_double);
-        break;
-    case TAG_BYTE_ARRAY:
-        node->payload.tag_byte_array = read_byte_array(memory, length);
-        break;
-    case TAG_STRING:
-        node->payload.tag_string = read_string(memory, length);
-        break;
-    case TAG_LIST:
-        node->payload.tag_list = read_list(memory, length);
-        /* try to fix empty lists with no elements */
-        if (node->payload.tag_list.type == TAG_INVALID && node->payload.tag_list.list && list_length(&node->payload.tag_list.list->entry) == 0) {
-            if (node->name && (strcmp(node->name, "TileEntities") == 0 || strcmp(node->name, "Entities") == 0)) {
-                node->payload.tag_list.type = TAG_COMPOUND;
-            } else {
-                /* default to TAG_COMPOUND */
-                node->payload.tag_list.type = TAG_COMPOUND;
-                //fprintf(stderr, "Unknown empty list with no elements: %s\n", node->name?node->name:"(null)");
-            }
+        /* Only paths with an empty component get into a list's elements. */
+        bool any = false;
+
+        for(size_t i = 0; i < n && !any; i++)
+            any = at[i][0] == '.' || at[i][0] == '\0';
+
+        if(!any)
+        {
+            if(!skip_list_elements((nbt_type)elem_type, elems, NBT_DEFAULT_MAX_DEPTH - depth - 1,
+                                   memory, length))
+                return NBT_ERR;
+
+            return NBT_OK;
         }
-        break;
-    case TAG_COMPOUND:
-        node->payload.tag_compound = read_compound(memory, length);
-        break;
-    case TAG_INT_ARRAY:
-        node->payload.tag_int_array = read_int_array(memory, length);
-        break;
-    case TAG_LONG_ARRAY:
-        node->payload.tag_long_array = read_long_array(memory, length);
-        break;
 
-    default:
-        goto parse_error; /* Unknown node or TAG_END. Either way, we shouldn't be parsing this. */
+        for(int32_t i = 0; i < elems; i++)
+        {
+            if((err = extract_tag(x, (nbt_type)elem_type, NULL, 0, live, at, n,
+                                  depth + 1, memory, length)) != NBT_OK)
+                return err;
+
+            if(x->pending == 0)
+                return NBT_OK;
+        }
+
+        return NBT_OK;
     }
 
-#undef COPY_INTO_PAYLOAD
+    for(;;)
+    {
+        uint8_t t;
+        uint16_t name_length;
 
-    if(errno != NBT_OK) goto parse_error;
+        READ_GENERIC(&t, sizeof t, memscan, return NBT_ERR);
 
-    return node;
+        if(t == 0) return NBT_OK; /* TAG_End */
 
-parse_error:
-    if(errno == NBT_OK)
-        errno = NBT_ERR;
+        READ_GENERIC(&name_length, sizeof name_length, swapped_memscan, return NBT_ERR);
 
-    free(node);
-    return NULL;
+        if(name_length > 32767 || *length < name_length) return NBT_ERR;
+
+        const char* name = *memory;
+
+        *memory += name_length;
+        *length -= name_length;
+
+        if((err = extract_tag(x, (nbt_type)t, name, name_length, live, at, n,
+                              depth + 1, memory, length)) != NBT_OK)
+            return err;
+
+        if(x->pending == 0)
+            return NBT_OK;
+    }
 }
 
-nbt_node* nbt_parse(const void* mem, size_t len)
+nbt_status nbt_extract(const void* mem, size_t len,
+                       const char* const* paths, size_t count, nbt_node** found)
 {
-    errno = NBT_OK;
+    assert(paths || count == 0);
+    assert(found || count == 0);
+
+    for(size_t i = 0; i < count; i++)
+        found[i] = NULL;
+
+    if(count == 0)
+        return NBT_OK;
 
     const char** memory = (const char**)&mem;
     size_t* length = &len;
 
-    /*
-     * this needs to stay up here since it's referenced by the parse_error
-     * block.
-     */
-    char* name = NULL;
+    struct extract_ctx x = { found, count };
+    size_t live[count];
+
+    for(size_t i = 0; i < count; i++)
+        live[i] = i;
 
     uint8_t type;
-    READ_GENERIC(&type, sizeof type, memscan, goto parse_error);
+    uint16_t name_length;
 
-    name = read_string(memory, length);
-    if(name == NULL) goto parse_error;
+    READ_GENERIC(&type,        sizeof type,        memscan,         return NBT_ERR);
+    READ_GENERIC(&name_length, sizeof name_length, swapped_memscan, return NBT_ERR);
 
-    nbt_node* ret = parse_unnamed_tag((nbt_type)type, name, memory, length);
+    if(name_length > 32767 || *length < name_length) return NBT_ERR;
 
-    /* We can't check for NULL, because it COULD be an empty tree. */
-    if(errno != NBT_OK) goto parse_error;
+    const char* name = *memory;
 
-    return ret;
+    *memory += name_length;
+    *length -= name_length;
 
-parse_error:
-    if(errno == NBT_OK)
-        errno = NBT_ERR;
+    nbt_status err = extract_tag(&x, (nbt_type)type, name, name_length, live, paths, count,
+                                 0, memory, length);
 
-    free(name);
-    return NULL;
+    if(err != NBT_OK)
+    {
+        for(size_t i = 0; i < count; i++)
+        {
+            nbt_free(found[i]);
+            found[i] = NULL;
+        }
+    }
+
+    return err;
 }
 
 /* spaces, not tabs ;) */
 static inline void indent(struct buffer* b, size_t amount)
 {
-    size_t spaces = amount * 4; /* 4 spaces per indent */
+    static const char spaces[] = "                                ";
 
-    char temp[spaces + 1];
+    size_t n = amount * 4; /* 4 spaces per indent */
 
-    for(size_t i = 0; i < spaces; ++i)
-        temp[i] = ' ';
-    temp[spaces] = '\0';
+    for(; n > sizeof spaces - 1; n -= sizeof spaces - 1)
+        buffer_append(b, spaces, sizeof spaces - 1);
 
-    bprintf(b, "%s", temp);
+    buffer_append(b, spaces, n);
 }
 
-static nbt_status __nbt_dump_ascii(const nbt_node*, struct buffer*, size_t ident);
+static nbt_status dump_node_ascii(const nbt_node*, struct buffer*, size_t ident, const struct tag_list** children);
 
 /* prints the node's name, or (null) if it has none. */
 #define SAFE_NAME(node) ((node)->name ? (node)->name : "<null>")
 
-static inline void dump_byte_array(const struct nbt_byte_array ba, struct buffer* b)
+static inline void dump_byte_array(const nbt_node* ba, struct buffer* b)
 {
-    assert(ba.length >= 0);
+    assert(ba->payload.tag_byte_array.length >= 0);
 
     bprintf(b, "[ ");
-    for(int32_t i = 0; i < ba.length; ++i)
-        bprintf(b, "%u ", +ba.data[i]);
+    for(int32_t i = 0; i < ba->payload.tag_byte_array.length; ++i)
+        bprintf(b, "%u ", +nbt_byte_array_get(ba, i));
     bprintf(b, "]");
 }
 
-static inline void dump_int_array(const struct nbt_int_array ia, struct buffer* b)
+static inline void dump_int_array(const nbt_node* ia, struct buffer* b)
 {
-    assert(ia.length >= 0);
+    assert(ia->payload.tag_int_array.length >= 0);
 
     bprintf(b, "[ ");
-    for(int32_t i = 0; i < ia.length; ++i)
-        bprintf(b, "%d ", +ia.data[i]);
+    for(int32_t i = 0; i < ia->payload.tag_int_array.length; ++i)
+        bprintf(b, "%d ", nbt_int_array_get(ia, i));
     bprintf(b, "]");
 }
 
-static inline void dump_long_array(const struct nbt_long_array la, struct buffer* b)
+static inline void dump_long_array(const nbt_node* la, struct buffer* b)
 {
-    assert(la.length >= 0);
+    assert(la->payload.tag_long_array.length >= 0);
 
     bprintf(b, "[ ");
-    for(int32_t i = 0; i < la.length; ++i)
-        bprintf(b, "%d ", +la.data[i]);
+    for(int32_t i = 0; i < la->payload.tag_long_array.length; ++i)
+        bprintf(b, "%" PRIi64 " ", nbt_long_array_get(la, i));
     bprintf(b, "]");
 }
 
-static inline nbt_status dump_list_contents_ascii(const struct tag_list* list, struct buffer* b, size_t ident)
+/* Prints a packed list's numbers as if each were a node of its own. */
+static inline nbt_status dump_packed_contents_ascii(const struct nbt_packed_list* packed, struct buffer* b, size_t ident)
 {
-    const struct list_head* pos;
+    size_t size = fixed_payload_size(packed->type);
 
-    list_for_each(pos, &list->entry)
+    for(int32_t i = 0; i < packed->length; i++)
     {
-        const struct tag_list* entry = list_entry(pos, const struct tag_list, entry);
+        nbt_node item = { .type = packed->type, .flags = 0, .name = NULL };
+        const struct tag_list* none;
         nbt_status err;
 
-        if((err = __nbt_dump_ascii(entry->data, b, ident)) != NBT_OK)
+        memcpy(&item.payload, (const char*)packed->data + (size_t)i * size, size);
+
+        if((err = dump_node_ascii(&item, b, ident, &none)) != NBT_OK)
             return err;
     }
 
     return NBT_OK;
 }
 
-static inline nbt_status __nbt_dump_ascii(const nbt_node* tree, struct buffer* b, size_t ident)
+/*
+ * Prints a single node. For a list or compound, that's only as far as its
+ * opening brace: `children' is pointed at what goes inside, for the caller to
+ * print and then close. A packed list has no nodes to hand over, so it's
+ * printed whole.
+ */
+static nbt_status dump_node_ascii(const nbt_node* tree, struct buffer* b, size_t ident,
+                                  const struct tag_list** children)
 {
+    *children = NULL;
+
     if(tree == NULL) return NBT_OK;
 
     indent(b, ident);
@@ -563,7 +2037,7 @@ static inline nbt_status __nbt_dump_ascii(const nbt_node* tree, struct buffer* b
     else if(tree->type == TAG_BYTE_ARRAY)
     {
         bprintf(b, "TAG_Byte_Array(\"%s\"): ", SAFE_NAME(tree));
-        dump_byte_array(tree->payload.tag_byte_array, b);
+        dump_byte_array(tree, b);
         bprintf(b, "\n");
     }
     else if(tree->type == TAG_STRING)
@@ -579,7 +2053,10 @@ static inline nbt_status __nbt_dump_ascii(const nbt_node* tree, struct buffer* b
         indent(b, ident);
         bprintf(b, "{\n");
 
-        nbt_status err = dump_list_contents_ascii(tree->payload.tag_list.list, b, ident + 1);
+        if(!(tree->flags & NBT_NODE_PACKED))
+            return (*children = tree->payload.tag_list.list), NBT_OK;
+
+        nbt_status err = dump_packed_contents_ascii(&tree->payload.tag_packed, b, ident + 1);
 
         indent(b, ident);
         bprintf(b, "}\n");
@@ -589,28 +2066,27 @@ static inline nbt_status __nbt_dump_ascii(const nbt_node* tree, struct buffer* b
     }
     else if(tree->type == TAG_COMPOUND)
     {
+        /* Printing it is looking inside it. */
+        nbt_status err = nbt_materialize((nbt_node*)tree);
+        if(err != NBT_OK)
+            return err;
+
         bprintf(b, "TAG_Compound(\"%s\")\n", SAFE_NAME(tree));
         indent(b, ident);
         bprintf(b, "{\n");
 
-        nbt_status err = dump_list_contents_ascii(tree->payload.tag_compound, b, ident + 1);
-
-        indent(b, ident);
-        bprintf(b, "}\n");
-
-        if(err != NBT_OK)
-            return err;
+        *children = tree->payload.tag_compound;
     }
     else if(tree->type == TAG_INT_ARRAY)
     {
         bprintf(b, "TAG_Int_Array(\"%s\"): ", SAFE_NAME(tree));
-        dump_int_array(tree->payload.tag_int_array, b);
+        dump_int_array(tree, b);
         bprintf(b, "\n");
     }
     else if(tree->type == TAG_LONG_ARRAY)
     {
         bprintf(b, "TAG_Long_Array(\"%s\"): ", SAFE_NAME(tree));
-        dump_long_array(tree->payload.tag_long_array, b);
+        dump_long_array(tree, b);
         bprintf(b, "\n");
     }
 
@@ -620,6 +2096,73 @@ static inline nbt_status __nbt_dump_ascii(const nbt_node* tree, struct buffer* b
     return NBT_OK;
 }
 
+/* A list or compound __nbt_dump_ascii is in the middle of printing. */
+struct ascii_frame {
+    const struct list_head* head; /* Its elements or children... */
+    const struct list_head* pos;  /* ...and the last one printed. */
+};
+
+/*
+ * Keeps a stack of its own rather than recursing, so there's no tree too deep
+ * to print. How deep we are in it is how far to indent.
+ */
+static nbt_status __nbt_dump_ascii(const nbt_node* tree, struct buffer* b)
+{
+    struct ascii_frame shallow[32];
+    struct ascii_frame* stack = shallow;
+    size_t depth = 0, capacity = sizeof shallow / sizeof *shallow;
+    nbt_status err;
+
+    for(;;)
+    {
+        const struct tag_list* children;
+
+        if((err = dump_node_ascii(tree, b, depth, &children)) != NBT_OK)
+            break;
+
+        if(children != NULL)
+        {
+            if(depth == capacity)
+            {
+                struct ascii_frame* frames = realloc(stack == shallow ? NULL : stack, 2 * capacity * sizeof *frames);
+
+                if(frames == NULL)
+                {
+                    err = NBT_EMEM;
+                    break;
+                }
+
+                if(stack == shallow)
+                    memcpy(frames, shallow, sizeof shallow);
+
+                stack     = frames;
+                capacity *= 2;
+            }
+
+            stack[depth++] = (struct ascii_frame){ &children->entry, &children->entry };
+        }
+
+        /* the next node to print, closing every list or compound that's done. */
+        while(depth > 0 && (stack[depth - 1].pos = stack[depth - 1].pos->flink) == stack[depth - 1].head)
+        {
+            depth--;
+
+            indent(b, depth);
+            bprintf(b, "}\n");
+        }
+
+        if(depth == 0)
+            break;
+
+        tree = list_entry(stack[depth - 1].pos, const struct tag_list, entry)->data;
+    }
+
+    if(stack != shallow)
+        free(stack);
+
+    return err;
+}
+
 char* nbt_dump_ascii(const nbt_node* tree)
 {
     errno = NBT_OK;
@@ -637,7 +2180,7 @@ char* nbt_dump_ascii(const nbt_node* tree)
 
     struct buffer b = BUFFER_INIT;
 
-    if((errno = __nbt_dump_ascii(tree, &b, 0)) != NBT_OK) goto OOM;
+    if((errno = __nbt_dump_ascii(tree, &b))    != NBT_OK) goto OOM;
     if(         buffer_reserve(&b, b.len + 1))            goto OOM;
 
     b.data[b.len] = '\0'; /* null-terminate that biatch, since bprintf doesn't
@@ -668,7 +2211,8 @@ static nbt_status dump_byte_array_binary(const struct nbt_byte_array ba, struct
     return NBT_OK;
 }
 
-static nbt_status dump_int_array_binary(const struct nbt_int_array ia, struct buffer* b)
+/* `big_endian' is set for borrowed arrays, which can be dumped as they are. */
+static nbt_status dump_int_array_binary(const struct nbt_int_array ia, bool big_endian, struct buffer* b)
 {
     int32_t dumped_length = ia.length;
 
@@ -678,21 +2222,23 @@ static nbt_status dump_int_array_binary(const struct nbt_int_array ia, struct bu
 
     if(ia.length) assert(ia.data);
 
-    // big endian
-    int32_t *be_data = ia.data;
-    if (little_endian()) {
-        be_data = malloc(4*ia.length);
-        if (be_data == NULL) return NBT_EMEM;
-        for(int i=0; i < ia.length; i++) be_data[i] = htonl(ia.data[i]);
+    if(big_endian)
+    {
+        CHECKED_APPEND(b, ia.data, 4*ia.length);
+        return NBT_OK;
     }
-    
-    CHECKED_APPEND(b, be_data, 4*ia.length);
 
-    if (be_data != ia.data) free(be_data);
+    /* swap straight into the buffer. */
+    if(buffer_reserve(b, b->len + (size_t)4*ia.length))
+        return NBT_EMEM;
+
+    ne2be_array32(b->data + b->len, ia.data, (size_t)ia.length);
+    b->len += (size_t)4*ia.length;
+
     return NBT_OK;
 }
 
-static nbt_status dump_long_array_binary(const struct nbt_long_array la, struct buffer* b)
+static nbt_status dump_long_array_binary(const struct nbt_long_array la, bool big_endian, struct buffer* b)
 {
     int32_t dumped_length = la.length;
 
@@ -702,17 +2248,64 @@ static nbt_status dump_long_array_binary(const struct nbt_long_array la, struct
 
     if(la.length) assert(la.data);
 
-    // big endian
-    int64_t *be_data = la.data;
-    if (little_endian()) {
-        be_data = malloc(8*la.length);
-        if (be_data == NULL) return NBT_EMEM;
-        for(int i=0; i < la.length; i++) be_data[i] = ntohll(la.data[i]);
+    if(big_endian)
+    {
+        CHECKED_APPEND(b, la.data, 8*la.length);
+        return NBT_OK;
     }
-    
-    CHECKED_APPEND(b, be_data, 8*la.length);
 
-    if (be_data != la.data) free(be_data);
+    if(buffer_reserve(b, b->len + (size_t)8*la.length))
+        return NBT_EMEM;
+
+    ne2be_array64(b->data + b->len, la.data, (size_t)la.length);
+    b->len += (size_t)8*la.length;
+
+    return NBT_OK;
+}
+
+/* Encoded arrays are decoded on the way out. Ints and longs go through a copy to be swapped. */
+static nbt_status dump_encoded_binary(const nbt_node* array, struct buffer* b)
+{
+    int32_t length = array->payload.tag_encoded.length;
+    int32_t dumped_length = length;
+
+    ne2be(&dumped_length, sizeof dumped_length);
+
+    CHECKED_APPEND(b, &dumped_length, sizeof dumped_length);
+
+    if(array->type == TAG_BYTE_ARRAY)
+    {
+        if(buffer_reserve(b, b->len + (size_t)length))
+            return NBT_EMEM;
+
+        nbt_byte_array_copy(array, b->data + b->len);
+        b->len += (size_t)length;
+
+        return NBT_OK;
+    }
+
+    size_t width = array->type == TAG_INT_ARRAY ? 4 : 8;
+    void* native;
+
+    if(buffer_reserve(b, b->len + width*length))
+        return NBT_EMEM;
+
+    CHECKED_MALLOC(native, width*length, return NBT_EMEM);
+
+    if(width == 4)
+    {
+        nbt_int_array_copy(array, native);
+        ne2be_array32(b->data + b->len, native, (size_t)length);
+    }
+    else
+    {
+        nbt_long_array_copy(array, native);
+        ne2be_array64(b->data + b->len, native, (size_t)length);
+    }
+
+    b->len += width*length;
+
+    free(native);
     return NBT_OK;
 }
 
@@ -721,31 +2314,41 @@ static nbt_status dump_string_binary(const char* name, struct buffer* b)
     assert(name);
 
     size_t len = strlen(name);
+    size_t dumped = nbt_utf8_to_mutf8_length(name, len);
 
-    if(len > 32767 /* SHORT_MAX */)
+    if(dumped > 32767 /* SHORT_MAX */)
         return NBT_ERR;
 
     { /* dump the length */
-        int16_t dumped_len = (int16_t)len;
+        int16_t dumped_len = (int16_t)dumped;
         ne2be(&dumped_len, sizeof dumped_len);
 
         CHECKED_APPEND(b, &dumped_len, sizeof dumped_len);
     }
 
-    CHECKED_APPEND(b, name, len);
+    /* Java can't read four-byte UTF-8. Anything else is already fine. */
+    if(dumped == len)
+        CHECKED_APPEND(b, name, len);
+    else
+    {
+        if(buffer_reserve(b, b->len + dumped))
+            return NBT_EMEM;
+
+        b->len += nbt_utf8_to_mutf8((char*)b->data + b->len, name, len);
+    }
 
     return NBT_OK;
 }
 
-static nbt_status __dump_binary(const nbt_node*, bool, struct buffer*);
-
-static nbt_status dump_list_binary(const struct nbt_list nbtlist, struct buffer* b)
+/* Writes out a list's header. The elements are left to __dump_binary. */
+static nbt_status dump_list_header_binary(const nbt_node* tree, struct buffer* b)
 {
-    nbt_type type = list_is_homogenous(nbtlist);
-    
-    const struct tag_list* list = nbtlist.list;
+    /* Vectors and packed lists can only ever hold their own type, so there's no need to check. */
+    nbt_type type = tree->flags & (NBT_NODE_VECTOR | NBT_NODE_PACKED)
+                  ? tree->payload.tag_list.type
+                  : list_is_homogenous(tree->payload.tag_list);
 
-    size_t len = list_length(&list->entry);
+    size_t len = nbt_list_length(tree);
 
     if(len > 2147483647 /* INT_MAX */)
         return NBT_ERR;
@@ -766,44 +2369,45 @@ static nbt_status dump_list_binary(const struct nbt_list nbtlist, struct buffer*
         CHECKED_APPEND(b, &dumped_len, sizeof dumped_len);
     }
 
-    const struct list_head* pos;
-    list_for_each(pos, &list->entry)
-    {
-        const struct tag_list* entry = list_entry(pos, const struct tag_list, entry);
-        nbt_status ret;
-
-        if((ret = __dump_binary(entry->data, false, b)) != NBT_OK)
-            return ret;
-    }
-
     return NBT_OK;
 }
 
-static nbt_status dump_compound_binary(const struct tag_list* list, struct buffer* b)
+/* Writes out a packed list, header and all, converting its numbers back in one go. */
+static nbt_status dump_packed_binary(const nbt_node* tree, struct buffer* b)
 {
-    const struct list_head* pos;
-    list_for_each(pos, &list->entry)
-    {
-        const struct tag_list* entry = list_entry(pos, const struct tag_list, entry);
-        nbt_status ret;
+    const struct nbt_packed_list* packed = &tree->payload.tag_packed;
+    size_t size = fixed_payload_size(packed->type);
+    size_t n = (size_t)packed->length;
 
-        if((ret = __dump_binary(entry->data, true, b)) != NBT_OK)
-            return ret;
-    }
+    nbt_status err = dump_list_header_binary(tree, b);
+    if(err != NBT_OK) return err;
 
-    /* write out TAG_End */
-    uint8_t zero = 0;
-    CHECKED_APPEND(b, &zero, sizeof zero);
+    if(buffer_reserve(b, b->len + size * n))
+        return NBT_EMEM;
+
+    unsigned char* at = b->data + b->len;
+    b->len += size * n;
+
+    switch(size)
+    {
+    case 1: memcpy(at, packed->data, n);        break;
+    case 2: ne2be_array16(at, packed->data, n); break;
+    case 4: ne2be_array32(at, packed->data, n); break;
+    case 8: ne2be_array64(at, packed->data, n); break;
+    }
 
     return NBT_OK;
 }
 
 /*
+ * Writes out a single node. The elements of lists and the children of
+ * compounds are left to __dump_binary.
+ *
  * @param dump_type   Should we dump the type, or just skip it? We need to skip
  *                    when dumping lists, because the list header already says
  *                    the type.
  */
-static inline nbt_status __dump_binary(const nbt_node* tree, bool dump_type, struct buffer* b)
+static inline nbt_status dump_node_binary(const nbt_node* tree, bool dump_type, struct buffer* b)
 {
     if(dump_type)
     { /* write out the type */
@@ -838,18 +2442,24 @@ static inline nbt_status __dump_binary(const nbt_node* tree, bool dump_type, str
         DUMP_NUM(float, tree->payload.tag_float);
     else if(tree->type == TAG_DOUBLE)
         DUMP_NUM(double, tree->payload.tag_double);
+    else if(tree->flags & NBT_NODE_ENCODED)
+        return dump_encoded_binary(tree, b);
     else if(tree->type == TAG_BYTE_ARRAY)
         return dump_byte_array_binary(tree->payload.tag_byte_array, b);
     else if(tree->type == TAG_STRING)
         return dump_string_binary(tree->payload.tag_string, b);
+    else if(tree->type == TAG_LIST && (tree->flags & NBT_NODE_PACKED))
+        return dump_packed_binary(tree, b);
     else if(tree->type == TAG_LIST)
-        return dump_list_binary(tree->payload.tag_list, b);
+        return dump_list_header_binary(tree, b);
+    else if(tree->type == TAG_COMPOUND && (tree->flags & NBT_NODE_LAZY))
+        CHECKED_APPEND(b, tree->payload.tag_lazy.data, tree->payload.tag_lazy.length);
     else if(tree->type == TAG_COMPOUND)
-        return dump_compound_binary(tree->payload.tag_compound, b);
+        ; /* nothing but children */
     else if(tree->type == TAG_INT_ARRAY)
-        return dump_int_array_binary(tree->payload.tag_int_array, b);
+        return dump_int_array_binary(tree->payload.tag_int_array, tree->flags & NBT_NODE_BORROWED, b);
     else if(tree->type == TAG_LONG_ARRAY)
-        return dump_long_array_binary(tree->payload.tag_long_array, b);
+        return dump_long_array_binary(tree->payload.tag_long_array, tree->flags & NBT_NODE_BORROWED, b);
 
 
     else
@@ -860,6 +2470,98 @@ static inline nbt_status __dump_binary(const nbt_node* tree, bool dump_type, str
 #undef DUMP_NUM
 }
 
+/* A list or compound __dump_binary is in the middle of writing out. */
+struct dump_frame {
+    const struct list_head* head; /* Its elements or children... */
+    const struct list_head* pos;  /* ...and the last one written. */
+    bool is_list;
+};
+
+/*
+ * Writes out the whole tree, keeping a stack of its own rather than recursing
+ * into lists and compounds, so there's no tree too deep to dump.
+ */
+static nbt_status __dump_binary(const nbt_node* tree, struct buffer* b)
+{
+    struct dump_frame* stack = NULL;
+    size_t depth = 0, capacity = 0;
+
+    nbt_status err;
+    bool dump_type = true;
+
+    for(;;)
+    {
+        if((err = dump_node_binary(tree, dump_type, b)) != NBT_OK)
+            goto dump_error;
+
+        bool is_list = tree->type == TAG_LIST;
+
+        /* lazy compounds and packed lists were written out whole. */
+        if((is_list && !(tree->flags & NBT_NODE_PACKED)) ||
+           (tree->type == TAG_COMPOUND && !(tree->flags & NBT_NODE_LAZY)))
+        {
+            if(depth == capacity)
+            {
+                size_t new_capacity = capacity ? 2 * capacity : 16;
+                struct dump_frame* frames = realloc(stack, new_capacity * sizeof *frames);
+
+                if(frames == NULL)
+                {
+                    err = NBT_EMEM;
+                    goto dump_error;
+                }
+
+                stack    = frames;
+                capacity = new_capacity;
+            }
+
+            const struct tag_list* children = is_list ? tree->payload.tag_list.list
+                                                      : tree->payload.tag_compound;
+
+            stack[depth].head    = &children->entry;
+            stack[depth].pos     = &children->entry;
+            stack[depth].is_list = is_list;
+            depth++;
+        }
+
+        /* find the next node to write, finishing off everything we're done with. */
+        while(depth > 0)
+        {
+            struct dump_frame* top = &stack[depth - 1];
+
+            top->pos = top->pos->flink;
+
+            if(top->pos != top->head)
+                break;
+
+            if(!top->is_list)
+            { /* write out TAG_End */
+                uint8_t zero = 0;
+
+                if(buffer_append(b, &zero, sizeof zero))
+                {
+                    err = NBT_EMEM;
+                    goto dump_error;
+                }
+            }
+
+            depth--;
+        }
+
+        if(depth == 0) break;
+
+        tree      = list_entry(stack[depth - 1].pos, const struct tag_list, entry)->data;
+        dump_type = !stack[depth - 1].is_list;
+    }
+
+    free(stack);
+    return NBT_OK;
+
+dump_error:
+    free(stack);
+    return err;
+}
+
 struct buffer nbt_dump_binary(const nbt_node* tree)
 {
     errno = NBT_OK;
@@ -868,7 +2570,8 @@ struct buffer nbt_dump_binary(const nbt_node* tree)
 
     struct buffer ret = BUFFER_INIT;
 
-    errno = __dump_binary(tree, true, &ret);
+    if((errno = __dump_binary(tree, &ret)) != NBT_OK)
+        buffer_free(&ret);
 
     return ret;
 }
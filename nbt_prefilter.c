@@ -0,0 +1,326 @@
+/*
+ * -----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * Lukas Niederbremer <webmaster@flippeh.de> and Clark Gaebel <cg.wowus.cg@gmail.com>
+ * wrote this file. As long as you retain this notice you can do whatever you
+ * want with this stuff. If we meet some day, and you think this stuff is worth
+ * it, you can buy us a beer in return.
+ * -----------------------------------------------------------------------------
+ */
+#include "nbt.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * A prefilter is an Aho-Corasick automaton, built all the way out into a DFA:
+ * every state has an edge for every byte, so scanning is one table lookup per
+ * byte, with no failure links to chase. Each state knows which patterns end
+ * there (including the ones that are suffixes of others).
+ */
+
+#define NO_STATE UINT32_MAX
+
+struct nbt_prefilter {
+    uint32_t* next;    /* next[state * 256 + byte] */
+    uint64_t* matches; /* The patterns that end at each state. */
+    size_t states;
+
+    /* Whether each byte starts a pattern, i.e. leaves the first state at all. */
+    unsigned char starts[256];
+
+    size_t count;
+    uint64_t all;      /* Every pattern. */
+    uint64_t empty;    /* Empty patterns, which are always there. */
+};
+
+static inline unsigned char fold(unsigned char c)
+{
+    return c >= 'A' && c <= 'Z' ? (unsigned char)(c - 'A' + 'a') : c;
+}
+
+nbt_prefilter* nbt_prefilter_new(const char* const* patterns, const size_t* lengths,
+                                 size_t count, bool ignore_case)
+{
+    assert(patterns || count == 0);
+
+    if(count > NBT_PREFILTER_MAX_PATTERNS)
+        return (errno = NBT_ERR), NULL;
+
+    nbt_prefilter* ret = calloc(1, sizeof *ret);
+    uint32_t* fail  = NULL;
+    uint32_t* queue = NULL;
+
+    if(ret == NULL)
+        return (errno = NBT_EMEM), NULL;
+
+    ret->count = count;
+    ret->all   = count == 64 ? UINT64_MAX : ((uint64_t)1 << count) - 1;
+
+    /* Worst case, no two patterns share a prefix. */
+    size_t max_states = 1;
+
+    for(size_t i = 0; i < count; i++)
+        max_states += lengths ? lengths[i] : strlen(patterns[i]);
+
+    if(max_states >= NO_STATE)
+        goto mem_error;
+
+    ret->next    = malloc(max_states * 256 * sizeof *ret->next);
+    ret->matches = calloc(max_states, sizeof *ret->matches);
+    fail         = malloc(max_states * sizeof *fail);
+    queue        = malloc(max_states * sizeof *queue);
+
+    if(ret->next == NULL || ret->matches == NULL || fail == NULL || queue == NULL)
+        goto mem_error;
+
+    for(size_t i = 0; i < 256; i++)
+        ret->next[i] = NO_STATE;
+
+    ret->states = 1;
+
+    /* First, a plain trie of the patterns. */
+    for(size_t i = 0; i < count; i++)
+    {
+        const unsigned char* p = (const unsigned char*)patterns[i];
+        size_t length = lengths ? lengths[i] : strlen(patterns[i]);
+        uint32_t s = 0;
+
+        if(length == 0)
+            ret->empty |= (uint64_t)1 << i;
+
+        for(size_t j = 0; j < length; j++)
+        {
+            unsigned char c = ignore_case ? fold(p[j]) : p[j];
+            uint32_t* edge = &ret->next[(size_t)s * 256 + c];
+
+            if(*edge == NO_STATE)
+            {
+                *edge = (uint32_t)ret->states++;
+
+                for(size_t k = 0; k < 256; k++)
+                    ret->next[(size_t)*edge * 256 + k] = NO_STATE;
+            }
+
+            s = *edge;
+        }
+
+        if(length)
+            ret->matches[s] |= (uint64_t)1 << i;
+    }
+
+    /*
+     * Then, breadth first, every missing edge goes wherever the longest
+     * suffix that's also in the trie goes. Shallower states are always done
+     * first, so theirs are already filled in.
+     */
+    size_t head = 0, tail = 0;
+
+    for(size_t c = 0; c < 256; c++)
+    {
+        uint32_t* edge = &ret->next[c];
+
+        if(*edge == NO_STATE)
+            *edge = 0;
+        else
+            fail[*edge] = 0, queue[tail++] = *edge;
+    }
+
+    while(head < tail)
+    {
+        uint32_t s = queue[head++];
+
+        ret->matches[s] |= ret->matches[fail[s]];
+
+        for(size_t c = 0; c < 256; c++)
+        {
+            uint32_t* edge = &ret->next[(size_t)s * 256 + c];
+            uint32_t fallback = ret->next[(size_t)fail[s] * 256 + c];
+
+            if(*edge == NO_STATE)
+                *edge = fallback;
+            else
+                fail[*edge] = fallback, queue[tail++] = *edge;
+        }
+    }
+
+    /* Upper case letters go wherever their lower case ones do. */
+    if(ignore_case)
+        for(size_t s = 0; s < ret->states; s++)
+            for(unsigned c = 'A'; c <= 'Z'; c++)
+                ret->next[s * 256 + c] = ret->next[s * 256 + fold((unsigned char)c)];
+
+    for(size_t c = 0; c < 256; c++)
+        ret->starts[c] = ret->next[c] != 0;
+
+    free(fail);
+    free(queue);
+
+    /* Give back what the patterns' shared prefixes saved. */
+    uint32_t* next = realloc(ret->next, ret->states * 256 * sizeof *next);
+    if(next) ret->next = next;
+
+    return ret;
+
+mem_error:
+    free(fail);
+    free(queue);
+    nbt_prefilter_free(ret);
+
+    return (errno = NBT_EMEM), NULL;
+}
+
+void nbt_prefilter_free(nbt_prefilter* f)
+{
+    if(f == NULL) return;
+
+    free(f->next);
+    free(f->matches);
+    free(f);
+}
+
+/*
+ * Runs `data' through the automaton from the start, and returns `found' with
+ * every pattern it saw added. Stops as soon as it's seen them all.
+ */
+static uint64_t scan_piece(const nbt_prefilter* f, const unsigned char* p, size_t length,
+                           uint64_t found)
+{
+    const uint32_t* next = f->next;
+    const unsigned char* starts = f->starts;
+
+    uint32_t s = 0;
+    size_t i = 0;
+
+    while(i < length && found != f->all)
+    {
+        /*
+         * Most of a chunk is block data that doesn't start any pattern, and
+         * until something does, there's nothing to look up.
+         */
+        if(s == 0)
+        {
+            while(i + 8 <= length && !(starts[p[i    ]] | starts[p[i + 1]] |
+                                       starts[p[i + 2]] | starts[p[i + 3]] |
+                                       starts[p[i + 4]] | starts[p[i + 5]] |
+                                       starts[p[i + 6]] | starts[p[i + 7]]))
+                i += 8;
+
+            while(i < length && !starts[p[i]])
+                i++;
+
+            if(i == length)
+                break;
+        }
+
+        s = next[(size_t)s * 256 + p[i++]];
+        found |= f->matches[s];
+    }
+
+    return found;
+}
+
+/* Turns a set of patterns into what nbt_prefilter_scan returns. */
+static size_t report(const nbt_prefilter* f, uint64_t found, bool* seen)
+{
+    size_t ret = 0;
+
+    for(size_t i = 0; i < f->count; i++)
+    {
+        bool here = (found >> i) & 1;
+
+        if(seen) seen[i] = here;
+        ret += here;
+    }
+
+    return ret;
+}
+
+size_t nbt_prefilter_scan(const nbt_prefilter* f, const void* data, size_t length, bool* seen)
+{
+    assert(f);
+
+    return report(f, scan_piece(f, data, length, f->empty), seen);
+}
+
+bool nbt_prefilter_match(const nbt_prefilter* f, const void* data, size_t length)
+{
+    return nbt_prefilter_scan(f, data, length, NULL) == f->count;
+}
+
+/*
+ * Scanning a tree only looks at its names and strings, one at a time. Arrays
+ * and lists of numbers, which are most of a chunk, are stepped over by length
+ * without being looked at.
+ */
+struct tree_scan {
+    const nbt_prefilter* f;
+    uint64_t found;
+};
+
+static nbt_event_action scan_name(const struct nbt_event* ev, struct tree_scan* scan)
+{
+    if(ev->name)
+        scan->found = scan_piece(scan->f, (const unsigned char*)ev->name, ev->name_length,
+                                 scan->found);
+
+    return scan->found == scan->f->all ? NBT_EVENT_STOP : NBT_EVENT_CONTINUE;
+}
+
+static nbt_event_action scan_compound(const struct nbt_event* ev, void* aux)
+{
+    return scan_name(ev, aux);
+}
+
+static nbt_event_action scan_list(const struct nbt_event* ev, void* aux)
+{
+    nbt_event_action action = scan_name(ev, aux);
+
+    if(action != NBT_EVENT_CONTINUE)
+        return action;
+
+    switch(ev->payload.tag_list.type)
+    {
+    case TAG_STRING: case TAG_LIST: case TAG_COMPOUND:
+        return NBT_EVENT_CONTINUE;
+
+    default:
+        return NBT_EVENT_SKIP; /* Numbers and arrays. Nothing to see. */
+    }
+}
+
+static nbt_event_action scan_value(const struct nbt_event* ev, void* aux)
+{
+    struct tree_scan* scan = aux;
+
+    if(ev->type == TAG_STRING)
+        scan->found = scan_piece(scan->f, (const unsigned char*)ev->payload.tag_string.data,
+                                 ev->payload.tag_string.length, scan->found);
+
+    return scan_name(ev, aux);
+}
+
+size_t nbt_prefilter_scan_tree(const nbt_prefilter* f, const void* data, size_t length, bool* seen)
+{
+    assert(f);
+
+    static const struct nbt_event_handler handler = {
+        .compound_begin = scan_compound,
+        .list_begin     = scan_list,
+        .value          = scan_value
+    };
+
+    struct tree_scan scan = { f, f->empty };
+
+    if(scan.found != f->all && nbt_parse_events(data, length, &handler, &scan) != NBT_OK)
+        scan.found = f->all; /* Corrupt. Leave it to the parser to say so. */
+
+    return report(f, scan.found, seen);
+}
+
+bool nbt_prefilter_match_tree(const nbt_prefilter* f, const void* data, size_t length)
+{
+    return nbt_prefilter_scan_tree(f, data, length, NULL) == f->count;
+}
@@ -0,0 +1,913 @@
+/*
+ * -----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * Lukas Niederbremer <webmaster@flippeh.de> and Clark Gaebel <cg.wowus.cg@gmail.com>
+ * wrote this file. As long as you retain this notice you can do whatever you
+ * want with this stuff. If we meet some day, and you think this stuff is worth
+ * it, you can buy us a beer in return.
+ * -----------------------------------------------------------------------------
+ */
+#include "nbt.h"
+
+#include "bswap.h"
+#include "list.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * The push parser is nbt_parse turned inside out. Instead of recursing down
+ * the tree and pulling bytes as it needs them, it keeps its place in an
+ * explicit stack and a state, and consumes whatever bytes it's given. When a
+ * slice ends in the middle of a tag, the state says exactly what we were in the
+ * middle of reading, so the next slice picks up from there.
+ *
+ * Every node is hooked into the tree the moment it's created, so a half-built
+ * tree can always be torn down with nbt_free.
+ *
+ * With an event handler, no tree is built at all. Each tag is handed to the
+ * handler once it's complete, and what it takes up is given back. Names,
+ * strings and arrays are pieced together in buffers that are reused from one
+ * tag to the next, and ones inside a skipped list or compound aren't kept at
+ * all.
+ */
+
+/* What we're waiting for the next bytes to be. */
+enum push_state {
+    PUSH_TAG_TYPE,      /* The root's type, or the type of a compound's next child. */
+    PUSH_NAME_LENGTH,
+    PUSH_NAME,
+    PUSH_SCALAR,        /* A fixed-size payload. */
+    PUSH_STRING_LENGTH,
+    PUSH_STRING,
+    PUSH_ARRAY_LENGTH,
+    PUSH_ARRAY,
+    PUSH_LIST_HEADER,   /* A list's element type and count. */
+    PUSH_DONE,          /* The tree is complete. Anything after it is ignored. */
+    PUSH_FAILED
+};
+
+/* A list or compound we're in the middle of. */
+struct push_frame {
+    nbt_node* node;     /* Tree mode only. */
+    nbt_type type;
+    nbt_type elem_type; /* Lists only. */
+    int32_t length;     /* Lists only. */
+    int32_t remaining;  /* Lists only: elements still to come. */
+
+    char* name;         /* Event mode only, for the end event. */
+    size_t name_length;
+};
+
+struct nbt_push_parser {
+    enum push_state state;
+    nbt_status error;  /* Only meaningful in PUSH_FAILED. */
+    size_t nodes;      /* How many nodes we've created so far. */
+
+    nbt_node* root;
+    nbt_node* node;    /* The node whose payload we're reading. */
+
+    struct push_frame* stack;
+    size_t depth;
+    size_t cap;
+
+    nbt_type type;     /* The type of the next node, before it exists. */
+    char* name;        /* The name of the next node, before it exists. */
+    size_t name_length;
+
+    /* Fixed-size fields that straddle two slices are pieced together here. */
+    unsigned char scratch[8];
+    size_t need;
+    size_t have;
+
+    /* Names, strings and arrays are copied straight to where they belong. */
+    unsigned char* blob;
+    size_t blob_length;
+    size_t blob_have;
+    size_t blob_room;  /* Arrays only get room for what's come in so far. */
+
+    /* Event mode. Without a handler, we're building a tree. */
+    const struct nbt_event_handler* handler;
+    void* aux;
+    struct nbt_event ev;  /* The tag whose payload we're reading. */
+    size_t skipping;      /* If not 0, nothing this deep or deeper is reported. */
+
+    char* names;          /* Where names are pieced together. */
+    size_t names_cap;
+    unsigned char* buf;   /* Where strings and arrays are. */
+    size_t buf_cap;
+};
+
+nbt_push_parser* nbt_push_parser_new(void)
+{
+    nbt_push_parser* ret = calloc(1, sizeof *ret);
+
+    if(ret == NULL)
+        return (errno = NBT_EMEM), NULL;
+
+    ret->state = PUSH_TAG_TYPE;
+    ret->need  = 1;
+
+    return ret;
+}
+
+nbt_push_parser* nbt_push_parser_new_events(const struct nbt_event_handler* handler, void* aux)
+{
+    assert(handler);
+
+    nbt_push_parser* ret = nbt_push_parser_new();
+
+    if(ret == NULL)
+        return NULL;
+
+    ret->handler = handler;
+    ret->aux     = aux;
+
+    return ret;
+}
+
+void nbt_push_parser_free(nbt_push_parser* p)
+{
+    if(p == NULL) return;
+
+    for(size_t i = 0; i < p->depth; i++)
+        free(p->stack[i].name);
+
+    nbt_free(p->root);
+    free(p->stack);
+    free(p->names);
+    free(p->buf);
+
+    if(p->handler == NULL)
+        free(p->name);
+
+    free(p);
+}
+
+bool nbt_push_parser_done(const nbt_push_parser* p)
+{
+    return p->state == PUSH_DONE;
+}
+
+nbt_node* nbt_push_parser_finish(nbt_push_parser* p)
+{
+    if(p->state == PUSH_FAILED)
+        return (errno = p->error), NULL;
+
+    /* The input ran out before the tree did. */
+    if(p->state != PUSH_DONE)
+        return (errno = NBT_ERR), NULL;
+
+    nbt_node* ret = p->root;
+    p->root = NULL;
+
+    errno = NBT_OK;
+    return ret;
+}
+
+static inline nbt_status fail(nbt_push_parser* p, nbt_status err)
+{
+    p->state = PUSH_FAILED;
+    p->error = err;
+    return err;
+}
+
+/* Starts waiting for an `n'-byte fixed-size field. */
+static inline void expect(nbt_push_parser* p, enum push_state state, size_t n)
+{
+    assert(n <= sizeof p->scratch);
+
+    p->state = state;
+    p->need  = n;
+    p->have  = 0;
+}
+
+/*
+ * Takes as much as we can of the field we're waiting for. Returns true once
+ * it's all there, in p->scratch and in big-endian byte order.
+ */
+static inline bool gather(nbt_push_parser* p, const unsigned char** data, size_t* length)
+{
+    size_t n = p->need - p->have;
+    if(n > *length) n = *length;
+
+    memcpy(p->scratch + p->have, *data, n);
+    p->have += n;
+    *data   += n;
+    *length -= n;
+
+    return p->have == p->need;
+}
+
+/* The same as gather, but for names, strings and arrays. A NULL blob is thrown away. */
+static inline bool gather_blob(nbt_push_parser* p, const unsigned char** data, size_t* length)
+{
+    size_t n = p->blob_length - p->blob_have;
+    if(n > *length) n = *length;
+
+    if(p->blob)
+        memcpy(p->blob + p->blob_have, *data, n);
+
+    p->blob_have += n;
+    *data        += n;
+    *length      -= n;
+
+    return p->blob_have == p->blob_length;
+}
+
+/*
+ * Whether the name, string or array we're waiting for is already all there,
+ * as an empty one is, and can be finished without any more input.
+ */
+static inline bool blob_complete(const nbt_push_parser* p)
+{
+    return (p->state == PUSH_NAME || p->state == PUSH_STRING || p->state == PUSH_ARRAY) &&
+           p->blob_have == p->blob_length;
+}
+
+static inline void expect_blob(nbt_push_parser* p, enum push_state state, void* dest, size_t n)
+{
+    p->state       = state;
+    p->blob        = dest;
+    p->blob_length = n;
+    p->blob_have   = 0;
+    p->blob_room   = n;
+}
+
+/*
+ * Makes sure one of the event mode buffers has room for `n' bytes. Returns the
+ * buffer, which may have moved, or NULL if we're out of memory.
+ */
+static void* reserve(void* buffer, size_t* cap, size_t n)
+{
+    if(n == 0)
+        n = 1;
+
+    if(buffer && n <= *cap)
+        return buffer;
+
+    if(n < *cap * 2)
+        n = *cap * 2;
+
+    void* grown = realloc(buffer, n);
+
+    if(grown)
+        *cap = n;
+
+    return grown;
+}
+
+/*
+ * An array's length comes from the input, so it only gets this much room up
+ * front. After that, it grows as its elements actually arrive, and a header
+ * that lies about the length costs no more than the bytes that came with it.
+ */
+#define ARRAY_ROOM 65536
+
+static inline size_t initial_room(size_t n)
+{
+    return n < ARRAY_ROOM ? n : ARRAY_ROOM;
+}
+
+/* Makes room in the array being gathered for as much of `length' as it'll take. */
+static bool make_room(nbt_push_parser* p, size_t length)
+{
+    size_t n = p->blob_length - p->blob_have;
+    if(n > length) n = length;
+
+    if(p->blob == NULL || p->blob_have + n <= p->blob_room)
+        return true;
+
+    size_t room = 2 * p->blob_room;
+
+    if(room < p->blob_have + n) room = p->blob_have + n;
+    if(room > p->blob_length)   room = p->blob_length;
+
+    unsigned char* grown;
+
+    if(p->handler)
+    {
+        if((grown = reserve(p->buf, &p->buf_cap, room)) == NULL)
+            return false;
+
+        p->buf = grown;
+        p->ev.payload.tag_array.data = grown;
+    }
+    else
+    {
+        if((grown = realloc(p->blob, room)) == NULL)
+            return false;
+
+        /* all three array structs look alike. */
+        p->node->payload.tag_byte_array.data = grown;
+    }
+
+    p->blob      = grown;
+    p->blob_room = room;
+
+    return true;
+}
+
+/* Whether the tag we're about to read is inside something that's being skipped. */
+static inline bool quiet(const nbt_push_parser* p)
+{
+    return p->skipping && p->depth >= p->skipping;
+}
+
+/* Hands the current tag to one of the callbacks, unless we're being quiet. */
+static inline nbt_event_action emit(nbt_push_parser* p,
+                                    nbt_event_action (*callback)(const struct nbt_event*, void*),
+                                    const struct nbt_event* ev)
+{
+    if(callback == NULL || quiet(p))
+        return NBT_EVENT_CONTINUE;
+
+    return callback(ev, p->aux);
+}
+
+static nbt_status push_frame(nbt_push_parser* p, struct push_frame frame)
+{
+    /* The same limit nbt_parse has. */
+    if(p->depth >= NBT_DEFAULT_MAX_DEPTH)
+        return NBT_ERR;
+
+    if(p->depth == p->cap)
+    {
+        size_t cap = p->cap ? p->cap * 2 : 16;
+        struct push_frame* stack = realloc(p->stack, cap * sizeof *stack);
+
+        if(stack == NULL)
+            return NBT_EMEM;
+
+        p->stack = stack;
+        p->cap   = cap;
+    }
+
+    p->stack[p->depth++] = frame;
+    return NBT_OK;
+}
+
+/*
+ * In event mode, a list or compound needs its name again when it ends. Copies
+ * it out of the name buffer, which the next tag will overwrite, into a frame.
+ */
+static nbt_status push_named_frame(nbt_push_parser* p, struct push_frame frame)
+{
+    nbt_status err;
+
+    if(p->handler && p->ev.name && !quiet(p))
+    {
+        if((frame.name = malloc(p->ev.name_length + 1)) == NULL)
+            return NBT_EMEM;
+
+        memcpy(frame.name, p->ev.name, p->ev.name_length);
+        frame.name[p->ev.name_length] = '\0';
+        frame.name_length = p->ev.name_length;
+    }
+
+    if((err = push_frame(p, frame)) != NBT_OK)
+        free(frame.name);
+
+    return err;
+}
+
+/* Acts on what a begin event said to do. `stopped' is set on NBT_EVENT_STOP. */
+static void obey(nbt_push_parser* p, nbt_event_action action, bool* stopped)
+{
+    *stopped = action == NBT_EVENT_STOP;
+
+    if(*stopped)
+        p->state = PUSH_DONE;
+    else if(action == NBT_EVENT_SKIP && !p->skipping)
+        p->skipping = p->depth; /* Everything in the frame we just pushed. */
+}
+
+static struct tag_list* new_list_head(void)
+{
+    struct tag_list* ret = malloc(sizeof *ret);
+
+    if(ret == NULL)
+        return NULL;
+
+    ret->data = NULL;
+    INIT_LIST_HEAD(&ret->entry);
+    return ret;
+}
+
+static inline struct tag_list* children_of(nbt_node* container)
+{
+    return container->type == TAG_LIST ? container->payload.tag_list.list
+                                       : container->payload.tag_compound;
+}
+
+/* The same fix-ups read_list and parse_unnamed_tag do once a list is read. */
+static void finish_list(nbt_node* list)
+{
+    if(list->payload.tag_list.type == TAG_INVALID &&
+       list_empty(&list->payload.tag_list.list->entry))
+        list->payload.tag_list.type = TAG_COMPOUND;
+}
+
+/*
+ * Pops the list or compound on top of the stack. In event mode, says so, unless
+ * it was skipped. Sets `stopped' if the handler says stop.
+ */
+static void end_frame(nbt_push_parser* p, bool* stopped)
+{
+    struct push_frame top = p->stack[--p->depth];
+
+    *stopped = false;
+
+    if(p->handler == NULL)
+    {
+        if(top.type == TAG_LIST)
+            finish_list(top.node);
+
+        return;
+    }
+
+    if(p->skipping)
+    {
+        /* The end of the list or compound that was skipped isn't reported. */
+        if(p->depth + 1 == p->skipping)
+            p->skipping = 0;
+
+        free(top.name);
+        return;
+    }
+
+    struct nbt_event ev = {
+        .type        = top.type,
+        .name        = top.name,
+        .name_length = top.name_length,
+        .depth       = p->depth
+    };
+
+    nbt_event_action action;
+
+    if(top.type == TAG_LIST)
+    {
+        ev.payload.tag_list.type   = top.elem_type;
+        ev.payload.tag_list.length = top.length;
+
+        action = emit(p, p->handler->list_end, &ev);
+    }
+    else
+    {
+        action = emit(p, p->handler->compound_end, &ev);
+    }
+
+    free(top.name);
+
+    if(action == NBT_EVENT_STOP)
+    {
+        *stopped = true;
+        p->state = PUSH_DONE;
+    }
+}
+
+static nbt_status next_node(nbt_push_parser* p);
+
+/*
+ * Creates the node we've got the type (and maybe name) of, hooks it into the
+ * tree, and starts reading its payload. In event mode, there's no node, and
+ * `name' is only borrowed.
+ */
+static nbt_status begin_node(nbt_push_parser* p, nbt_type type, char* name, size_t name_length)
+{
+    p->nodes++;
+
+    if(p->handler)
+    {
+        p->ev = (struct nbt_event) {
+            .type        = type,
+            .name        = name,
+            .name_length = name_length,
+            .depth       = p->depth
+        };
+    }
+    else
+    {
+        nbt_node* node = calloc(1, sizeof *node);
+
+        if(node == NULL)
+            return free(name), NBT_EMEM;
+
+        node->type = type;
+        node->name = name;
+
+        if(p->depth)
+        {
+            struct tag_list* entry = malloc(sizeof *entry);
+
+            if(entry == NULL)
+                return nbt_free(node), NBT_EMEM;
+
+            entry->data = node;
+            list_add_tail(&entry->entry, &children_of(p->stack[p->depth - 1].node)->entry);
+        }
+        else
+        {
+            p->root = node;
+        }
+
+        p->node = node;
+    }
+
+    switch(type)
+    {
+    case TAG_BYTE:   expect(p, PUSH_SCALAR, 1); break;
+    case TAG_SHORT:  expect(p, PUSH_SCALAR, 2); break;
+    case TAG_INT:    expect(p, PUSH_SCALAR, 4); break;
+    case TAG_LONG:   expect(p, PUSH_SCALAR, 8); break;
+    case TAG_FLOAT:  expect(p, PUSH_SCALAR, 4); break;
+    case TAG_DOUBLE: expect(p, PUSH_SCALAR, 8); break;
+
+    case TAG_STRING:
+        expect(p, PUSH_STRING_LENGTH, 2);
+        break;
+
+    case TAG_BYTE_ARRAY:
+    case TAG_INT_ARRAY:
+    case TAG_LONG_ARRAY:
+        expect(p, PUSH_ARRAY_LENGTH, 4);
+        break;
+
+    case TAG_LIST:
+        expect(p, PUSH_LIST_HEADER, 5);
+        break;
+
+    case TAG_COMPOUND:
+    {
+        nbt_status err;
+        struct push_frame frame = { .node = p->node, .type = TAG_COMPOUND };
+
+        if(p->handler)
+        {
+            nbt_event_action action = emit(p, p->handler->compound_begin, &p->ev);
+            bool stopped;
+
+            if(action == NBT_EVENT_STOP)
+                return obey(p, action, &stopped), NBT_OK;
+
+            if((err = push_named_frame(p, frame)) != NBT_OK)
+                return err;
+
+            obey(p, action, &stopped);
+        }
+        else
+        {
+            if((p->node->payload.tag_compound = new_list_head()) == NULL)
+                return NBT_EMEM;
+
+            if((err = push_frame(p, frame)) != NBT_OK)
+                return err;
+        }
+
+        expect(p, PUSH_TAG_TYPE, 1);
+        break;
+    }
+
+    default:
+        return NBT_ERR; /* Unknown node or TAG_END. */
+    }
+
+    return NBT_OK;
+}
+
+/*
+ * The current node is complete. In event mode, it's reported now. Then figures
+ * out what comes next: another list element, another compound child, or the
+ * end of one or more containers.
+ */
+static nbt_status finish_node(nbt_push_parser* p)
+{
+    if(p->handler && emit(p, p->handler->value, &p->ev) == NBT_EVENT_STOP)
+    {
+        p->state = PUSH_DONE;
+        return NBT_OK;
+    }
+
+    return next_node(p);
+}
+
+static nbt_status next_node(nbt_push_parser* p)
+{
+    while(p->depth)
+    {
+        struct push_frame* top = &p->stack[p->depth - 1];
+        bool stopped;
+
+        /* compounds end with a TAG_End, which we have to wait for. */
+        if(top->type == TAG_COMPOUND)
+        {
+            expect(p, PUSH_TAG_TYPE, 1);
+            return NBT_OK;
+        }
+
+        if(top->remaining > 0)
+        {
+            top->remaining--;
+            return begin_node(p, top->elem_type, NULL, 0);
+        }
+
+        end_frame(p, &stopped);
+
+        if(stopped)
+            return NBT_OK;
+    }
+
+    p->state = PUSH_DONE;
+    return NBT_OK;
+}
+
+/* Reads a big-endian field out of the scratch space. */
+#define SCRATCH_AS(type, var) \
+    type var; memcpy(&var, p->scratch, sizeof var); be2ne(&var, sizeof var)
+
+static nbt_status step(nbt_push_parser* p, const unsigned char** data, size_t* length)
+{
+    switch(p->state)
+    {
+    case PUSH_TAG_TYPE:
+    {
+        if(!gather(p, data, length)) return NBT_OK;
+
+        uint8_t type = p->scratch[0];
+
+        if(type == 0 && p->depth) /* TAG_End */
+        {
+            bool stopped;
+            end_frame(p, &stopped);
+
+            return stopped ? NBT_OK : next_node(p);
+        }
+
+        p->type = (nbt_type)type;
+        expect(p, PUSH_NAME_LENGTH, 2);
+        return NBT_OK;
+    }
+    case PUSH_NAME_LENGTH:
+    {
+        if(!gather(p, data, length)) return NBT_OK;
+
+        SCRATCH_AS(int16_t, name_length);
+
+        if(name_length < 0)
+            return NBT_ERR;
+
+        if(p->handler)
+        {
+            char* names = reserve(p->names, &p->names_cap, (size_t)name_length + 1);
+
+            if(names == NULL)
+                return NBT_EMEM;
+
+            p->name = p->names = names;
+        }
+        else if((p->name = malloc((size_t)name_length + 1)) == NULL)
+        {
+            return NBT_EMEM;
+        }
+
+        p->name[name_length] = '\0';
+        p->name_length = (size_t)name_length;
+
+        expect_blob(p, PUSH_NAME, quiet(p) ? NULL : p->name, (size_t)name_length);
+        return NBT_OK;
+    }
+    case PUSH_NAME:
+    {
+        if(!gather_blob(p, data, length)) return NBT_OK;
+
+        char* name = p->name;
+        p->name = NULL;
+
+        return begin_node(p, p->type, name, p->name_length);
+    }
+    case PUSH_SCALAR:
+    {
+        if(!gather(p, data, length)) return NBT_OK;
+
+        /* Both unions start with every scalar. */
+        void* payload = p->handler ? (void*)&p->ev.payload : (void*)&p->node->payload;
+
+        memcpy(payload, p->scratch, p->need);
+        be2ne(payload, p->need);
+
+        return finish_node(p);
+    }
+    case PUSH_STRING_LENGTH:
+    {
+        if(!gather(p, data, length)) return NBT_OK;
+
+        SCRATCH_AS(int16_t, string_length);
+
+        if(string_length < 0)
+            return NBT_ERR;
+
+        char* s;
+
+        if(p->handler)
+        {
+            if(quiet(p))
+                return expect_blob(p, PUSH_STRING, NULL, (size_t)string_length), NBT_OK;
+
+            if((s = reserve(p->buf, &p->buf_cap, (size_t)string_length + 1)) == NULL)
+                return NBT_EMEM;
+
+            p->buf = (unsigned char*)s;
+
+            p->ev.payload.tag_string.data   = s;
+            p->ev.payload.tag_string.length = (size_t)string_length;
+        }
+        else
+        {
+            if((s = malloc((size_t)string_length + 1)) == NULL)
+                return NBT_EMEM;
+
+            p->node->payload.tag_string = s;
+        }
+
+        s[string_length] = '\0';
+
+        expect_blob(p, PUSH_STRING, s, (size_t)string_length);
+        return NBT_OK;
+    }
+    case PUSH_ARRAY_LENGTH:
+    {
+        if(!gather(p, data, length)) return NBT_OK;
+
+        SCRATCH_AS(int32_t, elems);
+
+        if(elems < 0)
+            return NBT_ERR;
+
+        nbt_type type = p->handler ? p->ev.type : p->node->type;
+        size_t elem_size = type == TAG_BYTE_ARRAY ? 1 : type == TAG_INT_ARRAY ? 4 : 8;
+
+        if(p->handler)
+        {
+            if(quiet(p))
+                return expect_blob(p, PUSH_ARRAY, NULL, elem_size * (size_t)elems), NBT_OK;
+
+            size_t room = initial_room(elem_size * (size_t)elems);
+            unsigned char* buf = reserve(p->buf, &p->buf_cap, room);
+
+            if(buf == NULL)
+                return NBT_EMEM;
+
+            p->buf = buf;
+
+            /* Arrays are left big-endian, just like nbt_parse_events leaves them. */
+            p->ev.payload.tag_array.data   = p->buf;
+            p->ev.payload.tag_array.length = elems;
+
+            expect_blob(p, PUSH_ARRAY, p->buf, elem_size * (size_t)elems);
+            p->blob_room = p->buf_cap;
+            return NBT_OK;
+        }
+
+        nbt_node* node = p->node;
+
+        size_t room = initial_room(elem_size * (size_t)elems);
+        void* a = malloc(room);
+        if(a == NULL && elems)
+            return NBT_EMEM;
+
+        /* all three array structs look alike. */
+        node->payload.tag_byte_array.data   = a;
+        node->payload.tag_byte_array.length = elems;
+
+        expect_blob(p, PUSH_ARRAY, a, elem_size * (size_t)elems);
+        p->blob_room = room;
+        return NBT_OK;
+    }
+    case PUSH_STRING:
+    case PUSH_ARRAY:
+    {
+        if(!make_room(p, *length)) return NBT_EMEM;
+        if(!gather_blob(p, data, length)) return NBT_OK;
+
+        if(p->handler)
+            return finish_node(p);
+
+        nbt_node* node = p->node;
+
+        if(node->type == TAG_INT_ARRAY)
+            be2ne_array32(node->payload.tag_int_array.data,
+                          node->payload.tag_int_array.data,
+                          (size_t)node->payload.tag_int_array.length);
+
+        if(node->type == TAG_LONG_ARRAY)
+            be2ne_array64(node->payload.tag_long_array.data,
+                          node->payload.tag_long_array.data,
+                          (size_t)node->payload.tag_long_array.length);
+
+        return finish_node(p);
+    }
+    case PUSH_LIST_HEADER:
+    {
+        if(!gather(p, data, length)) return NBT_OK;
+
+        nbt_type type = (nbt_type)p->scratch[0];
+        nbt_status err;
+
+        int32_t elems;
+        memcpy(&elems, p->scratch + 1, sizeof elems);
+        be2ne(&elems, sizeof elems);
+
+        if(!p->handler)
+        {
+            if((p->node->payload.tag_list.list = new_list_head()) == NULL)
+                return NBT_EMEM;
+
+            p->node->payload.tag_list.type = type;
+        }
+
+        if(elems > 0 && type == TAG_INVALID)
+            return NBT_ERR;
+
+        struct push_frame frame = {
+            .node      = p->node,
+            .type      = TAG_LIST,
+            .elem_type = type,
+            .length    = elems,
+            .remaining = elems > 0 ? elems : 0
+        };
+
+        if(p->handler)
+        {
+            p->ev.payload.tag_list.type   = type;
+            p->ev.payload.tag_list.length = elems;
+
+            nbt_event_action action = emit(p, p->handler->list_begin, &p->ev);
+            bool stopped;
+
+            if(action == NBT_EVENT_STOP)
+                return obey(p, action, &stopped), NBT_OK;
+
+            if((err = push_named_frame(p, frame)) != NBT_OK)
+                return err;
+
+            obey(p, action, &stopped);
+        }
+        else if((err = push_frame(p, frame)) != NBT_OK)
+        {
+            return err;
+        }
+
+        return next_node(p);
+    }
+
+    case PUSH_DONE:
+        *data  += *length; /* trailing garbage is ignored, like nbt_parse does. */
+        *length = 0;
+        return NBT_OK;
+
+    case PUSH_FAILED:
+        return p->error;
+    }
+
+    return NBT_ERR;
+}
+
+#undef SCRATCH_AS
+
+nbt_status nbt_push_parser_feed(nbt_push_parser* p, const void* data, size_t length)
+{
+    return nbt_push_parser_feed_some(p, data, length, SIZE_MAX, NULL);
+}
+
+nbt_status nbt_push_parser_feed_some(nbt_push_parser* p, const void* data, size_t length,
+                                     size_t max_nodes, size_t* used)
+{
+    assert(p);
+
+    if(used) *used = 0;
+
+    if(p->state == PUSH_FAILED)
+        return p->error;
+
+    const unsigned char* cursor = data;
+    const size_t start = p->nodes;
+
+    while((length > 0 || blob_complete(p)) && p->nodes - start < max_nodes)
+    {
+        nbt_status err = step(p, &cursor, &length);
+
+        if(used) *used = (size_t)(cursor - (const unsigned char*)data);
+
+        if(err != NBT_OK)
+            return fail(p, err);
+    }
+
+    return NBT_OK;
+}
+
+size_t nbt_push_parser_nodes(const nbt_push_parser* p)
+{
+    return p->nodes;
+}
@@ -0,0 +1,625 @@
+/*
+ * -----------------------------------------------------------------------------
+ * "THE BEER-WARE LICENSE" (Revision 42):
+ * Lukas Niederbremer <webmaster@flippeh.de> and Clark Gaebel <cg.wowus.cg@gmail.com>
+ * wrote this file. As long as you retain this notice you can do whatever you
+ * want with this stuff. If we meet some day, and you think this stuff is worth
+ * it, you can buy us a beer in return.
+ * -----------------------------------------------------------------------------
+ */
+
+/*
+ * The tree parser, written once for every byte order. nbt_parsing.c includes
+ * this file once per variant, after defining:
+ *
+ *   READER(name)        What to call each function in this instance.
+ *   READER_SCAN         A memscan that also converts the scalar it copies,
+ *                       from the input's byte order to the native one.
+ *   READER_ARRAY16/32/64  The same, for whole arrays of shorts, ints and longs.
+ *   READER_BIG_ENDIAN   1 if the input is big-endian. Lazy compounds,
+ *                       borrowed arrays and threads only come with it, since
+ *                       they lean on code (the skipper, nbt_int_array_get) that
+ *                       only reads big-endian.
+ *
+ * Every instance gets its own copy of every function, so whatever varies is
+ * fixed at compile time and nothing about it is looked at per tag. They're all
+ * undefined again at the bottom, ready for the next one.
+ *
+ * There's no include guard, on purpose. Nothing else should include this.
+ */
+
+/*
+ * Reads a string from memory, moving the pointer and updating the length
+ * appropriately. Returns NULL on failure.
+ *
+ * If `interned' isn't NULL, the string may come out of ctx->intern instead,
+ * in which case it's set to true, and the string isn't the caller's to free.
+ * If `small' isn't NULL, a string of up to NBT_INLINE_NAME_MAX bytes that
+ * would otherwise have been allocated is put there instead.
+ */
+static inline char* READER(read_string)(struct parse_ctx* ctx, const char** memory, size_t* length,
+                                        bool* interned, char* small)
+{
+    int16_t string_length;
+    char* ret = NULL;
+
+    READ_GENERIC(&string_length, sizeof string_length, READER_SCAN, goto parse_error);
+
+    if(string_length < 0)               goto parse_error;
+    if(*length < (size_t)string_length) goto parse_error;
+
+    if(ctx->borrowed)
+        ret = borrow_string(memory, length, (size_t)string_length);
+
+    else if(interned && ctx->intern && string_length <= NBT_INTERN_MAX_LENGTH)
+    {
+        char scratch[NBT_INTERN_MAX_LENGTH];
+        size_t n = (size_t)string_length;
+
+        READ_GENERIC(scratch, n, memscan, goto parse_error);
+
+        if(ctx->utf8 && (n = nbt_mutf8_to_utf8(scratch, scratch, n)) == SIZE_MAX)
+            goto parse_error;
+
+        const char* found = ctx->intern_readonly ? nbt_intern_find(ctx->intern, scratch, n)
+                                                 : nbt_intern(ctx->intern, scratch, n);
+        if(found)
+            return *interned = true, (char*)found;
+
+        if(!ctx->intern_readonly) goto parse_error; /* out of memory */
+
+        /* Not in there, and we can't add it. An ordinary copy it is. */
+        if(!charge(ctx, n + 1, 0)) goto parse_error;
+
+        if(small && n <= NBT_INLINE_NAME_MAX)
+            ret = small;
+        else
+            CTX_MALLOC(ctx, ret, n + 1, goto parse_error);
+
+        memcpy(ret, scratch, n);
+        ret[n] = '\0';
+        return ret;
+    }
+
+    else
+    {
+        if(!charge(ctx, (size_t)string_length + 1, 0)) goto parse_error;
+
+        if(small && string_length <= NBT_INLINE_NAME_MAX)
+            ret = small;
+        else
+            CTX_MALLOC(ctx, ret, string_length + 1, goto parse_error);
+
+        READ_GENERIC(ret, (size_t)string_length, memscan, goto parse_error);
+    }
+
+    if(ctx->utf8)
+    {
+        /* It only ever gets shorter, so it can stay where it is. */
+        size_t transcoded = nbt_mutf8_to_utf8(ret, ret, (size_t)string_length);
+
+        if(transcoded == SIZE_MAX) goto parse_error;
+
+        string_length = (int16_t)transcoded;
+    }
+
+    ret[string_length] = '\0'; /* don't forget to NULL-terminate ;) */
+    return ret;
+
+parse_error:
+    if(errno == NBT_OK)
+        errno = NBT_ERR;
+
+    if(ret != small) ctx_free_data(ctx, ret);
+    return NULL;
+}
+
+/*
+ * Reads an array's length, and makes sure that many elements of `size' bytes
+ * are really there, and are allowed, before anyone allocates room for them.
+ */
+static inline bool READER(read_array_length)(struct parse_ctx* ctx, int32_t* elems, size_t size,
+                                             const char** memory, size_t* length)
+{
+    READ_GENERIC(elems, sizeof *elems, READER_SCAN, return false);
+
+    if(*elems < 0 || (size_t)*elems > *length / size)
+        return false;
+
+    if(!allowed_length(ctx, *elems))
+        return false;
+
+    return ctx->borrowed || charge(ctx, size * (size_t)*elems, 0);
+}
+
+static inline struct nbt_byte_array READER(read_byte_array)(struct parse_ctx* ctx, const char** memory, size_t* length)
+{
+    struct nbt_byte_array ret = { NULL, 0 };
+
+    if(!READER(read_array_length)(ctx, &ret.length, 1, memory, length))
+        goto parse_error;
+
+    if(ctx->borrowed)
+    {
+        ret.data = (unsigned char*)*memory;
+        *memory += ret.length;
+        *length -= ret.length;
+        return ret;
+    }
+
+    CTX_MALLOC(ctx, ret.data, (size_t)ret.length, goto parse_error);
+
+    READ_GENERIC(ret.data, (size_t)ret.length, memscan, goto parse_error);
+
+    return ret;
+
+parse_error:
+    if(errno == NBT_OK)
+        errno = NBT_ERR;
+
+    ctx_free_data(ctx, ret.data);
+    ret.data = NULL;
+    return ret;
+}
+
+static inline struct nbt_int_array READER(read_int_array)(struct parse_ctx* ctx, const char** memory, size_t* length)
+{
+    struct nbt_int_array ret = { NULL, 0 };
+
+    if(!READER(read_array_length)(ctx, &ret.length, 4, memory, length))
+        goto parse_error;
+
+#if READER_BIG_ENDIAN
+    /* borrowed int arrays stay big-endian. nbt_int_array_get deals with it. */
+    if(ctx->borrowed)
+    {
+        ret.data = (int32_t*)*memory;
+        *memory += (size_t)4*ret.length;
+        *length -= (size_t)4*ret.length;
+        return ret;
+    }
+#endif
+
+    CTX_MALLOC(ctx, ret.data, (size_t)4*ret.length, goto parse_error);
+
+    READER_ARRAY32(ret.data, *memory, (size_t)ret.length);
+    *memory += (size_t)4*ret.length;
+    *length -= (size_t)4*ret.length;
+
+    return ret;
+
+parse_error:
+    if(errno == NBT_OK)
+        errno = NBT_ERR;
+
+    ctx_free_data(ctx, ret.data);
+    ret.data = NULL;
+    return ret;
+}
+
+static inline struct nbt_long_array READER(read_long_array)(struct parse_ctx* ctx, const char** memory, size_t* length)
+{
+    struct nbt_long_array ret = { NULL, 0 };
+
+    if(!READER(read_array_length)(ctx, &ret.length, 8, memory, length))
+        goto parse_error;
+
+#if READER_BIG_ENDIAN
+    if(ctx->borrowed)
+    {
+        ret.data = (int64_t*)*memory;
+        *memory += (size_t)8*ret.length;
+        *length -= (size_t)8*ret.length;
+        return ret;
+    }
+#endif
+
+    CTX_MALLOC(ctx, ret.data, (size_t)8*ret.length, goto parse_error);
+
+    READER_ARRAY64(ret.data, *memory, (size_t)ret.length);
+    *memory += (size_t)8*ret.length;
+    *length -= (size_t)8*ret.length;
+
+    return ret;
+
+parse_error:
+    if(errno == NBT_OK)
+        errno = NBT_ERR;
+
+    ctx_free_data(ctx, ret.data);
+    ret.data = NULL;
+    return ret;
+}
+
+/*
+ * Fills in a node's payload. Lists and compounds are only opened: their header
+ * is read and they're pushed onto the stack for parse_children to fill in.
+ */
+static bool READER(read_payload)(struct parse_ctx* ctx, struct parse_stack* stack, nbt_node* node,
+                         const char** memory, size_t* length)
+{
+#define COPY_INTO_PAYLOAD(payload_name) \
+    READ_GENERIC(&node->payload.payload_name, sizeof node->payload.payload_name, READER_SCAN, goto parse_error);
+
+    switch(node->type)
+    {
+    case TAG_BYTE:
+        COPY_INTO_PAYLOAD(tag_byte);
+        break;
+    case TAG_SHORT:
+        COPY_INTO_PAYLOAD(tag_short);
+        break;
+    case TAG_INT:
+        COPY_INTO_PAYLOAD(tag_int);
+        break;
+    case TAG_LONG:
+        COPY_INTO_PAYLOAD(tag_long);
+        break;
+    case TAG_FLOAT:
+        COPY_INTO_PAYLOAD(tag_float);
+        break;
+    case TAG_DOUBLE:
+        COPY_INTO_PAYLOAD(tag_double);
+        break;
+    case TAG_BYTE_ARRAY:
+        node->payload.tag_byte_array = READER(read_byte_array)(ctx, memory, length);
+        break;
+    case TAG_STRING:
+    {
+        bool interned = false;
+
+        node->payload.tag_string = READER(read_string)(ctx, memory, length, &interned, NULL);
+
+        if(interned)
+            node->flags |= NBT_NODE_INTERNED_STRING;
+
+        break;
+    }
+    case TAG_INT_ARRAY:
+        node->payload.tag_int_array = READER(read_int_array)(ctx, memory, length);
+        break;
+    case TAG_LONG_ARRAY:
+        node->payload.tag_long_array = READER(read_long_array)(ctx, memory, length);
+        break;
+
+    case TAG_LIST:
+    case TAG_COMPOUND:
+    {
+        size_t depth = ctx->depth + stack->depth;
+
+        if(depth >= ctx->max_depth) goto parse_error; /* Too deep. */
+
+#if READER_BIG_ENDIAN
+        if(node->type == TAG_COMPOUND && ctx->lazy)
+        {
+            node->flags |= NBT_NODE_LAZY;
+            node->payload.tag_lazy = read_lazy_compound(ctx->max_depth - depth - 1, memory, length);
+            break;
+        }
+#endif
+
+        uint8_t type = TAG_INVALID;
+        int32_t elems = 0;
+
+        if(node->type == TAG_LIST)
+        {
+            READ_GENERIC(&type, sizeof type, READER_SCAN, goto parse_error);
+            READ_GENERIC(&elems, sizeof elems, READER_SCAN, goto parse_error);
+        }
+
+        size_t count = elems > 0 ? (size_t)elems : 0;
+
+        if(count)
+        {
+            /* Every element takes up some input, so a count can be checked before any are read. */
+            size_t min = min_payload_size((nbt_type)type);
+
+            if(min == 0 || count > *length / min) goto parse_error;
+            if(!allowed_length(ctx, elems))          goto parse_error;
+        }
+
+        size_t packed = node->type == TAG_LIST && ctx->pack && count ? fixed_payload_size((nbt_type)type) : 0;
+
+        if(packed)
+        {
+            /* One block for the lot, swapped in one go. Nothing to push. */
+            size_t bytes = packed * count;
+            void* data;
+
+            if(!charge(ctx, bytes, count)) goto parse_error;
+
+            CTX_MALLOC(ctx, data, bytes, goto parse_error);
+
+            switch(packed)
+            {
+            case 1: memcpy(data, *memory, bytes);                break;
+            case 2: READER_ARRAY16(data, *memory, count);        break;
+            case 4: READER_ARRAY32(data, *memory, count);        break;
+            case 8: READER_ARRAY64(data, *memory, count);        break;
+            }
+
+            *memory += bytes;
+            *length -= bytes;
+
+            node->flags |= NBT_NODE_PACKED;
+            node->payload.tag_packed.type   = (nbt_type)type;
+            node->payload.tag_packed.length = elems;
+            node->payload.tag_packed.data   = data;
+            break;
+        }
+
+        bool indexed = node->type == TAG_COMPOUND && ctx->indexes;
+        size_t sentinel = indexed ? sizeof(struct tag_index) : sizeof(struct tag_list);
+
+        /* The list's elements are paid for here, all at once. A compound's, as they come. */
+        if(!charge(ctx, sentinel + count * (sizeof(nbt_node) + sizeof(struct tag_list)), count))
+            goto parse_error;
+
+        struct tag_list* children;
+
+        CTX_MALLOC(ctx, children, sentinel, goto parse_error);
+
+        children->data = NULL; /* the first value in a list is a sentinel. don't even try to read it. */
+        INIT_LIST_HEAD(&children->entry);
+
+        if(indexed)
+        {
+            /* the sentinel comes first in an index. The table waits for the first lookup. */
+            struct tag_index* idx = list_entry(children, struct tag_index, head);
+
+            idx->table      = NULL;
+            idx->mask       = 0;
+            idx->used       = 0;
+            idx->duplicates = false;
+
+            node->flags |= NBT_NODE_INDEXED;
+            node->payload.tag_compound = children;
+        }
+        else if(node->type == TAG_COMPOUND)
+        {
+            node->payload.tag_compound = children;
+        }
+        else
+        {
+            /* Lists with no elements often don't say what type they'd hold. */
+            if(type == TAG_INVALID && elems <= 0)
+                type = TAG_COMPOUND;
+
+            node->payload.tag_list.type = (nbt_type)type;
+            node->payload.tag_list.list = children;
+
+            if(ctx->vectors && nbt_list_vectorize(node, count) != NBT_OK)
+                goto parse_error;
+        }
+
+#if READER_BIG_ENDIAN
+        if(node->type == TAG_LIST && ctx->threads > 1 && elems >= PARALLEL_MIN_ELEMENTS)
+        {
+            /* The elements are all parsed by the time this returns. Nothing to push. */
+            struct parse_ctx elements = *ctx;
+            elements.depth = depth + 1;
+
+            bool ok = parse_list_parallel(&elements, node, elems, memory, length);
+
+            ctx->bytes = elements.bytes;
+            ctx->nodes = elements.nodes;
+
+            if(!ok) goto parse_error;
+
+            break;
+        }
+#endif
+
+        if(!push_frame(stack, node, elems))
+            goto parse_error;
+
+        break;
+    }
+
+    default:
+        goto parse_error; /* Unknown node or TAG_END. Either way, we shouldn't be parsing this. */
+    }
+
+#undef COPY_INTO_PAYLOAD
+
+    if(errno != NBT_OK) goto parse_error;
+
+    return true;
+
+parse_error:
+    if(errno == NBT_OK)
+        errno = NBT_ERR;
+
+    return false;
+}
+
+/*
+ * Fills in the lists and compounds on the stack, and everything in them, until
+ * the stack is empty. Every node is added to its parent before its payload is
+ * read, so on failure, freeing the outermost node frees everything.
+ */
+static bool READER(parse_children)(struct parse_ctx* ctx, struct parse_stack* stack,
+                           const char** memory, size_t* length)
+{
+    while(stack->depth > 0)
+    {
+        struct parse_frame* top = &stack->frames[stack->depth - 1];
+        struct tag_list* children;
+        nbt_type type;
+        char* name = NULL;
+        bool interned = false;
+
+        /* A vector has entries of its own. Anything else can have the child's. */
+        bool compact = ctx->compact && !(top->node->flags & NBT_NODE_VECTOR);
+        char small[NBT_INLINE_NAME_MAX + 1];
+
+        if(top->node->type == TAG_LIST)
+        {
+            if(top->remaining <= 0)
+            {
+                stack->depth--;
+                continue;
+            }
+
+            top->remaining--;
+
+            type     = top->node->payload.tag_list.type;
+            children = top->node->payload.tag_list.list;
+        }
+        else
+        {
+            uint8_t t;
+            READ_GENERIC(&t, sizeof t, READER_SCAN, goto parse_error);
+
+            if(t == 0) /* TAG_END == 0. We've hit the end of the compound. */
+            {
+                stack->depth--;
+                continue;
+            }
+
+            if(!charge(ctx, sizeof(nbt_node) + sizeof(struct tag_list), 1))
+                goto parse_error;
+
+            name = READER(read_string)(ctx, memory, length, &interned, compact ? small : NULL);
+            if(name == NULL) goto parse_error;
+
+            type     = (nbt_type)t;
+            children = top->node->payload.tag_compound;
+        }
+
+        nbt_node* child = compact ? new_compact_node(ctx, type, name, small)
+                                  : new_node(ctx, type, name);
+
+        if(child == NULL)
+        {
+            if(!interned && name != small) ctx_free_data(ctx, name);
+            goto parse_error;
+        }
+
+        if(interned)
+            child->flags |= NBT_NODE_INTERNED_NAME;
+
+        if(compact)
+        {
+            list_add_tail(&list_entry(child, struct tag_compact, node)->entry.entry, &children->entry);
+        }
+
+        /* A vector has room for every element already, so this only fills in an entry. */
+        else if(top->node->flags & NBT_NODE_VECTOR)
+        {
+            if(nbt_list_append(top->node, child) != NBT_OK)
+            {
+                ctx_free_node(ctx, child);
+                goto parse_error;
+            }
+        }
+        else if(!append_child(ctx, children, child))
+        {
+            ctx_free_node(ctx, child);
+            goto parse_error;
+        }
+
+        if(!READER(read_payload)(ctx, stack, child, memory, length))
+            goto parse_error;
+    }
+
+    return true;
+
+parse_error:
+    if(errno == NBT_OK)
+        errno = NBT_ERR;
+
+    return false;
+}
+
+/*
+ * Parses a tag, given a name (may be NULL) and a type. Fills in the payload.
+ * `name' only becomes part of the tree if we succeed.
+ */
+static nbt_node* READER(parse_unnamed_tag)(struct parse_ctx* ctx, nbt_type type, char* name, const char** memory, size_t* length)
+{
+    struct parse_stack stack = { NULL, 0, 0 };
+
+    nbt_node* node = new_node(ctx, type, name);
+
+    if(node == NULL)
+        return NULL;
+
+    bool ok = READER(read_payload)(ctx, &stack, node, memory, length)
+           && READER(parse_children)(ctx, &stack, memory, length);
+
+    free(stack.frames);
+
+    if(ok)
+        return node;
+
+    node->name = NULL;
+    ctx_free_node(ctx, node);
+    return NULL;
+}
+
+/*
+ * The entry point shared by every flavor of nbt_parse. Only network NBT leaves
+ * out the root's name, and then a lone TAG_END stands for no tree at all.
+ */
+static nbt_node* READER(parse_root)(struct parse_ctx* ctx, const void* mem, size_t len, bool named)
+{
+    errno = NBT_OK;
+
+    const char** memory = (const char**)&mem;
+    size_t* length = &len;
+
+    /*
+     * this needs to stay up here since it's referenced by the parse_error
+     * block.
+     */
+    char* name = NULL;
+    bool interned = false;
+
+    /*
+     * A borrowed name points into `mem'. Read the mode up front: after ctx
+     * has been through a few calls the compiler can't tell it hasn't
+     * changed, and warns that we might free the middle of `mem'.
+     */
+    const bool owned = !ctx->borrowed;
+
+    uint8_t type;
+    READ_GENERIC(&type, sizeof type, memscan, goto parse_error);
+
+    if(!charge(ctx, sizeof(nbt_node), 1))
+        goto parse_error;
+
+    if(named)
+    {
+        name = READER(read_string)(ctx, memory, length, &interned, NULL);
+        if(name == NULL) goto parse_error;
+    }
+    else if(type == TAG_INVALID)
+    {
+        return NULL;
+    }
+
+    nbt_node* ret = READER(parse_unnamed_tag)(ctx, (nbt_type)type, name, memory, length);
+
+    /* We can't check for NULL, because it COULD be an empty tree. */
+    if(errno != NBT_OK) goto parse_error;
+
+    if(ret && interned)
+        ret->flags |= NBT_NODE_INTERNED_NAME;
+
+    return ret;
+
+parse_error:
+    if(errno == NBT_OK)
+        errno = NBT_ERR;
+
+    if(owned && !interned) ctx_free(ctx, name);
+    return NULL;
+}
+
+#undef READER
+#undef READER_SCAN
+#undef READER_ARRAY16
+#undef READER_ARRAY32
+#undef READER_ARRAY64
+#undef READER_BIG_ENDIAN
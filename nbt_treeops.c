@@ -9,6 +9,8 @@
  */
 #include "nbt.h"
 
+#include "bswap.h"
+
 #include <assert.h>
 #include <errno.h>
 #include <stdlib.h>
@@ -32,517 +34,2396 @@ static inline char* __strdup(const char* s)
     }                                         \
 } while(0)
 
-void nbt_free_list(struct tag_list* list)
+/*
+ * Makes sure a compound's children have been parsed, and a list's elements
+ * unpacked, before we go looking at them. Neither changes what a tree means,
+ * so even the functions that take a const tree do it.
+ */
+static inline bool materialized(const nbt_node* node)
 {
-    if (!list)
-        return;
+    return nbt_materialize((nbt_node*)node) == NBT_OK &&
+           nbt_unpack((nbt_node*)node) == NBT_OK;
+}
 
-    struct list_head* current;
-    struct list_head* temp;
-    list_for_each_safe(current, temp, &list->entry)
+/* How big each number in a packed list of `type' is. */
+static inline size_t number_size(nbt_type type)
+{
+    switch(type)
     {
-        struct tag_list* entry = list_entry(current, struct tag_list, entry);
-
-        nbt_free(entry->data);
-        free(entry);
+    case TAG_BYTE:                  return 1;
+    case TAG_SHORT:                 return 2;
+    case TAG_INT:  case TAG_FLOAT:  return 4;
+    case TAG_LONG: case TAG_DOUBLE: return 8;
+    default:                        return 0;
     }
+}
 
-    free(list);
+static inline struct tag_vector* vector_of(const nbt_node* list)
+{
+    return list_entry(list->payload.tag_list.list, struct tag_vector, head);
 }
 
-void nbt_free(nbt_node* tree)
+/* An empty vector, with room for `capacity' entries. Sets errno on failure. */
+static struct tag_vector* new_vector(size_t capacity)
 {
-    if(tree == NULL) return;
+    struct tag_vector* v;
 
-    if(tree->type == TAG_LIST)
-        nbt_free_list(tree->payload.tag_list.list);
+    if(capacity > (SIZE_MAX - sizeof *v) / sizeof v->items[0])
+        return (errno = NBT_EMEM), NULL;
 
-    else if (tree->type == TAG_COMPOUND)
-        nbt_free_list(tree->payload.tag_compound);
+    CHECKED_MALLOC(v, sizeof *v + capacity * sizeof v->items[0], return NULL);
 
-    else if(tree->type == TAG_BYTE_ARRAY)
-        free(tree->payload.tag_byte_array.data);
+    v->head.data = NULL;
+    INIT_LIST_HEAD(&v->head.entry);
+    v->length   = 0;
+    v->capacity = capacity;
 
-    else if(tree->type == TAG_INT_ARRAY)
-        free(tree->payload.tag_int_array.data);
+    return v;
+}
 
-    else if(tree->type == TAG_LONG_ARRAY)
-        free(tree->payload.tag_long_array.data);
+static inline struct tag_index* index_for(const nbt_node* compound)
+{
+    return list_entry(compound->payload.tag_compound, struct tag_index, head);
+}
 
-    else if(tree->type == TAG_STRING)
-        free(tree->payload.tag_string);
+/* Throws an index's table away. The next lookup builds a new one. */
+static inline void forget(struct tag_index* idx)
+{
+    free(idx->table);
 
-    free(tree->name);
-    free(tree);
+    idx->table      = NULL;
+    idx->mask       = 0;
+    idx->used       = 0;
+    idx->duplicates = false;
 }
 
-static struct tag_list* clone_list(struct tag_list* list)
+static inline struct tag_compact* compact_of(const nbt_node* node)
 {
-    /* even empty lists are valid pointers! */
-    assert(list);
-
-    struct tag_list* ret;
-    CHECKED_MALLOC(ret, sizeof *ret, goto clone_error);
+    return list_entry(node, struct tag_compact, node);
+}
 
-    INIT_LIST_HEAD(&ret->entry);
-    ret->data = NULL;
+/* Whether an entry came with its NBT_NODE_COMPACT node, and goes with it too. */
+static inline bool embedded(const struct tag_list* entry)
+{
+    return entry->data && (entry->data->flags & NBT_NODE_COMPACT) &&
+           &compact_of(entry->data)->entry == entry;
+}
 
-    struct list_head* pos;
-    list_for_each(pos, &list->entry)
-    {
-        struct tag_list* current = list_entry(pos, struct tag_list, entry);
-        struct tag_list* new;
+/* Frees an entry that's been unlinked, unless its node still needs it. */
+static inline void free_entry(struct tag_list* entry)
+{
+    if(!embedded(entry))
+        free(entry);
+}
 
-        CHECKED_MALLOC(new, sizeof *new, goto clone_error);
+/* Threads a vector's entries back onto its sentinel, in order. */
+static void relink(struct tag_vector* v)
+{
+    INIT_LIST_HEAD(&v->head.entry);
 
-        new->data = nbt_clone(current->data);
+    for(size_t i = 0; i < v->length; i++)
+        list_add_tail(&v->items[i].entry, &v->head.entry);
+}
 
-        if(new->data == NULL)
-        {
-            free(new);
-            goto clone_error;
-        }
+/*
+ * Encoded arrays. A blob holds an array's elements in one of three encodings,
+ * and is shared by every NBT_NODE_ENCODED array with the same elements that
+ * was encoded through the same pool. Elements are in native byte order, and
+ * read with memcpy, since nothing lines them up.
+ */
+enum blob_encoding {
+    BLOB_FILL, /* One element, which is all of them. */
+    BLOB_RUNS, /* `runs' uint32_t ends, each one past its run, then each run's element. */
+    BLOB_RAW   /* Every element in turn. */
+};
+
+struct nbt_array_blob {
+    size_t refs;          /* Arrays using it. */
+    nbt_array_pool* pool; /* NULL if it isn't in one. */
+    size_t hash;
+
+    enum blob_encoding encoding;
+    size_t width;         /* Bytes per element. */
+    int32_t length;       /* Elements. */
+    size_t runs;          /* BLOB_RUNS only. */
+    size_t size;          /* Bytes of `data'. */
+
+    unsigned char data[];
+};
 
-        list_add_tail(&new->entry, &ret->entry);
+/*
+ * Open addressing with linear probing, at most half full, like a compound
+ * index. A blob takes itself out when the last array using it goes.
+ */
+struct nbt_array_pool {
+    struct nbt_array_blob** table;
+    size_t mask; /* The table's size, less one. */
+    size_t used;
+};
+
+/* How big each element of an array of `type' is. */
+static inline size_t element_size(nbt_type type)
+{
+    switch(type)
+    {
+    case TAG_BYTE_ARRAY: return 1;
+    case TAG_INT_ARRAY:  return 4;
+    case TAG_LONG_ARRAY: return 8;
+    default:             return 0;
     }
-
-    return ret;
-
-clone_error:
-    nbt_free_list(ret);
-    return NULL;
 }
 
-/* same as strdup, but handles NULL gracefully */
-static inline char* safe_strdup(const char* s)
+static inline uint64_t element(const unsigned char* p, size_t width)
 {
-    return s ? __strdup(s) : NULL;
+    uint32_t i;
+    uint64_t l;
+
+    switch(width)
+    {
+    case 1:  return *p;
+    case 4:  memcpy(&i, p, 4); return i;
+    default: memcpy(&l, p, 8); return l;
+    }
 }
 
-nbt_node* nbt_clone(nbt_node* tree)
+/* The Nth element of a blob, as however many bytes wide it is. */
+static uint64_t blob_get(const struct nbt_array_blob* blob, int32_t n)
 {
-    if(tree == NULL) return NULL;
-    assert(tree->type != TAG_INVALID);
+    assert(n >= 0 && n < blob->length);
 
-    nbt_node* ret;
-    CHECKED_MALLOC(ret, sizeof *ret, return NULL);
+    if(blob->encoding == BLOB_FILL)
+        return element(blob->data, blob->width);
 
-    ret->type = tree->type;
-    ret->name = safe_strdup(tree->name);
-
-    if(tree->name && ret->name == NULL) goto clone_error;
+    if(blob->encoding == BLOB_RAW)
+        return element(blob->data + (size_t)n * blob->width, blob->width);
 
-    if(tree->type == TAG_STRING)
-    {
-        ret->payload.tag_string = __strdup(tree->payload.tag_string);
-        if(ret->payload.tag_string == NULL) goto clone_error;
-    }
+    /* the first run that ends after it. */
+    size_t lo = 0, hi = blob->runs - 1;
 
-    else if(tree->type == TAG_BYTE_ARRAY)
+    while(lo < hi)
     {
-        unsigned char* newbuf;
-        CHECKED_MALLOC(newbuf, tree->payload.tag_byte_array.length, goto clone_error);
+        size_t mid = lo + (hi - lo) / 2;
 
-        memcpy(newbuf,
-               tree->payload.tag_byte_array.data,
-               tree->payload.tag_byte_array.length);
-
-        ret->payload.tag_byte_array.data   = newbuf;
-        ret->payload.tag_byte_array.length = tree->payload.tag_byte_array.length;
+        if(element(blob->data + 4 * mid, 4) > (uint64_t)n)
+            hi = mid;
+        else
+            lo = mid + 1;
     }
 
-    else if(tree->type == TAG_INT_ARRAY)
-    {
-        int32_t* newbuf;
-        CHECKED_MALLOC(newbuf, 4*tree->payload.tag_int_array.length, goto clone_error);
+    return element(blob->data + 4 * blob->runs + lo * blob->width, blob->width);
+}
 
-        memcpy(newbuf,
-               tree->payload.tag_int_array.data,
-               4*tree->payload.tag_int_array.length);
+/* Decodes a blob into `dest', which has room for all of it. */
+static void blob_copy(const struct nbt_array_blob* blob, void* dest)
+{
+    unsigned char* d = dest;
+    size_t width = blob->width;
 
-        ret->payload.tag_int_array.data   = newbuf;
-        ret->payload.tag_int_array.length = tree->payload.tag_int_array.length;
+    if(blob->encoding == BLOB_RAW)
+    {
+        memcpy(d, blob->data, blob->size);
+        return;
     }
 
-    else if(tree->type == TAG_LONG_ARRAY)
+    size_t runs = blob->encoding == BLOB_FILL ? 1 : blob->runs;
+    const unsigned char* values = blob->encoding == BLOB_FILL ? blob->data : blob->data + 4 * runs;
+
+    for(size_t r = 0, start = 0; r < runs; r++)
     {
-        int32_t* newbuf;
-        CHECKED_MALLOC(newbuf, 8*tree->payload.tag_long_array.length, goto clone_error);
+        size_t end = blob->encoding == BLOB_FILL ? (size_t)blob->length : (size_t)element(blob->data + 4 * r, 4);
+        const unsigned char* value = values + r * width;
 
-        memcpy(newbuf,
-               tree->payload.tag_long_array.data,
-               8*tree->payload.tag_long_array.length);
+        if(width == 1)
+            memset(d + start, *value, end - start);
+        else
+            for(size_t i = start; i < end; i++)
+                memcpy(d + i * width, value, width);
 
-        ret->payload.tag_long_array.data   = newbuf;
-        ret->payload.tag_long_array.length = tree->payload.tag_long_array.length;
+        start = end;
     }
+}
 
-    else if(tree->type == TAG_LIST)
-    {
-        ret->payload.tag_list.list = clone_list(tree->payload.tag_list.list);
-        ret->payload.tag_list.type = tree->payload.tag_list.type;
-        if(ret->payload.tag_list.list == NULL) goto clone_error;
-    }
-    else if(tree->type == TAG_COMPOUND)
-    {
-        ret->payload.tag_compound = clone_list(tree->payload.tag_compound);
-        if(ret->payload.tag_compound == NULL) goto clone_error;
-    }
-    else
+/* The slot a blob just like `blob' is in, or the empty one it would go in. */
+static struct nbt_array_blob** pool_slot(const nbt_array_pool* pool, const struct nbt_array_blob* blob)
+{
+    for(size_t i = blob->hash & pool->mask;; i = (i + 1) & pool->mask)
     {
-        ret->payload = tree->payload;
-    }
-
-    return ret;
+        const struct nbt_array_blob* b = pool->table[i];
 
-clone_error:
-    if(ret) free(ret->name);
-
-    free(ret);
-    return NULL;
+        if(b == NULL ||
+           (b->hash == blob->hash && b->encoding == blob->encoding && b->width == blob->width &&
+            b->length == blob->length && b->size == blob->size &&
+            memcmp(b->data, blob->data, blob->size) == 0))
+            return &pool->table[i];
+    }
 }
 
-bool nbt_map(nbt_node* tree, nbt_visitor_t v, void* aux)
+/* Takes `blob' out of its pool. Anything that probed past it moves back, as in unindex. */
+static void pool_remove(nbt_array_pool* pool, const struct nbt_array_blob* blob)
 {
-    assert(v);
-
-    if(tree == NULL)  return true;
-    if(!v(tree, aux)) return false;
+    size_t i = blob->hash & pool->mask;
 
-    /* And if the item is a list or compound, recurse through each of their elements. */
-    if(tree->type == TAG_COMPOUND)
+    while(pool->table[i] != blob)
     {
-        struct list_head* pos;
-
-        list_for_each(pos, &tree->payload.tag_compound->entry)
-            if(!nbt_map(list_entry(pos, struct tag_list, entry)->data, v, aux))
-                return false;
+        if(pool->table[i] == NULL) return;
+        i = (i + 1) & pool->mask;
     }
-    
-    if(tree->type == TAG_LIST)
+
+    for(size_t j = (i + 1) & pool->mask; pool->table[j]; j = (j + 1) & pool->mask)
     {
-        struct list_head* pos;
+        size_t home = pool->table[j]->hash & pool->mask;
 
-        list_for_each(pos, &tree->payload.tag_list.list->entry)
-            if(!nbt_map(list_entry(pos, struct tag_list, entry)->data, v, aux))
-                return false;
+        if(((j - home) & pool->mask) >= ((j - i) & pool->mask))
+        {
+            pool->table[i] = pool->table[j];
+            i = j;
+        }
     }
 
-    return true;
+    pool->table[i] = NULL;
+    pool->used--;
 }
 
-/* Only returns NULL on error. An empty list is still a valid pointer */
-static struct tag_list* filter_list(const struct tag_list* list, nbt_predicate_t predicate, void* aux)
+/* One array fewer uses `blob'. */
+static void release(struct nbt_array_blob* blob)
 {
-    assert(list);
+    if(--blob->refs > 0) return;
 
-    struct tag_list* ret;
-    CHECKED_MALLOC(ret, sizeof *ret, goto filter_error);
+    if(blob->pool)
+        pool_remove(blob->pool, blob);
 
-    ret->data = NULL;
-    INIT_LIST_HEAD(&ret->entry);
-
-    const struct list_head* pos;
-    list_for_each(pos, &list->entry)
-    {
-        const struct tag_list* p = list_entry(pos, struct tag_list, entry);
-
-        nbt_node* new_node = nbt_filter(p->data, predicate, aux);
-
-        if(errno != NBT_OK)  goto filter_error;
-        if(new_node == NULL) continue;
-
-        struct tag_list* new_entry;
-        CHECKED_MALLOC(new_entry, sizeof *new_entry, goto filter_error);
-
-        new_entry->data = new_node;
-        list_add_tail(&new_entry->entry, &ret->entry);
-    }
-
-    return ret;
+    free(blob);
+}
 
-filter_error:
-    if(errno == NBT_OK)
-        errno = NBT_EMEM;
+/*
+ * What's left to free: entries that were allocated one by one, and the vectors
+ * of NBT_NODE_VECTOR lists, which are chained up through their sentinels.
+ */
+struct pending {
+    struct list_head entries;
+    struct list_head vectors;
+};
 
-    nbt_free_list(ret);
-    return NULL;
+static inline void init_pending(struct pending* pending)
+{
+    INIT_LIST_HEAD(&pending->entries);
+    INIT_LIST_HEAD(&pending->vectors);
 }
 
-nbt_node* nbt_filter(const nbt_node* tree, nbt_predicate_t filter, void* aux)
+/*
+ * Frees a single node. Its children, if it has any, are put on `pending'
+ * instead of being recursed into, so no tree is too deep to free.
+ */
+static void free_node(nbt_node* tree, struct pending* pending)
 {
-    assert(filter);
+    if(tree == NULL) return;
 
-    errno = NBT_OK;
+    /* another tree still has it. */
+    if(tree->flags >> NBT_NODE_REFS_SHIFT)
+    {
+        tree->flags -= 1u << NBT_NODE_REFS_SHIFT;
+        return;
+    }
 
-    if(tree == NULL)       return NULL;
-    if(!filter(tree, aux)) return NULL;
+    struct tag_list* children = NULL;
 
-    nbt_node* ret;
-    CHECKED_MALLOC(ret, sizeof *ret, goto filter_error);
+    if(tree->type == TAG_LIST && (tree->flags & NBT_NODE_PACKED))
+        free(tree->payload.tag_packed.data);
 
-    ret->type = tree->type;
-    ret->name = safe_strdup(tree->name);
+    else if(tree->type == TAG_LIST && (tree->flags & NBT_NODE_VECTOR))
+        /* nothing walks the sentinel's links from here on, so they're free to reuse. */
+        list_add_tail(&tree->payload.tag_list.list->entry, &pending->vectors);
 
-    if(tree->name && ret->name == NULL) goto filter_error;
+    else if(tree->type == TAG_LIST)
+        children = tree->payload.tag_list.list;
 
-    if(tree->type == TAG_STRING)
+    else if (tree->type == TAG_COMPOUND)
     {
-        ret->payload.tag_string = __strdup(tree->payload.tag_string);
-        if(ret->payload.tag_string == NULL) goto filter_error;
+        /* a lazy compound's children are still just bytes in someone's buffer. */
+        if(!(tree->flags & NBT_NODE_LAZY))
+            children = tree->payload.tag_compound;
+
+        /* the sentinel comes first, so freeing it frees the rest of the index. */
+        if(tree->flags & NBT_NODE_INDEXED)
+            forget(index_for(tree));
     }
 
-    else if(tree->type == TAG_BYTE_ARRAY)
-    {
-        CHECKED_MALLOC(ret->payload.tag_byte_array.data,
-                       tree->payload.tag_byte_array.length,
-                       goto filter_error);
+    else if(tree->flags & NBT_NODE_ENCODED)
+        release(tree->payload.tag_encoded.data);
 
-        memcpy(ret->payload.tag_byte_array.data,
-               tree->payload.tag_byte_array.data,
-               tree->payload.tag_byte_array.length);
+    /* the name and payload live in somebody else's buffer. */
+    else if(tree->flags & NBT_NODE_BORROWED)
+        ;
 
-        ret->payload.tag_byte_array.length = tree->payload.tag_byte_array.length;
-    }
+    else if(tree->type == TAG_BYTE_ARRAY)
+        free(tree->payload.tag_byte_array.data);
 
     else if(tree->type == TAG_INT_ARRAY)
-    {
-        CHECKED_MALLOC(ret->payload.tag_int_array.data,
-                       4*tree->payload.tag_int_array.length,
-                       goto filter_error);
-
-        memcpy(ret->payload.tag_int_array.data,
-               tree->payload.tag_int_array.data,
-               tree->payload.tag_int_array.length);
-
-        ret->payload.tag_int_array.length = tree->payload.tag_int_array.length;
-    }
+        free(tree->payload.tag_int_array.data);
 
     else if(tree->type == TAG_LONG_ARRAY)
-    {
-        CHECKED_MALLOC(ret->payload.tag_long_array.data,
-                       8*tree->payload.tag_long_array.length,
-                       goto filter_error);
-
-        memcpy(ret->payload.tag_long_array.data,
-               tree->payload.tag_long_array.data,
-               tree->payload.tag_long_array.length);
+        free(tree->payload.tag_long_array.data);
 
-        ret->payload.tag_long_array.length = tree->payload.tag_long_array.length;
-    }
+    else if(tree->type == TAG_STRING && !(tree->flags & NBT_NODE_INTERNED_STRING))
+        free(tree->payload.tag_string);
 
-    /* Okay, we want to keep this node, but keep traversing the tree! */
-    else if(tree->type == TAG_LIST)
-    {
-        ret->payload.tag_list.list = filter_list(tree->payload.tag_list.list, filter, aux);
-        if(ret->payload.tag_list.list == NULL) goto filter_error;
-    }
-    else if(tree->type == TAG_COMPOUND)
-    {
-        ret->payload.tag_compound = filter_list(tree->payload.tag_compound, filter, aux);
-        if(ret->payload.tag_compound == NULL) goto filter_error;
-    }
-    else
+    if(children)
     {
-        ret->payload = tree->payload;
+        list_splice_head(&children->entry, &pending->entries);
+        free(children);
     }
 
-    return ret;
-
-filter_error:
-    if(errno == NBT_OK)
-        errno = NBT_EMEM;
-
-    if(ret) free(ret->name);
+    if(!(tree->flags & (NBT_NODE_BORROWED | NBT_NODE_INTERNED_NAME | NBT_NODE_INLINE_NAME)))
+        free(tree->name);
 
-    free(ret);
-    return NULL;
+    /* and a compact node's entry goes with it. */
+    if(tree->flags & NBT_NODE_COMPACT)
+        free(compact_of(tree));
+    else
+        free(tree);
 }
 
-nbt_node* nbt_filter_inplace(nbt_node* tree, nbt_predicate_t filter, void* aux)
+/* Frees everything on `pending', along with everything under it. */
+static void free_pending(struct pending* pending)
 {
-    assert(filter);
+    for(;;)
+    {
+        if(!list_empty(&pending->entries))
+        {
+            struct tag_list* entry = list_entry(pending->entries.flink, struct tag_list, entry);
 
-    if(tree == NULL)               return                 NULL;
-    if(!filter(tree, aux))         return nbt_free(tree), NULL;
-    if(tree->type != TAG_LIST &&
-       tree->type != TAG_COMPOUND) return tree;
+            nbt_node* node = entry->data;
 
-    struct list_head* pos;
-    struct list_head* n;
-    struct tag_list *list = tree->type == TAG_LIST? tree->payload.tag_list.list : tree->payload.tag_compound;
+            list_del(&entry->entry);
 
-    list_for_each_safe(pos, n, &list->entry)
-    {
-        struct tag_list* cur = list_entry(pos, struct tag_list, entry);
+            free_entry(entry);
+            free_node(node, pending);
+        }
+        else if(!list_empty(&pending->vectors))
+        {
+            struct tag_vector* v = list_entry(pending->vectors.flink, struct tag_vector, head.entry);
+
+            list_del(&v->head.entry);
 
-        cur->data = nbt_filter_inplace(cur->data, filter, aux);
+            for(size_t i = 0; i < v->length; i++)
+                free_node(v->items[i].data, pending);
 
-        if(cur->data == NULL)
+            free(v);
+        }
+        else
         {
-            list_del(pos);
-            free(cur);
+            return;
         }
     }
-
-    return tree;
 }
 
-nbt_node* nbt_find(nbt_node* tree, nbt_predicate_t predicate, void* aux)
+void nbt_free_list(struct tag_list* list)
 {
-    if(tree == NULL)                  return NULL;
-    if(predicate(tree, aux))          return tree;
-    if(tree->type != TAG_LIST &&
-       tree->type != TAG_COMPOUND)    return NULL;
+    if (!list)
+        return;
 
-    struct list_head* pos;
-    struct tag_list *list = tree->type == TAG_LIST? tree->payload.tag_list.list : tree->payload.tag_compound;
-    
-    list_for_each(pos, &list->entry)
-    {
-        struct tag_list* p = list_entry(pos, struct tag_list, entry);
-        struct nbt_node* found;
+    struct pending pending;
+    init_pending(&pending);
 
-        if((found = nbt_find(p->data, predicate, aux)))
-            return found;
-    }
+    list_splice_head(&list->entry, &pending.entries);
+    free(list);
 
-    return NULL;
+    free_pending(&pending);
 }
 
-static bool names_are_equal(const nbt_node* node, void* vname)
+void nbt_free(nbt_node* tree)
 {
-    const char* name = vname;
-
-    assert(node);
-
-    if(name == NULL && node->name == NULL)
-        return true;
+    struct pending pending;
+    init_pending(&pending);
 
-    if(name == NULL || node->name == NULL)
-        return false;
+    free_node(tree, &pending);
+    free_pending(&pending);
+}
 
-    return strcmp(node->name, name) == 0;
+/* Reads a big-endian integer, wherever it may be. */
+static inline uint32_t read_be32(const unsigned char* p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | (uint32_t)p[3];
 }
 
-nbt_node* nbt_find_by_name(nbt_node* tree, const char* name)
+static inline uint64_t read_be64(const unsigned char* p)
 {
-    return nbt_find(tree, &names_are_equal, (void*)name);
+    return (uint64_t)read_be32(p) << 32 | read_be32(p + 4);
 }
 
-/*
- * Returns the index of the first occurence of `c' in `s', or the index of the
- * NULL-terminator. Whichever comes first.
- */
-static size_t index_of(const char* s, char c)
+unsigned char nbt_byte_array_get(const nbt_node* array, int32_t n)
 {
-    const char* p = s;
+    assert(array->type == TAG_BYTE_ARRAY);
+    assert(n >= 0 && n < array->payload.tag_byte_array.length);
 
-    for(; *p; p++)
-        if(*p == c)
-            return p - s;
+    if(array->flags & NBT_NODE_ENCODED)
+        return (unsigned char)blob_get(array->payload.tag_encoded.data, n);
 
-    return p - s;
+    return array->payload.tag_byte_array.data[n];
 }
 
-/*
- * Pretends that s1 ends after `len' bytes, and does a strcmp.
- */
-static int partial_strcmp(const char* s1, size_t len, const char* s2)
+int32_t nbt_int_array_get(const nbt_node* array, int32_t n)
 {
-    assert(s1);
+    assert(array->type == TAG_INT_ARRAY);
+    assert(n >= 0 && n < array->payload.tag_int_array.length);
 
-    if(s2 == NULL) return len != 0;
+    if(array->flags & NBT_NODE_ENCODED)
+        return (int32_t)blob_get(array->payload.tag_encoded.data, n);
 
-    int r;
-    if((r = strncmp(s1, s2, len)) != 0)
-        return r;
+    if(!(array->flags & NBT_NODE_BORROWED))
+        return array->payload.tag_int_array.data[n];
 
-    /* at this point, the first `len' characters match. Check for NULL. */
-    return s2[len] != '\0';
+    return (int32_t)read_be32((const unsigned char*)array->payload.tag_int_array.data + 4*(size_t)n);
 }
 
-/*
- * Format:
- *   current_name.[other shit]
- * OR
- *   current_name'\0'
- *
- * where current_name can be empty.
- */
-nbt_node* nbt_find_by_path(nbt_node* tree, const char* path)
+int64_t nbt_long_array_get(const nbt_node* array, int32_t n)
 {
-    assert(tree);
-    assert(path);
+    assert(array->type == TAG_LONG_ARRAY);
+    assert(n >= 0 && n < array->payload.tag_long_array.length);
 
-    /* The end of the "current_name" piece. */
-    size_t e = index_of(path, '.');
+    if(array->flags & NBT_NODE_ENCODED)
+        return (int64_t)blob_get(array->payload.tag_encoded.data, n);
 
-    bool names_match = partial_strcmp(path, e, tree->name) == 0;
+    if(!(array->flags & NBT_NODE_BORROWED))
+        return array->payload.tag_long_array.data[n];
 
-    /* Names don't match. These aren't the droids you're looking for. */
-    if(!names_match)                                         return NULL;
+    return (int64_t)read_be64((const unsigned char*)array->payload.tag_long_array.data + 8*(size_t)n);
+}
 
-    /* We're a leaf node, and the names match. Wooo found it. */
-    if(path[e] == '\0')                                     return tree;
+void nbt_byte_array_copy(const nbt_node* array, unsigned char* dest)
+{
+    assert(array->type == TAG_BYTE_ARRAY);
 
-    /*
-     * Initial names match, but the string isn't at the end. We're expecting a
-     * list, but haven't hit one.
-     */
-    if(tree->type != TAG_LIST && tree->type != TAG_COMPOUND) return NULL;
+    if(array->flags & NBT_NODE_ENCODED)
+        blob_copy(array->payload.tag_encoded.data, dest);
+    else
+        memcpy(dest, array->payload.tag_byte_array.data, (size_t)array->payload.tag_byte_array.length);
+}
 
-    /* At this point, the inital names match, and we're not at a leaf node. */
+void nbt_int_array_copy(const nbt_node* array, int32_t* dest)
+{
+    assert(array->type == TAG_INT_ARRAY);
 
-    struct list_head* pos;
-    struct tag_list *list = tree->type == TAG_LIST? tree->payload.tag_list.list : tree->payload.tag_compound;
-    list_for_each(pos, &list->entry)
+    int32_t len = array->payload.tag_int_array.length;
+
+    if(array->flags & NBT_NODE_ENCODED)
     {
-        struct tag_list* elem = list_entry(pos, struct tag_list, entry);
-        nbt_node* r;
+        blob_copy(array->payload.tag_encoded.data, dest);
+        return;
+    }
 
-        if((r = nbt_find_by_path(elem->data, path + e + 1)) != NULL)
-            return r;
+    if(!(array->flags & NBT_NODE_BORROWED))
+    {
+        memcpy(dest, array->payload.tag_int_array.data, 4*(size_t)len);
+        return;
     }
 
-    /* Wasn't found in the list (or the current node isn't a list). Give up. */
-    return NULL;
+    be2ne_array32(dest, array->payload.tag_int_array.data, (size_t)len);
 }
 
-/* Gets the length of the list, plus the length of all its children. */
-static inline size_t nbt_full_list_length(struct tag_list* list)
+void nbt_long_array_copy(const nbt_node* array, int64_t* dest)
 {
-    size_t accum = 0;
+    assert(array->type == TAG_LONG_ARRAY);
 
-    struct list_head* pos;
-    list_for_each(pos, &list->entry)
-        accum += nbt_size(list_entry(pos, const struct tag_list, entry)->data);
+    int32_t len = array->payload.tag_long_array.length;
+
+    if(array->flags & NBT_NODE_ENCODED)
+    {
+        blob_copy(array->payload.tag_encoded.data, dest);
+        return;
+    }
+
+    if(!(array->flags & NBT_NODE_BORROWED))
+    {
+        memcpy(dest, array->payload.tag_long_array.data, 8*(size_t)len);
+        return;
+    }
 
-    return accum;
+    be2ne_array64(dest, array->payload.tag_long_array.data, (size_t)len);
 }
 
-size_t nbt_size(const nbt_node* tree)
+/*
+ * Gives `dst' its own copy of `src''s array payload, in native byte order, or
+ * if it's encoded, a share of the same one. Returns non-zero if we ran out of
+ * memory.
+ */
+static int copy_array_payload(nbt_node* dst, const nbt_node* src)
 {
-    if(tree == NULL)
+    if(src->flags & NBT_NODE_ENCODED)
+    {
+        dst->flags |= NBT_NODE_ENCODED;
+        dst->payload.tag_encoded = src->payload.tag_encoded;
+        dst->payload.tag_encoded.data->refs++;
+
         return 0;
+    }
+
+    if(src->type == TAG_BYTE_ARRAY)
+    {
+        int32_t len = src->payload.tag_byte_array.length;
+
+        CHECKED_MALLOC(dst->payload.tag_byte_array.data, len, return 1);
+        memcpy(dst->payload.tag_byte_array.data, src->payload.tag_byte_array.data, len);
+
+        dst->payload.tag_byte_array.length = len;
+    }
+    else if(src->type == TAG_INT_ARRAY)
+    {
+        int32_t len = src->payload.tag_int_array.length;
+
+        CHECKED_MALLOC(dst->payload.tag_int_array.data, 4*(size_t)len, return 1);
+        nbt_int_array_copy(src, dst->payload.tag_int_array.data);
+
+        dst->payload.tag_int_array.length = len;
+    }
+    else if(src->type == TAG_LONG_ARRAY)
+    {
+        int32_t len = src->payload.tag_long_array.length;
+
+        CHECKED_MALLOC(dst->payload.tag_long_array.data, 8*(size_t)len, return 1);
+        nbt_long_array_copy(src, dst->payload.tag_long_array.data);
+
+        dst->payload.tag_long_array.length = len;
+    }
 
-    if(tree->type == TAG_LIST)
-        return nbt_full_list_length(tree->payload.tag_list.list) + 1;
-    if(tree->type == TAG_COMPOUND)
-        return nbt_full_list_length(tree->payload.tag_compound) + 1;
-    
-    return 1;
+    return 0;
 }
 
-nbt_node* nbt_list_item(nbt_node* list, int n) {
-    if (list == NULL || list->type != TAG_LIST) return NULL;
-    
-    nbt_node *node = NULL;
-    int i = 0;
-    const struct list_head* pos;
-    list_for_each(pos, &list->payload.tag_list.list->entry) {
-        if (i++ == n) node = list_entry(pos, struct tag_list, entry)->data;
+/* same as strdup, but handles NULL gracefully */
+static inline char* safe_strdup(const char* s)
+{
+    return s ? __strdup(s) : NULL;
+}
+
+/*
+ * Copies a single node. Lists and compounds come out empty: nbt_clone fills
+ * them in.
+ */
+static nbt_node* clone_node(nbt_node* tree)
+{
+    assert(tree->type != TAG_INVALID);
+
+    /* a packed list is copied as it is, so only compounds need looking at. */
+    if(nbt_materialize(tree) != NBT_OK) return NULL;
+
+    nbt_node* ret;
+    CHECKED_MALLOC(ret, sizeof *ret, return NULL);
+
+    /* clones always own their memory, even if the original didn't. Interned strings are everyone's. */
+    ret->type  = tree->type;
+    ret->flags = tree->flags & (NBT_NODE_INTERNED_NAME | NBT_NODE_INTERNED_STRING);
+    ret->name  = ret->flags & NBT_NODE_INTERNED_NAME ? tree->name : safe_strdup(tree->name);
+
+    if(tree->name && ret->name == NULL) goto clone_error;
+
+    if(tree->type == TAG_STRING && (ret->flags & NBT_NODE_INTERNED_STRING))
+    {
+        ret->payload.tag_string = tree->payload.tag_string;
+    }
+
+    else if(tree->type == TAG_STRING)
+    {
+        ret->payload.tag_string = __strdup(tree->payload.tag_string);
+        if(ret->payload.tag_string == NULL) goto clone_error;
+    }
+
+    else if(tree->type == TAG_BYTE_ARRAY ||
+            tree->type == TAG_INT_ARRAY  ||
+            tree->type == TAG_LONG_ARRAY)
+    {
+        if(copy_array_payload(ret, tree)) goto clone_error;
+    }
+
+    else if(tree->type == TAG_LIST && (tree->flags & NBT_NODE_PACKED))
+    {
+        const struct nbt_packed_list* packed = &tree->payload.tag_packed;
+        size_t bytes = (size_t)packed->length * number_size(packed->type);
+
+        ret->flags |= NBT_NODE_PACKED;
+        ret->payload.tag_packed = *packed;
+
+        CHECKED_MALLOC(ret->payload.tag_packed.data, bytes, goto clone_error);
+        memcpy(ret->payload.tag_packed.data, packed->data, bytes);
+    }
+
+    /* a vector is copied as one, with room for exactly what's in it. */
+    else if(tree->type == TAG_LIST && (tree->flags & NBT_NODE_VECTOR))
+    {
+        struct tag_vector* v = new_vector(vector_of(tree)->length);
+        if(v == NULL) goto clone_error;
+
+        ret->flags |= NBT_NODE_VECTOR;
+        ret->payload.tag_list.type = tree->payload.tag_list.type;
+        ret->payload.tag_list.list = &v->head;
+    }
+
+    /* so is an index, though its table is left for the first lookup to build. */
+    else if(tree->type == TAG_COMPOUND && (tree->flags & NBT_NODE_INDEXED))
+    {
+        struct tag_index* idx;
+        CHECKED_MALLOC(idx, sizeof *idx, goto clone_error);
+
+        idx->head.data = NULL;
+        INIT_LIST_HEAD(&idx->head.entry);
+        idx->table = NULL;
+        forget(idx);
+
+        ret->flags |= NBT_NODE_INDEXED;
+        ret->payload.tag_compound = &idx->head;
+    }
+
+    else if(tree->type == TAG_LIST || tree->type == TAG_COMPOUND)
+    {
+        struct tag_list* children;
+        CHECKED_MALLOC(children, sizeof *children, goto clone_error);
+
+        children->data = NULL;
+        INIT_LIST_HEAD(&children->entry);
+
+        if(tree->type == TAG_LIST)
+        {
+            ret->payload.tag_list.type = tree->payload.tag_list.type;
+            ret->payload.tag_list.list = children;
+        }
+        else
+        {
+            ret->payload.tag_compound = children;
+        }
+    }
+    else
+    {
+        ret->payload = tree->payload;
+    }
+
+    return ret;
+
+clone_error:
+    if(!(ret->flags & NBT_NODE_INTERNED_NAME))
+        free(ret->name);
+
+    free(ret);
+    return NULL;
+}
+
+static inline struct tag_list* children_of(nbt_node* node)
+{
+    return node->type == TAG_LIST ? node->payload.tag_list.list : node->payload.tag_compound;
+}
+
+/* A list or compound nbt_clone is in the middle of copying. */
+struct clone_frame {
+    const struct list_head* head; /* The original's children... */
+    const struct list_head* pos;  /* ...the last one we copied... */
+    nbt_node* copy;               /* ...and where the copies go. */
+};
+
+/*
+ * Walks the tree with a stack of its own rather than by recursing, so there's
+ * no tree too deep to clone.
+ */
+nbt_node* nbt_clone(nbt_node* tree)
+{
+    if(tree == NULL) return NULL;
+
+    struct clone_frame* stack = NULL;
+    size_t depth = 0, capacity = 0;
+
+    nbt_node* ret = clone_node(tree);
+    if(ret == NULL) return NULL;
+
+    nbt_node* original = tree;
+    nbt_node* copy = ret;
+
+    for(;;)
+    {
+        if((copy->type == TAG_LIST || copy->type == TAG_COMPOUND) && !(copy->flags & NBT_NODE_PACKED))
+        {
+            if(depth == capacity)
+            {
+                size_t new_capacity = capacity ? 2 * capacity : 16;
+                struct clone_frame* frames = realloc(stack, new_capacity * sizeof *frames);
+
+                if(frames == NULL)
+                {
+                    errno = NBT_EMEM;
+                    goto clone_error;
+                }
+
+                stack    = frames;
+                capacity = new_capacity;
+            }
+
+            stack[depth].head   = &children_of(original)->entry;
+            stack[depth].pos    = stack[depth].head;
+            stack[depth].copy   = copy;
+            depth++;
+        }
+
+        /* find the next node to copy, leaving everything we're done with. */
+        while(depth > 0)
+        {
+            struct clone_frame* top = &stack[depth - 1];
+
+            top->pos = top->pos->flink;
+
+            if(top->pos != top->head)
+                break;
+
+            depth--;
+        }
+
+        if(depth == 0) break;
+
+        struct clone_frame* top = &stack[depth - 1];
+        struct tag_list* entry;
+
+        original = list_entry(top->pos, const struct tag_list, entry)->data;
+
+        if((copy = clone_node(original)) == NULL) goto clone_error;
+
+        if(top->copy->flags & NBT_NODE_VECTOR)
+        {
+            /* there's room already, so all this does is fill in an entry. */
+            if(nbt_list_append(top->copy, copy) != NBT_OK)
+            {
+                nbt_free(copy);
+                goto clone_error;
+            }
+
+            continue;
+        }
+
+        CHECKED_MALLOC(entry, sizeof *entry,
+            nbt_free(copy);
+            goto clone_error;
+        );
+
+        entry->data = copy;
+        list_add_tail(&entry->entry, &children_of(top->copy)->entry);
     }
-    
+
+    free(stack);
+    return ret;
+
+clone_error:
+    free(stack);
+    nbt_free(ret);
+    return NULL;
+}
+
+/* How many trees, besides one, a node is part of. */
+static inline unsigned refs(const nbt_node* node)
+{
+    return node->flags >> NBT_NODE_REFS_SHIFT;
+}
+
+/*
+ * Makes `node' part of one more tree, and returns it, or a copy of it if it
+ * can't be shared any more widely than it is. NULL on memory errors.
+ */
+static nbt_node* share(nbt_node* node)
+{
+    if(refs(node) == NBT_NODE_REFS_MAX)
+        return nbt_clone(node);
+
+    node->flags += 1u << NBT_NODE_REFS_SHIFT;
     return node;
 }
+
+nbt_node* nbt_clone_shared(nbt_node* tree)
+{
+    if(tree == NULL) return NULL;
+
+    /* whatever it borrows from would only go away with one of them. */
+    if(tree->flags & NBT_NODE_BORROWED)
+        return nbt_clone(tree);
+
+    return share(tree);
+}
+
+/*
+ * Returns `node' if no other tree has it, and otherwise gives this one a copy
+ * of its own. The copy's numbers are copied too, so that nbt_list_set_long
+ * and friends can change them where they are, but the rest of its children
+ * are shared instead. NULL, with errno set, if we run out of memory, in which
+ * case nothing changes.
+ */
+static nbt_node* unshared(nbt_node* node)
+{
+    if(refs(node) == 0) return node;
+
+    nbt_node* copy = clone_node(node);
+    if(copy == NULL) return NULL;
+
+    if((copy->type == TAG_LIST || copy->type == TAG_COMPOUND) && !(copy->flags & NBT_NODE_PACKED))
+    {
+        const struct list_head* pos;
+        list_for_each(pos, &children_of(node)->entry)
+        {
+            nbt_node* child = list_entry(pos, struct tag_list, entry)->data;
+
+            child = number_size(child->type) ? clone_node(child) : share(child);
+            if(child == NULL) goto unshare_error;
+
+            /* a vector copy has room for them all, and an index copy has no table yet. */
+            if((copy->type == TAG_LIST ? nbt_list_append(copy, child)
+                                       : nbt_compound_add(copy, child)) != NBT_OK)
+            {
+                nbt_free(child);
+                goto unshare_error;
+            }
+        }
+    }
+
+    node->flags -= 1u << NBT_NODE_REFS_SHIFT;
+    return copy;
+
+unshare_error:
+    errno = NBT_EMEM;
+    nbt_free(copy);
+    return NULL;
+}
+
+/* A list or compound being walked, and the child we're at. */
+struct walk_frame {
+    struct list_head* head;
+    struct list_head* pos;
+    nbt_node* copy;         /* nbt_filter's copy of it, which its children go in. */
+};
+
+/*
+ * Like nbt_clone, the walkers below keep a stack of their own rather than
+ * recursing, so no tree is too deep for them. Only really deep trees need
+ * more of it than `shallow'.
+ */
+struct walk {
+    struct walk_frame* stack;
+    size_t depth, capacity;
+    struct walk_frame shallow[32];
+};
+
+static inline void walk_init(struct walk* w)
+{
+    w->stack    = w->shallow;
+    w->depth    = 0;
+    w->capacity = sizeof w->shallow / sizeof *w->shallow;
+}
+
+static inline void walk_free(struct walk* w)
+{
+    if(w->stack != w->shallow)
+        free(w->stack);
+}
+
+/*
+ * Makes a (materialized) list or compound's children the next ones walk_next
+ * hands out, ahead of its own siblings. Returns false, with errno set, if
+ * we're out of memory.
+ */
+static bool walk_into(struct walk* w, nbt_node* node)
+{
+    if(w->depth == w->capacity)
+    {
+        struct walk_frame* frames = realloc(w->stack == w->shallow ? NULL : w->stack,
+                                            2 * w->capacity * sizeof *frames);
+        if(frames == NULL)
+            return (errno = NBT_EMEM), false;
+
+        if(w->stack == w->shallow)
+            memcpy(frames, w->shallow, sizeof w->shallow);
+
+        w->stack     = frames;
+        w->capacity *= 2;
+    }
+
+    struct list_head* head = &children_of(node)->entry;
+
+    w->stack[w->depth++] = (struct walk_frame){ head, head, NULL };
+    return true;
+}
+
+/* The next node in preorder, or NULL once the walk is over. */
+static nbt_node* walk_next(struct walk* w)
+{
+    while(w->depth > 0)
+    {
+        struct walk_frame* top = &w->stack[w->depth - 1];
+
+        if((top->pos = top->pos->flink) != top->head)
+            return list_entry(top->pos, struct tag_list, entry)->data;
+
+        w->depth--;
+    }
+
+    return NULL;
+}
+
+static inline bool is_container(nbt_type type)
+{
+    return type == TAG_LIST || type == TAG_COMPOUND;
+}
+
+bool nbt_map(nbt_node* tree, nbt_visitor_t v, void* aux)
+{
+    assert(v);
+
+    struct walk w;
+    bool ret = true;
+
+    walk_init(&w);
+
+    for(; tree != NULL; tree = walk_next(&w))
+    {
+        if(!v(tree, aux) || !materialized(tree))
+        {
+            ret = false;
+            break;
+        }
+
+        /* And if the item is a list or compound, go through each of its elements. */
+        if(is_container(tree->type) && !walk_into(&w, tree))
+        {
+            ret = false;
+            break;
+        }
+    }
+
+    walk_free(&w);
+    return ret;
+}
+
+/*
+ * Copies a single node for nbt_filter. A list or compound comes out empty, for
+ * whichever of its children pass to be added to. NULL on memory errors.
+ */
+static nbt_node* filter_copy(const nbt_node* tree)
+{
+    nbt_node* ret;
+    CHECKED_MALLOC(ret, sizeof *ret, return NULL);
+
+    ret->type  = tree->type;
+    ret->flags = 0;
+    ret->name  = safe_strdup(tree->name);
+
+    if(tree->name && ret->name == NULL) goto copy_error;
+
+    if(tree->type == TAG_STRING)
+    {
+        ret->payload.tag_string = __strdup(tree->payload.tag_string);
+        if(ret->payload.tag_string == NULL) goto copy_error;
+    }
+
+    else if(tree->type == TAG_BYTE_ARRAY ||
+            tree->type == TAG_INT_ARRAY  ||
+            tree->type == TAG_LONG_ARRAY)
+    {
+        if(copy_array_payload(ret, tree)) goto copy_error;
+    }
+
+    else if(is_container(tree->type))
+    {
+        struct tag_list* children;
+        CHECKED_MALLOC(children, sizeof *children, goto copy_error);
+
+        children->data = NULL;
+        INIT_LIST_HEAD(&children->entry);
+
+        if(tree->type == TAG_LIST)
+        {
+            ret->payload.tag_list.type = tree->payload.tag_list.type;
+            ret->payload.tag_list.list = children;
+        }
+        else
+        {
+            ret->payload.tag_compound = children;
+        }
+    }
+    else
+    {
+        ret->payload = tree->payload;
+    }
+
+    return ret;
+
+copy_error:
+    errno = NBT_EMEM;
+
+    free(ret->name);
+    free(ret);
+    return NULL;
+}
+
+nbt_node* nbt_filter(const nbt_node* tree, nbt_predicate_t filter, void* aux)
+{
+    assert(filter);
+
+    errno = NBT_OK;
+
+    if(tree == NULL)       return NULL;
+    if(!filter(tree, aux)) return NULL;
+
+    struct walk w;
+    nbt_node* ret = NULL;
+
+    walk_init(&w);
+
+    if(!materialized(tree) || (ret = filter_copy(tree)) == NULL) goto filter_error;
+
+    nbt_node* node = (nbt_node*)tree;
+    nbt_node* copy = ret;
+
+    for(;;)
+    {
+        /* Okay, we want to keep this node, but keep traversing the tree! */
+        if(is_container(node->type))
+        {
+            if(!walk_into(&w, node)) goto filter_error;
+
+            w.stack[w.depth - 1].copy = copy;
+        }
+
+        while((node = walk_next(&w)) != NULL && !filter(node, aux))
+            ;
+
+        if(node == NULL) break;
+
+        struct tag_list* entry;
+
+        if(!materialized(node) || (copy = filter_copy(node)) == NULL) goto filter_error;
+
+        CHECKED_MALLOC(entry, sizeof *entry,
+            nbt_free(copy);
+            goto filter_error;
+        );
+
+        entry->data = copy;
+        list_add_tail(&entry->entry, &children_of(w.stack[w.depth - 1].copy)->entry);
+    }
+
+    walk_free(&w);
+    return ret;
+
+filter_error:
+    if(errno == NBT_OK)
+        errno = NBT_EMEM;
+
+    walk_free(&w);
+    nbt_free(ret);
+    return NULL;
+}
+
+/*
+ * Filters `node' itself for nbt_filter_inplace, and returns what takes its
+ * place: NULL if it's been freed, or a list or compound of our own, in which
+ * case `descend' says its children need filtering too.
+ */
+static nbt_node* filter_node_inplace(nbt_node* node, nbt_predicate_t filter, void* aux, bool* descend)
+{
+    *descend = false;
+
+    if(!filter(node, aux))         return nbt_free(node), NULL;
+    if(!is_container(node->type))  return node;
+
+    /* Out of memory. errno says so, and the node stays as it was. */
+    if(!materialized(node))        return node;
+
+    /* Another tree's list or compound isn't ours to change. Filter a copy of it instead. */
+    nbt_node* copy = unshared(node);
+    if(copy == NULL)               return node;
+
+    *descend = true;
+    return copy;
+}
+
+/* A list or compound nbt_filter_inplace is in the middle of. */
+struct filter_frame {
+    nbt_node* tree;
+    struct list_head* next; /* The next entry to filter... */
+    size_t i, kept;         /* ...or for a vector, the next item, and how many have stayed. */
+    bool changed;
+};
+
+nbt_node* nbt_filter_inplace(nbt_node* tree, nbt_predicate_t filter, void* aux)
+{
+    assert(filter);
+
+    bool descend;
+
+    if(tree == NULL) return NULL;
+    if((tree = filter_node_inplace(tree, filter, aux, &descend)) == NULL) return NULL;
+
+    struct filter_frame shallow[32];
+    struct filter_frame* stack = shallow;
+    size_t depth = 0, capacity = sizeof shallow / sizeof *shallow;
+
+    nbt_node* node = tree;
+
+    for(;;)
+    {
+        if(descend && depth == capacity)
+        {
+            struct filter_frame* frames = realloc(stack == shallow ? NULL : stack, 2 * capacity * sizeof *frames);
+
+            /* Out of memory. errno says so, and the node stays as it was. */
+            if(frames == NULL)
+            {
+                errno   = NBT_EMEM;
+                descend = false;
+            }
+            else
+            {
+                if(stack == shallow)
+                    memcpy(frames, shallow, sizeof shallow);
+
+                stack     = frames;
+                capacity *= 2;
+            }
+        }
+
+        if(descend)
+            stack[depth++] = (struct filter_frame){ node, children_of(node)->entry.flink, 0, 0, false };
+
+        if(depth == 0) break;
+
+        struct filter_frame* top = &stack[depth - 1];
+
+        /* A vector's entries can't be freed one at a time. The survivors close ranks instead. */
+        if(top->tree->flags & NBT_NODE_VECTOR)
+        {
+            struct tag_vector* v = vector_of(top->tree);
+
+            if(top->i == v->length)
+            {
+                if(top->changed)
+                    nbt_index_touch(top->tree);
+
+                v->length = top->kept;
+                relink(v);
+
+                depth--;
+                descend = false;
+                continue;
+            }
+
+            nbt_node* child = v->items[top->i++].data;
+
+            if((node = v->items[top->kept].data = filter_node_inplace(child, filter, aux, &descend)) != child)
+                top->changed = true;
+
+            if(node != NULL)
+                top->kept++;
+
+            continue;
+        }
+
+        struct list_head* head = &children_of(top->tree)->entry;
+
+        if(top->next == head)
+        {
+            if(top->tree->flags & NBT_NODE_INDEXED)
+                forget(index_for(top->tree));
+
+            depth--;
+            descend = false;
+            continue;
+        }
+
+        struct list_head* pos = top->next;
+        struct tag_list* cur = list_entry(pos, struct tag_list, entry);
+        struct tag_list* spare = NULL;
+        nbt_node* child = cur->data;
+        bool own = !embedded(cur);
+
+        top->next = pos->flink;
+
+        /* a shared compact node keeps its entry, so a copy of it will need one of its own. */
+        if(!own && refs(child) && is_container(child->type) &&
+           (spare = malloc(sizeof *spare)) == NULL)
+        {
+            errno = NBT_EMEM;
+            top->next = head;
+            descend = false;
+            continue;
+        }
+
+        /* a compact node takes its entry with it, so it's unlinked first, and put back if it stays. */
+        list_del(pos);
+
+        node = filter_node_inplace(child, filter, aux, &descend);
+
+        if(node == NULL)
+        {
+            if(own)
+                free(cur);
+        }
+        else if(node == child)
+        {
+            list_add_tail(pos, top->next);
+        }
+        else
+        {
+            if(!own)
+                cur = spare, spare = NULL;
+
+            cur->data = node;
+            list_add_tail(&cur->entry, top->next);
+        }
+
+        free(spare);
+
+        if(node != child)
+            nbt_index_touch(top->tree);
+    }
+
+    if(stack != shallow)
+        free(stack);
+
+    return tree;
+}
+
+nbt_node* nbt_find(nbt_node* tree, nbt_predicate_t predicate, void* aux)
+{
+    struct walk w;
+
+    walk_init(&w);
+
+    for(; tree != NULL; tree = walk_next(&w))
+    {
+        if(predicate(tree, aux))
+            break;
+
+        /* a compound we can't look inside has nothing in it to find. */
+        if(is_container(tree->type) && materialized(tree) && !walk_into(&w, tree))
+        {
+            tree = NULL;
+            break;
+        }
+    }
+
+    walk_free(&w);
+    return tree;
+}
+
+static bool names_are_equal(const nbt_node* node, void* vname)
+{
+    const char* name = vname;
+
+    assert(node);
+
+    if(name == NULL && node->name == NULL)
+        return true;
+
+    if(name == NULL || node->name == NULL)
+        return false;
+
+    return strcmp(node->name, name) == 0;
+}
+
+nbt_node* nbt_find_by_name(nbt_node* tree, const char* name)
+{
+    return nbt_find(tree, &names_are_equal, (void*)name);
+}
+
+/*
+ * Returns the index of the first occurence of `c' in `s', or the index of the
+ * NULL-terminator. Whichever comes first.
+ */
+static size_t index_of(const char* s, char c)
+{
+    const char* p = s;
+
+    for(; *p; p++)
+        if(*p == c)
+            return p - s;
+
+    return p - s;
+}
+
+/*
+ * Pretends that s1 ends after `len' bytes, and does a strcmp.
+ */
+static int partial_strcmp(const char* s1, size_t len, const char* s2)
+{
+    assert(s1);
+
+    if(s2 == NULL) return len != 0;
+
+    int r;
+    if((r = strncmp(s1, s2, len)) != 0)
+        return r;
+
+    /* at this point, the first `len' characters match. Check for NULL. */
+    return s2[len] != '\0';
+}
+
+/*
+ * Compound indexes. A table is open addressing with linear probing, at most
+ * half full, and holds only the first child by any name. Compounds with
+ * children that share a name keep no table worth using, since a path has to
+ * be able to try each of them in turn.
+ */
+
+/* Compounds with fewer children than this are quicker to search than to hash. */
+#define INDEX_MIN_CHILDREN 8
+
+/* FNV-1a. */
+static inline size_t hash_name(const char* name, size_t len)
+{
+    uint64_t h = UINT64_C(14695981039346656037);
+
+    for(size_t i = 0; i < len; i++)
+        h = (h ^ (unsigned char)name[i]) * UINT64_C(1099511628211);
+
+    return (size_t)h;
+}
+
+/* A nameless child goes by "", which is what a path calls it. */
+static inline size_t hash_entry(const struct tag_list* entry)
+{
+    const char* name = entry->data->name;
+    return name ? hash_name(name, strlen(name)) : hash_name("", 0);
+}
+
+/* Puts `entry' in the table, unless it has a child by that name already. */
+static void insert(struct tag_index* idx, struct tag_list* entry)
+{
+    const char* name = entry->data->name ? entry->data->name : "";
+    size_t len = strlen(name);
+
+    for(size_t i = hash_name(name, len) & idx->mask;; i = (i + 1) & idx->mask)
+    {
+        if(idx->table[i] == NULL)
+        {
+            idx->table[i] = entry;
+            idx->used++;
+            return;
+        }
+
+        if(partial_strcmp(name, len, idx->table[i]->data->name) == 0)
+        {
+            idx->duplicates = true;
+            return;
+        }
+    }
+}
+
+/*
+ * Builds a new table for `children' children. Returns false, leaving no table
+ * at all, if there are too few to bother or we're out of memory.
+ */
+static bool build(struct tag_index* idx, size_t children)
+{
+    forget(idx);
+
+    if(children < INDEX_MIN_CHILDREN) return false;
+
+    size_t size = 16;
+    while(size < 2 * children) size *= 2;
+
+    if((idx->table = calloc(size, sizeof *idx->table)) == NULL)
+        return false;
+
+    idx->mask = size - 1;
+
+    struct list_head* pos;
+    list_for_each(pos, &idx->head.entry)
+        insert(idx, list_entry(pos, struct tag_list, entry));
+
+    return true;
+}
+
+/* Whether a compound can be searched through its table, which is built if need be. */
+static bool usable(nbt_node* compound)
+{
+    if(!(compound->flags & NBT_NODE_INDEXED)) return false;
+
+    struct tag_index* idx = index_for(compound);
+
+    if(idx->table == NULL && !build(idx, list_length(&idx->head.entry)))
+        return false;
+
+    return !idx->duplicates;
+}
+
+/* The entry of the child named by the first `len' bytes of `name', if any. */
+static struct tag_list* lookup(const struct tag_index* idx, const char* name, size_t len)
+{
+    for(size_t i = hash_name(name, len) & idx->mask; idx->table[i]; i = (i + 1) & idx->mask)
+        if(partial_strcmp(name, len, idx->table[i]->data->name) == 0)
+            return idx->table[i];
+
+    return NULL;
+}
+
+/*
+ * Takes `entry' out of the table. Anything after it that probed past its slot
+ * is moved back, so that no lookup stops short of it.
+ */
+static void unindex(struct tag_index* idx, const struct tag_list* entry)
+{
+    size_t i = hash_entry(entry) & idx->mask;
+
+    while(idx->table[i] != entry)
+    {
+        if(idx->table[i] == NULL) return;
+        i = (i + 1) & idx->mask;
+    }
+
+    for(size_t j = (i + 1) & idx->mask; idx->table[j]; j = (j + 1) & idx->mask)
+    {
+        size_t home = hash_entry(idx->table[j]) & idx->mask;
+
+        /* it can fill the hole, unless it'd then sit before where it hashes to. */
+        if(((j - home) & idx->mask) >= ((j - i) & idx->mask))
+        {
+            idx->table[i] = idx->table[j];
+            i = j;
+        }
+    }
+
+    idx->table[i] = NULL;
+    idx->used--;
+}
+
+/* The entry of a compound's first child named by `len' bytes of `name', if any. */
+static struct tag_list* find_child(nbt_node* compound, const char* name, size_t len)
+{
+    if(usable(compound))
+        return lookup(index_for(compound), name, len);
+
+    struct list_head* pos;
+    list_for_each(pos, &compound->payload.tag_compound->entry)
+    {
+        struct tag_list* entry = list_entry(pos, struct tag_list, entry);
+
+        if(partial_strcmp(name, len, entry->data->name) == 0)
+            return entry;
+    }
+
+    return NULL;
+}
+
+nbt_node* nbt_compound_get(nbt_node* compound, const char* name)
+{
+    assert(compound);
+    assert(name);
+
+    if(compound->type != TAG_COMPOUND || !materialized(compound))
+        return NULL;
+
+    struct tag_list* entry = find_child(compound, name, strlen(name));
+    return entry ? entry->data : NULL;
+}
+
+nbt_status nbt_compound_index(nbt_node* compound)
+{
+    assert(compound && compound->type == TAG_COMPOUND);
+
+    if(!materialized(compound)) return (nbt_status)errno;
+
+    if(!(compound->flags & NBT_NODE_INDEXED))
+    {
+        struct tag_list* old = compound->payload.tag_compound;
+        struct tag_index* idx;
+
+        CHECKED_MALLOC(idx, sizeof *idx, return NBT_EMEM);
+
+        /* the children stay put. Only the sentinel moves. */
+        idx->head.data = NULL;
+
+        if(list_empty(&old->entry))
+        {
+            INIT_LIST_HEAD(&idx->head.entry);
+        }
+        else
+        {
+            idx->head.entry = old->entry;
+            idx->head.entry.flink->blink = &idx->head.entry;
+            idx->head.entry.blink->flink = &idx->head.entry;
+        }
+
+        free(old);
+
+        idx->table = NULL;
+        forget(idx);
+
+        compound->flags |= NBT_NODE_INDEXED;
+        compound->payload.tag_compound = &idx->head;
+    }
+
+    struct tag_index* idx = index_for(compound);
+
+    if(idx->table == NULL)
+        build(idx, list_length(&idx->head.entry));
+
+    return NBT_OK;
+}
+
+nbt_status nbt_compound_add(nbt_node* compound, nbt_node* child)
+{
+    assert(compound && compound->type == TAG_COMPOUND);
+    assert(child && child->type != TAG_INVALID);
+
+    if(!materialized(compound)) return (nbt_status)errno;
+
+    struct tag_list* entry;
+    CHECKED_MALLOC(entry, sizeof *entry, return NBT_EMEM);
+
+    entry->data = child;
+    list_add_tail(&entry->entry, &compound->payload.tag_compound->entry);
+
+    if(compound->flags & NBT_NODE_INDEXED)
+    {
+        struct tag_index* idx = index_for(compound);
+
+        if(idx->table == NULL)
+            ; /* nothing to keep up to date. */
+        else if(2 * (idx->used + 1) > idx->mask + 1)
+            build(idx, list_length(&idx->head.entry));
+        else
+            insert(idx, entry);
+    }
+
+    nbt_index_touch(compound);
+    return NBT_OK;
+}
+
+nbt_node* nbt_compound_remove(nbt_node* compound, const char* name)
+{
+    assert(compound);
+    assert(name);
+
+    if(compound->type != TAG_COMPOUND || !materialized(compound))
+        return NULL;
+
+    struct tag_list* entry = find_child(compound, name, strlen(name));
+    if(entry == NULL) return NULL;
+
+    if(compound->flags & NBT_NODE_INDEXED)
+    {
+        struct tag_index* idx = index_for(compound);
+
+        /* with duplicates about, the next child by that name has to take its place. */
+        if(idx->duplicates)
+            forget(idx);
+        else if(idx->table)
+            unindex(idx, entry);
+    }
+
+    nbt_node* ret = entry->data;
+
+    list_del(&entry->entry);
+    free_entry(entry);
+
+    nbt_index_touch(compound);
+    return ret;
+}
+
+/*
+ * Format:
+ *   current_name.[other shit]
+ * OR
+ *   current_name'\0'
+ *
+ * where current_name can be empty.
+ */
+nbt_node* nbt_find_by_path(nbt_node* tree, const char* path)
+{
+    assert(tree);
+    assert(path);
+
+    /* The end of the "current_name" piece. */
+    size_t e = index_of(path, '.');
+
+    bool names_match = partial_strcmp(path, e, tree->name) == 0;
+
+    /* Names don't match. These aren't the droids you're looking for. */
+    if(!names_match)                                         return NULL;
+
+    /* We're a leaf node, and the names match. Wooo found it. */
+    if(path[e] == '\0')                                     return tree;
+
+    /*
+     * Initial names match, but the string isn't at the end. We're expecting a
+     * list, but haven't hit one.
+     */
+    if(tree->type != TAG_LIST && tree->type != TAG_COMPOUND) return NULL;
+
+    /* Only the compounds along the path ever get parsed. */
+    if(!materialized(tree))                                  return NULL;
+
+    /* At this point, the inital names match, and we're not at a leaf node. */
+
+    /* With names known to be unique, only one child could possibly match. */
+    if(tree->type == TAG_COMPOUND && usable(tree))
+    {
+        const char* rest = path + e + 1;
+        struct tag_list* child = lookup(index_for(tree), rest, index_of(rest, '.'));
+
+        return child ? nbt_find_by_path(child->data, rest) : NULL;
+    }
+
+    struct list_head* pos;
+    struct tag_list *list = tree->type == TAG_LIST? tree->payload.tag_list.list : tree->payload.tag_compound;
+    list_for_each(pos, &list->entry)
+    {
+        struct tag_list* elem = list_entry(pos, struct tag_list, entry);
+        nbt_node* r;
+
+        if((r = nbt_find_by_path(elem->data, path + e + 1)) != NULL)
+            return r;
+    }
+
+    /* Wasn't found in the list (or the current node isn't a list). Give up. */
+    return NULL;
+}
+
+nbt_node* nbt_unshare(nbt_node** tree, const char* path)
+{
+    assert(tree && *tree);
+    assert(path);
+
+    errno = NBT_OK;
+
+    /* make sure it's there before copying anything on the way to it. */
+    if(nbt_find_by_path(*tree, path) == NULL) return NULL;
+
+    nbt_node* node = unshared(*tree);
+    if(node == NULL) return NULL;
+
+    *tree = node;
+
+    for(size_t e = index_of(path, '.'); path[e] != '\0'; e = index_of(path, '.'))
+    {
+        path += e + 1;
+
+        /* the child nbt_find_by_path would have gone through. */
+        struct tag_list* entry = NULL;
+        struct list_head* pos;
+
+        list_for_each(pos, &children_of(node)->entry)
+            if(nbt_find_by_path(list_entry(pos, struct tag_list, entry)->data, path))
+            {
+                entry = list_entry(pos, struct tag_list, entry);
+                break;
+            }
+
+        assert(entry);
+
+        nbt_node* child = entry->data;
+
+        if(refs(child) == 0)
+        {
+            node = child;
+            continue;
+        }
+
+        /* a compact node's entry stays with it, so its copy needs an entry of its own. */
+        if(embedded(entry))
+        {
+            struct tag_list* own;
+            CHECKED_MALLOC(own, sizeof *own, return NULL);
+
+            own->data = child;
+            list_add_head(&own->entry, &entry->entry);
+            list_del(&entry->entry);
+
+            if(node->flags & NBT_NODE_INDEXED)
+                forget(index_for(node));
+
+            entry = own;
+        }
+
+        if((entry->data = unshared(child)) == NULL)
+        {
+            entry->data = child;
+            return NULL;
+        }
+
+        nbt_index_touch(node);
+        node = entry->data;
+    }
+
+    return node;
+}
+
+size_t nbt_size(const nbt_node* tree)
+{
+    struct walk w;
+    size_t size = 0;
+
+    walk_init(&w);
+
+    for(nbt_node* node = (nbt_node*)tree; node != NULL; node = walk_next(&w))
+    {
+        size++;
+
+        if(node->type == TAG_LIST && (node->flags & NBT_NODE_PACKED))
+            size += (size_t)node->payload.tag_packed.length;
+        else if((node->type == TAG_LIST || (node->type == TAG_COMPOUND && materialized(node))) &&
+                !walk_into(&w, node))
+        {
+            size = 0;
+            break;
+        }
+    }
+
+    walk_free(&w);
+    return size;
+}
+
+nbt_node* nbt_list_item(nbt_node* list, int n)
+{
+    if(list == NULL || list->type != TAG_LIST || n < 0) return NULL;
+
+    /* whoever asks for a node gets one, and will probably ask for the rest. */
+    if(nbt_unpack(list) != NBT_OK) return NULL;
+
+    if(list->flags & NBT_NODE_VECTOR)
+    {
+        const struct tag_vector* v = vector_of(list);
+        return (size_t)n < v->length ? v->items[n].data : NULL;
+    }
+
+    const struct list_head* pos;
+    list_for_each(pos, &list->payload.tag_list.list->entry)
+        if(n-- == 0)
+            return list_entry(pos, struct tag_list, entry)->data;
+
+    return NULL;
+}
+
+size_t nbt_list_length(const nbt_node* list)
+{
+    assert(list && list->type == TAG_LIST);
+
+    if(list->flags & NBT_NODE_PACKED)
+        return (size_t)list->payload.tag_packed.length;
+
+    if(list->flags & NBT_NODE_VECTOR)
+        return vector_of(list)->length;
+
+    return list_length(&list->payload.tag_list.list->entry);
+}
+
+/* Whether `item' may go in `list' without making it a list of two types. */
+static inline bool fits(const nbt_node* list, const nbt_node* item)
+{
+    return item->type == list->payload.tag_list.type ||
+           list_empty(&list->payload.tag_list.list->entry);
+}
+
+nbt_status nbt_list_append(nbt_node* list, nbt_node* item)
+{
+    assert(list && list->type == TAG_LIST);
+    assert(item && item->type != TAG_INVALID);
+
+    nbt_status err = nbt_unpack(list);
+    if(err != NBT_OK) return err;
+
+    if(!fits(list, item))
+        return NBT_ERR;
+
+    if(!(list->flags & NBT_NODE_VECTOR))
+    {
+        struct tag_list* entry;
+        CHECKED_MALLOC(entry, sizeof *entry, return NBT_EMEM);
+
+        entry->data = item;
+        list_add_tail(&entry->entry, &list->payload.tag_list.list->entry);
+    }
+    else
+    {
+        struct tag_vector* v = vector_of(list);
+
+        /* Growing moves every entry, so they're all linked up again. */
+        if(v->length == v->capacity)
+        {
+            size_t capacity = v->capacity ? 2 * v->capacity : 4;
+
+            if(capacity > (SIZE_MAX - sizeof *v) / sizeof v->items[0])
+                return NBT_EMEM;
+
+            struct tag_vector* grown = realloc(v, sizeof *v + capacity * sizeof v->items[0]);
+            if(grown == NULL) return NBT_EMEM;
+
+            v = grown;
+            v->capacity = capacity;
+            relink(v);
+
+            list->payload.tag_list.list = &v->head;
+        }
+
+        v->items[v->length].data = item;
+        list_add_tail(&v->items[v->length].entry, &v->head.entry);
+        v->length++;
+    }
+
+    list->payload.tag_list.type = item->type;
+
+    nbt_index_touch(list);
+    return NBT_OK;
+}
+
+nbt_status nbt_list_vectorize(nbt_node* list, size_t capacity)
+{
+    assert(list && list->type == TAG_LIST);
+
+    nbt_status err = nbt_unpack(list);
+    if(err != NBT_OK) return err;
+
+    struct tag_list* old = list->payload.tag_list.list;
+    size_t length = 0;
+    struct list_head* pos;
+
+    if(list->flags & NBT_NODE_VECTOR)
+        return NBT_OK;
+
+    list_for_each(pos, &old->entry)
+    {
+        if(list_entry(pos, struct tag_list, entry)->data->type != list->payload.tag_list.type)
+            return NBT_ERR;
+
+        length++;
+    }
+
+    struct tag_vector* v = new_vector(length > capacity ? length : capacity);
+    if(v == NULL) return NBT_EMEM;
+
+    while(!list_empty(&old->entry))
+    {
+        struct tag_list* entry = list_entry(old->entry.flink, struct tag_list, entry);
+
+        v->items[v->length++].data = entry->data;
+
+        list_del(&entry->entry);
+        free_entry(entry);
+    }
+
+    free(old);
+    relink(v);
+
+    list->flags |= NBT_NODE_VECTOR;
+    list->payload.tag_list.list = &v->head;
+
+    return NBT_OK;
+}
+
+nbt_status nbt_unpack(nbt_node* list)
+{
+    assert(list);
+
+    if(!(list->flags & NBT_NODE_PACKED))
+        return NBT_OK;
+
+    struct nbt_packed_list packed = list->payload.tag_packed;
+    size_t size = number_size(packed.type);
+    struct tag_list* children;
+
+    CHECKED_MALLOC(children, sizeof *children, return NBT_EMEM);
+
+    children->data = NULL;
+    INIT_LIST_HEAD(&children->entry);
+
+    for(int32_t i = 0; i < packed.length; i++)
+    {
+        nbt_node* item;
+        struct tag_list* entry;
+
+        CHECKED_MALLOC(item, sizeof *item, goto unpack_error);
+        CHECKED_MALLOC(entry, sizeof *entry,
+            free(item);
+            goto unpack_error;
+        );
+
+        item->type  = packed.type;
+        item->flags = 0;
+        item->name  = NULL;
+
+        /* every number in the payload starts where the payload does. */
+        memcpy(&item->payload, (const char*)packed.data + (size_t)i * size, size);
+
+        entry->data = item;
+        list_add_tail(&entry->entry, &children->entry);
+    }
+
+    free(packed.data);
+
+    list->flags &= ~NBT_NODE_PACKED;
+    list->payload.tag_list.type = packed.type;
+    list->payload.tag_list.list = children;
+
+    return NBT_OK;
+
+unpack_error:
+    nbt_free_list(children);
+    return NBT_EMEM;
+}
+
+/* Where the Nth number of a list of numbers is, packed or not. */
+static void* number_at(const nbt_node* list, int32_t n)
+{
+    assert(list && list->type == TAG_LIST);
+
+    if(list->flags & NBT_NODE_PACKED)
+    {
+        const struct nbt_packed_list* packed = &list->payload.tag_packed;
+
+        assert(n >= 0 && n < packed->length);
+        return (char*)packed->data + (size_t)n * number_size(packed->type);
+    }
+
+    /* an unpacked list is left as it is, so nothing here changes it. */
+    nbt_node* item = nbt_list_item((nbt_node*)list, n);
+
+    assert(item);
+    return &item->payload;
+}
+
+int64_t nbt_list_get_long(const nbt_node* list, int32_t n)
+{
+    const void* at = number_at(list, n);
+
+    switch(list->payload.tag_list.type)
+    {
+    case TAG_BYTE:   return *(const int8_t*)at;
+    case TAG_SHORT:  return *(const int16_t*)at;
+    case TAG_INT:    return *(const int32_t*)at;
+    case TAG_LONG:   return *(const int64_t*)at;
+    case TAG_FLOAT:  return (int64_t)*(const float*)at;
+    case TAG_DOUBLE: return (int64_t)*(const double*)at;
+    default:         assert(!"not a list of numbers"); return 0;
+    }
+}
+
+double nbt_list_get_double(const nbt_node* list, int32_t n)
+{
+    const void* at = number_at(list, n);
+
+    switch(list->payload.tag_list.type)
+    {
+    case TAG_BYTE:   return *(const int8_t*)at;
+    case TAG_SHORT:  return *(const int16_t*)at;
+    case TAG_INT:    return *(const int32_t*)at;
+    case TAG_LONG:   return (double)*(const int64_t*)at;
+    case TAG_FLOAT:  return *(const float*)at;
+    case TAG_DOUBLE: return *(const double*)at;
+    default:         assert(!"not a list of numbers"); return 0;
+    }
+}
+
+void nbt_list_set_long(nbt_node* list, int32_t n, int64_t value)
+{
+    void* at = number_at(list, n);
+
+    switch(list->payload.tag_list.type)
+    {
+    case TAG_BYTE:   *(int8_t*)at  = (int8_t)value;  break;
+    case TAG_SHORT:  *(int16_t*)at = (int16_t)value; break;
+    case TAG_INT:    *(int32_t*)at = (int32_t)value; break;
+    case TAG_LONG:   *(int64_t*)at = value;          break;
+    case TAG_FLOAT:  *(float*)at   = (float)value;   break;
+    case TAG_DOUBLE: *(double*)at  = (double)value;  break;
+    default:         assert(!"not a list of numbers");
+    }
+}
+
+void nbt_list_set_double(nbt_node* list, int32_t n, double value)
+{
+    void* at = number_at(list, n);
+
+    switch(list->payload.tag_list.type)
+    {
+    case TAG_BYTE:   *(int8_t*)at  = (int8_t)value;  break;
+    case TAG_SHORT:  *(int16_t*)at = (int16_t)value; break;
+    case TAG_INT:    *(int32_t*)at = (int32_t)value; break;
+    case TAG_LONG:   *(int64_t*)at = (int64_t)value; break;
+    case TAG_FLOAT:  *(float*)at   = (float)value;   break;
+    case TAG_DOUBLE: *(double*)at  = value;          break;
+    default:         assert(!"not a list of numbers");
+    }
+}
+
+/* FNV-1a, a word at a time, with the high bits folded in so the table sees them. */
+static size_t hash_blob(const struct nbt_array_blob* blob)
+{
+    uint64_t h = UINT64_C(14695981039346656037);
+    uint64_t header = (uint64_t)blob->encoding << 40 | (uint64_t)blob->width << 32 | (uint32_t)blob->length;
+    size_t i = 0;
+
+    h = (h ^ header) * UINT64_C(1099511628211);
+
+    for(; i + 8 <= blob->size; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, blob->data + i, 8);
+
+        h = (h ^ word) * UINT64_C(1099511628211);
+        h ^= h >> 32;
+    }
+
+    for(; i < blob->size; i++)
+        h = (h ^ blob->data[i]) * UINT64_C(1099511628211);
+
+    return (size_t)(h ^ h >> 32);
+}
+
+nbt_array_pool* nbt_array_pool_new(void)
+{
+    nbt_array_pool* ret;
+    CHECKED_MALLOC(ret, sizeof *ret, return NULL);
+
+    ret->mask = 63;
+    ret->used = 0;
+
+    if((ret->table = calloc(ret->mask + 1, sizeof *ret->table)) == NULL)
+    {
+        free(ret);
+        return (errno = NBT_EMEM), NULL;
+    }
+
+    return ret;
+}
+
+void nbt_array_pool_free(nbt_array_pool* pool)
+{
+    if(pool == NULL) return;
+
+    /* the blobs belong to the arrays using them, which can go on using them. */
+    for(size_t i = 0; i <= pool->mask; i++)
+        if(pool->table[i])
+            pool->table[i]->pool = NULL;
+
+    free(pool->table);
+    free(pool);
+}
+
+/* Doubles the table. Returns false if we're out of memory, and leaves it be. */
+static bool grow_pool(nbt_array_pool* pool)
+{
+    struct nbt_array_blob** old = pool->table;
+    size_t old_size = pool->mask + 1;
+
+    if((pool->table = calloc(2 * old_size, sizeof *pool->table)) == NULL)
+        return (pool->table = old), false;
+
+    pool->mask = 2 * old_size - 1;
+
+    for(size_t i = 0; i < old_size; i++)
+        if(old[i])
+            *pool_slot(pool, old[i]) = old[i];
+
+    free(old);
+    return true;
+}
+
+/* Where an ordinary array's elements are. */
+static inline unsigned char* array_data(const nbt_node* array)
+{
+    switch(array->type)
+    {
+    case TAG_BYTE_ARRAY: return array->payload.tag_byte_array.data;
+    case TAG_INT_ARRAY:  return (unsigned char*)array->payload.tag_int_array.data;
+    default:             return (unsigned char*)array->payload.tag_long_array.data;
+    }
+}
+
+/*
+ * The first element from `i' on that isn't the same as the one before it, or
+ * `length' if there's none. Runs are skipped over eight bytes at a time, by
+ * comparing them with the eight bytes an element back.
+ */
+static size_t run_end(const unsigned char* src, size_t i, size_t length, size_t width)
+{
+    const unsigned shift = width == 1 ? 0 : width == 4 ? 2 : 3;
+    const size_t end = length << shift;
+    size_t p = i << shift;
+
+    for(; p + 8 <= end; p += 8)
+    {
+        uint64_t a, b;
+        memcpy(&a, src + p - width, 8);
+        memcpy(&b, src + p, 8);
+
+        if(a != b)
+        {
+            /* the element holding the first byte that's different. */
+            while(src[p - width] == src[p]) p++;
+
+            return p >> shift;
+        }
+    }
+
+    for(; p < end; p += width)
+        if(element(src + p, width) != element(src + p - width, width))
+            return p >> shift;
+
+    return length;
+}
+
+/*
+ * Notes down where each run of equal elements in `src' ends, stopping at the
+ * end of the array or once there's no room for any more in `ends'. Returns
+ * how many it found.
+ */
+static size_t find_runs(const unsigned char* src, size_t length, size_t width, uint32_t* ends, size_t capacity)
+{
+    size_t runs = 0;
+
+    for(size_t i = 0; i < length && runs < capacity; runs++)
+        ends[runs] = (uint32_t)(i = run_end(src, i + 1, length, width));
+
+    return runs;
+}
+
+/* Encodes a single array, unless that's not worth it. */
+static nbt_status encode_array(nbt_node* array, nbt_array_pool* pool)
+{
+    if(array->flags & (NBT_NODE_ENCODED | NBT_NODE_BORROWED)) return NBT_OK;
+
+    size_t width  = element_size(array->type);
+    size_t length = (size_t)array->payload.tag_byte_array.length;
+    unsigned char* src = array_data(array);
+
+    if(length == 0) return NBT_OK;
+
+    /* runs are only worth it if they take half the space. one more tells us there are too many. */
+    size_t max_runs = length * width / 2 / (4 + width);
+    uint32_t* ends;
+
+    CHECKED_MALLOC(ends, (max_runs + 1) * sizeof *ends, return NBT_EMEM);
+
+    size_t runs = find_runs(src, length, width, ends, max_runs + 1);
+    bool found_all = ends[runs - 1] == length;
+
+    enum blob_encoding encoding = found_all && runs == 1        ? BLOB_FILL
+                                : found_all && runs <= max_runs ? BLOB_RUNS
+                                :                                 BLOB_RAW;
+
+    size_t size = encoding == BLOB_FILL ? width
+                : encoding == BLOB_RUNS ? runs * (4 + width)
+                :                         length * width;
+
+    /* no smaller than it is, and nothing to share it with. */
+    if(pool == NULL && sizeof(struct nbt_array_blob) + size >= length * width)
+    {
+        free(ends);
+        return NBT_OK;
+    }
+
+    struct nbt_array_blob* blob;
+    CHECKED_MALLOC(blob, sizeof *blob + size, free(ends); return NBT_EMEM);
+
+    blob->refs     = 1;
+    blob->pool     = NULL;
+    blob->encoding = encoding;
+    blob->width    = width;
+    blob->length   = (int32_t)length;
+    blob->runs     = runs;
+    blob->size     = size;
+
+    if(encoding == BLOB_RUNS)
+    {
+        memcpy(blob->data, ends, 4 * runs);
+
+        for(size_t r = 0; r < runs; r++)
+            memcpy(blob->data + 4 * runs + r * width, src + (r ? ends[r - 1] : 0) * width, width);
+    }
+    else
+    {
+        memcpy(blob->data, src, size);
+    }
+
+    free(ends);
+
+    if(pool)
+    {
+        blob->hash = hash_blob(blob);
+
+        struct nbt_array_blob** slot = pool_slot(pool, blob);
+
+        if(*slot)
+        {
+            free(blob);
+            blob = *slot;
+            blob->refs++;
+        }
+        /* with no room for it, it just isn't shared. */
+        else if(2 * (pool->used + 1) <= pool->mask + 1 || grow_pool(pool))
+        {
+            *pool_slot(pool, blob) = blob;
+            blob->pool = pool;
+            pool->used++;
+        }
+    }
+
+    free(src);
+
+    array->flags |= NBT_NODE_ENCODED;
+    array->payload.tag_encoded.data   = blob;
+    array->payload.tag_encoded.length = (int32_t)length;
+
+    return NBT_OK;
+}
+
+/* Lazy compounds and packed lists are left alone: looking inside them would only cost memory. */
+nbt_status nbt_encode_arrays(nbt_node* tree, nbt_array_pool* pool)
+{
+    assert(tree);
+
+    struct walk w;
+    nbt_status err = NBT_OK;
+
+    walk_init(&w);
+
+    for(; tree != NULL; tree = walk_next(&w))
+    {
+        if(element_size(tree->type))
+        {
+            if((err = encode_array(tree, pool)) != NBT_OK)
+                break;
+        }
+        else if(is_container(tree->type) && !(tree->flags & (NBT_NODE_LAZY | NBT_NODE_PACKED)) &&
+                !walk_into(&w, tree))
+        {
+            err = NBT_EMEM;
+            break;
+        }
+    }
+
+    walk_free(&w);
+    return err;
+}
+
+nbt_status nbt_decode(nbt_node* array)
+{
+    assert(array);
+
+    if(!(array->flags & NBT_NODE_ENCODED)) return NBT_OK;
+
+    struct nbt_array_blob* blob = array->payload.tag_encoded.data;
+    unsigned char* data;
+
+    CHECKED_MALLOC(data, blob->width * (size_t)blob->length, return NBT_EMEM);
+
+    blob_copy(blob, data);
+    release(blob);
+
+    array->flags &= ~NBT_NODE_ENCODED;
+
+    switch(array->type)
+    {
+    case TAG_BYTE_ARRAY: array->payload.tag_byte_array.data = data;            break;
+    case TAG_INT_ARRAY:  array->payload.tag_int_array.data  = (int32_t*)data;  break;
+    default:             array->payload.tag_long_array.data = (int64_t*)data;  break;
+    }
+
+    return NBT_OK;
+}
+
+/*
+ * Adds up a node, and the entries of its children if it has any. Returns
+ * whether it has children for nbt_memory_usage to add up, too.
+ */
+static bool add_usage(const nbt_node* node, struct nbt_memory_stats* stats)
+{
+    const bool borrowed = node->flags & NBT_NODE_BORROWED;
+
+    stats->nodes++;
+
+    /* a compact node's entry, and maybe its name, come with it. */
+    if(node->flags & NBT_NODE_COMPACT)
+        stats->bytes += sizeof(struct tag_compact) +
+                        (node->flags & NBT_NODE_INLINE_NAME ? strlen(node->name) + 1 : 0);
+    else
+        stats->bytes += sizeof *node;
+
+    if(node->name && !(node->flags & (NBT_NODE_BORROWED | NBT_NODE_INTERNED_NAME | NBT_NODE_INLINE_NAME)))
+        stats->bytes += strlen(node->name) + 1;
+
+    if(element_size(node->type))
+    {
+        size_t decoded = element_size(node->type) * (size_t)node->payload.tag_byte_array.length;
+        size_t kept = decoded;
+
+        if(node->flags & NBT_NODE_ENCODED)
+        {
+            const struct nbt_array_blob* blob = node->payload.tag_encoded.data;
+
+            kept = (sizeof *blob + blob->size) / blob->refs;
+            stats->encoded++;
+        }
+        else if(borrowed)
+        {
+            return false;
+        }
+
+        stats->bytes          += kept;
+        stats->arrays         += kept;
+        stats->decoded_arrays += decoded;
+        return false;
+    }
+
+    if(node->type == TAG_STRING)
+    {
+        if(!(node->flags & (NBT_NODE_BORROWED | NBT_NODE_INTERNED_STRING)))
+            stats->bytes += strlen(node->payload.tag_string) + 1;
+        return false;
+    }
+
+    if(node->type == TAG_LIST && (node->flags & NBT_NODE_PACKED))
+    {
+        const struct nbt_packed_list* packed = &node->payload.tag_packed;
+        stats->bytes += (size_t)packed->length * number_size(packed->type);
+        return false;
+    }
+
+    if(!is_container(node->type) || (node->flags & NBT_NODE_LAZY))
+        return false;
+
+    const bool vector = node->flags & NBT_NODE_VECTOR;
+
+    if(vector)
+    {
+        const struct tag_vector* v = vector_of(node);
+        stats->bytes += sizeof *v + v->capacity * sizeof v->items[0];
+    }
+    else if(node->flags & NBT_NODE_INDEXED)
+    {
+        const struct tag_index* idx = index_for(node);
+        stats->bytes += sizeof *idx + (idx->table ? (idx->mask + 1) * sizeof *idx->table : 0);
+    }
+    else
+    {
+        stats->bytes += sizeof(struct tag_list);
+    }
+
+    /* a vector's entries are counted with it. */
+    if(!vector)
+    {
+        const struct list_head* pos;
+        list_for_each(pos, &children_of((nbt_node*)node)->entry)
+            if(!embedded(list_entry(pos, const struct tag_list, entry)))
+                stats->bytes += sizeof(struct tag_list);
+    }
+
+    return true;
+}
+
+void nbt_memory_usage(const nbt_node* tree, struct nbt_memory_stats* stats)
+{
+    assert(stats);
+
+    memset(stats, 0, sizeof *stats);
+
+    struct walk w;
+
+    walk_init(&w);
+
+    /* out of memory, errno says so, and the figures are only as far as we got. */
+    for(nbt_node* node = (nbt_node*)tree; node != NULL; node = walk_next(&w))
+        if(add_usage(node, stats) && !walk_into(&w, node))
+            break;
+
+    walk_free(&w);
+}
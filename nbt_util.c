@@ -9,6 +9,9 @@
  */
 #include "nbt.h"
 
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
 #include <string.h>
 
 const char* nbt_type_to_string(nbt_type t)
@@ -47,6 +50,10 @@ const char* nbt_error_to_string(nbt_status s)
         return "IO Error. Nonexistant/corrupt file?";
     case NBT_EZ:
         return "Fatal zlib error. Corrupt file?";
+    case NBT_ELIMIT:
+        return "Over budget. The tree is too big to be trusted.";
+    case NBT_AGAIN:
+        return "Not finished yet.";
     default:
         return "Unknown error.";
     }
@@ -55,6 +62,10 @@ const char* nbt_error_to_string(nbt_status s)
 /* Returns 1 if one is null and the other isn't. */
 static int safe_strcmp(const char* a, const char* b)
 {
+    /* interned strings that are the same are the same pointer, too. */
+    if(a == b)
+        return 0;
+
     if(a == NULL)
         return b != NULL; /* a is NULL, b is not */
 
@@ -78,7 +89,94 @@ static inline bool floats_are_close(double a, double b)
     return (min(a, b) + epsilon) >= max(a, b);
 }
 
-bool nbt_eq(const nbt_node* restrict a, const nbt_node* restrict b)
+/* Borrowed arrays are big-endian, so they can't be memcmp'd with owned ones. */
+static inline bool different_byte_order(const nbt_node* a, const nbt_node* b)
+{
+    return (a->flags & NBT_NODE_BORROWED) != (b->flags & NBT_NODE_BORROWED);
+}
+
+/* Whether two arrays of the same length can only be compared an element at a time. */
+static inline bool stored_differently(const nbt_node* a, const nbt_node* b)
+{
+    return different_byte_order(a, b) || ((a->flags | b->flags) & NBT_NODE_ENCODED);
+}
+
+/* Two encoded arrays sharing what they're encoded as. */
+static inline bool same_blob(const nbt_node* a, const nbt_node* b)
+{
+    return (a->flags & b->flags & NBT_NODE_ENCODED) && a->payload.tag_encoded.data == b->payload.tag_encoded.data;
+}
+
+/* Comparing compounds means looking inside them. See nbt_materialize. */
+static inline bool materialized(const nbt_node* node)
+{
+    return nbt_materialize((nbt_node*)node) == NBT_OK;
+}
+
+static bool node_eq(const nbt_node* restrict a, const nbt_node* restrict b);
+
+/* The Nth number of a packed list, as the node it'd be if it were unpacked. */
+static inline nbt_node packed_item(const struct nbt_packed_list* packed, int32_t n)
+{
+    nbt_node item = { .type = packed->type, .flags = 0, .name = NULL };
+
+    switch(packed->type)
+    {
+    case TAG_BYTE:   item.payload.tag_byte   = ((const int8_t*) packed->data)[n]; break;
+    case TAG_SHORT:  item.payload.tag_short  = ((const int16_t*)packed->data)[n]; break;
+    case TAG_INT:    item.payload.tag_int    = ((const int32_t*)packed->data)[n]; break;
+    case TAG_LONG:   item.payload.tag_long   = ((const int64_t*)packed->data)[n]; break;
+    case TAG_FLOAT:  item.payload.tag_float  = ((const float*)  packed->data)[n]; break;
+    case TAG_DOUBLE: item.payload.tag_double = ((const double*) packed->data)[n]; break;
+    default:         assert(!"not a list of numbers");
+    }
+
+    return item;
+}
+
+/* Compares a packed list with any other list, without unpacking either. */
+static bool packed_eq(const nbt_node* a, const nbt_node* b)
+{
+    const struct nbt_packed_list* packed = &a->payload.tag_packed;
+
+    if(nbt_list_length(b) != (size_t)packed->length)
+        return false;
+
+    if(b->flags & NBT_NODE_PACKED)
+    {
+        if(b->payload.tag_packed.type != packed->type)
+            return false;
+
+        for(int32_t i = 0; i < packed->length; i++)
+        {
+            nbt_node x = packed_item(packed, i), y = packed_item(&b->payload.tag_packed, i);
+
+            if(!node_eq(&x, &y))
+                return false;
+        }
+
+        return true;
+    }
+
+    const struct list_head* pos;
+    int32_t i = 0;
+
+    list_for_each(pos, &b->payload.tag_list.list->entry)
+    {
+        nbt_node x = packed_item(packed, i++);
+
+        if(!node_eq(&x, list_entry(pos, const struct tag_list, entry)->data))
+            return false;
+    }
+
+    return true;
+}
+
+/*
+ * Compares two nodes, but not their children: for a list or compound, that's
+ * left to nbt_eq.
+ */
+static bool node_eq(const nbt_node* restrict a, const nbt_node* restrict b)
 {
     if(a->type != b->type)
         return false;
@@ -102,42 +200,48 @@ bool nbt_eq(const nbt_node* restrict a, const nbt_node* restrict b)
         return floats_are_close(a->payload.tag_double, b->payload.tag_double);
     case TAG_BYTE_ARRAY:
         if(a->payload.tag_byte_array.length != b->payload.tag_byte_array.length) return false;
+        if(same_blob(a, b)) return true;
+        if(stored_differently(a, b))
+        {
+            for(int32_t i = 0; i < a->payload.tag_byte_array.length; i++)
+                if(nbt_byte_array_get(a, i) != nbt_byte_array_get(b, i))
+                    return false;
+            return true;
+        }
         return memcmp(a->payload.tag_byte_array.data,
                       b->payload.tag_byte_array.data,
                       a->payload.tag_byte_array.length) == 0;
     case TAG_STRING:
-        return strcmp(a->payload.tag_string, b->payload.tag_string) == 0;
+        return safe_strcmp(a->payload.tag_string, b->payload.tag_string) == 0;
     case TAG_LIST:
+        if(a->flags & NBT_NODE_PACKED) return packed_eq(a, b);
+        if(b->flags & NBT_NODE_PACKED) return packed_eq(b, a);
+        /* fall through */
     case TAG_COMPOUND:
-    {
-        struct list_head *ai, *bi;
-        struct tag_list *alist = a->type == TAG_LIST? a->payload.tag_list.list : a->payload.tag_compound;
-        struct tag_list *blist = b->type == TAG_LIST? b->payload.tag_list.list : b->payload.tag_compound;
-
-        for(ai = alist->entry.flink, bi = blist->entry.flink;
-            ai != &alist->entry &&   bi != &blist->entry;
-            ai = ai->flink,                        bi = bi->flink)
-        {
-            struct tag_list* ae = list_entry(ai, struct tag_list, entry);
-            struct tag_list* be = list_entry(bi, struct tag_list, entry);
-
-            if(!nbt_eq(ae->data, be->data))
-                return false;
-        }
-
-        /* if there are still elements left in either list... */
-        if(ai != &alist->entry || bi != &blist->entry)
-            return false;
-
-        return true;
-    }
+        return materialized(a) && materialized(b);
     case TAG_INT_ARRAY:
         if(a->payload.tag_int_array.length != b->payload.tag_int_array.length) return false;
+        if(same_blob(a, b)) return true;
+        if(stored_differently(a, b))
+        {
+            for(int32_t i = 0; i < a->payload.tag_int_array.length; i++)
+                if(nbt_int_array_get(a, i) != nbt_int_array_get(b, i))
+                    return false;
+            return true;
+        }
         return memcmp(a->payload.tag_int_array.data,
                       b->payload.tag_int_array.data,
                       4*a->payload.tag_int_array.length) == 0;
     case TAG_LONG_ARRAY:
         if(a->payload.tag_long_array.length != b->payload.tag_long_array.length) return false;
+        if(same_blob(a, b)) return true;
+        if(stored_differently(a, b))
+        {
+            for(int32_t i = 0; i < a->payload.tag_long_array.length; i++)
+                if(nbt_long_array_get(a, i) != nbt_long_array_get(b, i))
+                    return false;
+            return true;
+        }
         return memcmp(a->payload.tag_long_array.data,
                       b->payload.tag_long_array.data,
                       8*a->payload.tag_long_array.length) == 0;
@@ -147,3 +251,96 @@ bool nbt_eq(const nbt_node* restrict a, const nbt_node* restrict b)
     }
 }
 
+static inline const struct tag_list* children_of(const nbt_node* node)
+{
+    return node->type == TAG_LIST ? node->payload.tag_list.list : node->payload.tag_compound;
+}
+
+/* A pair of lists or compounds nbt_eq is comparing, and how far it's got in each. */
+struct eq_frame {
+    const struct list_head *ahead, *ai;
+    const struct list_head *bhead, *bi;
+};
+
+/*
+ * Walks both trees side by side with a stack of its own, rather than by
+ * recursing, so no tree is too deep to compare. Only really deep ones need
+ * more of it than `shallow'.
+ */
+bool nbt_eq(const nbt_node* restrict a, const nbt_node* restrict b)
+{
+    struct eq_frame shallow[32];
+    struct eq_frame* stack = shallow;
+    size_t depth = 0, capacity = sizeof shallow / sizeof *shallow;
+    bool ret = true;
+
+    for(;;)
+    {
+        if(!node_eq(a, b))
+        {
+            ret = false;
+            break;
+        }
+
+        /* packed lists were compared whole. */
+        if((a->type == TAG_LIST || a->type == TAG_COMPOUND) &&
+           !((a->flags | b->flags) & NBT_NODE_PACKED))
+        {
+            if(depth == capacity)
+            {
+                struct eq_frame* frames = realloc(stack == shallow ? NULL : stack, 2 * capacity * sizeof *frames);
+
+                if(frames == NULL)
+                {
+                    errno = NBT_EMEM;
+                    ret = false;
+                    break;
+                }
+
+                if(stack == shallow)
+                    memcpy(frames, shallow, sizeof shallow);
+
+                stack     = frames;
+                capacity *= 2;
+            }
+
+            const struct list_head* ahead = &children_of(a)->entry;
+            const struct list_head* bhead = &children_of(b)->entry;
+
+            stack[depth++] = (struct eq_frame){ ahead, ahead, bhead, bhead };
+        }
+
+        /* the next pair to compare, leaving the lists we're done with. */
+        while(depth > 0)
+        {
+            struct eq_frame* top = &stack[depth - 1];
+
+            top->ai = top->ai->flink;
+            top->bi = top->bi->flink;
+
+            if(top->ai != top->ahead && top->bi != top->bhead)
+                break;
+
+            /* if there are still elements left in either list... */
+            if(top->ai != top->ahead || top->bi != top->bhead)
+            {
+                ret = false;
+                break;
+            }
+
+            depth--;
+        }
+
+        if(depth == 0 || !ret)
+            break;
+
+        a = list_entry(stack[depth - 1].ai, const struct tag_list, entry)->data;
+        b = list_entry(stack[depth - 1].bi, const struct tag_list, entry)->data;
+    }
+
+    if(stack != shallow)
+        free(stack);
+
+    return ret;
+}
+
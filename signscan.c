@@ -14,23 +14,20 @@
 #define  err(...)  fprintf(stderr,"[SignScan] <ERROR> ");fprintf(stderr,__VA_ARGS__);exit(1);
 #define  VERSION "0.1"
 
-// private structures
-struct MCR {
-    int fd;
-    int readonly;
-    uint32_t last_timestamp;
-    struct MCRChunk {
-        uint32_t timestamp;
-        uint32_t len;
-        unsigned char *data; // compression type + data
-    } chunk[32][32];
-};
-
 struct Coord {
     int x;
     int y;
 };
 
+// What we know about the tile entity we're in the middle of
+struct SignScan {
+    const char *forbidden;
+    int in_tile_entities;
+    int is_sign;
+    int x, y, z;
+    char text[4][512];
+};
+
 void parse_args_world(char**,char**);
 MCR *region_open(char*,char*,int);
 
@@ -44,6 +41,88 @@ void lowercase(char* text) {
     for(;*text;text++) *text = tolower(*text);
 }
 
+static int name_is(const struct nbt_event *ev, const char *name) {
+    return ev->name && ev->name_length == strlen(name) && memcmp(ev->name, name, ev->name_length) == 0;
+}
+
+// We only care about .Level.TileEntities, skip everything else without looking at it
+static nbt_event_action on_compound_begin(const struct nbt_event *ev, void *aux) {
+    struct SignScan *scan = aux;
+    if (ev->depth == 0) return NBT_EVENT_CONTINUE;
+    if (ev->depth == 1) return name_is(ev, "Level") ? NBT_EVENT_CONTINUE : NBT_EVENT_SKIP;
+    if (ev->depth == 3 && scan->in_tile_entities) {
+        scan->is_sign = 0;
+        scan->x = scan->y = scan->z = 0;
+        for (int i = 0; i < 4; i++) scan->text[i][0] = '\0';
+        return NBT_EVENT_CONTINUE;
+    }
+    return NBT_EVENT_SKIP;
+}
+
+static nbt_event_action on_list_begin(const struct nbt_event *ev, void *aux) {
+    struct SignScan *scan = aux;
+    if (ev->depth == 2 && name_is(ev, "TileEntities")) {
+        scan->in_tile_entities = 1;
+        return NBT_EVENT_CONTINUE;
+    }
+    return NBT_EVENT_SKIP;
+}
+
+static nbt_event_action on_list_end(const struct nbt_event *ev, void *aux) {
+    struct SignScan *scan = aux;
+    (void)ev;
+    // there's only one TileEntities list per chunk
+    scan->in_tile_entities = 0;
+    return NBT_EVENT_STOP;
+}
+
+static nbt_event_action on_value(const struct nbt_event *ev, void *aux) {
+    struct SignScan *scan = aux;
+    if (ev->depth != 4 || !scan->in_tile_entities) return NBT_EVENT_CONTINUE;
+
+    if (ev->type == TAG_INT) {
+        if (name_is(ev, "x")) scan->x = ev->payload.tag_int;
+        if (name_is(ev, "y")) scan->y = ev->payload.tag_int;
+        if (name_is(ev, "z")) scan->z = ev->payload.tag_int;
+    } else if (ev->type == TAG_STRING) {
+        char *dest = NULL;
+        if (name_is(ev, "id")) {
+            char id[64];
+            size_t len = ev->payload.tag_string.length < sizeof id - 1 ? ev->payload.tag_string.length : sizeof id - 1;
+            memcpy(id, ev->payload.tag_string.data, len);
+            id[len] = '\0';
+            scan->is_sign = strstr(id, "Sign") != NULL;
+            return NBT_EVENT_CONTINUE;
+        }
+        for (int i = 0; i < 4; i++) {
+            char field[] = "Text1";
+            field[4] = '1' + i;
+            if (name_is(ev, field)) dest = scan->text[i];
+        }
+        if (dest) {
+            size_t len = ev->payload.tag_string.length < sizeof scan->text[0] - 1 ? ev->payload.tag_string.length : sizeof scan->text[0] - 1;
+            memcpy(dest, ev->payload.tag_string.data, len);
+            dest[len] = '\0';
+            lowercase(dest);
+        }
+    }
+    return NBT_EVENT_CONTINUE;
+}
+
+static nbt_event_action on_compound_end(const struct nbt_event *ev, void *aux) {
+    struct SignScan *scan = aux;
+    if (ev->depth != 3 || !scan->in_tile_entities || !scan->is_sign) return NBT_EVENT_CONTINUE;
+
+    if (strstr(scan->text[0],scan->forbidden) ||
+        strstr(scan->text[1],scan->forbidden) ||
+        strstr(scan->text[2],scan->forbidden) ||
+        strstr(scan->text[3],scan->forbidden)
+    ) {
+        say(" + Found offending sign at (X Y Z) : %d %d %d\n", scan->x,scan->y,scan->z);
+    }
+    return NBT_EVENT_CONTINUE;
+}
+
 // main function, processes args before work
 int main(int argc, char** argv) {
     char* world; // String path to world to scan
@@ -63,6 +142,20 @@ int main(int argc, char** argv) {
     // Copy test string to local storage, make lower case
     strcpy(forbidden,argv[2]);
     lowercase(forbidden);
+
+    // A chunk can only have what we're looking for if it has both of these somewhere
+    const char *required[] = { "Sign", forbidden };
+    nbt_prefilter *filter = nbt_prefilter_new(required, NULL, 2, true);
+    if (filter == NULL) { err("  !!! Out of memory\n"); }
+
+    struct SignScan scan = { .forbidden = forbidden };
+    const struct nbt_event_handler handler = {
+        .compound_begin = on_compound_begin,
+        .compound_end   = on_compound_end,
+        .list_begin     = on_list_begin,
+        .list_end       = on_list_end,
+        .value          = on_value
+    };
     
     // Get the list of region files
     while((ep = readdir (dp))) {
@@ -72,52 +165,20 @@ int main(int argc, char** argv) {
          
             // Get each chunk in the region
             for(int x=0; x<32; x++) for(int z=0; z<32; z++) {
-                nbt_node *root = mcr_chunk_get(src,x,z);
-                if (root == NULL) continue;
-
-                // Check every block in the chunk
-                nbt_node *s = nbt_find_by_path(root, ".Level.TileEntities");
-                const struct list_head* pos;
-                if (s && s->type == TAG_LIST) {
-                    list_for_each(pos, &s->payload.tag_list.list->entry) {
-                        nbt_node *tile_entity = list_entry(pos, struct tag_list, entry)->data;
-                        if (tile_entity->type != TAG_COMPOUND) continue;
-                        nbt_node* eid_node = nbt_find_by_path(tile_entity,".id");
-                        if (!eid_node) continue;
-
-                        char *eid = eid_node->payload.tag_string;
-                        //say("Scanning TileEntity: %s\n",eid);
-                        if (!strstr(eid,"Sign")) continue;
-
-                        int bx = nbt_find_by_path(tile_entity, ".x")->payload.tag_int;
-                        int by = nbt_find_by_path(tile_entity, ".y")->payload.tag_int;
-                        int bz = nbt_find_by_path(tile_entity, ".z")->payload.tag_int;
-
-                        char *text1 = nbt_find_by_path(tile_entity, ".Text1")->payload.tag_string;
-                        lowercase(text1);
-                        char *text2 = nbt_find_by_path(tile_entity, ".Text2")->payload.tag_string;
-                        lowercase(text2);
-                        char *text3 = nbt_find_by_path(tile_entity, ".Text3")->payload.tag_string;
-                        lowercase(text3);
-                        char *text4 = nbt_find_by_path(tile_entity, ".Text4")->payload.tag_string;
-                        lowercase(text4);
-                        
-                        if (strstr(text1,argv[2]) ||
-                            strstr(text2,argv[2]) ||
-                            strstr(text3,argv[2]) ||
-                            strstr(text4,argv[2])                       
-                        ) {
-                            say(" + Found offending sign at (X Y Z) : %d %d %d\n", bx,by,bz);
-                        } 
-                    }
-                }
-                nbt_free(root);
+                size_t len;
+                const void *data = mcr_chunk_data(src,x,z,&len);
+                if (data == NULL) continue;
+
+                // Check every sign in the chunk, without building a tree for it
+                scan.in_tile_entities = 0;
+                nbt_parse_compressed_events_filtered(data, len, filter, &handler, &scan);
             } 
 
             // Close region file
             mcr_close(src);
        }
     }
+   nbt_prefilter_free(filter);
    exit(0); 
 }
 